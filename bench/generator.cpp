@@ -0,0 +1,251 @@
+#include "generator.hpp"
+#include "ddsfile.hpp"
+#include "utils.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Text is formatted into this much memory before each write
+static const size_t WRITE_BUFFER_SIZE = 1 << 20;
+
+class TextWriter
+{
+public:
+    TextWriter(const char* filename) : m_Filename(filename), m_File(fopen(filename, "wb"))
+    {
+        if (!m_File)
+        {
+            THROW_RUNTIME("Can't create " << filename)
+        }
+        m_Buffer.reserve(WRITE_BUFFER_SIZE + 256);
+    }
+
+    ~TextWriter()
+    {
+        if (m_File)
+        {
+            fclose(m_File);
+        }
+    }
+
+    void Printf(const char* format, double a, double b, double c)
+    {
+        char line[128];
+        int length = snprintf(line, sizeof(line), format, a, b, c);
+        Append(line, (size_t)length);
+    }
+
+    void Append(const char* text, size_t length)
+    {
+        m_Buffer.append(text, length);
+        if (m_Buffer.size() >= WRITE_BUFFER_SIZE)
+        {
+            Flush();
+        }
+    }
+
+    void Close()
+    {
+        Flush();
+        int result = fclose(m_File);
+        m_File = nullptr;
+        if (result != 0)
+        {
+            THROW_RUNTIME("Can't write " << m_Filename)
+        }
+    }
+
+private:
+    void Flush()
+    {
+        if (fwrite(m_Buffer.data(), 1, m_Buffer.size(), m_File) != m_Buffer.size())
+        {
+            THROW_RUNTIME("Can't write " << m_Filename)
+        }
+        m_Buffer.clear();
+    }
+
+    std::string m_Filename;
+    FILE* m_File;
+    std::string m_Buffer;
+
+};
+
+size_t WriteSyntheticObj(const char* filename, const SyntheticObjOptions_t& options)
+{
+    size_t quads = (options.triangleCount + 1) / 2;
+    unsigned int columns = (unsigned int)std::ceil(std::sqrt((double)quads));
+    unsigned int rows = (unsigned int)((quads + columns - 1) / columns);
+    unsigned int bands = options.materialCount * options.materialBands;
+    if (bands > rows)
+    {
+        bands = rows;
+    }
+
+    TextWriter writer(filename);
+    const char header[] = "# Synthetic mesh for the asset benchmarks\nmtllib synthetic.mtl\n";
+    writer.Append(header, sizeof(header) - 1);
+
+    // Gentle ripples, so normals and tangents vary like on real surfaces
+    for (unsigned int y = 0; y <= rows; ++y)
+    {
+        for (unsigned int x = 0; x <= columns; ++x)
+        {
+            double u = (double)x / columns, v = (double)y / rows;
+            writer.Printf("v %.6f %.6f %.6f\n", u * columns, 0.25 * std::sin(u * 40.0) * std::cos(v * 40.0), v * rows);
+        }
+    }
+    for (unsigned int y = 0; y <= rows; ++y)
+    {
+        for (unsigned int x = 0; x <= columns; ++x)
+        {
+            writer.Printf("vt %.6f %.6f %.6f\n", (double)x / columns, (double)y / rows, 0.0);
+        }
+    }
+    for (unsigned int y = 0; y <= rows; ++y)
+    {
+        for (unsigned int x = 0; x <= columns; ++x)
+        {
+            double u = (double)x / columns, v = (double)y / rows;
+            double dx = -10.0 * std::cos(u * 40.0) * std::cos(v * 40.0) / columns;
+            double dz = 10.0 * std::sin(u * 40.0) * std::sin(v * 40.0) / rows;
+            double length = std::sqrt(dx * dx + 1.0 + dz * dz);
+            writer.Printf("vn %.6f %.6f %.6f\n", dx / length, 1.0 / length, dz / length);
+        }
+    }
+
+    size_t triangles = 0;
+    unsigned int band = (unsigned int)-1;
+    for (unsigned int y = 0; y < rows; ++y)
+    {
+        unsigned int rowBand = bands ? (unsigned int)((unsigned long long)y * bands / rows) : 0;
+        if (options.materialCount && rowBand != band)
+        {
+            band = rowBand;
+            char line[64];
+            int length = snprintf(line, sizeof(line), "usemtl synthetic_%u\n", band % options.materialCount);
+            writer.Append(line, (size_t)length);
+        }
+
+        for (unsigned int x = 0; x < columns; ++x)
+        {
+            // OBJ indices start at 1, vertex, texcoord and normal share them
+            unsigned int i0 = y * (columns + 1) + x + 1;
+            unsigned int i1 = i0 + 1;
+            unsigned int i2 = i0 + columns + 1;
+            unsigned int i3 = i2 + 1;
+            char line[160];
+            int length = snprintf(line, sizeof(line), "f %u/%u/%u %u/%u/%u %u/%u/%u\nf %u/%u/%u %u/%u/%u %u/%u/%u\n",
+                                  i0, i0, i0, i2, i2, i2, i1, i1, i1, i1, i1, i1, i2, i2, i2, i3, i3, i3);
+            writer.Append(line, (size_t)length);
+            triangles += 2;
+        }
+    }
+
+    writer.Close();
+    return triangles;
+}
+
+size_t WriteSyntheticDds(const char* filename, SyntheticDdsLayout_t layout, unsigned int size)
+{
+    DDS_HEADER header;
+    memset(&header, 0, sizeof(header));
+    header.size = sizeof(DDS_HEADER);
+    header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000; // DDSD_CAPS | HEIGHT | WIDTH | PIXELFORMAT | MIPMAPCOUNT
+    header.width = size;
+    header.height = size;
+    header.caps = 0x1000 | 0x400000 | 0x8; // DDSCAPS_TEXTURE | MIPMAP | COMPLEX
+    header.ddspf.size = sizeof(DDS_PIXELFORMAT);
+
+    DDS_HEADER_DXT10 header10;
+    memset(&header10, 0, sizeof(header10));
+
+    DDSTextureDesc_t desc;
+    desc.width = size;
+    desc.height = size;
+    desc.depth = 1;
+    desc.mipCount = 1;
+    while ((size >> desc.mipCount) > 0)
+    {
+        ++desc.mipCount;
+    }
+    desc.arraySize = 1;
+    desc.dimension = DDS_DIMENSION_TEXTURE2D;
+    desc.isCubeMap = false;
+    header.mipMapCount = (uint32_t)desc.mipCount;
+
+    switch (layout)
+    {
+    case SYNTHETIC_DDS_RGBA8:
+        header.ddspf.flags = DDS_RGB | 0x1; // DDPF_ALPHAPIXELS
+        header.ddspf.RGBBitCount = 32;
+        header.ddspf.RBitMask = 0x000000ff;
+        header.ddspf.GBitMask = 0x0000ff00;
+        header.ddspf.BBitMask = 0x00ff0000;
+        header.ddspf.ABitMask = 0xff000000;
+        desc.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        break;
+
+    case SYNTHETIC_DDS_BC1:
+        header.ddspf.flags = DDS_FOURCC;
+        header.ddspf.fourCC = MAKEFOURCC('D', 'X', '1', '0');
+        header10.dxgiFormat = DXGI_FORMAT_BC1_UNORM;
+        header10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+        header10.arraySize = 1;
+        desc.format = DXGI_FORMAT_BC1_UNORM;
+        break;
+
+    case SYNTHETIC_DDS_DXT5_CUBE:
+        header.ddspf.flags = DDS_FOURCC;
+        header.ddspf.fourCC = MAKEFOURCC('D', 'X', 'T', '5');
+        header.caps2 = DDS_CUBEMAP_ALLFACES;
+        desc.format = DXGI_FORMAT_BC3_UNORM;
+        desc.arraySize = 6;
+        desc.isCubeMap = true;
+        break;
+
+    default:
+        THROW_RUNTIME("Unknown synthetic DDS layout " << layout)
+    }
+
+    // Sized the way the loader walks it
+    size_t payloadSize = 0;
+    for (size_t mip = 0; mip < desc.mipCount; ++mip)
+    {
+        size_t sliceBytes;
+        size_t mipSize = std::max<size_t>(1, size >> mip);
+        GetSurfaceInfo(mipSize, mipSize, desc.format, &sliceBytes, nullptr, nullptr);
+        payloadSize += sliceBytes;
+    }
+    payloadSize *= desc.arraySize;
+
+    std::vector<uint8_t> payload(payloadSize);
+    uint32_t state = 0x12345678;
+    for (size_t i = 0; i < payload.size(); ++i)
+    {
+        state = state * 1664525u + 1013904223u;
+        payload[i] = (uint8_t)(state >> 24);
+    }
+
+    FILE* file = fopen(filename, "wb");
+    if (!file)
+    {
+        THROW_RUNTIME("Can't create " << filename)
+    }
+    bool written = fwrite(&DDS_MAGIC, sizeof(DDS_MAGIC), 1, file) == 1 && fwrite(&header, sizeof(header), 1, file) == 1;
+    size_t fileSize = sizeof(DDS_MAGIC) + sizeof(header) + payload.size();
+    if (layout == SYNTHETIC_DDS_BC1)
+    {
+        written = written && fwrite(&header10, sizeof(header10), 1, file) == 1;
+        fileSize += sizeof(header10);
+    }
+    written = written && fwrite(payload.data(), 1, payload.size(), file) == payload.size();
+    written = fclose(file) == 0 && written;
+    if (!written)
+    {
+        THROW_RUNTIME("Can't write " << filename)
+    }
+    return fileSize;
+}
@@ -0,0 +1,37 @@
+#ifndef GENERATOR_HPP
+#define GENERATOR_HPP
+
+#include <cstddef>
+
+struct SyntheticObjOptions_t
+{
+    SyntheticObjOptions_t() : triangleCount(1000000), materialCount(8), materialBands(4) {}
+
+    // Rounded up to a square grid of quads, two triangles each
+    size_t triangleCount;
+    // Rows of the grid cycle through the materials in this many bands per material,
+    // so the import has usemtl switches to merge
+    unsigned int materialCount;
+    unsigned int materialBands;
+
+};
+
+// Writes a rippled grid with positions, texcoords and normals, like an exported
+// terrain or cloth. Returns the triangle count, throws if the file can't be written.
+size_t WriteSyntheticObj(const char* filename, const SyntheticObjOptions_t& options);
+
+enum SyntheticDdsLayout_t
+{
+    // Legacy header, 32-bit RGBA bit masks
+    SYNTHETIC_DDS_RGBA8 = 0,
+    // DX10 header, BC1
+    SYNTHETIC_DDS_BC1,
+    // Legacy header, DXT5 cube map
+    SYNTHETIC_DDS_DXT5_CUBE,
+};
+
+// Square texture with its full mip chain. The payload is filler, only its size matters.
+// Returns the file size, throws if the file can't be written.
+size_t WriteSyntheticDds(const char* filename, SyntheticDdsLayout_t layout, unsigned int size);
+
+#endif // GENERATOR_HPP
@@ -0,0 +1,567 @@
+// Headless benchmarks of the asset import paths: OBJ scanning and parsing,
+// corner re-indexing, the full import, baked .dat loading and DDS parsing.
+// Inputs are synthetic and generated first, re-indexing also runs on a real
+// mesh. Every file benchmark runs against a cold page cache, with the inputs
+// dropped from it before each run, and against a warm one.
+
+#include "generator.hpp"
+#include "meshdata.hpp"
+#include "objreader.hpp"
+#include "mappedfile.hpp"
+#include "ddsfile.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Every allocation of the process goes through these
+static std::atomic<unsigned long long> g_AllocCount(0);
+static std::atomic<unsigned long long> g_AllocBytes(0);
+
+void* operator new(size_t size)
+{
+    g_AllocCount.fetch_add(1, std::memory_order_relaxed);
+    g_AllocBytes.fetch_add(size, std::memory_order_relaxed);
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+// Peak resident set size in bytes. VmHWM can be reset per run, ru_maxrss can't.
+static size_t GetPeakRss()
+{
+    FILE* file = fopen("/proc/self/status", "r");
+    if (file)
+    {
+        char line[256];
+        while (fgets(line, sizeof(line), file))
+        {
+            unsigned long long kilobytes;
+            if (sscanf(line, "VmHWM: %llu kB", &kilobytes) == 1)
+            {
+                fclose(file);
+                return (size_t)kilobytes * 1024;
+            }
+        }
+        fclose(file);
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (size_t)usage.ru_maxrss * 1024;
+}
+
+// Returns false if the kernel doesn't allow it, peaks then cover the whole process
+static bool ResetPeakRss()
+{
+    int file = open("/proc/self/clear_refs", O_WRONLY);
+    if (file < 0)
+    {
+        return false;
+    }
+    bool reset = write(file, "5", 1) == 1;
+    close(file);
+    return reset;
+}
+
+// Written pages must reach the disk before the kernel agrees to drop them
+static void DropFromPageCache(const std::string& filename)
+{
+    int file = open(filename.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+        THROW_RUNTIME("Can't open " << filename)
+    }
+    fdatasync(file);
+    posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+    close(file);
+}
+
+static size_t GetFileSize(const std::string& filename)
+{
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0)
+    {
+        THROW_RUNTIME("Can't stat " << filename)
+    }
+    return (size_t)info.st_size;
+}
+
+// Exposes the import and .dat paths without a device. LoadGeometry does what
+// Mesh::LoadGeometry does, with a copy standing in for each buffer upload.
+class BenchMesh : public MeshData
+{
+public:
+    BenchMesh() : m_UploadIndexCount(0) {}
+
+    using MeshData::LoadFromObj;
+    using MeshData::LoadFromDat;
+    using MeshData::SaveToDat;
+
+    size_t GetTriangleCount() const { return (m_Indices.empty() ? m_UploadIndexCount : m_Indices.size()) / 3; }
+
+protected:
+    virtual void LoadGeometry(const void* vertices, size_t vertexCount, VertexFormat_t vertexFormat, const void* indices, size_t indexCount, size_t indexSize)
+    {
+        if (vertexFormat == m_VertexFormat)
+        {
+            const unsigned char* bytes = (const unsigned char*)vertices;
+            m_UploadVertices.assign(bytes, bytes + vertexCount * GetVertexFormatDesc(vertexFormat).stride);
+        }
+        else
+        {
+            ConvertVertices((const Vertex*)vertices, vertexCount, m_VertexFormat, m_UploadVertices);
+        }
+
+        const unsigned char* indexBytes = (const unsigned char*)indices;
+        if (indexSize == sizeof(unsigned int) && GetIndexSize((const unsigned int*)indices, indexCount) == sizeof(unsigned short))
+        {
+            std::vector<unsigned short> narrowIndices = NarrowIndices((const unsigned int*)indices, indexCount);
+            indexBytes = (const unsigned char*)narrowIndices.data();
+            m_UploadIndices.assign(indexBytes, indexBytes + indexCount * sizeof(unsigned short));
+        }
+        else
+        {
+            m_UploadIndices.assign(indexBytes, indexBytes + indexCount * indexSize);
+        }
+        m_UploadIndexCount = indexCount;
+    }
+
+    std::vector<unsigned char> m_UploadVertices;
+    std::vector<unsigned char> m_UploadIndices;
+    size_t m_UploadIndexCount;
+
+};
+
+struct BenchOptions_t
+{
+    BenchOptions_t() : textureSize(2048), runs(5), keep(false), dir("bench_data"), realObj("meshes/cube2.obj") {}
+
+    SyntheticObjOptions_t obj;
+    unsigned int textureSize;
+    unsigned int runs;
+    bool keep;
+    std::string dir;
+    // Re-indexed next to the synthetic OBJ
+    std::string realObj;
+
+};
+
+struct BenchResult_t
+{
+    double milliseconds;
+    size_t peakRss;
+    unsigned long long allocCount;
+    unsigned long long allocBytes;
+
+};
+
+// One timed run. The work returns a value derived from what it read, so none of it is optimized out.
+static BenchResult_t RunOnce(const std::function<size_t()>& work, size_t& checksum)
+{
+    ResetPeakRss();
+    unsigned long long allocCount = g_AllocCount.load();
+    unsigned long long allocBytes = g_AllocBytes.load();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    checksum += work();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    BenchResult_t result;
+    result.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+    result.peakRss = GetPeakRss();
+    result.allocCount = g_AllocCount.load() - allocCount;
+    result.allocBytes = g_AllocBytes.load() - allocBytes;
+    return result;
+}
+
+static void PrintHeader()
+{
+    printf("%-22s %-5s %9s %10s %10s %9s %9s %9s %10s %9s\n", "bench", "cache", "MB", "best ms", "median ms", "MB/s", "Mtri/s", "RSS MB", "allocs", "alloc MB");
+}
+
+// Cold runs drop the inputs from the page cache first, warm runs follow an untimed pass.
+// Work on data already in memory only runs warm, the inputs then just give the MB/s.
+static void Benchmark(const char* name, const std::vector<std::string>& inputs, size_t triangles, const BenchOptions_t& options, const std::function<size_t()>& work, bool readsInputs = true)
+{
+    size_t bytes = 0;
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        bytes += GetFileSize(inputs[i]);
+    }
+
+    size_t checksum = 0;
+    for (int cold = readsInputs ? 1 : 0; cold >= 0; --cold)
+    {
+        if (!cold)
+        {
+            work();
+        }
+
+        std::vector<BenchResult_t> results;
+        for (unsigned int run = 0; run < options.runs; ++run)
+        {
+            if (cold)
+            {
+                for (size_t i = 0; i < inputs.size(); ++i)
+                {
+                    DropFromPageCache(inputs[i]);
+                }
+            }
+            results.push_back(RunOnce(work, checksum));
+        }
+
+        std::sort(results.begin(), results.end(), [](const BenchResult_t& a, const BenchResult_t& b) { return a.milliseconds < b.milliseconds; });
+        const BenchResult_t& best = results.front();
+        const BenchResult_t& median = results[results.size() / 2];
+        size_t peakRss = 0;
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            peakRss = std::max(peakRss, results[i].peakRss);
+        }
+
+        double megabytes = bytes / (1024.0 * 1024.0);
+        char trianglesPerSecond[32] = "-";
+        if (triangles)
+        {
+            snprintf(trianglesPerSecond, sizeof(trianglesPerSecond), "%.2f", triangles / (median.milliseconds * 1000.0));
+        }
+        printf("%-22s %-5s %9.2f %10.2f %10.2f %9.1f %9s %9.1f %10llu %9.2f\n", name, cold ? "cold" : "warm", megabytes,
+               best.milliseconds, median.milliseconds, megabytes / (median.milliseconds / 1000.0), trianglesPerSecond,
+               peakRss / (1024.0 * 1024.0), median.allocCount, median.allocBytes / (1024.0 * 1024.0));
+        fflush(stdout);
+    }
+
+    // Keeps the checksum alive
+    if (checksum == 1)
+    {
+        printf(" ");
+    }
+}
+
+// Walks the surfaces the way CreateTextureFromDDS hands them to the device
+static size_t ParseDds(const std::string& filename)
+{
+    MappedFile file(filename.c_str());
+    const DDS_HEADER* header;
+    const uint8_t* bitData;
+    size_t bitSize;
+    if (!ParseDDSHeader((const uint8_t*)file.GetData(), file.GetSize(), &header, &bitData, &bitSize))
+    {
+        THROW_RUNTIME(filename << ": invalid DDS header")
+    }
+    DDSTextureDesc_t desc;
+    if (GetDDSTextureDesc(header, desc) != DDS_RESULT_OK)
+    {
+        THROW_RUNTIME(filename << ": unsupported DDS texture")
+    }
+    std::vector<DDSSurface_t> surfaces;
+    if (!GetDDSSurfaces(desc, bitData, bitSize, surfaces))
+    {
+        THROW_RUNTIME(filename << ": DDS payload too small")
+    }
+
+    size_t checksum = 0;
+    for (size_t i = 0; i < surfaces.size(); ++i)
+    {
+        const DDSSurface_t& surface = surfaces[i];
+        size_t size = surface.sliceBytes * surface.depth;
+        for (size_t j = 0; j < size; j += 64)
+        {
+            checksum += surface.data[j];
+        }
+    }
+    return checksum;
+}
+
+// The re-indexing LoadFromObj did before VertexDictionary, every corner formatted into a string key
+static size_t ReindexWithStrings(const ObjData_t& obj, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    std::unordered_map<std::string, unsigned int> indexDictionary;
+    std::unordered_map<std::string, unsigned int>::iterator iter;
+    unsigned int newIndex = 0;
+    vertices.clear();
+    indices.clear();
+    for (size_t i = 0; i < obj.GetCornerCount(); ++i)
+    {
+        const unsigned int* corner = &obj.corners[i * 3];
+        std::stringstream ss;
+        ss << corner[0] << " " << corner[1] << " " << corner[2];
+        std::string triple = ss.str();
+        if ((iter = indexDictionary.find(triple)) != indexDictionary.end())
+        {
+            indices.push_back(iter->second);
+        }
+        else
+        {
+            vertices.push_back(Vertex(obj.positions[corner[0]], obj.texcoords[corner[1]], obj.normals[corner[2]]));
+            indexDictionary[triple] = newIndex;
+            indices.push_back(newIndex++);
+        }
+    }
+    return vertices.size();
+}
+
+// The re-indexing of LoadFromObj
+static size_t ReindexWithDictionary(const ObjData_t& obj, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    size_t cornerCount = obj.GetCornerCount();
+    VertexDictionary indexDictionary(cornerCount / 3);
+    vertices.clear();
+    indices.resize(cornerCount);
+    for (size_t i = 0; i < cornerCount; ++i)
+    {
+        const unsigned int* corner = &obj.corners[i * 3];
+        bool isNew;
+        indices[i] = indexDictionary.FindOrInsert(corner[0], corner[1], corner[2], isNew);
+        if (isNew)
+        {
+            vertices.push_back(Vertex(obj.positions[corner[0]], obj.texcoords[corner[1]], obj.normals[corner[2]]));
+        }
+    }
+    return vertices.size();
+}
+
+// Both paths on an OBJ parsed up front, throws if they don't build the same mesh
+static void BenchmarkReindex(const char* name, const std::string& filename, const BenchOptions_t& options)
+{
+    ObjData_t obj;
+    ReadObjFile(filename.c_str(), obj);
+    std::vector<Vertex> stringVertices, dictionaryVertices;
+    std::vector<unsigned int> stringIndices, dictionaryIndices;
+    ReindexWithStrings(obj, stringVertices, stringIndices);
+    ReindexWithDictionary(obj, dictionaryVertices, dictionaryIndices);
+    // Vertices are built in first-use order on both paths, equal indices mean equal vertices
+    if (stringIndices != dictionaryIndices || stringVertices.size() != dictionaryVertices.size())
+    {
+        THROW_RUNTIME(filename << ": VertexDictionary re-indexes differently from the string keys")
+    }
+
+    std::vector<std::string> inputs(1, filename);
+    size_t triangles = obj.GetCornerCount() / 3;
+    std::string stringName = std::string(name) + " strings";
+    std::string dictionaryName = std::string(name) + " dict";
+    Benchmark(stringName.c_str(), inputs, triangles, options, [&]()
+    {
+        return ReindexWithStrings(obj, stringVertices, stringIndices);
+    }, false);
+    Benchmark(dictionaryName.c_str(), inputs, triangles, options, [&]()
+    {
+        return ReindexWithDictionary(obj, dictionaryVertices, dictionaryIndices);
+    }, false);
+}
+
+static void PrintUsage()
+{
+    printf("Usage: assetbench [options]\n"
+           "  --triangles N     triangles of the synthetic OBJ (default 1000000)\n"
+           "  --materials N     materials the OBJ switches between (default 8)\n"
+           "  --texture-size N  width and height of the synthetic DDS files (default 2048)\n"
+           "  --runs N          timed runs per benchmark and cache state (default 5)\n"
+           "  --dir PATH        where the inputs are generated (default bench_data)\n"
+           "  --real-obj PATH   real mesh re-indexed next to the synthetic one (default meshes/cube2.obj)\n"
+           "  --keep            leave the generated inputs behind\n");
+}
+
+static bool ParseArguments(int argc, char** argv, BenchOptions_t& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--triangles" && hasValue)
+        {
+            options.obj.triangleCount = (size_t)strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--materials" && hasValue)
+        {
+            options.obj.materialCount = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--texture-size" && hasValue)
+        {
+            options.textureSize = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--runs" && hasValue)
+        {
+            options.runs = std::max(1u, (unsigned int)strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--dir" && hasValue)
+        {
+            options.dir = argv[++i];
+        }
+        else if (arg == "--real-obj" && hasValue)
+        {
+            options.realObj = argv[++i];
+        }
+        else if (arg == "--keep")
+        {
+            options.keep = true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return options.obj.triangleCount > 0 && options.textureSize > 0;
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions_t options;
+    if (!ParseArguments(argc, argv, options))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    try
+    {
+        mkdir(options.dir.c_str(), 0755);
+        std::string objFile = options.dir + "/synthetic.obj";
+        std::string rawDatFile = options.dir + "/synthetic.dat";
+        std::string compressedDatFile = options.dir + "/synthetic_compressed.dat";
+        const char* ddsNames[] = { "rgba8", "bc1", "dxt5_cube" };
+        std::vector<std::string> ddsFiles;
+
+        fprintf(stderr, "Generating inputs in %s\n", options.dir.c_str());
+        size_t triangles = WriteSyntheticObj(objFile.c_str(), options.obj);
+        for (int i = 0; i < 3; ++i)
+        {
+            ddsFiles.push_back(options.dir + "/synthetic_" + ddsNames[i] + ".dds");
+            WriteSyntheticDds(ddsFiles.back().c_str(), (SyntheticDdsLayout_t)i, options.textureSize);
+        }
+
+        // The baked files hold the imported mesh, after welding and merging
+        size_t importedTriangles;
+        {
+            BenchMesh mesh;
+            mesh.LoadFromObj(objFile.c_str());
+            mesh.SaveToDat(rawDatFile.c_str(), false);
+            mesh.SaveToDat(compressedDatFile.c_str(), true);
+            importedTriangles = mesh.GetTriangleCount();
+        }
+
+        if (!ResetPeakRss())
+        {
+            fprintf(stderr, "Can't reset the peak RSS, it covers the whole process\n");
+        }
+        printf("%zu triangles, %u materials, %ux%u textures, %u runs, median of the runs unless noted\n",
+               triangles, options.obj.materialCount, options.textureSize, options.textureSize, options.runs);
+        PrintHeader();
+
+        std::vector<std::string> objInputs(1, objFile);
+        Benchmark("obj scan", objInputs, triangles, options, [&]()
+        {
+            MappedFile file(objFile.c_str());
+            ObjReader reader(file.GetData(), file.GetData() + file.GetSize());
+            size_t faces = 0;
+            ObjReader::ObjToken_t token;
+            while ((token = reader.NextToken()) != ObjReader::OBJ_EOF)
+            {
+                faces += token == ObjReader::OBJ_FACE;
+            }
+            return faces;
+        });
+        Benchmark("obj parse", objInputs, triangles, options, [&]()
+        {
+            ObjData_t obj;
+            ReadObjFile(objFile.c_str(), obj);
+            return obj.GetCornerCount();
+        });
+        BenchmarkReindex("reindex", objFile, options);
+        if (access(options.realObj.c_str(), R_OK) == 0)
+        {
+            BenchmarkReindex("reindex real", options.realObj, options);
+        }
+        else
+        {
+            fprintf(stderr, "Can't read %s, run from the repository root or pass --real-obj\n", options.realObj.c_str());
+        }
+        Benchmark("obj import", objInputs, triangles, options, [&]()
+        {
+            BenchMesh mesh;
+            mesh.LoadFromObj(objFile.c_str());
+            return mesh.GetTriangleCount();
+        });
+        Benchmark("dat load", std::vector<std::string>(1, rawDatFile), importedTriangles, options, [&]()
+        {
+            BenchMesh mesh;
+            mesh.LoadFromDat(rawDatFile.c_str());
+            return mesh.GetTriangleCount();
+        });
+        Benchmark("dat load compressed", std::vector<std::string>(1, compressedDatFile), importedTriangles, options, [&]()
+        {
+            BenchMesh mesh;
+            mesh.LoadFromDat(compressedDatFile.c_str());
+            return mesh.GetTriangleCount();
+        });
+        for (int i = 0; i < 3; ++i)
+        {
+            std::string name = std::string("dds ") + ddsNames[i];
+            const std::string& ddsFile = ddsFiles[i];
+            Benchmark(name.c_str(), std::vector<std::string>(1, ddsFile), 0, options, [&]()
+            {
+                return ParseDds(ddsFile);
+            });
+        }
+
+        if (!options.keep)
+        {
+            remove(objFile.c_str());
+            remove(rawDatFile.c_str());
+            remove(compressedDatFile.c_str());
+            for (size_t i = 0; i < ddsFiles.size(); ++i)
+            {
+                remove(ddsFiles[i].c_str());
+            }
+            rmdir(options.dir.c_str());
+        }
+    }
+    catch (const std::exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
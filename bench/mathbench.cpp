@@ -0,0 +1,569 @@
+// Matrix kernel check and benchmark. The kernels picked for this build are
+// compared with the plain C++ code they replaced, on random affine and general
+// matrices, then both are timed. Multiply, transpose and the transforms, single
+// and batched, must match bit for bit, the inverse within a tolerance. Affine
+// transforms are checked and timed against the 4x4 kernels. Exits with 1 on a mismatch.
+
+#include "mathlib.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+// Largest relative error of Inverse against Gauss-Jordan, and of M * Inverse(M) against identity
+static const float INVERSE_TOLERANCE = 1e-4f;
+
+// The replaced code, kept verbatim in what it computes. Out of line like the
+// engine's, so the timings compare calls with calls.
+#if defined(_MSC_VER)
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+BENCH_NOINLINE static Matrix ReferenceMultiply(const Matrix& a, const Matrix& b)
+{
+    Matrix result;
+    for (int i = 0; i < 4; ++i)
+    {
+        float x = a.m[i][0];
+        float y = a.m[i][1];
+        float z = a.m[i][2];
+        float w = a.m[i][3];
+        result.m[i][0] = (b.m[0][0] * x) + (b.m[1][0] * y) + (b.m[2][0] * z) + (b.m[3][0] * w);
+        result.m[i][1] = (b.m[0][1] * x) + (b.m[1][1] * y) + (b.m[2][1] * z) + (b.m[3][1] * w);
+        result.m[i][2] = (b.m[0][2] * x) + (b.m[1][2] * y) + (b.m[2][2] * z) + (b.m[3][2] * w);
+        result.m[i][3] = (b.m[0][3] * x) + (b.m[1][3] * y) + (b.m[2][3] * z) + (b.m[3][3] * w);
+    }
+    return result;
+}
+
+BENCH_NOINLINE static Matrix ReferenceTranspose(const Matrix& a)
+{
+    return Matrix(a.m[0][0], a.m[1][0], a.m[2][0], a.m[3][0],
+                  a.m[0][1], a.m[1][1], a.m[2][1], a.m[3][1],
+                  a.m[0][2], a.m[1][2], a.m[2][2], a.m[3][2],
+                  a.m[0][3], a.m[1][3], a.m[2][3], a.m[3][3]);
+}
+
+BENCH_NOINLINE static float3 ReferenceTransformPoint(const Matrix& mat, const float3& vec)
+{
+    return float3(mat.m[0][0] * vec.x + mat.m[0][1] * vec.y + mat.m[0][2] * vec.z + mat.m[0][3],
+                  mat.m[1][0] * vec.x + mat.m[1][1] * vec.y + mat.m[1][2] * vec.z + mat.m[1][3],
+                  mat.m[2][0] * vec.x + mat.m[2][1] * vec.y + mat.m[2][2] * vec.z + mat.m[2][3]);
+}
+
+BENCH_NOINLINE static float3 ReferenceTransformVector(const Matrix& mat, const float3& vec)
+{
+    return float3(mat.m[0][0] * vec.x + mat.m[0][1] * vec.y + mat.m[0][2] * vec.z,
+                  mat.m[1][0] * vec.x + mat.m[1][1] * vec.y + mat.m[1][2] * vec.z,
+                  mat.m[2][0] * vec.x + mat.m[2][1] * vec.y + mat.m[2][2] * vec.z);
+}
+
+BENCH_NOINLINE static float3 ReferenceTransformProjected(const Matrix& mat, const float3& vec)
+{
+    float3 point = ReferenceTransformPoint(mat, vec);
+    float w = mat.m[3][0] * vec.x + mat.m[3][1] * vec.y + mat.m[3][2] * vec.z + mat.m[3][3];
+    return float3(point.x / w, point.y / w, point.z / w);
+}
+
+// Gauss-Jordan with full pivoting
+BENCH_NOINLINE static Matrix ReferenceInverse(const Matrix& a)
+{
+    int indxc[4], indxr[4];
+    int ipiv[4] = { 0, 0, 0, 0 };
+    float minv[4][4];
+    memcpy(minv, a.m, sizeof(float) * 16);
+    for (int i = 0; i < 4; i++)
+    {
+        int irow = 0, icol = 0;
+        float big = 0.f;
+        for (int j = 0; j < 4; j++)
+        {
+            if (ipiv[j] != 1)
+            {
+                for (int k = 0; k < 4; k++)
+                {
+                    if (ipiv[k] == 0 && std::abs(minv[j][k]) >= big)
+                    {
+                        big = float(std::abs(minv[j][k]));
+                        irow = j;
+                        icol = k;
+                    }
+                }
+            }
+        }
+        ++ipiv[icol];
+        if (irow != icol)
+        {
+            for (int k = 0; k < 4; ++k) std::swap(minv[irow][k], minv[icol][k]);
+        }
+        indxr[i] = irow;
+        indxc[i] = icol;
+
+        float pivinv = 1.0f / minv[icol][icol];
+        minv[icol][icol] = 1.0f;
+        for (int j = 0; j < 4; j++) minv[icol][j] *= pivinv;
+
+        for (int j = 0; j < 4; j++)
+        {
+            if (j != icol)
+            {
+                float save = minv[j][icol];
+                minv[j][icol] = 0;
+                for (int k = 0; k < 4; k++) minv[j][k] -= minv[icol][k] * save;
+            }
+        }
+    }
+    for (int j = 3; j >= 0; j--)
+    {
+        if (indxr[j] != indxc[j])
+        {
+            for (int k = 0; k < 4; k++)
+            {
+                std::swap(minv[k][indxr[j]], minv[k][indxc[j]]);
+            }
+        }
+    }
+    return Matrix(minv);
+}
+
+static bool SameBits(const float* a, const float* b, size_t count)
+{
+    return memcmp(a, b, count * sizeof(float)) == 0;
+}
+
+// Largest difference relative to the largest magnitude in b
+static float RelativeError(const Matrix& a, const Matrix& b)
+{
+    float error = 0.0f;
+    float scale = 1e-30f;
+    for (int i = 0; i < 4; ++i)
+    {
+        for (int j = 0; j < 4; ++j)
+        {
+            error = std::max<float>(error, std::abs(a.m[i][j] - b.m[i][j]));
+            scale = std::max<float>(scale, std::abs(b.m[i][j]));
+        }
+    }
+    return error / scale;
+}
+
+typedef void (*BatchArrays_t)(const Matrix& matrix, const float3* input, size_t count, float3* result);
+typedef void (*BatchStreams_t)(const Matrix& matrix, const float* x, const float* y, const float* z, size_t count, float* resultX, float* resultY, float* resultZ);
+typedef float3 (*ReferenceTransform_t)(const Matrix& matrix, const float3& vec);
+
+// Elements differing from the plain code through float3 arrays, in place and
+// through streams. One short of a multiple of 8, so the 8 and 4 wide blocks and the tail all run.
+static size_t CountBatchMismatches(const Matrix& matrix, const std::vector<float3>& input, BatchArrays_t arrays, BatchStreams_t streams, ReferenceTransform_t reference)
+{
+    size_t count = input.size() / 8 * 8 - 1;
+    std::vector<float3> result(count), inPlace(input.begin(), input.begin() + count);
+    std::vector<float> x(count), y(count), z(count), resultX(count), resultY(count), resultZ(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        x[i] = input[i].x;
+        y[i] = input[i].y;
+        z[i] = input[i].z;
+    }
+    arrays(matrix, input.data(), count, result.data());
+    arrays(matrix, inPlace.data(), count, inPlace.data());
+    streams(matrix, x.data(), y.data(), z.data(), count, resultX.data(), resultY.data(), resultZ.data());
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        float3 expected = reference(matrix, input[i]);
+        float3 streamed(resultX[i], resultY[i], resultZ[i]);
+        mismatches += !SameBits(&result[i].x, &expected.x, 3) || !SameBits(&inPlace[i].x, &expected.x, 3) || !SameBits(&streamed.x, &expected.x, 3);
+    }
+    return mismatches;
+}
+
+// Half of them rigid transforms with scale, like the scene's, half of them
+// general but diagonally dominant, so well conditioned
+static std::vector<Matrix> GenerateMatrices(size_t count, std::mt19937& random)
+{
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<Matrix> matrices;
+    while (matrices.size() < count)
+    {
+        Matrix matrix;
+        if (matrices.size() % 2 == 0)
+        {
+            float3 axis(unit(random), unit(random), unit(random));
+            if (axis.length() < 0.1f)
+            {
+                continue;
+            }
+            matrix = Matrix::Translation(unit(random) * 100.0f, unit(random) * 100.0f, unit(random) * 100.0f) *
+                     Matrix::RotationAxis(axis, unit(random) * MATH_PI) *
+                     Matrix::Scaling(1.0f + unit(random) * 0.9f, 1.0f + unit(random) * 0.9f, 1.0f + unit(random) * 0.9f);
+        }
+        else
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                for (int j = 0; j < 4; ++j)
+                {
+                    matrix.m[i][j] = unit(random) * 4.0f + (i == j ? 16.0f : 0.0f);
+                }
+            }
+        }
+        matrices.push_back(matrix);
+    }
+    return matrices;
+}
+
+// Rotations and translations, with a random scale per axis unless rigid
+static std::vector<AffineTransform> GenerateAffineTransforms(size_t count, bool rigid, std::mt19937& random)
+{
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<AffineTransform> transforms;
+    while (transforms.size() < count)
+    {
+        float3 axis(unit(random), unit(random), unit(random));
+        if (axis.length() < 0.1f)
+        {
+            continue;
+        }
+        Matrix matrix = Matrix::Translation(unit(random) * 100.0f, unit(random) * 100.0f, unit(random) * 100.0f) * Matrix::RotationAxis(axis, unit(random) * MATH_PI);
+        if (!rigid)
+        {
+            matrix = matrix * Matrix::Scaling(1.0f + unit(random) * 0.9f, 1.0f + unit(random) * 0.9f, 1.0f + unit(random) * 0.9f);
+        }
+        transforms.push_back(AffineTransform(matrix));
+    }
+    return transforms;
+}
+
+// Compares values, so zeros of either sign are equal
+static bool SameValues(const float* a, const float* b, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (a[i] != b[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static float Checksum(const float* values, size_t count)
+{
+    float sum = 0.0f;
+    for (size_t i = 0; i < count; ++i)
+    {
+        sum += values[i];
+    }
+    return sum;
+}
+
+// Nanoseconds per call, best of a few passes over the inputs
+static double Time(size_t callsPerPass, const std::function<float()>& pass, float& checksum)
+{
+    double best = 1e30;
+    for (int run = 0; run < 7; ++run)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        checksum += pass();
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count() / callsPerPass);
+    }
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? (size_t)strtoul(argv[1], nullptr, 10) : 4096;
+    if (count < 8)
+    {
+        printf("Usage: mathbench [matrix count, default 4096]\n");
+        return 1;
+    }
+
+#if defined(MATHLIB_AVX)
+    const char* kernels = "AVX";
+#elif defined(MATHLIB_SSE2)
+    const char* kernels = "SSE2";
+#else
+    const char* kernels = "plain C++";
+#endif
+#ifdef MATHLIB_ALIGN_MATRIX
+    const char* alignment = "aligned";
+#else
+    const char* alignment = "unaligned";
+#endif
+    printf("%s kernels, %s matrices, %zu matrices\n", kernels, alignment, count);
+
+    std::mt19937 random(1234);
+    std::vector<Matrix> matrices = GenerateMatrices(count, random);
+    std::uniform_real_distribution<float> unit(-100.0f, 100.0f);
+    std::vector<float3> points(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        points[i] = float3(unit(random), unit(random), unit(random));
+    }
+
+    size_t multiplyMismatches = 0, transposeMismatches = 0, transformMismatches = 0;
+    float inverseError = 0.0f, identityError = 0.0f;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Matrix& a = matrices[i];
+        const Matrix& b = matrices[(i + 1) % count];
+        Matrix product = a * b;
+        Matrix expected = ReferenceMultiply(a, b);
+        Matrix inPlace = a;
+        inPlace *= b;
+        multiplyMismatches += !SameBits(&product.m[0][0], &expected.m[0][0], 16) || !SameBits(&inPlace.m[0][0], &expected.m[0][0], 16);
+
+        Matrix transposed = a.Transpose();
+        Matrix expectedTransposed = ReferenceTranspose(a);
+        transposeMismatches += !SameBits(&transposed.m[0][0], &expectedTransposed.m[0][0], 16);
+
+        float3 point = a.TransformPoint(points[i]);
+        float3 expectedPoint = ReferenceTransformPoint(a, points[i]);
+        float3 vec = a.TransformVector(points[i]);
+        float3 expectedVec = ReferenceTransformVector(a, points[i]);
+        transformMismatches += !SameBits(&point.x, &expectedPoint.x, 3) || !SameBits(&vec.x, &expectedVec.x, 3);
+
+        Matrix inverse = a.Inverse();
+        inverseError = std::max<float>(inverseError, RelativeError(inverse, ReferenceInverse(a)));
+        identityError = std::max<float>(identityError, RelativeError(a * inverse, Matrix::Identity()));
+    }
+
+    // The general matrices have a projective last row
+    size_t batchMismatches = 0;
+    for (size_t i = 0; i < 4; ++i)
+    {
+        batchMismatches += CountBatchMismatches(matrices[i], points, TransformPoints, TransformPoints, ReferenceTransformPoint);
+        batchMismatches += CountBatchMismatches(matrices[i], points, TransformVectors, TransformVectors, ReferenceTransformVector);
+        batchMismatches += CountBatchMismatches(matrices[i], points, TransformPointsProjected, TransformPointsProjected, ReferenceTransformProjected);
+    }
+
+    // Affine transforms against the same products and inverses done on 4x4 matrices
+    std::vector<AffineTransform> affines = GenerateAffineTransforms(count, false, random);
+    std::vector<AffineTransform> rigids = GenerateAffineTransforms(count, true, random);
+    size_t composeMismatches = 0;
+    float affineInverseError = 0.0f, rigidInverseError = 0.0f;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const AffineTransform& a = affines[i];
+        const AffineTransform& b = affines[(i + 1) % count];
+        AffineTransform product = a * b;
+        Matrix expected = a.ToMatrix() * b.ToMatrix();
+        composeMismatches += !SameValues(&product.m[0][0], &expected.m[0][0], 12);
+
+        affineInverseError = std::max<float>(affineInverseError, RelativeError(a.Inverse().ToMatrix(), ReferenceInverse(a.ToMatrix())));
+        rigidInverseError = std::max<float>(rigidInverseError, RelativeError(rigids[i].InverseRigid().ToMatrix(), ReferenceInverse(rigids[i].ToMatrix())));
+    }
+
+    bool passed = multiplyMismatches == 0 && transposeMismatches == 0 && transformMismatches == 0 && batchMismatches == 0 &&
+                  inverseError <= INVERSE_TOLERANCE && identityError <= INVERSE_TOLERANCE &&
+                  composeMismatches == 0 && affineInverseError <= INVERSE_TOLERANCE && rigidInverseError <= INVERSE_TOLERANCE;
+    printf("multiply:  %zu of %zu differ from the plain code\n", multiplyMismatches, count);
+    printf("transpose: %zu of %zu differ from the plain code\n", transposeMismatches, count);
+    printf("transform: %zu of %zu differ from the plain code\n", transformMismatches, count);
+    printf("batch:     %zu differ from the plain code\n", batchMismatches);
+    printf("inverse:   relative error %g against Gauss-Jordan, %g against identity, tolerance %g\n", inverseError, identityError, INVERSE_TOLERANCE);
+    printf("affine:    %zu of %zu products differ from 4x4 ones, relative error of the inverses %g, rigid %g\n",
+           composeMismatches, count, affineInverseError, rigidInverseError);
+
+    std::vector<Matrix> results(count);
+    std::vector<float3> transformed(count);
+    float checksum = 0.0f;
+    printf("\n%-16s %12s %12s\n", "ns per call", "kernel", "plain");
+
+    double kernel = Time(count, [&]()
+    {
+        for (size_t i = 0; i + 1 < count; ++i)
+        {
+            results[i] = matrices[i] * matrices[i + 1];
+        }
+        return Checksum(&results[count / 2].m[0][0], 16);
+    }, checksum);
+    double plain = Time(count, [&]()
+    {
+        for (size_t i = 0; i + 1 < count; ++i)
+        {
+            results[i] = ReferenceMultiply(matrices[i], matrices[i + 1]);
+        }
+        return Checksum(&results[count / 2].m[0][0], 16);
+    }, checksum);
+    printf("%-16s %12.2f %12.2f\n", "multiply", kernel, plain);
+
+    kernel = Time(count, [&]()
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            results[i] = matrices[i].Transpose();
+        }
+        return Checksum(&results[count / 2].m[0][0], 16);
+    }, checksum);
+    plain = Time(count, [&]()
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            results[i] = ReferenceTranspose(matrices[i]);
+        }
+        return Checksum(&results[count / 2].m[0][0], 16);
+    }, checksum);
+    printf("%-16s %12.2f %12.2f\n", "transpose", kernel, plain);
+
+    kernel = Time(count, [&]()
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            transformed[i] = matrices[i].TransformPoint(points[i]);
+        }
+        return transformed[count / 2].x;
+    }, checksum);
+    plain = Time(count, [&]()
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            transformed[i] = ReferenceTransformPoint(matrices[i], points[i]);
+        }
+        return transformed[count / 2].x;
+    }, checksum);
+    printf("%-16s %12.2f %12.2f\n", "transform point", kernel, plain);
+
+    kernel = Time(count, [&]()
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            results[i] = matrices[i].Inverse();
+        }
+        return Checksum(&results[count / 2].m[0][0], 16);
+    }, checksum);
+    plain = Time(count, [&]()
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            results[i] = ReferenceInverse(matrices[i]);
+        }
+        return Checksum(&results[count / 2].m[0][0], 16);
+    }, checksum);
+    printf("%-16s %12.2f %12.2f\n", "inverse", kernel, plain);
+
+    // Batches per element, against the plain code one element at a time
+    std::vector<float> x(count), y(count), z(count), resultX(count), resultY(count), resultZ(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        x[i] = points[i].x;
+        y[i] = points[i].y;
+        z[i] = points[i].z;
+    }
+    const Matrix& batchMatrix = matrices[1];
+    plain = Time(count, [&]()
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            transformed[i] = ReferenceTransformPoint(batchMatrix, points[i]);
+        }
+        return transformed[count / 2].x;
+    }, checksum);
+    kernel = Time(count, [&]()
+    {
+        TransformPoints(batchMatrix, points.data(), count, transformed.data());
+        return transformed[count / 2].x;
+    }, checksum);
+    printf("%-16s %12.2f %12.2f\n", "batch points", kernel, plain);
+    kernel = Time(count, [&]()
+    {
+        TransformPoints(batchMatrix, x.data(), y.data(), z.data(), count, resultX.data(), resultY.data(), resultZ.data());
+        return resultX[count / 2];
+    }, checksum);
+    printf("%-16s %12.2f %12.2f\n", "batch streams", kernel, plain);
+    plain = Time(count, [&]()
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            transformed[i] = ReferenceTransformProjected(batchMatrix, points[i]);
+        }
+        return transformed[count / 2].x;
+    }, checksum);
+    kernel = Time(count, [&]()
+    {
+        TransformPointsProjected(batchMatrix, points.data(), count, transformed.data());
+        return transformed[count / 2].x;
+    }, checksum);
+    printf("%-16s %12.2f %12.2f\n", "batch projected", kernel, plain);
+
+    // Affine transforms against the 4x4 kernels on the same transforms
+    std::vector<Matrix> affineMatrices(count), rigidMatrices(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        affineMatrices[i] = affines[i].ToMatrix();
+        rigidMatrices[i] = rigids[i].ToMatrix();
+    }
+    std::vector<AffineTransform> affineResults(count);
+    printf("\n%-16s %12s %12s\n", "ns per call", "affine", "4x4");
+    plain = Time(count, [&]()
+    {
+        for (size_t i = 0; i + 1 < count; ++i)
+        {
+            results[i] = affineMatrices[i] * affineMatrices[i + 1];
+        }
+        return Checksum(&results[count / 2].m[0][0], 16);
+    }, checksum);
+    kernel = Time(count, [&]()
+    {
+        for (size_t i = 0; i + 1 < count; ++i)
+        {
+            affineResults[i] = affines[i] * affines[i + 1];
+        }
+        return Checksum(&affineResults[count / 2].m[0][0], 12);
+    }, checksum);
+    printf("%-16s %12.2f %12.2f\n", "compose", kernel, plain);
+    plain = Time(count, [&]()
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            results[i] = affineMatrices[i].Inverse();
+        }
+        return Checksum(&results[count / 2].m[0][0], 16);
+    }, checksum);
+    kernel = Time(count, [&]()
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            affineResults[i] = affines[i].Inverse();
+        }
+        return Checksum(&affineResults[count / 2].m[0][0], 12);
+    }, checksum);
+    printf("%-16s %12.2f %12.2f\n", "inverse", kernel, plain);
+    plain = Time(count, [&]()
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            results[i] = rigidMatrices[i].Inverse();
+        }
+        return Checksum(&results[count / 2].m[0][0], 16);
+    }, checksum);
+    kernel = Time(count, [&]()
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            affineResults[i] = rigids[i].InverseRigid();
+        }
+        return Checksum(&affineResults[count / 2].m[0][0], 12);
+    }, checksum);
+    printf("%-16s %12.2f %12.2f\n", "rigid inverse", kernel, plain);
+
+    // Keeps the timed loops alive
+    if (checksum == 1.0f)
+    {
+        printf(" ");
+    }
+
+    printf("\n%s\n", passed ? "All kernels match" : "MISMATCH");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,217 @@
+// ParseFloat check and benchmark. Random numbers are printed the way OBJ
+// exporters write them and in general notation, the latter often long enough
+// to take the strtof fallback. ParseFloat must match strtof in the C locale on
+// all of them, run with a ',' decimal locale set when one is installed. Then
+// ParseFloat, the pow(10, n) routine it replaced and strtof are timed.
+// Exits with 1 on a mismatch.
+
+#include "numberparser.hpp"
+#include <algorithm>
+#include <chrono>
+#include <clocale>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+// Locales tried for the decimal comma check, the first installed one is used
+static const char* COMMA_LOCALES[] = { "de_DE.UTF-8", "de_DE.utf8", "fr_FR.UTF-8", "ru_RU.UTF-8", "German_Germany.1252" };
+
+// The routine ParseFloat replaced in FileReader::ReadFloatValue
+static const char* ParsePowerOfTen(const char* current, const char* end, float& result)
+{
+    float value = 0.0f;
+    bool minus = current < end && *current == '-';
+    if (minus) ++current;
+    while (current < end && *current >= '0' && *current <= '9')
+    {
+        value = value * 10.0f + (float)((int)*current++ - 48);
+    }
+    if (current < end && *current++ == '.')
+    {
+        size_t frac = 1;
+        while (current < end && *current >= '0' && *current <= '9')
+        {
+            value += (float)((int)*current++ - 48) / (pow(10.0f, frac++));
+        }
+    }
+    result = minus ? -value : value;
+    return current;
+}
+
+// Numbers one per line, parsed from a single buffer like the OBJ reader does
+struct NumberText_t
+{
+    std::string text;
+    std::vector<size_t> starts;
+
+    size_t GetCount() const { return starts.size() - 1; }
+    const char* GetBegin(size_t i) const { return text.data() + starts[i]; }
+    // Without the newline
+    const char* GetEnd(size_t i) const { return text.data() + starts[i + 1] - 1; }
+
+};
+
+// Like exported vertex data, or anything a float can hold
+static NumberText_t GenerateNumbers(size_t count, bool general, std::mt19937& random)
+{
+    std::uniform_real_distribution<double> coordinate(-1000.0, 1000.0);
+    std::uniform_int_distribution<int> exponent(-40, 38);
+    std::uniform_int_distribution<int> precision(1, 17);
+    NumberText_t numbers;
+    numbers.starts.push_back(0);
+    char buffer[64];
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (general)
+        {
+            double value = coordinate(random) / 1000.0 * std::pow(10.0, exponent(random));
+            snprintf(buffer, sizeof(buffer), "%.*g", precision(random), value);
+        }
+        else
+        {
+            snprintf(buffer, sizeof(buffer), "%.4f", coordinate(random));
+        }
+        numbers.text += buffer;
+        numbers.text += '\n';
+        numbers.starts.push_back(numbers.text.size());
+    }
+    return numbers;
+}
+
+// strtof in whatever locale is current
+static std::vector<float> ParseWithStrtof(const NumberText_t& numbers)
+{
+    std::vector<float> values(numbers.GetCount());
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        values[i] = strtof(numbers.GetBegin(i), nullptr);
+    }
+    return values;
+}
+
+static size_t CountMismatches(const NumberText_t& numbers, const std::vector<float>& expected)
+{
+    size_t mismatches = 0;
+    for (size_t i = 0; i < numbers.GetCount(); ++i)
+    {
+        float value;
+        ParseFloat(numbers.GetBegin(i), numbers.GetEnd(i), value);
+        mismatches += memcmp(&value, &expected[i], sizeof(float)) != 0;
+    }
+    return mismatches;
+}
+
+template <typename Parse>
+static double MeasureMillionsPerSecond(const NumberText_t& numbers, Parse parse, float& checksum)
+{
+    double best = 1e30;
+    for (int run = 0; run < 5; ++run)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < numbers.GetCount(); ++i)
+        {
+            checksum += parse(numbers.GetBegin(i), numbers.GetEnd(i));
+        }
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    return numbers.GetCount() / best / 1e6;
+}
+
+static size_t CountOldMismatches(const NumberText_t& numbers, const std::vector<float>& expected)
+{
+    size_t mismatches = 0;
+    for (size_t i = 0; i < numbers.GetCount(); ++i)
+    {
+        float value;
+        ParsePowerOfTen(numbers.GetBegin(i), numbers.GetEnd(i), value);
+        mismatches += memcmp(&value, &expected[i], sizeof(float)) != 0;
+    }
+    return mismatches;
+}
+
+// Sets the first installed locale with a decimal comma, null if there is none
+static const char* SetCommaLocale()
+{
+    for (size_t i = 0; i < sizeof(COMMA_LOCALES) / sizeof(COMMA_LOCALES[0]); ++i)
+    {
+        if (setlocale(LC_ALL, COMMA_LOCALES[i]) && strcmp(localeconv()->decimal_point, ",") == 0)
+        {
+            return COMMA_LOCALES[i];
+        }
+    }
+    setlocale(LC_ALL, "C");
+    return nullptr;
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? (size_t)strtoul(argv[1], nullptr, 10) : 2000000;
+    if (count == 0)
+    {
+        printf("Usage: parsebench [number count per set, default 2000000]\n");
+        return 1;
+    }
+
+    std::mt19937 random(1234);
+    const char* setNames[2] = { "OBJ-style %.4f", "general %.*g" };
+    NumberText_t sets[2] = { GenerateNumbers(count, false, random), GenerateNumbers(count, true, random) };
+    // The process starts in the C locale
+    std::vector<float> expected[2] = { ParseWithStrtof(sets[0]), ParseWithStrtof(sets[1]) };
+
+    const char* commaLocale = SetCommaLocale();
+    size_t mismatches = 0;
+    for (int set = 0; set < 2; ++set)
+    {
+        size_t setMismatches = CountMismatches(sets[set], expected[set]);
+        size_t oldMismatches = CountOldMismatches(sets[set], expected[set]);
+        mismatches += setMismatches;
+        printf("%-16s ParseFloat: %zu of %zu differ from strtof, pow(10, n): %zu (%.1f%%)\n",
+               setNames[set], setMismatches, count, oldMismatches, 100.0 * oldMismatches / count);
+    }
+    if (commaLocale)
+    {
+        printf("Checked in %s, strtof there would read \"1.5\" as %g\n", commaLocale, strtof("1.5", nullptr));
+    }
+    else
+    {
+        printf("No decimal comma locale installed, checked in the C locale only\n");
+    }
+    setlocale(LC_ALL, "C");
+
+    printf("\n%-16s %12s %12s %12s\n", "Mfloats/s", "ParseFloat", "pow(10, n)", "strtof");
+    float checksum = 0.0f;
+    for (int set = 0; set < 2; ++set)
+    {
+        double parseFloat = MeasureMillionsPerSecond(sets[set], [](const char* begin, const char* end)
+        {
+            float value;
+            ParseFloat(begin, end, value);
+            return value;
+        }, checksum);
+        double powerOfTen = MeasureMillionsPerSecond(sets[set], [](const char* begin, const char* end)
+        {
+            float value;
+            ParsePowerOfTen(begin, end, value);
+            return value;
+        }, checksum);
+        double strtofRate = MeasureMillionsPerSecond(sets[set], [](const char* begin, const char*)
+        {
+            return strtof(begin, nullptr);
+        }, checksum);
+        printf("%-16s %12.1f %12.1f %12.1f\n", setNames[set], parseFloat, powerOfTen, strtofRate);
+    }
+
+    // Keeps the timed loops alive
+    if (checksum == 1.0f)
+    {
+        printf(" ");
+    }
+
+    printf("\n%s\n", mismatches == 0 ? "ParseFloat matches strtof" : "MISMATCH");
+    return mismatches == 0 ? 0 : 1;
+}
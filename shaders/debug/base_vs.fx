@@ -6,14 +6,7 @@ cbuffer ConstantBuffer : register(b0)
 
 }
 
-struct VS_INPUT
-{
-    float4 Position : POSITION0;
-    float2 Texcoord : TEXCOORD0;
-    float3 Normal   : NORMAL0;
-    float3 Tangent_S: TANGENT_S0;
-    float3 Tangent_T: TANGENT_T0;
-};
+#include "../vertexformat.fxh"
 
 struct VS_OUTPUT
 {
@@ -30,15 +23,16 @@ struct VS_OUTPUT
 VS_OUTPUT vs_main(VS_INPUT Input)
 {
 	VS_OUTPUT Output;
-    Output.Position = mul(Input.Position, matWorld);
+    VertexData Vertex = DecodeVertex(Input);
+    Output.Position = mul(Vertex.Position, matWorld);
 
-    Output.Texcoord = Input.Texcoord;
+    Output.Texcoord = Vertex.Texcoord;
     Output.WorldPos = Output.Position.xyz;
     Output.ShadowPos = mul(Output.Position, matShadowToWorld);
 
     Output.Position = mul(Output.Position, matViewProjection);
-    Output.Normal   = Input.Normal;
-    Output.Tangent_S = Input.Tangent_S;
-    Output.Tangent_T = Input.Tangent_T;
+    Output.Normal   = Vertex.Normal;
+    Output.Tangent_S = Vertex.Tangent_S;
+    Output.Tangent_T = Vertex.Tangent_T;
     return Output;
 }
@@ -8,12 +8,7 @@ cbuffer ConstantBuffer : register(b0)
 
 }
 
-struct VS_INPUT
-{
-    float4 Position : POSITION0;
-    float2 Texcoord : TEXCOORD0;
-    float3 Normal   : NORMAL0;
-};
+#include "vertexformat.fxh"
 
 struct VS_OUTPUT
 {
@@ -28,13 +23,14 @@ struct VS_OUTPUT
 VS_OUTPUT vs_main(VS_INPUT Input)
 {
 	VS_OUTPUT Output;
-    Output.Position = mul(Input.Position, matWorld);
-    Output.Texcoord = Input.Texcoord;
+    VertexData Vertex = DecodeVertex(Input);
+    Output.Position = mul(Vertex.Position, matWorld);
+    Output.Texcoord = Vertex.Texcoord;
     Output.WorldPos = Output.Position.xyz;
 
     Output.Position = mul(Output.Position, matViewProjection);
     Output.ProjPos  = Output.Position;
-    Output.Normal   = Input.Normal;
+    Output.Normal   = Vertex.Normal;
     return Output;
 }
 
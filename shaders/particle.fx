@@ -21,14 +21,7 @@ cbuffer PSConstantBuffer : register(b1)
     float3 phongScale;
 }
 
-struct VS_INPUT
-{
-    float4 Position : POSITION0;
-    float2 Texcoord : TEXCOORD0;
-    float3 Normal   : NORMAL0;
-    float3 Tangent_S: TANGENT_S0;
-    float3 Tangent_T: TANGENT_T0;
-};
+#include "vertexformat.fxh"
 
 struct VS_OUTPUT
 {
@@ -45,16 +38,17 @@ struct VS_OUTPUT
 VS_OUTPUT vs_main(VS_INPUT Input)
 {
 	VS_OUTPUT Output;
-    Output.Position = mul(Input.Position, matWorld);
+    VertexData Vertex = DecodeVertex(Input);
+    Output.Position = mul(Vertex.Position, matWorld);
 
-    Output.Texcoord = Input.Texcoord;
+    Output.Texcoord = Vertex.Texcoord;
     Output.WorldPos = Output.Position.xyz;
     Output.ShadowPos = mul(Output.Position, matShadowToWorld);
 
     Output.Position = mul(Output.Position, matViewProjection);
-    Output.Normal   = mul(Input.Normal, matWorld);
-    Output.Tangent_S = mul(Input.Tangent_S, matWorld);
-    Output.Tangent_T = mul(Input.Tangent_T, matWorld);
+    Output.Normal   = mul(Vertex.Normal, matWorld);
+    Output.Tangent_S = mul(Vertex.Tangent_S, matWorld);
+    Output.Tangent_T = mul(Vertex.Tangent_T, matWorld);
     return Output;
 }
 
@@ -0,0 +1,153 @@
+#include "assetcache.hpp"
+#include "mappedfile.hpp"
+#include "jobsystem.hpp"
+#include "utils.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Files are hashed in blocks of this size, one job each
+static const size_t HASH_BLOCK_SIZE = 4 << 20;
+
+static const unsigned long long PRIME1 = 0x9E3779B185EBCA87ULL;
+static const unsigned long long PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+static const unsigned long long PRIME3 = 0x165667B19E3779F9ULL;
+
+static unsigned long long RotateLeft(unsigned long long value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static unsigned long long HashRound(unsigned long long lane, unsigned long long word)
+{
+    return RotateLeft(lane + word * PRIME2, 31) * PRIME1;
+}
+
+unsigned long long HashBytes(const void* data, size_t size, unsigned long long seed)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    unsigned long long lanes[4] = { seed + PRIME1 + PRIME2, seed + PRIME2, seed, seed - PRIME1 };
+
+    // Four independent lanes over 8-byte words
+    size_t blockCount = size / 32;
+    for (size_t i = 0; i < blockCount; ++i)
+    {
+        unsigned long long words[4];
+        memcpy(words, bytes + i * 32, 32);
+        lanes[0] = HashRound(lanes[0], words[0]);
+        lanes[1] = HashRound(lanes[1], words[1]);
+        lanes[2] = HashRound(lanes[2], words[2]);
+        lanes[3] = HashRound(lanes[3], words[3]);
+    }
+
+    unsigned long long hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+    hash += size;
+    for (size_t i = blockCount * 32; i < size; ++i)
+    {
+        hash = RotateLeft(hash ^ (bytes[i] * PRIME3), 11) * PRIME1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+unsigned long long HashFile(const char* filename)
+{
+    MappedFile file(filename);
+
+    size_t blockCount = (file.GetSize() + HASH_BLOCK_SIZE - 1) / HASH_BLOCK_SIZE;
+    std::vector<unsigned long long> blockHashes(blockCount);
+    jobs->ParallelFor((unsigned int)blockCount, [&](unsigned int i)
+    {
+        size_t offset = i * HASH_BLOCK_SIZE;
+        size_t size = file.GetSize() - offset < HASH_BLOCK_SIZE ? file.GetSize() - offset : HASH_BLOCK_SIZE;
+        blockHashes[i] = HashBytes(file.GetData() + offset, size);
+    });
+
+    return HashBytes(blockHashes.data(), blockHashes.size() * sizeof(unsigned long long), file.GetSize());
+}
+
+bool FileExists(const char* filename)
+{
+#ifdef _WIN32
+    DWORD attributes = GetFileAttributesA(filename);
+    return attributes != INVALID_FILE_ATTRIBUTES && !(attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    struct stat info;
+    return stat(filename, &info) == 0 && S_ISREG(info.st_mode);
+#endif
+}
+
+std::string GetCachePath(const char* sourceFile, unsigned long long key, const char* extension)
+{
+#ifdef _WIN32
+    CreateDirectoryA(ASSET_CACHE_DIRECTORY, nullptr);
+#else
+    mkdir(ASSET_CACHE_DIRECTORY, 0755);
+#endif
+
+    const char* name = sourceFile;
+    for (const char* current = sourceFile; *current; ++current)
+    {
+        if (*current == '/' || *current == '\\')
+        {
+            name = current + 1;
+        }
+    }
+    const char* nameEnd = strrchr(name, '.');
+    if (!nameEnd)
+    {
+        nameEnd = name + strlen(name);
+    }
+
+    char keyString[17];
+    sprintf(keyString, "%016llx", key);
+    return std::string(ASSET_CACHE_DIRECTORY) + "/" + std::string(name, nameEnd) + "_" + keyString + extension;
+}
+
+std::string GetCacheTempPath(const std::string& cacheFile)
+{
+    static std::atomic<unsigned int> counter(0);
+#ifdef _WIN32
+    unsigned long processId = GetCurrentProcessId();
+#else
+    unsigned long processId = (unsigned long)getpid();
+#endif
+
+    char suffix[32];
+    sprintf(suffix, ".%lu.%u.tmp", processId, counter++);
+    return cacheFile + suffix;
+}
+
+void PublishCacheFile(const std::string& tempFile, const std::string& cacheFile)
+{
+#ifdef _WIN32
+    bool success = MoveFileExA(tempFile.c_str(), cacheFile.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    bool success = rename(tempFile.c_str(), cacheFile.c_str()) == 0;
+#endif
+
+    if (!success)
+    {
+        remove(tempFile.c_str());
+        // Lost a race with another writer, whose entry has the same key and contents
+        if (FileExists(cacheFile.c_str()))
+        {
+            return;
+        }
+        THROW_RUNTIME("Failed to publish cache file " << cacheFile)
+    }
+
+}
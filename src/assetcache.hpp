@@ -0,0 +1,27 @@
+#ifndef ASSETCACHE_HPP
+#define ASSETCACHE_HPP
+
+#include <string>
+
+// Cache of files derived from source assets, e.g. .dat meshes baked from .obj.
+// Entries are named after the source and a key that covers its contents plus
+// anything else that changes the output, so stale entries are never picked up.
+// Old entries are left behind, clearing the cache directory is always safe.
+
+const char* const ASSET_CACHE_DIRECTORY = "cache";
+
+unsigned long long HashBytes(const void* data, size_t size, unsigned long long seed = 0);
+// Hashes the contents of a file through a mapping, in parallel for large files
+unsigned long long HashFile(const char* filename);
+
+// cache/<source name>_<key><extension>, creates the cache directory if needed
+std::string GetCachePath(const char* sourceFile, unsigned long long key, const char* extension);
+// A unique name next to cacheFile to write the entry to before publishing it
+std::string GetCacheTempPath(const std::string& cacheFile);
+// Atomically moves a fully written temp file into place.
+// Readers see either the old entry or the complete new one.
+void PublishCacheFile(const std::string& tempFile, const std::string& cacheFile);
+
+bool FileExists(const char* filename);
+
+#endif // ASSETCACHE_HPP
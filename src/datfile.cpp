@@ -0,0 +1,240 @@
+#include "datfile.hpp"
+#include "utils.hpp"
+#include <cstring>
+#include <fstream>
+
+static_assert(sizeof(DatHeader_t) == DAT_ALIGNMENT, "DatHeader_t must stay 64 bytes");
+static_assert(sizeof(DatSection_t) == DAT_ALIGNMENT, "DatSection_t must stay 64 bytes");
+
+static size_t AlignUp(size_t value)
+{
+    return (value + DAT_ALIGNMENT - 1) & ~(size_t)(DAT_ALIGNMENT - 1);
+}
+
+unsigned int DatChecksum(const void* data, size_t size)
+{
+    // FNV-1a over 32-bit words, four interleaved lanes
+    const unsigned int prime = 0x01000193;
+    unsigned int lanes[4] = { 0x811C9DC5, 0x811C9DC5 ^ 1, 0x811C9DC5 ^ 2, 0x811C9DC5 ^ 3 };
+
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t blockCount = size / 16;
+    for (size_t i = 0; i < blockCount; ++i)
+    {
+        unsigned int words[4];
+        memcpy(words, bytes + i * 16, 16);
+        lanes[0] = (lanes[0] ^ words[0]) * prime;
+        lanes[1] = (lanes[1] ^ words[1]) * prime;
+        lanes[2] = (lanes[2] ^ words[2]) * prime;
+        lanes[3] = (lanes[3] ^ words[3]) * prime;
+    }
+
+    for (size_t i = blockCount * 16; i < size; ++i)
+    {
+        lanes[0] = (lanes[0] ^ bytes[i]) * prime;
+    }
+
+    unsigned int hash = (unsigned int)size;
+    for (size_t i = 0; i < 4; ++i)
+    {
+        hash = (hash ^ lanes[i]) * prime;
+    }
+    return hash;
+}
+
+DatFile::DatFile(const char* filename) : m_File(filename), m_Filename(filename), m_Version(0)
+{
+    DatHeader_t header;
+    if (m_File.GetSize() >= sizeof(header))
+    {
+        memcpy(&header, m_File.GetData(), sizeof(header));
+    }
+
+    // Version 1 files have no header, they start with the size of the vertex blob
+    if (m_File.GetSize() >= sizeof(header) && header.magic == DAT_MAGIC)
+    {
+        ParseVersion2();
+    }
+    else
+    {
+        ParseVersion1();
+    }
+
+}
+
+void DatFile::ParseVersion1()
+{
+    static const DatSectionType_t types[] = { DAT_SECTION_VERTICES, DAT_SECTION_INDICES, DAT_SECTION_MESHGROUPS };
+
+    m_Version = 1;
+    const char* current = m_File.GetData();
+    const char* end = current + m_File.GetSize();
+    for (size_t i = 0; i < 3; ++i)
+    {
+        unsigned int size;
+        if ((size_t)(end - current) < sizeof(size))
+        {
+            THROW_RUNTIME("Truncated mesh file " << m_Filename)
+        }
+        memcpy(&size, current, sizeof(size));
+        current += sizeof(size);
+
+        if ((size_t)(end - current) < size)
+        {
+            THROW_RUNTIME("Truncated mesh file " << m_Filename)
+        }
+
+        // Version 1 didn't record element sizes, they are checked against the caller's on lookup
+        Section_t section;
+        section.type = types[i];
+        section.elementSize = 0;
+        section.data = current;
+        section.size = size;
+        section.checksum = 0;
+        section.verified = true;
+        m_Sections.push_back(section);
+        current += size;
+    }
+
+}
+
+void DatFile::ParseVersion2()
+{
+    const char* data = m_File.GetData();
+    size_t fileSize = m_File.GetSize();
+
+    DatHeader_t header;
+    memcpy(&header, data, sizeof(header));
+    if (header.endianTag != DAT_ENDIAN_TAG)
+    {
+        THROW_RUNTIME("Mesh file " << m_Filename << " was written on a machine with different byte order")
+    }
+    if (header.version < 2 || header.version > DAT_VERSION)
+    {
+        THROW_RUNTIME("Mesh file " << m_Filename << " has unsupported version " << header.version)
+    }
+    if (header.sectionCount > (fileSize - sizeof(header)) / sizeof(DatSection_t))
+    {
+        THROW_RUNTIME("Truncated mesh file " << m_Filename)
+    }
+
+    m_Version = header.version;
+    for (unsigned int i = 0; i < header.sectionCount; ++i)
+    {
+        DatSection_t entry;
+        memcpy(&entry, data + sizeof(header) + i * sizeof(DatSection_t), sizeof(entry));
+
+        if (entry.offset > fileSize || entry.size > fileSize - entry.offset)
+        {
+            THROW_RUNTIME("Section " << i << " of mesh file " << m_Filename << " is out of bounds")
+        }
+        if (entry.offset % DAT_ALIGNMENT != 0)
+        {
+            THROW_RUNTIME("Section " << i << " of mesh file " << m_Filename << " is misaligned")
+        }
+        Section_t section;
+        section.type = entry.type;
+        section.elementSize = entry.elementSize;
+        section.data = data + entry.offset;
+        section.size = (size_t)entry.size;
+        section.checksum = entry.checksum;
+        section.verified = false;
+        m_Sections.push_back(section);
+    }
+
+}
+
+const void* DatFile::GetSection(DatSectionType_t type, size_t elementSize, size_t& count) const
+{
+    return GetSection(type, 0, elementSize, count);
+}
+
+const void* DatFile::GetSection(DatSectionType_t type, size_t index, size_t elementSize, size_t& count) const
+{
+    for (size_t i = 0; i < m_Sections.size(); ++i)
+    {
+        const Section_t& section = m_Sections[i];
+        if (section.type != type || index-- != 0)
+        {
+            continue;
+        }
+
+        if ((section.elementSize != 0 && section.elementSize != elementSize) || section.size % elementSize != 0)
+        {
+            THROW_RUNTIME("Section " << type << " of mesh file " << m_Filename << " has unexpected element size")
+        }
+        if (!section.verified)
+        {
+            if (DatChecksum(section.data, section.size) != section.checksum)
+            {
+                THROW_RUNTIME("Section " << i << " of mesh file " << m_Filename << " is corrupted")
+            }
+            section.verified = true;
+        }
+
+        count = section.size / elementSize;
+        return section.data;
+    }
+
+    count = 0;
+    return nullptr;
+}
+
+void DatWriter::AddSection(DatSectionType_t type, const void* data, size_t elementSize, size_t count)
+{
+    Section_t section;
+    section.type = type;
+    section.elementSize = (unsigned int)elementSize;
+    section.data = data;
+    section.size = elementSize * count;
+    m_Sections.push_back(section);
+}
+
+void DatWriter::Write(const char* filename) const
+{
+    DatHeader_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = DAT_MAGIC;
+    header.version = DAT_VERSION;
+    header.endianTag = DAT_ENDIAN_TAG;
+    header.sectionCount = (unsigned int)m_Sections.size();
+
+    std::vector<DatSection_t> entries(m_Sections.size());
+    size_t offset = AlignUp(sizeof(header) + sizeof(DatSection_t) * entries.size());
+    for (size_t i = 0; i < m_Sections.size(); ++i)
+    {
+        memset(&entries[i], 0, sizeof(DatSection_t));
+        entries[i].type = m_Sections[i].type;
+        entries[i].elementSize = m_Sections[i].elementSize;
+        entries[i].offset = offset;
+        entries[i].size = m_Sections[i].size;
+        entries[i].checksum = DatChecksum(m_Sections[i].data, m_Sections[i].size);
+        offset = AlignUp(offset + m_Sections[i].size);
+    }
+
+    std::ofstream outfile(filename, std::ios::out | std::ofstream::binary);
+    if (!outfile)
+    {
+        THROW_RUNTIME("Failed to create file " << filename)
+    }
+
+    static const char padding[DAT_ALIGNMENT] = {};
+    outfile.write((const char*)&header, sizeof(header));
+    outfile.write((const char*)entries.data(), sizeof(DatSection_t) * entries.size());
+
+    size_t position = sizeof(header) + sizeof(DatSection_t) * entries.size();
+    for (size_t i = 0; i < m_Sections.size(); ++i)
+    {
+        outfile.write(padding, entries[i].offset - position);
+        outfile.write((const char*)m_Sections[i].data, m_Sections[i].size);
+        position = (size_t)(entries[i].offset + entries[i].size);
+    }
+
+    // The last buffered bytes only reach the file here, callers publish it right after
+    outfile.close();
+    if (!outfile)
+    {
+        THROW_RUNTIME("Failed to write file " << filename)
+    }
+
+}
@@ -0,0 +1,141 @@
+#ifndef DATFILE_HPP
+#define DATFILE_HPP
+
+#include "mappedfile.hpp"
+#include <string>
+#include <vector>
+
+// Baked mesh container (.dat)
+//
+// Layout since version 2, all values in the byte order of the machine that wrote it:
+//   DatHeader_t                       64 bytes
+//   DatSection_t[sectionCount]        64 bytes each
+//   section payloads                  each starting on a 64-byte boundary
+//
+// Version 1 files are three size-prefixed blobs (vertices, indices, groups)
+// with no header. They are still readable and show up as the same sections.
+// Version 3 added 16-bit index sections and MeshGroup_t::baseVertex.
+// Version 4 added the vertex format section, version 5 the LOD section,
+// version 6 the meshlet section, version 7 the chunk sections of streaming meshes,
+// version 8 the source ranges of static batches, version 9 the bounds section.
+// Version 10 packs vertices in their vertex format, with quantized positions,
+// and indices to their 16 or 32 bits.
+
+const unsigned int DAT_MAGIC = 'C' | ('G' << 8) | ('L' << 16) | ('M' << 24);
+const unsigned int DAT_VERSION = 10;
+const unsigned int DAT_ENDIAN_TAG = 0x01020304;
+const unsigned int DAT_ALIGNMENT = 64;
+
+enum DatSectionType_t
+{
+    DAT_SECTION_VERTICES = 1,
+    DAT_SECTION_INDICES,
+    DAT_SECTION_MESHGROUPS,
+    // Compressed encoding, replaces the vertex and index sections. Since version 10
+    // the plain index section stays when packing would not make it smaller.
+    DAT_SECTION_PACKED_INFO,
+    DAT_SECTION_PACKED_VERTICES,
+    DAT_SECTION_PACKED_INDICES,
+    // Replaces DAT_SECTION_INDICES when every index fits in 16 bits
+    DAT_SECTION_INDICES_16,
+    // One VertexFormat_t for the vertex sections, packed ones included, FULL when absent.
+    // Packed vertices of versions before 10 decode to Vertex and are converted after loading.
+    DAT_SECTION_VERTEX_FORMAT,
+    // MeshLod_t per level of detail. Without it all mesh groups are level 0.
+    DAT_SECTION_LODS,
+    // Meshlet_t sorted by mesh group. Without it groups are drawn whole.
+    DAT_SECTION_MESHLETS,
+    // Streaming meshes: MeshChunk_t per chunk, then the MeshGroup_t of every
+    // chunk, then one vertex and one index section per chunk, in chunk order
+    DAT_SECTION_CHUNKS,
+    DAT_SECTION_CHUNK_GROUPS,
+    DAT_SECTION_CHUNK_VERTICES,
+    DAT_SECTION_CHUNK_INDICES,
+    // Static batches: BatchRange_t per mesh group of every merged mesh
+    DAT_SECTION_BATCH_RANGES,
+    // MeshBounds_t of the whole mesh, then one per mesh group
+    DAT_SECTION_BOUNDS,
+};
+
+struct DatHeader_t
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int endianTag;
+    unsigned int sectionCount;
+    unsigned int reserved[12];
+};
+
+struct DatSection_t
+{
+    unsigned int type;
+    unsigned int elementSize;
+    unsigned long long offset;
+    unsigned long long size;
+    unsigned int checksum;
+    unsigned int reserved[9];
+};
+
+// Checksum stored per section. Four independent lanes over 32-bit words,
+// so verifying a section runs close to memory speed.
+unsigned int DatChecksum(const void* data, size_t size);
+
+// Read side. Maps the file and validates the header and section bounds.
+// Checksums are verified the first time a section is looked up, so sections
+// that are never read are never paged in. Sections point straight into the
+// mapping and live as long as the DatFile.
+class DatFile
+{
+public:
+    DatFile(const char* filename);
+
+    unsigned int GetVersion() const { return m_Version; }
+
+    // Returns nullptr if the section is missing. Throws if its element size doesn't match.
+    const void* GetSection(DatSectionType_t type, size_t elementSize, size_t& count) const;
+    // Same for the index-th section of that type
+    const void* GetSection(DatSectionType_t type, size_t index, size_t elementSize, size_t& count) const;
+
+private:
+    struct Section_t
+    {
+        unsigned int type;
+        unsigned int elementSize;
+        const char* data;
+        size_t size;
+        unsigned int checksum;
+        mutable bool verified;
+    };
+
+    void ParseVersion1();
+    void ParseVersion2();
+
+    MappedFile m_File;
+    std::string m_Filename;
+    unsigned int m_Version;
+    std::vector<Section_t> m_Sections;
+
+};
+
+// Write side. Collects sections and writes them out in one go.
+// The data must stay alive until Write returns.
+class DatWriter
+{
+public:
+    void AddSection(DatSectionType_t type, const void* data, size_t elementSize, size_t count);
+    void Write(const char* filename) const;
+
+private:
+    struct Section_t
+    {
+        unsigned int type;
+        unsigned int elementSize;
+        const void* data;
+        size_t size;
+    };
+
+    std::vector<Section_t> m_Sections;
+
+};
+
+#endif // DATFILE_HPP
@@ -0,0 +1,149 @@
+#include "jobsystem.hpp"
+
+static JobSystem g_JobSystem;
+JobSystem* jobs = &g_JobSystem;
+
+JobSystem::JobSystem() : m_Job(nullptr), m_JobCount(0), m_NextJob(0), m_FinishedJobs(0), m_Generation(0), m_ActiveWorkers(0), m_Busy(false), m_Quit(false)
+{
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Quit = true;
+    }
+    m_WakeCondition.notify_all();
+
+    for (size_t i = 0; i < m_Threads.size(); ++i)
+    {
+        m_Threads[i].join();
+    }
+}
+
+void JobSystem::Start()
+{
+    unsigned int cores = std::thread::hardware_concurrency();
+    // The calling thread works too
+    for (unsigned int i = 1; i < cores; ++i)
+    {
+        m_Threads.push_back(std::thread(&JobSystem::WorkerLoop, this));
+    }
+}
+
+unsigned int JobSystem::GetThreadCount()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_Threads.empty())
+    {
+        Start();
+    }
+    return (unsigned int)m_Threads.size() + 1;
+}
+
+void JobSystem::RunJobs()
+{
+    unsigned int finished = 0;
+    unsigned int index;
+    while ((index = m_NextJob++) < m_JobCount)
+    {
+        try
+        {
+            (*m_Job)(index);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (!m_Exception)
+            {
+                m_Exception = std::current_exception();
+            }
+        }
+        ++finished;
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_FinishedJobs += finished;
+    if (m_FinishedJobs == m_JobCount)
+    {
+        m_DoneCondition.notify_all();
+    }
+}
+
+void JobSystem::WorkerLoop()
+{
+    unsigned int generation = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_WakeCondition.wait(lock, [&] { return m_Quit || m_Generation != generation; });
+            if (m_Quit)
+            {
+                return;
+            }
+            generation = m_Generation;
+            // Woke up after the batch was already finished
+            if (!m_Busy)
+            {
+                continue;
+            }
+            ++m_ActiveWorkers;
+        }
+
+        RunJobs();
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        --m_ActiveWorkers;
+        m_DoneCondition.notify_all();
+    }
+}
+
+void JobSystem::ParallelFor(unsigned int count, const std::function<void(unsigned int)>& job)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        if (m_Threads.empty())
+        {
+            Start();
+        }
+
+        // Already inside a job, or nothing to split
+        if (m_Busy || m_Threads.empty() || count < 2)
+        {
+            lock.unlock();
+            for (unsigned int i = 0; i < count; ++i)
+            {
+                job(i);
+            }
+            return;
+        }
+
+        m_Busy = true;
+        m_Job = &job;
+        m_JobCount = count;
+        m_NextJob = 0;
+        m_FinishedJobs = 0;
+        m_Exception = nullptr;
+        ++m_Generation;
+    }
+    m_WakeCondition.notify_all();
+
+    RunJobs();
+
+    std::exception_ptr exception;
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        // Workers must be out of RunJobs before the job and counters are reused
+        m_DoneCondition.wait(lock, [&] { return m_FinishedJobs == m_JobCount && m_ActiveWorkers == 0; });
+        m_Busy = false;
+        m_Job = nullptr;
+        exception = m_Exception;
+        m_Exception = nullptr;
+    }
+
+    if (exception)
+    {
+        std::rethrow_exception(exception);
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef JOBSYSTEM_HPP
+#define JOBSYSTEM_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads, one per core, started on first use
+class JobSystem
+{
+public:
+    JobSystem();
+    ~JobSystem();
+
+    // Calls job(i) for every i in [0, count) on the workers and the calling thread.
+    // Returns when all of them are done. Nested calls from inside a job run serially.
+    void ParallelFor(unsigned int count, const std::function<void(unsigned int)>& job);
+    unsigned int GetThreadCount();
+
+private:
+    void Start();
+    void WorkerLoop();
+    void RunJobs();
+
+    std::vector<std::thread> m_Threads;
+    std::mutex m_Mutex;
+    std::condition_variable m_WakeCondition;
+    std::condition_variable m_DoneCondition;
+
+    const std::function<void(unsigned int)>* m_Job;
+    unsigned int m_JobCount;
+    std::atomic<unsigned int> m_NextJob;
+    unsigned int m_FinishedJobs;
+    unsigned int m_Generation;
+    unsigned int m_ActiveWorkers;
+    std::exception_ptr m_Exception;
+    bool m_Busy;
+    bool m_Quit;
+
+};
+
+extern JobSystem* jobs;
+
+#endif // JOBSYSTEM_HPP
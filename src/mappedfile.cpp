@@ -0,0 +1,94 @@
+#include "mappedfile.hpp"
+#include "utils.hpp"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const char* filename) : m_Data(nullptr), m_Size(0), m_File(INVALID_HANDLE_VALUE), m_Mapping(nullptr)
+{
+    m_File = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_File == INVALID_HANDLE_VALUE)
+    {
+        THROW_RUNTIME("Failed to open file " << filename)
+    }
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(m_File, &size);
+    m_Size = (size_t)size.QuadPart;
+
+    // Empty files can't be mapped, leave the view null
+    if (m_Size == 0)
+    {
+        return;
+    }
+
+    m_Mapping = CreateFileMappingA(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_Mapping)
+    {
+        m_Data = (const char*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+
+    if (!m_Data)
+    {
+        if (m_Mapping) CloseHandle(m_Mapping);
+        CloseHandle(m_File);
+        THROW_RUNTIME("Failed to map file " << filename)
+    }
+
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_Data) UnmapViewOfFile(m_Data);
+    if (m_Mapping) CloseHandle(m_Mapping);
+    if (m_File != INVALID_HANDLE_VALUE) CloseHandle(m_File);
+}
+
+#else
+
+MappedFile::MappedFile(const char* filename) : m_Data(nullptr), m_Size(0), m_File(-1)
+{
+    m_File = open(filename, O_RDONLY);
+    if (m_File < 0)
+    {
+        THROW_RUNTIME("Failed to open file " << filename)
+    }
+
+    struct stat info;
+    fstat(m_File, &info);
+    m_Size = (size_t)info.st_size;
+
+    // Empty files can't be mapped, leave the view null
+    if (m_Size == 0)
+    {
+        return;
+    }
+
+    void* data = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, m_File, 0);
+    if (data == MAP_FAILED)
+    {
+        close(m_File);
+        THROW_RUNTIME("Failed to map file " << filename)
+    }
+
+    // The importers scan front to back
+    madvise(data, m_Size, MADV_SEQUENTIAL);
+    m_Data = (const char*)data;
+
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_Data) munmap((void*)m_Data, m_Size);
+    if (m_File >= 0) close(m_File);
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <cstddef>
+
+// Read-only view of a whole file, mapped into the address space
+class MappedFile
+{
+public:
+    MappedFile(const char* filename);
+    ~MappedFile();
+
+    const char* GetData() const { return m_Data; }
+    size_t GetSize() const { return m_Size; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const char* m_Data;
+    size_t m_Size;
+
+#ifdef _WIN32
+    void* m_File;
+    void* m_Mapping;
+#else
+    int m_File;
+#endif
+
+};
+
+#endif // MAPPEDFILE_HPP
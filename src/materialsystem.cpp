@@ -18,15 +18,54 @@ void MaterialSystem::Init()
 
 }
 
+static DXGI_FORMAT GetElementFormat(VertexElementType_t type)
+{
+    switch (type)
+    {
+    case VERTEX_ELEMENT_FLOAT2:              return DXGI_FORMAT_R32G32_FLOAT;
+    case VERTEX_ELEMENT_FLOAT3:              return DXGI_FORMAT_R32G32B32_FLOAT;
+    case VERTEX_ELEMENT_HALF2:               return DXGI_FORMAT_R16G16_FLOAT;
+    case VERTEX_ELEMENT_UNORM_10_10_10_2:    return DXGI_FORMAT_R10G10B10A2_UNORM;
+    case VERTEX_ELEMENT_SNORM16_4:           return DXGI_FORMAT_R16G16B16A16_SNORM;
+    }
+    return DXGI_FORMAT_UNKNOWN;
+}
+
+// Fills layout, which needs room for MAX_VERTEX_ELEMENTS entries. Returns the element count.
+static unsigned int BuildInputLayout(VertexFormat_t format, D3D11_INPUT_ELEMENT_DESC* layout)
+{
+    const VertexFormatDesc_t& desc = GetVertexFormatDesc(format);
+    for (unsigned int i = 0; i < desc.elementCount; ++i)
+    {
+        D3D11_INPUT_ELEMENT_DESC& element = layout[i];
+        element.SemanticName = desc.elements[i].semantic;
+        element.SemanticIndex = 0;
+        element.Format = GetElementFormat(desc.elements[i].type);
+        element.InputSlot = 0;
+        element.AlignedByteOffset = desc.elements[i].offset;
+        element.InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+        element.InstanceDataStepRate = 0;
+    }
+    return desc.elementCount;
+}
+
 VertexShader::VertexShader(const char* filename) : m_Name(filename)
+{
+    Compile(VERTEX_FORMAT_FULL);
+}
+
+void VertexShader::Compile(VertexFormat_t vertexFormat) const
 {
     ID3DBlob* errorBlob;
-    ID3DBlob* vertexShaderBuffer;
+    ScopedObject<ID3DBlob> vertexShaderBuffer;
 
     wchar_t shadername[80];
-    swprintf(shadername, L"shaders/%S.fx", filename);
+    swprintf(shadername, L"shaders/%S.fx", m_Name.c_str());
+
+    const VertexFormatDesc_t& desc = GetVertexFormatDesc(vertexFormat);
+    D3D_SHADER_MACRO defines[] = { { desc.shaderDefine, "1" }, { nullptr, nullptr } };
 
-    HRESULT hr = D3DCompileFromFile(shadername, nullptr, nullptr, "vs_main", "vs_5_0", 0, 0, &vertexShaderBuffer, &errorBlob);
+    HRESULT hr = D3DCompileFromFile(shadername, desc.shaderDefine ? defines : nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "vs_main", "vs_5_0", 0, 0, &vertexShaderBuffer, &errorBlob);
     if (FAILED(hr))
     {
         if (errorBlob)
@@ -42,26 +81,25 @@ VertexShader::VertexShader(const char* filename) : m_Name(filename)
         }
     }
 
-    render->GetDevice()->CreateVertexShader(vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), nullptr, &m_VertexShader);
+    render->GetDevice()->CreateVertexShader(vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), nullptr, &m_VertexShaders[vertexFormat]);
 
-    D3D11_INPUT_ELEMENT_DESC layout[] =
-    {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-        { "TEXCOORD",  0, DXGI_FORMAT_R32G32_FLOAT,    0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-        { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-        { "TANGENT_S", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-        { "TANGENT_T", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-    };
+    D3D11_INPUT_ELEMENT_DESC layout[MAX_VERTEX_ELEMENTS];
+    UINT elementCount = BuildInputLayout(vertexFormat, layout);
 
-    render->GetDevice()->CreateInputLayout(layout, ARRAYSIZE(layout),
-        vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), &m_InputLayout);
+    render->GetDevice()->CreateInputLayout(layout, elementCount,
+        vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), &m_InputLayouts[vertexFormat]);
 
 }
 
-void VertexShader::Set() const
+void VertexShader::Set(VertexFormat_t vertexFormat) const
 {
-    render->GetDeviceContext()->IASetInputLayout(m_InputLayout.Get());
-    render->GetDeviceContext()->VSSetShader(m_VertexShader.Get(), nullptr, 0);
+    if (m_VertexShaders[vertexFormat].IsNull())
+    {
+        Compile(vertexFormat);
+    }
+
+    render->GetDeviceContext()->IASetInputLayout(m_InputLayouts[vertexFormat].Get());
+    render->GetDeviceContext()->VSSetShader(m_VertexShaders[vertexFormat].Get(), nullptr, 0);
 }
 
 PixelShader::PixelShader(const char* filename) : m_Name(filename)
@@ -71,7 +109,7 @@ PixelShader::PixelShader(const char* filename) : m_Name(filename)
     wchar_t shadername[80];
     swprintf(shadername, L"shaders/%S.fx", filename);
 
-    if (FAILED(D3DCompileFromFile(shadername, nullptr, nullptr, "ps_main", "ps_5_0", 0, 0, &pixelShaderBuffer, &errorBlob)))
+    if (FAILED(D3DCompileFromFile(shadername, nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "ps_main", "ps_5_0", 0, 0, &pixelShaderBuffer, &errorBlob)))
     {
         THROW_RUNTIME((char*)errorBlob->GetBufferPointer())
     }
@@ -274,9 +312,9 @@ std::shared_ptr<Material> MaterialSystem::FindMaterial(const char* filename)
     
 }
 
-void Material::SetMaterial(const VSConstantBuffer& vsBuffer, const PSConstantBuffer& psBuffer) const
+void Material::SetMaterial(const VSConstantBuffer& vsBuffer, const PSConstantBuffer& psBuffer, VertexFormat_t vertexFormat) const
 {
-    m_VertexShader->Set();
+    m_VertexShader->Set(vertexFormat);
     m_PixelShader->Set();
 
     render->GetDeviceContext()->RSSetState(m_RasterizerState.Get());
@@ -372,6 +410,7 @@ WorldMaterial::WorldMaterial(FILE* file)
         m_Specular = materials->FindTexture("white", TEXTURE_GROUP_OTHER);
     }
     
+    m_CullBackfaces = rasterizerDesc.CullMode == D3D11_CULL_BACK;
     render->GetDevice()->CreateRasterizerState(&rasterizerDesc, &m_RasterizerState);
     InitConstantBuffers();
     
@@ -397,14 +436,14 @@ WorldMaterial::WorldMaterial(FILE* file)
     
 }
 
-void WorldMaterial::SetMaterial(const VSConstantBuffer& vsBuffer, const PSConstantBuffer& psBuffer) const
+void WorldMaterial::SetMaterial(const VSConstantBuffer& vsBuffer, const PSConstantBuffer& psBuffer, VertexFormat_t vertexFormat) const
 {
     m_Albedo->Set(0);
     m_ShadowDepth->Set(1);
     m_Normal->Set(2);
     m_Specular->Set(3);
 
-    Material::SetMaterial(vsBuffer, psBuffer);
+    Material::SetMaterial(vsBuffer, psBuffer, vertexFormat);
     
 }
 
@@ -438,6 +477,7 @@ ParticleMaterial::ParticleMaterial(FILE* file)
 
     m_ShadowDepth = materials->FindTexture("_rt_ShadowDepth", TEXTURE_GROUP_SHADOW_DEPTH);
     
+    m_CullBackfaces = rasterizerDesc.CullMode == D3D11_CULL_BACK;
     render->GetDevice()->CreateRasterizerState(&rasterizerDesc, &m_RasterizerState);
     InitConstantBuffers();
 
@@ -463,11 +503,11 @@ ParticleMaterial::ParticleMaterial(FILE* file)
 
 }
 
-void ParticleMaterial::SetMaterial(const VSConstantBuffer& vsBuffer, const PSConstantBuffer& psBuffer) const
+void ParticleMaterial::SetMaterial(const VSConstantBuffer& vsBuffer, const PSConstantBuffer& psBuffer, VertexFormat_t vertexFormat) const
 {
     m_Albedo->Set(0);
     m_ShadowDepth->Set(1);
-    Material::SetMaterial(vsBuffer, psBuffer);
+    Material::SetMaterial(vsBuffer, psBuffer, vertexFormat);
     render->GetDeviceContext()->OMSetBlendState(m_OpacityBlend.Get(), 0, 0xffffffff);
 
 
@@ -501,6 +541,7 @@ SkyMaterial::SkyMaterial(FILE* file)
         }
     }
 
+    m_CullBackfaces = rasterizerDesc.CullMode == D3D11_CULL_BACK;
     render->GetDevice()->CreateRasterizerState(&rasterizerDesc, &m_RasterizerState);
     InitConstantBuffers();
 
@@ -509,11 +550,11 @@ SkyMaterial::SkyMaterial(FILE* file)
     
 }
 
-void SkyMaterial::SetMaterial(const VSConstantBuffer& vsBuffer, const PSConstantBuffer& psBuffer) const
+void SkyMaterial::SetMaterial(const VSConstantBuffer& vsBuffer, const PSConstantBuffer& psBuffer, VertexFormat_t vertexFormat) const
 {
     m_Albedo->Set(0);
 
-    Material::SetMaterial(vsBuffer, psBuffer);
+    Material::SetMaterial(vsBuffer, psBuffer, vertexFormat);
 
 }
 
@@ -528,6 +569,7 @@ DepthMaterial::DepthMaterial()
     ZeroMemory(&rasterizerDesc, sizeof(D3D11_RASTERIZER_DESC));
     rasterizerDesc.FillMode = D3D11_FILL_SOLID;
     rasterizerDesc.CullMode = D3D11_CULL_NONE;
+    m_CullBackfaces = rasterizerDesc.CullMode == D3D11_CULL_BACK;
     render->GetDevice()->CreateRasterizerState(&rasterizerDesc, &m_RasterizerState);
 
 
@@ -544,6 +586,7 @@ DebugMaterial::DebugMaterial(std::shared_ptr<VertexShader> vs, std::shared_ptr<P
     ZeroMemory(&rasterizerDesc, sizeof(D3D11_RASTERIZER_DESC));
     rasterizerDesc.FillMode = D3D11_FILL_SOLID;
     rasterizerDesc.CullMode = D3D11_CULL_NONE;
+    m_CullBackfaces = rasterizerDesc.CullMode == D3D11_CULL_BACK;
     render->GetDevice()->CreateRasterizerState(&rasterizerDesc, &m_RasterizerState);
 
 }
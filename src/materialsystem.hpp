@@ -3,6 +3,7 @@
 
 #include "mathlib.hpp"
 #include "utils.hpp"
+#include "vertexformat.hpp"
 #include <map>
 #include <vector>
 #include <memory>
@@ -12,11 +13,14 @@ class VertexShader
 {
 public:
     VertexShader(const char* filename);
-    void Set() const;
+    // Other formats than FULL are compiled on first use
+    void Set(VertexFormat_t vertexFormat = VERTEX_FORMAT_FULL) const;
 
 private:
-    ScopedObject<ID3D11VertexShader> m_VertexShader;
-    ScopedObject<ID3D11InputLayout> m_InputLayout;
+    void Compile(VertexFormat_t vertexFormat) const;
+
+    mutable ScopedObject<ID3D11VertexShader> m_VertexShaders[VERTEX_FORMAT_COUNT];
+    mutable ScopedObject<ID3D11InputLayout> m_InputLayouts[VERTEX_FORMAT_COUNT];
     std::string m_Name;
 
 };
@@ -81,7 +85,12 @@ public:
         float3_aligned phongScale;
     };
 
-    virtual void SetMaterial(const VSConstantBuffer& vsBuffer, const PSConstantBuffer& psBuffer) const;
+    Material() : m_CullBackfaces(false) {}
+
+    virtual void SetMaterial(const VSConstantBuffer& vsBuffer, const PSConstantBuffer& psBuffer, VertexFormat_t vertexFormat = VERTEX_FORMAT_FULL) const;
+
+    // Whether back faces never reach the pixel shader, so meshes may skip them on the CPU
+    bool CullsBackfaces() const { return m_CullBackfaces; }
 
 protected:
     void InitConstantBuffers();
@@ -93,6 +102,7 @@ protected:
     ScopedObject<ID3D11Buffer> m_PSConstantBuffer;
 
     ScopedObject<ID3D11RasterizerState> m_RasterizerState;
+    bool m_CullBackfaces;
 
     std::shared_ptr<VertexShader> m_VertexShader;
     std::shared_ptr<PixelShader>  m_PixelShader;
@@ -104,7 +114,7 @@ class WorldMaterial : public Material
 {
 public:
     WorldMaterial(FILE* file);
-    virtual void SetMaterial(const VSConstantBuffer& vsBuffer, const PSConstantBuffer& psBuffer) const;
+    virtual void SetMaterial(const VSConstantBuffer& vsBuffer, const PSConstantBuffer& psBuffer, VertexFormat_t vertexFormat = VERTEX_FORMAT_FULL) const;
    
 private:
     std::shared_ptr<Texture> m_Albedo;
@@ -120,7 +130,7 @@ class ParticleMaterial : public Material
 {
 public:
     ParticleMaterial(FILE* file);
-    virtual void SetMaterial(const VSConstantBuffer& vsBuffer, const PSConstantBuffer& psBuffer) const;
+    virtual void SetMaterial(const VSConstantBuffer& vsBuffer, const PSConstantBuffer& psBuffer, VertexFormat_t vertexFormat = VERTEX_FORMAT_FULL) const;
 
 private:
     std::shared_ptr<Texture> m_Albedo;
@@ -135,7 +145,7 @@ class SkyMaterial : public Material
 {
 public:
     SkyMaterial(FILE* file);
-    virtual void SetMaterial(const VSConstantBuffer& vsBuffer, const PSConstantBuffer& psBuffer) const;
+    virtual void SetMaterial(const VSConstantBuffer& vsBuffer, const PSConstantBuffer& psBuffer, VertexFormat_t vertexFormat = VERTEX_FORMAT_FULL) const;
 
 private:
     std::shared_ptr<Texture> m_Albedo;
@@ -52,7 +52,11 @@ private:
 
 };
 
+#ifdef _MSC_VER
 #define float3_aligned _declspec(align(16)) float3
+#else
+#define float3_aligned float3 __attribute__((aligned(16)))
+#endif
 
 struct float2
 {
@@ -110,7 +114,7 @@ inline float3 reflect(const float3& vec, const float3& normal)
 
 inline float3 AngleToVector(float pitch, float yaw)
 {
-    return float3(std::cosf(yaw)*std::cosf(pitch), std::sinf(yaw)*std::cosf(pitch), std::sinf(pitch));
+    return float3(std::cos(yaw)*std::cos(pitch), std::sin(yaw)*std::cos(pitch), std::sin(pitch));
 }
 
 struct Vertex
@@ -128,7 +132,28 @@ struct Vertex
 
 };
 
-struct Matrix
+// Matrix kernels use AVX or SSE2 when the compiler targets them, plain C++ otherwise.
+// MATHLIB_NO_SIMD forces the plain ones. All of them round like the plain ones,
+// except Inverse, which solves by cofactors instead of Gauss-Jordan.
+#if !defined(MATHLIB_NO_SIMD) && defined(__AVX__)
+#define MATHLIB_AVX
+#endif
+#if !defined(MATHLIB_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define MATHLIB_SSE2
+#endif
+
+// MATHLIB_ALIGN_MATRIX aligns Matrix to 16 bytes so the kernels load its rows
+// with aligned loads. Only where the heap is 16-byte aligned too, like x64,
+// and no Matrix is passed by value.
+#if defined(MATHLIB_ALIGN_MATRIX) && defined(_MSC_VER)
+#define MATRIX_ALIGN _declspec(align(16))
+#elif defined(MATHLIB_ALIGN_MATRIX)
+#define MATRIX_ALIGN __attribute__((aligned(16)))
+#else
+#define MATRIX_ALIGN
+#endif
+
+struct MATRIX_ALIGN Matrix
 {
     static Matrix LookAtLH(const float3& eye, const float3& target, const float3& up = float3(0.0f, 0.0f, 1.0f));
     static Matrix LookAtRH(const float3& eye, const float3& target, const float3& up = float3(0.0f, 0.0f, 1.0f));
@@ -170,17 +195,15 @@ struct Matrix
 
     // Methods
     Matrix Inverse() const;
-    Matrix Transpose() const
-    {
-        return Matrix(m[0][0], m[1][0], m[2][0], m[3][0],
-                      m[0][1], m[1][1], m[2][1], m[3][1],
-                      m[0][2], m[1][2], m[2][2], m[3][2],
-                      m[0][3], m[1][3], m[2][3], m[3][3]);
-    }
+    Matrix Transpose() const;
+    // Matrices take column vectors. Points get the translation, vectors don't, neither is divided by w.
+    float3 TransformPoint(const float3& point) const;
+    float3 TransformVector(const float3& vec) const;
 
     // Operators
     Matrix operator*(const Matrix& other);
     Matrix& operator*= (const Matrix& other);
+    // TransformPoint
     float3  operator* (const float3& vec);
     Matrix& operator= (const Matrix& other)
     {
@@ -197,6 +220,50 @@ struct Matrix
 Matrix operator*(const Matrix&a, const Matrix& b);
 float3 operator*(const Matrix& mat, const float3& vec);
 
+// Batch transforms of count elements into caller-provided output, which may be
+// the input itself but must not overlap it otherwise. They match TransformPoint
+// and TransformVector bit for bit, 4 or 8 elements at a time with SSE2 or AVX.
+// The projected variants divide points by w, for clip to normalized device space.
+void TransformPoints(const Matrix& matrix, const float3* points, size_t count, float3* result);
+void TransformPointsProjected(const Matrix& matrix, const float3* points, size_t count, float3* result);
+void TransformVectors(const Matrix& matrix, const float3* vectors, size_t count, float3* result);
+
+// The same on separate x, y and z streams
+void TransformPoints(const Matrix& matrix, const float* x, const float* y, const float* z, size_t count, float* resultX, float* resultY, float* resultZ);
+void TransformPointsProjected(const Matrix& matrix, const float* x, const float* y, const float* z, size_t count, float* resultX, float* resultY, float* resultZ);
+void TransformVectors(const Matrix& matrix, const float* x, const float* y, const float* z, size_t count, float* resultX, float* resultY, float* resultZ);
+
+// Affine transform taking column vectors, the first three rows of a Matrix with
+// (0, 0, 0, 1) as the implied last row. Composing two costs 36 multiplies
+// instead of 64, and the inverses skip the general 4x4 solve.
+struct AffineTransform
+{
+    static AffineTransform Identity();
+    // The view transform of Matrix::LookAtLH, for column vectors
+    static AffineTransform LookAtLH(const float3& eye, const float3& target, const float3& up = float3(0.0f, 0.0f, 1.0f));
+
+    AffineTransform() { memset(m, 0, sizeof(m)); }
+    // Drops the last row, which has to be (0, 0, 0, 1)
+    explicit AffineTransform(const Matrix& matrix) { memcpy(m, matrix.m, sizeof(m)); }
+
+    // Any invertible transform, the 3x3 part by cofactors
+    AffineTransform Inverse() const;
+    // Rotations and translations only, the 3x3 part is transposed
+    AffineTransform InverseRigid() const;
+    float3 TransformPoint(const float3& point) const;
+    float3 TransformVector(const float3& vec) const;
+    // The 4x4 layout the vertex constant buffers take
+    Matrix ToMatrix() const;
+
+    float m[3][4];
+
+};
+
+// b first, then a, like Matrix
+AffineTransform operator*(const AffineTransform& a, const AffineTransform& b);
+// TransformPoint
+float3 operator*(const AffineTransform& transform, const float3& point);
+
 template <typename T>
 inline T clamp(T value, T min, T max)
 {
@@ -1,6 +1,12 @@
 #include "mathlib.hpp"
 #include <cstring>
 #include <algorithm>
+#ifdef MATHLIB_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef MATHLIB_AVX
+#include <immintrin.h>
+#endif
 
 Matrix Matrix::LookAtLH(const float3& eye, const float3& target, const float3& up)
 {
@@ -28,7 +34,7 @@ Matrix Matrix::LookAtRH(const float3& eye, const float3& target, const float3& u
 
 Matrix Matrix::PerspectiveFovLH(float fov, float aspect, float nearZ, float farZ)
 {
-    float h = 1.0f / std::tanf(0.5f * fov);
+    float h = 1.0f / std::tan(0.5f * fov);
     float w = h / aspect;
     float range = farZ / (farZ - nearZ);
 
@@ -41,7 +47,7 @@ Matrix Matrix::PerspectiveFovLH(float fov, float aspect, float nearZ, float farZ
 
 Matrix Matrix::PerspectiveFovRH(float fov, float aspect, float nearZ, float farZ)
 {
-    float h = 1.0f / std::tanf(0.5f * fov);
+    float h = 1.0f / std::tan(0.5f * fov);
     float w = h / aspect;
     float range = farZ / (nearZ - farZ);
 
@@ -91,8 +97,8 @@ Matrix Matrix::Identity()
 
 Matrix Matrix::RotationAxis(const float3& axis, float angle)
 {
-    float cosAngle = std::cosf(angle);
-    float sinAngle = std::sinf(angle);
+    float cosAngle = std::cos(angle);
+    float sinAngle = std::sin(angle);
     float3 a = axis.normalize();
 
     Matrix result;
@@ -193,129 +199,502 @@ mResult.m[3][2] = (M2.m[0][2] * x) + (M2.m[1][2] * y) + (M2.m[2][2] * z) + (M2.m
 mResult.m[3][3] = (M2.m[0][3] * x) + (M2.m[1][3] * y) + (M2.m[2][3] * z) + (M2.m[3][3] * w);
 */
 
+#ifdef MATHLIB_SSE2
+
+static inline __m128 LoadRow(const float* row)
+{
+#ifdef MATHLIB_ALIGN_MATRIX
+    return _mm_load_ps(row);
+#else
+    return _mm_loadu_ps(row);
+#endif
+}
+
+static inline void StoreRow(float* row, __m128 value)
+{
+#ifdef MATHLIB_ALIGN_MATRIX
+    _mm_store_ps(row, value);
+#else
+    _mm_storeu_ps(row, value);
+#endif
+}
+
+#endif
+
+// Rows of the result are linear combinations of the rows of b, summed in the same
+// order by every path. result may be a or b.
+static void MultiplyMatrices(const Matrix& a, const Matrix& b, Matrix& result)
+{
+#if defined(MATHLIB_AVX)
+    // Two rows of the result per register, one per lane
+    __m256 b0 = _mm256_broadcast_ps((const __m128*)b.m[0]);
+    __m256 b1 = _mm256_broadcast_ps((const __m128*)b.m[1]);
+    __m256 b2 = _mm256_broadcast_ps((const __m128*)b.m[2]);
+    __m256 b3 = _mm256_broadcast_ps((const __m128*)b.m[3]);
+    for (int i = 0; i < 4; i += 2)
+    {
+        const float* row0 = a.m[i];
+        const float* row1 = a.m[i + 1];
+        __m256 x = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(row0[0])), _mm_set1_ps(row1[0]), 1);
+        __m256 y = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(row0[1])), _mm_set1_ps(row1[1]), 1);
+        __m256 z = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(row0[2])), _mm_set1_ps(row1[2]), 1);
+        __m256 w = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(row0[3])), _mm_set1_ps(row1[3]), 1);
+        __m256 rows = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(b0, x), _mm256_mul_ps(b1, y)), _mm256_mul_ps(b2, z)), _mm256_mul_ps(b3, w));
+        _mm256_storeu_ps(result.m[i], rows);
+    }
+#elif defined(MATHLIB_SSE2)
+    __m128 b0 = LoadRow(b.m[0]);
+    __m128 b1 = LoadRow(b.m[1]);
+    __m128 b2 = LoadRow(b.m[2]);
+    __m128 b3 = LoadRow(b.m[3]);
+    for (int i = 0; i < 4; ++i)
+    {
+        const float* row = a.m[i];
+        __m128 x = _mm_set1_ps(row[0]);
+        __m128 y = _mm_set1_ps(row[1]);
+        __m128 z = _mm_set1_ps(row[2]);
+        __m128 w = _mm_set1_ps(row[3]);
+        StoreRow(result.m[i], _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(b0, x), _mm_mul_ps(b1, y)), _mm_mul_ps(b2, z)), _mm_mul_ps(b3, w)));
+    }
+#else
+    float product[4][4];
+    for (int i = 0; i < 4; ++i)
+    {
+        float x = a.m[i][0];
+        float y = a.m[i][1];
+        float z = a.m[i][2];
+        float w = a.m[i][3];
+        product[i][0] = (b.m[0][0] * x) + (b.m[1][0] * y) + (b.m[2][0] * z) + (b.m[3][0] * w);
+        product[i][1] = (b.m[0][1] * x) + (b.m[1][1] * y) + (b.m[2][1] * z) + (b.m[3][1] * w);
+        product[i][2] = (b.m[0][2] * x) + (b.m[1][2] * y) + (b.m[2][2] * z) + (b.m[3][2] * w);
+        product[i][3] = (b.m[0][3] * x) + (b.m[1][3] * y) + (b.m[2][3] * z) + (b.m[3][3] * w);
+    }
+    memcpy(result.m, product, sizeof(product));
+#endif
+}
+
 Matrix operator*(const Matrix&a, const Matrix& b)
 {
     Matrix result;
-    float x = a.m[0][0];
-    float y = a.m[0][1];
-    float z = a.m[0][2];
-    float w = a.m[0][3];
-    // Perform the operation on the first row
-    result.m[0][0] = (b.m[0][0] * x) + (b.m[1][0] * y) + (b.m[2][0] * z) + (b.m[3][0] * w);
-    result.m[0][1] = (b.m[0][1] * x) + (b.m[1][1] * y) + (b.m[2][1] * z) + (b.m[3][1] * w);
-    result.m[0][2] = (b.m[0][2] * x) + (b.m[1][2] * y) + (b.m[2][2] * z) + (b.m[3][2] * w);
-    result.m[0][3] = (b.m[0][3] * x) + (b.m[1][3] * y) + (b.m[2][3] * z) + (b.m[3][3] * w);
-    // Repeat for all the other rows
-    x = a.m[1][0];
-    y = a.m[1][1];
-    z = a.m[1][2];
-    w = a.m[1][3];
-    result.m[1][0] = (b.m[0][0] * x) + (b.m[1][0] * y) + (b.m[2][0] * z) + (b.m[3][0] * w);
-    result.m[1][1] = (b.m[0][1] * x) + (b.m[1][1] * y) + (b.m[2][1] * z) + (b.m[3][1] * w);
-    result.m[1][2] = (b.m[0][2] * x) + (b.m[1][2] * y) + (b.m[2][2] * z) + (b.m[3][2] * w);
-    result.m[1][3] = (b.m[0][3] * x) + (b.m[1][3] * y) + (b.m[2][3] * z) + (b.m[3][3] * w);
-    x = a.m[2][0];
-    y = a.m[2][1];
-    z = a.m[2][2];
-    w = a.m[2][3];
-    result.m[2][0] = (b.m[0][0] * x) + (b.m[1][0] * y) + (b.m[2][0] * z) + (b.m[3][0] * w);
-    result.m[2][1] = (b.m[0][1] * x) + (b.m[1][1] * y) + (b.m[2][1] * z) + (b.m[3][1] * w);
-    result.m[2][2] = (b.m[0][2] * x) + (b.m[1][2] * y) + (b.m[2][2] * z) + (b.m[3][2] * w);
-    result.m[2][3] = (b.m[0][3] * x) + (b.m[1][3] * y) + (b.m[2][3] * z) + (b.m[3][3] * w);
-    x = a.m[3][0];
-    y = a.m[3][1];
-    z = a.m[3][2];
-    w = a.m[3][3];
-    result.m[3][0] = (b.m[0][0] * x) + (b.m[1][0] * y) + (b.m[2][0] * z) + (b.m[3][0] * w);
-    result.m[3][1] = (b.m[0][1] * x) + (b.m[1][1] * y) + (b.m[2][1] * z) + (b.m[3][1] * w);
-    result.m[3][2] = (b.m[0][2] * x) + (b.m[1][2] * y) + (b.m[2][2] * z) + (b.m[3][2] * w);
-    result.m[3][3] = (b.m[0][3] * x) + (b.m[1][3] * y) + (b.m[2][3] * z) + (b.m[3][3] * w);
-
+    MultiplyMatrices(a, b, result);
     return result;
 }
 
 Matrix Matrix::operator*(const Matrix& other)
 {
     Matrix result;
-    float x = m[0][0];
-    float y = m[0][1];
-    float z = m[0][2];
-    float w = m[0][3];
-    // Perform the operation on the first row
-    result.m[0][0] = (other.m[0][0] * x) + (other.m[1][0] * y) + (other.m[2][0] * z) + (other.m[3][0] * w);
-    result.m[0][1] = (other.m[0][1] * x) + (other.m[1][1] * y) + (other.m[2][1] * z) + (other.m[3][1] * w);
-    result.m[0][2] = (other.m[0][2] * x) + (other.m[1][2] * y) + (other.m[2][2] * z) + (other.m[3][2] * w);
-    result.m[0][3] = (other.m[0][3] * x) + (other.m[1][3] * y) + (other.m[2][3] * z) + (other.m[3][3] * w);
-    // Repeat for all the other rows
-    x = m[1][0];
-    y = m[1][1];
-    z = m[1][2];
-    w = m[1][3];
-    result.m[1][0] = (other.m[0][0] * x) + (other.m[1][0] * y) + (other.m[2][0] * z) + (other.m[3][0] * w);
-    result.m[1][1] = (other.m[0][1] * x) + (other.m[1][1] * y) + (other.m[2][1] * z) + (other.m[3][1] * w);
-    result.m[1][2] = (other.m[0][2] * x) + (other.m[1][2] * y) + (other.m[2][2] * z) + (other.m[3][2] * w);
-    result.m[1][3] = (other.m[0][3] * x) + (other.m[1][3] * y) + (other.m[2][3] * z) + (other.m[3][3] * w);
-    x = m[2][0];
-    y = m[2][1];
-    z = m[2][2];
-    w = m[2][3];
-    result.m[2][0] = (other.m[0][0] * x) + (other.m[1][0] * y) + (other.m[2][0] * z) + (other.m[3][0] * w);
-    result.m[2][1] = (other.m[0][1] * x) + (other.m[1][1] * y) + (other.m[2][1] * z) + (other.m[3][1] * w);
-    result.m[2][2] = (other.m[0][2] * x) + (other.m[1][2] * y) + (other.m[2][2] * z) + (other.m[3][2] * w);
-    result.m[2][3] = (other.m[0][3] * x) + (other.m[1][3] * y) + (other.m[2][3] * z) + (other.m[3][3] * w);
-    x = m[3][0];
-    y = m[3][1];
-    z = m[3][2];
-    w = m[3][3];
-    result.m[3][0] = (other.m[0][0] * x) + (other.m[1][0] * y) + (other.m[2][0] * z) + (other.m[3][0] * w);
-    result.m[3][1] = (other.m[0][1] * x) + (other.m[1][1] * y) + (other.m[2][1] * z) + (other.m[3][1] * w);
-    result.m[3][2] = (other.m[0][2] * x) + (other.m[1][2] * y) + (other.m[2][2] * z) + (other.m[3][2] * w);
-    result.m[3][3] = (other.m[0][3] * x) + (other.m[1][3] * y) + (other.m[2][3] * z) + (other.m[3][3] * w);
-
+    MultiplyMatrices(*this, other, result);
     return result;
 
 }
 
 Matrix& Matrix::operator*=(const Matrix& other)
 {
-    float x = m[0][0],     y = m[0][1],     z = m[0][2],     w = m[0][3];
-    m[0][0] = (other.m[0][0] * x) + (other.m[1][0] * y) + (other.m[2][0] * z) + (other.m[3][0] * w);
-    m[0][1] = (other.m[0][1] * x) + (other.m[1][1] * y) + (other.m[2][1] * z) + (other.m[3][1] * w);
-    m[0][2] = (other.m[0][2] * x) + (other.m[1][2] * y) + (other.m[2][2] * z) + (other.m[3][2] * w);
-    m[0][3] = (other.m[0][3] * x) + (other.m[1][3] * y) + (other.m[2][3] * z) + (other.m[3][3] * w);
-    x = m[1][0];    y = m[1][1];    z = m[1][2];    w = m[1][3];
-    m[1][0] = (other.m[0][0] * x) + (other.m[1][0] * y) + (other.m[2][0] * z) + (other.m[3][0] * w);
-    m[1][1] = (other.m[0][1] * x) + (other.m[1][1] * y) + (other.m[2][1] * z) + (other.m[3][1] * w);
-    m[1][2] = (other.m[0][2] * x) + (other.m[1][2] * y) + (other.m[2][2] * z) + (other.m[3][2] * w);
-    m[1][3] = (other.m[0][3] * x) + (other.m[1][3] * y) + (other.m[2][3] * z) + (other.m[3][3] * w);
-    x = m[2][0];    y = m[2][1];    z = m[2][2];    w = m[2][3];
-    m[2][0] = (other.m[0][0] * x) + (other.m[1][0] * y) + (other.m[2][0] * z) + (other.m[3][0] * w);
-    m[2][1] = (other.m[0][1] * x) + (other.m[1][1] * y) + (other.m[2][1] * z) + (other.m[3][1] * w);
-    m[2][2] = (other.m[0][2] * x) + (other.m[1][2] * y) + (other.m[2][2] * z) + (other.m[3][2] * w);
-    m[2][3] = (other.m[0][3] * x) + (other.m[1][3] * y) + (other.m[2][3] * z) + (other.m[3][3] * w);
-    x = m[3][0];    y = m[3][1];    z = m[3][2];    w = m[3][3];
-    m[3][0] = (other.m[0][0] * x) + (other.m[1][0] * y) + (other.m[2][0] * z) + (other.m[3][0] * w);
-    m[3][1] = (other.m[0][1] * x) + (other.m[1][1] * y) + (other.m[2][1] * z) + (other.m[3][1] * w);
-    m[3][2] = (other.m[0][2] * x) + (other.m[1][2] * y) + (other.m[2][2] * z) + (other.m[3][2] * w);
-    m[3][3] = (other.m[0][3] * x) + (other.m[1][3] * y) + (other.m[2][3] * z) + (other.m[3][3] * w);
-
+    MultiplyMatrices(*this, other, *this);
     return *this;
 }
 
+Matrix Matrix::Transpose() const
+{
+#ifdef MATHLIB_SSE2
+    __m128 row0 = LoadRow(m[0]);
+    __m128 row1 = LoadRow(m[1]);
+    __m128 row2 = LoadRow(m[2]);
+    __m128 row3 = LoadRow(m[3]);
+    _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+    Matrix result;
+    StoreRow(result.m[0], row0);
+    StoreRow(result.m[1], row1);
+    StoreRow(result.m[2], row2);
+    StoreRow(result.m[3], row3);
+    return result;
+#else
+    return Matrix(m[0][0], m[1][0], m[2][0], m[3][0],
+                  m[0][1], m[1][1], m[2][1], m[3][1],
+                  m[0][2], m[1][2], m[2][2], m[3][2],
+                  m[0][3], m[1][3], m[2][3], m[3][3]);
+#endif
+}
+
+#ifdef MATHLIB_SSE2
+
+// Rows times vec, transposed so lane i of column j holds m[i][j] * vec[j].
+// Summing the columns then adds each row left to right, like the plain code.
+static inline void MultiplyColumns(const Matrix& matrix, __m128 vec, __m128& column0, __m128& column1, __m128& column2, __m128& column3)
+{
+    column0 = _mm_mul_ps(LoadRow(matrix.m[0]), vec);
+    column1 = _mm_mul_ps(LoadRow(matrix.m[1]), vec);
+    column2 = _mm_mul_ps(LoadRow(matrix.m[2]), vec);
+    column3 = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(column0, column1, column2, column3);
+}
+
+static inline float3 ToFloat3(__m128 vec)
+{
+    float result[4];
+    _mm_storeu_ps(result, vec);
+    return float3(result[0], result[1], result[2]);
+}
+
+#endif
+
+float3 Matrix::TransformPoint(const float3& point) const
+{
+#ifdef MATHLIB_SSE2
+    __m128 column0, column1, column2, column3;
+    MultiplyColumns(*this, _mm_setr_ps(point.x, point.y, point.z, 1.0f), column0, column1, column2, column3);
+    return ToFloat3(_mm_add_ps(_mm_add_ps(_mm_add_ps(column0, column1), column2), column3));
+#else
+    return float3(m[0][0] * point.x + m[0][1] * point.y + m[0][2] * point.z + m[0][3],
+                  m[1][0] * point.x + m[1][1] * point.y + m[1][2] * point.z + m[1][3],
+                  m[2][0] * point.x + m[2][1] * point.y + m[2][2] * point.z + m[2][3]);
+#endif
+}
+
+float3 Matrix::TransformVector(const float3& vec) const
+{
+#ifdef MATHLIB_SSE2
+    __m128 column0, column1, column2, column3;
+    MultiplyColumns(*this, _mm_setr_ps(vec.x, vec.y, vec.z, 0.0f), column0, column1, column2, column3);
+    return ToFloat3(_mm_add_ps(_mm_add_ps(column0, column1), column2));
+#else
+    return float3(m[0][0] * vec.x + m[0][1] * vec.y + m[0][2] * vec.z,
+                  m[1][0] * vec.x + m[1][1] * vec.y + m[1][2] * vec.z,
+                  m[2][0] * vec.x + m[2][1] * vec.y + m[2][2] * vec.z);
+#endif
+}
+
 float3 Matrix::operator*(const float3& vec)
 {
-    return float3(m[0][0] * vec.x + m[0][1] * vec.y + m[0][2] * vec.z + m[0][3],
-        m[1][0] * vec.x + m[1][1] * vec.y + m[1][2] * vec.z + m[1][3],
-        m[2][0] * vec.x + m[2][1] * vec.y + m[2][2] * vec.z + m[2][3]);
+    return TransformPoint(vec);
 }
 
 float3 operator*(const Matrix& mat, const float3& vec)
 {
-        return float3(mat.m[0][0] * vec.x + mat.m[0][1] * vec.y + mat.m[0][2] * vec.z + mat.m[0][3],
-            mat.m[1][0] * vec.x + mat.m[1][1] * vec.y + mat.m[1][2] * vec.z + mat.m[1][3],
-            mat.m[2][0] * vec.x + mat.m[2][1] * vec.y + mat.m[2][2] * vec.z + mat.m[2][3]);
+    return mat.TransformPoint(vec);
+}
+
+enum BatchTransform_t
+{
+    BATCH_POINTS = 0,
+    BATCH_VECTORS,
+    // Points divided by w
+    BATCH_PROJECTED_POINTS,
+};
+
+static inline float3 TransformOne(const Matrix& matrix, const float3& vec, BatchTransform_t kind)
+{
+    if (kind == BATCH_VECTORS)
+    {
+        return matrix.TransformVector(vec);
+    }
+    float3 point = matrix.TransformPoint(vec);
+    if (kind == BATCH_PROJECTED_POINTS)
+    {
+        float w = matrix.m[3][0] * vec.x + matrix.m[3][1] * vec.y + matrix.m[3][2] * vec.z + matrix.m[3][3];
+        point = float3(point.x / w, point.y / w, point.z / w);
+    }
+    return point;
+}
+
+#ifdef MATHLIB_SSE2
+
+static_assert(sizeof(float3) == 3 * sizeof(float), "The batch transforms read float3 arrays as packed floats");
+
+// The lanes hold one element each, x, y and z in separate registers. The same
+// code runs 4 wide on SSE2 registers and 8 wide on AVX ones.
+static inline __m128 Add(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+static inline __m128 Mul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+static inline __m128 Div(__m128 a, __m128 b) { return _mm_div_ps(a, b); }
+static inline void Splat(float value, __m128& result) { result = _mm_set1_ps(value); }
+
+#ifdef MATHLIB_AVX
+static inline __m256 Add(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+static inline __m256 Mul(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+static inline __m256 Div(__m256 a, __m256 b) { return _mm256_div_ps(a, b); }
+static inline void Splat(float value, __m256& result) { result = _mm256_set1_ps(value); }
+#endif
+
+template <typename Register>
+static inline void SplatMatrix(const Matrix& matrix, Register (&splats)[4][4])
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        for (int j = 0; j < 4; ++j)
+        {
+            Splat(matrix.m[i][j], splats[i][j]);
+        }
+    }
+}
+
+// Adds left to right like TransformPoint
+template <typename Register>
+static inline void TransformLanes(const Register (&m)[4][4], Register& x, Register& y, Register& z, BatchTransform_t kind)
+{
+    Register resultX = Add(Add(Mul(m[0][0], x), Mul(m[0][1], y)), Mul(m[0][2], z));
+    Register resultY = Add(Add(Mul(m[1][0], x), Mul(m[1][1], y)), Mul(m[1][2], z));
+    Register resultZ = Add(Add(Mul(m[2][0], x), Mul(m[2][1], y)), Mul(m[2][2], z));
+    if (kind != BATCH_VECTORS)
+    {
+        resultX = Add(resultX, m[0][3]);
+        resultY = Add(resultY, m[1][3]);
+        resultZ = Add(resultZ, m[2][3]);
+    }
+    if (kind == BATCH_PROJECTED_POINTS)
+    {
+        Register w = Add(Add(Add(Mul(m[3][0], x), Mul(m[3][1], y)), Mul(m[3][2], z)), m[3][3]);
+        resultX = Div(resultX, w);
+        resultY = Div(resultY, w);
+        resultZ = Div(resultZ, w);
+    }
+    x = resultX;
+    y = resultY;
+    z = resultZ;
+}
+
+// Four float3 in three registers, (x0 y0 z0 x1) (y1 z1 x2 y2) (z2 x3 y3 z3), to x, y and z
+static inline void Deinterleave(__m128 xyzx, __m128 yzxy, __m128 zxyz, __m128& x, __m128& y, __m128& z)
+{
+    __m128 xy = _mm_shuffle_ps(yzxy, zxyz, _MM_SHUFFLE(2, 1, 3, 2));
+    __m128 yz = _mm_shuffle_ps(xyzx, yzxy, _MM_SHUFFLE(1, 0, 2, 1));
+    x = _mm_shuffle_ps(xyzx, xy, _MM_SHUFFLE(2, 0, 3, 0));
+    y = _mm_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+    z = _mm_shuffle_ps(yz, zxyz, _MM_SHUFFLE(3, 0, 3, 1));
+}
+
+static inline void Interleave(__m128 x, __m128 y, __m128 z, __m128& xyzx, __m128& yzxy, __m128& zxyz)
+{
+    __m128 xy = _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 yz = _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 1, 3, 1));
+    __m128 zx = _mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 1, 2, 0));
+    xyzx = _mm_shuffle_ps(xy, zx, _MM_SHUFFLE(2, 0, 2, 0));
+    yzxy = _mm_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+    zxyz = _mm_shuffle_ps(zx, yz, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+#ifdef MATHLIB_AVX
+
+// Eight float3, the first four in the low lanes and the last four in the high ones
+static inline void Deinterleave(const float* input, __m256& x, __m256& y, __m256& z)
+{
+    __m256 xyzx = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(input)), _mm_loadu_ps(input + 12), 1);
+    __m256 yzxy = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(input + 4)), _mm_loadu_ps(input + 16), 1);
+    __m256 zxyz = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(input + 8)), _mm_loadu_ps(input + 20), 1);
+    __m256 xy = _mm256_shuffle_ps(yzxy, zxyz, _MM_SHUFFLE(2, 1, 3, 2));
+    __m256 yz = _mm256_shuffle_ps(xyzx, yzxy, _MM_SHUFFLE(1, 0, 2, 1));
+    x = _mm256_shuffle_ps(xyzx, xy, _MM_SHUFFLE(2, 0, 3, 0));
+    y = _mm256_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+    z = _mm256_shuffle_ps(yz, zxyz, _MM_SHUFFLE(3, 0, 3, 1));
+}
+
+static inline void Interleave(__m256 x, __m256 y, __m256 z, float* output)
+{
+    __m256 xy = _mm256_shuffle_ps(x, y, _MM_SHUFFLE(2, 0, 2, 0));
+    __m256 yz = _mm256_shuffle_ps(y, z, _MM_SHUFFLE(3, 1, 3, 1));
+    __m256 zx = _mm256_shuffle_ps(z, x, _MM_SHUFFLE(3, 1, 2, 0));
+    __m256 xyzx = _mm256_shuffle_ps(xy, zx, _MM_SHUFFLE(2, 0, 2, 0));
+    __m256 yzxy = _mm256_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+    __m256 zxyz = _mm256_shuffle_ps(zx, yz, _MM_SHUFFLE(3, 1, 3, 1));
+    _mm_storeu_ps(output, _mm256_castps256_ps128(xyzx));
+    _mm_storeu_ps(output + 4, _mm256_castps256_ps128(yzxy));
+    _mm_storeu_ps(output + 8, _mm256_castps256_ps128(zxyz));
+    _mm_storeu_ps(output + 12, _mm256_extractf128_ps(xyzx, 1));
+    _mm_storeu_ps(output + 16, _mm256_extractf128_ps(yzxy, 1));
+    _mm_storeu_ps(output + 20, _mm256_extractf128_ps(zxyz, 1));
+}
+
+#endif
+
+#endif
+
+// A whole block is loaded before it is stored, so the output may be the input
+static void TransformArray(const Matrix& matrix, const float3* input, size_t count, float3* output, BatchTransform_t kind)
+{
+    size_t i = 0;
+#ifdef MATHLIB_AVX
+    __m256 splats8[4][4];
+    SplatMatrix(matrix, splats8);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 x, y, z;
+        Deinterleave(&input[i].x, x, y, z);
+        TransformLanes(splats8, x, y, z, kind);
+        Interleave(x, y, z, &output[i].x);
+    }
+#endif
+#ifdef MATHLIB_SSE2
+    __m128 splats[4][4];
+    SplatMatrix(matrix, splats);
+    for (; i + 4 <= count; i += 4)
+    {
+        const float* in = &input[i].x;
+        __m128 x, y, z;
+        Deinterleave(_mm_loadu_ps(in), _mm_loadu_ps(in + 4), _mm_loadu_ps(in + 8), x, y, z);
+        TransformLanes(splats, x, y, z, kind);
+        __m128 xyzx, yzxy, zxyz;
+        Interleave(x, y, z, xyzx, yzxy, zxyz);
+        float* out = &output[i].x;
+        _mm_storeu_ps(out, xyzx);
+        _mm_storeu_ps(out + 4, yzxy);
+        _mm_storeu_ps(out + 8, zxyz);
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        output[i] = TransformOne(matrix, input[i], kind);
+    }
+}
+
+static void TransformStreams(const Matrix& matrix, const float* x, const float* y, const float* z, size_t count,
+                             float* resultX, float* resultY, float* resultZ, BatchTransform_t kind)
+{
+    size_t i = 0;
+#ifdef MATHLIB_AVX
+    __m256 splats8[4][4];
+    SplatMatrix(matrix, splats8);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 laneX = _mm256_loadu_ps(x + i);
+        __m256 laneY = _mm256_loadu_ps(y + i);
+        __m256 laneZ = _mm256_loadu_ps(z + i);
+        TransformLanes(splats8, laneX, laneY, laneZ, kind);
+        _mm256_storeu_ps(resultX + i, laneX);
+        _mm256_storeu_ps(resultY + i, laneY);
+        _mm256_storeu_ps(resultZ + i, laneZ);
+    }
+#endif
+#ifdef MATHLIB_SSE2
+    __m128 splats[4][4];
+    SplatMatrix(matrix, splats);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 laneX = _mm_loadu_ps(x + i);
+        __m128 laneY = _mm_loadu_ps(y + i);
+        __m128 laneZ = _mm_loadu_ps(z + i);
+        TransformLanes(splats, laneX, laneY, laneZ, kind);
+        _mm_storeu_ps(resultX + i, laneX);
+        _mm_storeu_ps(resultY + i, laneY);
+        _mm_storeu_ps(resultZ + i, laneZ);
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        float3 result = TransformOne(matrix, float3(x[i], y[i], z[i]), kind);
+        resultX[i] = result.x;
+        resultY[i] = result.y;
+        resultZ[i] = result.z;
+    }
+}
+
+void TransformPoints(const Matrix& matrix, const float3* points, size_t count, float3* result)
+{
+    TransformArray(matrix, points, count, result, BATCH_POINTS);
 }
 
+void TransformPointsProjected(const Matrix& matrix, const float3* points, size_t count, float3* result)
+{
+    TransformArray(matrix, points, count, result, BATCH_PROJECTED_POINTS);
+}
+
+void TransformVectors(const Matrix& matrix, const float3* vectors, size_t count, float3* result)
+{
+    TransformArray(matrix, vectors, count, result, BATCH_VECTORS);
+}
+
+void TransformPoints(const Matrix& matrix, const float* x, const float* y, const float* z, size_t count, float* resultX, float* resultY, float* resultZ)
+{
+    TransformStreams(matrix, x, y, z, count, resultX, resultY, resultZ, BATCH_POINTS);
+}
+
+void TransformPointsProjected(const Matrix& matrix, const float* x, const float* y, const float* z, size_t count, float* resultX, float* resultY, float* resultZ)
+{
+    TransformStreams(matrix, x, y, z, count, resultX, resultY, resultZ, BATCH_PROJECTED_POINTS);
+}
+
+void TransformVectors(const Matrix& matrix, const float* x, const float* y, const float* z, size_t count, float* resultX, float* resultY, float* resultZ)
+{
+    TransformStreams(matrix, x, y, z, count, resultX, resultY, resultZ, BATCH_VECTORS);
+}
+
+#ifdef MATHLIB_SSE2
+
+// 2x2 blocks of a matrix row by row in one register, (m00, m01, m10, m11).
+// a * b
+static inline __m128 Multiply2x2(__m128 a, __m128 b)
+{
+    return _mm_add_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 3, 0))),
+                      _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+
+// adjugate(a) * b
+static inline __m128 AdjugateMultiply2x2(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 3, 3)), b),
+                      _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2))));
+}
+
+// a * adjugate(b)
+static inline __m128 MultiplyAdjugate2x2(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 0, 3))),
+                      _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+
+// Block inversion of M = | A B |. The blocks of the inverse come from the adjugates
+//                        | C D |
+// of the 2x2 blocks, and |M| = |A||D| + |B||C| - tr(A#B * D#C). There is no
+// pivoting, badly conditioned matrices lose a little more than with Gauss-Jordan.
+Matrix Matrix::Inverse() const
+{
+    __m128 row0 = LoadRow(m[0]);
+    __m128 row1 = LoadRow(m[1]);
+    __m128 row2 = LoadRow(m[2]);
+    __m128 row3 = LoadRow(m[3]);
+
+    __m128 a = _mm_movelh_ps(row0, row1);
+    __m128 b = _mm_movehl_ps(row1, row0);
+    __m128 c = _mm_movelh_ps(row2, row3);
+    __m128 d = _mm_movehl_ps(row3, row2);
+
+    // (|A|, |B|, |C|, |D|)
+    __m128 blockDeterminants = _mm_sub_ps(
+        _mm_mul_ps(_mm_shuffle_ps(row0, row2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(row1, row3, _MM_SHUFFLE(3, 1, 3, 1))),
+        _mm_mul_ps(_mm_shuffle_ps(row0, row2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(row1, row3, _MM_SHUFFLE(2, 0, 2, 0))));
+    __m128 detA = _mm_shuffle_ps(blockDeterminants, blockDeterminants, _MM_SHUFFLE(0, 0, 0, 0));
+    __m128 detB = _mm_shuffle_ps(blockDeterminants, blockDeterminants, _MM_SHUFFLE(1, 1, 1, 1));
+    __m128 detC = _mm_shuffle_ps(blockDeterminants, blockDeterminants, _MM_SHUFFLE(2, 2, 2, 2));
+    __m128 detD = _mm_shuffle_ps(blockDeterminants, blockDeterminants, _MM_SHUFFLE(3, 3, 3, 3));
+
+    __m128 adjDC = AdjugateMultiply2x2(d, c);
+    __m128 adjAB = AdjugateMultiply2x2(a, b);
+    // Adjugates of the blocks of the inverse, times |M|
+    __m128 x = _mm_sub_ps(_mm_mul_ps(detD, a), Multiply2x2(b, adjDC));
+    __m128 w = _mm_sub_ps(_mm_mul_ps(detA, d), Multiply2x2(c, adjAB));
+    __m128 y = _mm_sub_ps(_mm_mul_ps(detB, c), MultiplyAdjugate2x2(d, adjAB));
+    __m128 z = _mm_sub_ps(_mm_mul_ps(detC, b), MultiplyAdjugate2x2(a, adjDC));
+
+    __m128 trace = _mm_mul_ps(adjAB, _mm_shuffle_ps(adjDC, adjDC, _MM_SHUFFLE(3, 1, 2, 0)));
+    trace = _mm_add_ps(trace, _mm_shuffle_ps(trace, trace, _MM_SHUFFLE(1, 0, 3, 2)));
+    trace = _mm_add_ps(trace, _mm_shuffle_ps(trace, trace, _MM_SHUFFLE(2, 3, 0, 1)));
+    __m128 determinant = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), trace);
+
+    // The signs turn the adjugates back into the blocks
+    __m128 scale = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), determinant);
+    x = _mm_mul_ps(x, scale);
+    y = _mm_mul_ps(y, scale);
+    z = _mm_mul_ps(z, scale);
+    w = _mm_mul_ps(w, scale);
+
+    Matrix result;
+    StoreRow(result.m[0], _mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 3, 1, 3)));
+    StoreRow(result.m[1], _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 2, 0, 2)));
+    StoreRow(result.m[2], _mm_shuffle_ps(z, w, _MM_SHUFFLE(1, 3, 1, 3)));
+    StoreRow(result.m[3], _mm_shuffle_ps(z, w, _MM_SHUFFLE(0, 2, 0, 2)));
+    return result;
+}
+
+#else
+
 Matrix Matrix::Inverse() const
 {
     int indxc[4], indxr[4];
@@ -389,3 +768,185 @@ Matrix Matrix::Inverse() const
     return Matrix(minv);
 
 }
+
+#endif
+
+AffineTransform AffineTransform::Identity()
+{
+    AffineTransform result;
+    result.m[0][0] = 1.0f;
+    result.m[1][1] = 1.0f;
+    result.m[2][2] = 1.0f;
+    return result;
+}
+
+AffineTransform AffineTransform::LookAtLH(const float3& eye, const float3& target, const float3& up)
+{
+    float3 zaxis = (target - eye).normalize();
+    float3 xaxis = cross(up, zaxis).normalize();
+    float3 yaxis = cross(zaxis, xaxis);
+
+    AffineTransform result;
+    const float3 axes[3] = { xaxis, yaxis, zaxis };
+    for (int i = 0; i < 3; ++i)
+    {
+        result.m[i][0] = axes[i].x;
+        result.m[i][1] = axes[i].y;
+        result.m[i][2] = axes[i].z;
+        result.m[i][3] = -dot(axes[i], eye);
+    }
+    return result;
+}
+
+Matrix AffineTransform::ToMatrix() const
+{
+    return Matrix(m[0][0], m[0][1], m[0][2], m[0][3],
+                  m[1][0], m[1][1], m[1][2], m[1][3],
+                  m[2][0], m[2][1], m[2][2], m[2][3],
+                  0.0f,    0.0f,    0.0f,    1.0f);
+}
+
+float3 AffineTransform::TransformPoint(const float3& point) const
+{
+    return float3(m[0][0] * point.x + m[0][1] * point.y + m[0][2] * point.z + m[0][3],
+                  m[1][0] * point.x + m[1][1] * point.y + m[1][2] * point.z + m[1][3],
+                  m[2][0] * point.x + m[2][1] * point.y + m[2][2] * point.z + m[2][3]);
+}
+
+float3 AffineTransform::TransformVector(const float3& vec) const
+{
+    return float3(m[0][0] * vec.x + m[0][1] * vec.y + m[0][2] * vec.z,
+                  m[1][0] * vec.x + m[1][1] * vec.y + m[1][2] * vec.z,
+                  m[2][0] * vec.x + m[2][1] * vec.y + m[2][2] * vec.z);
+}
+
+float3 operator*(const AffineTransform& transform, const float3& point)
+{
+    return transform.TransformPoint(point);
+}
+
+AffineTransform operator*(const AffineTransform& a, const AffineTransform& b)
+{
+    AffineTransform result;
+#ifdef MATHLIB_SSE2
+    // Like MultiplyMatrices without the products of the implied last row
+    __m128 b0 = _mm_loadu_ps(b.m[0]);
+    __m128 b1 = _mm_loadu_ps(b.m[1]);
+    __m128 b2 = _mm_loadu_ps(b.m[2]);
+    for (int i = 0; i < 3; ++i)
+    {
+        const float* row = a.m[i];
+        __m128 sum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(b0, _mm_set1_ps(row[0])), _mm_mul_ps(b1, _mm_set1_ps(row[1]))), _mm_mul_ps(b2, _mm_set1_ps(row[2])));
+        _mm_storeu_ps(result.m[i], _mm_add_ps(sum, _mm_setr_ps(0.0f, 0.0f, 0.0f, row[3])));
+    }
+#else
+    for (int i = 0; i < 3; ++i)
+    {
+        float x = a.m[i][0];
+        float y = a.m[i][1];
+        float z = a.m[i][2];
+        result.m[i][0] = (b.m[0][0] * x) + (b.m[1][0] * y) + (b.m[2][0] * z);
+        result.m[i][1] = (b.m[0][1] * x) + (b.m[1][1] * y) + (b.m[2][1] * z);
+        result.m[i][2] = (b.m[0][2] * x) + (b.m[1][2] * y) + (b.m[2][2] * z);
+        result.m[i][3] = (b.m[0][3] * x) + (b.m[1][3] * y) + (b.m[2][3] * z) + a.m[i][3];
+    }
+#endif
+    return result;
+}
+
+#ifdef MATHLIB_SSE2
+
+static inline __m128 Cross(__m128 a, __m128 b)
+{
+    __m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 aZXY = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2));
+    __m128 bZXY = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+    return _mm_sub_ps(_mm_mul_ps(aYZX, bZXY), _mm_mul_ps(aZXY, bYZX));
+}
+
+// The columns of the inverted 3x3 part, then the translation goes through them
+static inline AffineTransform FinishInverse(__m128 column0, __m128 column1, __m128 column2, const AffineTransform& transform)
+{
+    __m128 translation = _mm_add_ps(_mm_add_ps(_mm_mul_ps(column0, _mm_set1_ps(transform.m[0][3])), _mm_mul_ps(column1, _mm_set1_ps(transform.m[1][3]))),
+                                    _mm_mul_ps(column2, _mm_set1_ps(transform.m[2][3])));
+    translation = _mm_sub_ps(_mm_setzero_ps(), translation);
+    _MM_TRANSPOSE4_PS(column0, column1, column2, translation);
+    AffineTransform result;
+    _mm_storeu_ps(result.m[0], column0);
+    _mm_storeu_ps(result.m[1], column1);
+    _mm_storeu_ps(result.m[2], column2);
+    return result;
+}
+
+AffineTransform AffineTransform::Inverse() const
+{
+    // Without the translations
+    __m128 mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    __m128 row0 = _mm_and_ps(_mm_loadu_ps(m[0]), mask);
+    __m128 row1 = _mm_and_ps(_mm_loadu_ps(m[1]), mask);
+    __m128 row2 = _mm_and_ps(_mm_loadu_ps(m[2]), mask);
+
+    // The adjugate's columns are the cross products of the rows
+    __m128 column0 = Cross(row1, row2);
+    __m128 column1 = Cross(row2, row0);
+    __m128 column2 = Cross(row0, row1);
+    __m128 products = _mm_mul_ps(row0, column0);
+    __m128 determinant = _mm_add_ss(_mm_add_ss(products, _mm_shuffle_ps(products, products, _MM_SHUFFLE(1, 1, 1, 1))), _mm_movehl_ps(products, products));
+    __m128 scale = _mm_div_ps(_mm_set1_ps(1.0f), _mm_shuffle_ps(determinant, determinant, _MM_SHUFFLE(0, 0, 0, 0)));
+    return FinishInverse(_mm_mul_ps(column0, scale), _mm_mul_ps(column1, scale), _mm_mul_ps(column2, scale), *this);
+}
+
+AffineTransform AffineTransform::InverseRigid() const
+{
+    // The transpose's columns are the rows
+    __m128 mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    return FinishInverse(_mm_and_ps(_mm_loadu_ps(m[0]), mask), _mm_and_ps(_mm_loadu_ps(m[1]), mask), _mm_and_ps(_mm_loadu_ps(m[2]), mask), *this);
+}
+
+#else
+
+// The inverted 3x3 part is in place, the translation goes through it
+static inline void FinishInverse(const AffineTransform& transform, AffineTransform& result)
+{
+    float3 translation = result.TransformVector(float3(transform.m[0][3], transform.m[1][3], transform.m[2][3]));
+    result.m[0][3] = -translation.x;
+    result.m[1][3] = -translation.y;
+    result.m[2][3] = -translation.z;
+}
+
+AffineTransform AffineTransform::Inverse() const
+{
+    // The adjugate's columns are the cross products of the rows
+    float3 row0(m[0][0], m[0][1], m[0][2]);
+    float3 row1(m[1][0], m[1][1], m[1][2]);
+    float3 row2(m[2][0], m[2][1], m[2][2]);
+    float3 columns[3] = { cross(row1, row2), cross(row2, row0), cross(row0, row1) };
+    float scale = 1.0f / dot(row0, columns[0]);
+
+    AffineTransform result;
+    for (int column = 0; column < 3; ++column)
+    {
+        result.m[0][column] = columns[column].x * scale;
+        result.m[1][column] = columns[column].y * scale;
+        result.m[2][column] = columns[column].z * scale;
+    }
+    FinishInverse(*this, result);
+    return result;
+}
+
+AffineTransform AffineTransform::InverseRigid() const
+{
+    AffineTransform result;
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            result.m[i][j] = m[j][i];
+        }
+    }
+    FinishInverse(*this, result);
+    return result;
+}
+
+#endif
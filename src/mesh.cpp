@@ -1,500 +1,288 @@
 #include "mesh.hpp"
 #include "materialsystem.hpp"
-#include <cctype>
-#include <fstream>
+#include "assetcache.hpp"
+#include "tangents.hpp"
+#include <algorithm>
 #include <string>
 
-class FileReader
+void Mesh::InitBuffers()
 {
-public:
-    FileReader(const char* filename) : m_InputFile(filename), m_VectorValue(0.0f)
-    {
-        if (!m_InputFile)
-        {
-            THROW_RUNTIME("Failed to load object file " << filename)
-
-        }
-    }
-
-    std::string GetStringValue() const
+    if (m_VertexFormat == VERTEX_FORMAT_FULL)
     {
-        return m_StringValue;
+        InitVertexBuffer(m_Vertices.data(), m_Vertices.size(), VERTEX_FORMAT_FULL);
     }
-
-    float3 GetVectorValue() const
-    {
-        return m_VectorValue;
-    }
-
-protected:
-    float ReadFloatValue()
+    else
     {
-        SkipSpaces();
-        float value = 0.0f;
-        bool minus = m_CurrentLine[m_CurrentChar] == '-';
-        if (minus) ++m_CurrentChar;
-        while (m_CurrentChar < m_CurrentLine.size() && m_CurrentLine[m_CurrentChar] >= '0' && m_CurrentLine[m_CurrentChar] <= '9')
-        {
-            value = value * 10.0f + (float)((int)m_CurrentLine[m_CurrentChar++] - 48);
-        }
-        if (m_CurrentLine[m_CurrentChar++] == '.')
-        {
-            size_t frac = 1;
-            while (m_CurrentChar < m_CurrentLine.size() && m_CurrentLine[m_CurrentChar] >= '0' && m_CurrentLine[m_CurrentChar] <= '9')
-            {
-                value += (float)((int)m_CurrentLine[m_CurrentChar++] - 48) / (pow(10.0f, frac++));
-            }
-        }
-
-        return minus ? -value : value;
-
+        std::vector<unsigned char> vertices;
+        ConvertVertices(m_Vertices.data(), m_Vertices.size(), m_VertexFormat, vertices);
+        InitVertexBuffer(vertices.data(), m_Vertices.size(), m_VertexFormat);
     }
+    InitIndexBuffer(m_Indices.data(), m_Indices.size());
+    ApplyResidency();
+}
 
-    int ReadIntValue()
+void Mesh::ApplyResidency()
+{
+    if (m_Residency == GEOMETRY_RESIDENCY_KEEP)
     {
-        SkipSpaces();
-        int value = 0;
-        bool minus = m_CurrentLine[m_CurrentChar] == '-';
-        if (minus) ++m_CurrentChar;
-
-        while (m_CurrentChar < m_CurrentLine.size() && m_CurrentLine[m_CurrentChar] >= '0' && m_CurrentLine[m_CurrentChar] <= '9')
-        {
-            value = value * 10 + ((int)m_CurrentLine[m_CurrentChar++] - 48);
-        }
-        return minus ? -value : value;
+        return;
     }
 
-    unsigned int ReadUintValue()
+    if (m_Residency == GEOMETRY_RESIDENCY_POSITIONS && !m_Vertices.empty())
     {
-        SkipSpaces();
-        unsigned int value = 0;
-
-        while (m_CurrentChar < m_CurrentLine.size() && m_CurrentLine[m_CurrentChar] >= '0' && m_CurrentLine[m_CurrentChar] <= '9')
+        m_Positions.resize(m_Vertices.size());
+        for (size_t i = 0; i < m_Vertices.size(); ++i)
         {
-            value = value * 10 + ((unsigned int)m_CurrentLine[m_CurrentChar++] - 48);
+            m_Positions[i] = m_Vertices[i].position;
         }
-        return value;
-    }
-
-    void ReadVectorValue()
-    {
-        m_VectorValue.x = ReadFloatValue();
-        m_VectorValue.y = ReadFloatValue();
-        m_VectorValue.z = ReadFloatValue();
-
     }
-
-    void ReadStringValue()
+    else if (m_Residency == GEOMETRY_RESIDENCY_DROP)
     {
-        SkipSpaces();
-        m_StringValue.clear();
-
-        if (m_CurrentChar < m_CurrentLine.size() && IsIdentifierStart(m_CurrentLine[m_CurrentChar]))
-        {
-            m_StringValue += m_CurrentLine[m_CurrentChar++];
-            while (m_CurrentChar < m_CurrentLine.size() && IsIdentifierBody(m_CurrentLine[m_CurrentChar]))
-            {
-                m_StringValue += m_CurrentLine[m_CurrentChar++];
-            }
-        }
-
+        std::vector<float3>().swap(m_Positions);
+        std::vector<unsigned int>().swap(m_Indices);
     }
+    std::vector<Vertex>().swap(m_Vertices);
+}
 
-    bool ReadLine()
+void Mesh::KeepGeometry(const void* vertices, size_t vertexCount, VertexFormat_t vertexFormat, const void* indices, size_t indexCount, size_t indexSize)
+{
+    if (m_Residency == GEOMETRY_RESIDENCY_DROP)
     {
-        do
-        {
-            if (!std::getline(m_InputFile, m_CurrentLine))
-            {
-                return false;
-            }
-        } while (m_CurrentLine.size() == 0);
-
-        m_CurrentChar = 0;
-        return true;
+        return;
     }
 
-    void SkipSpaces()
+    m_Indices.resize(indexCount);
+    if (indexSize == sizeof(unsigned short))
     {
-        while (std::isspace(m_CurrentLine[m_CurrentChar])) { m_CurrentChar++; }
+        const unsigned short* indices16 = (const unsigned short*)indices;
+        std::copy(indices16, indices16 + indexCount, m_Indices.begin());
     }
-
-    void SkipSymbol(char symbol)
+    else if (indexCount)
     {
-        SkipSpaces();
-        while (m_CurrentLine[m_CurrentChar] == symbol) { m_CurrentChar++; }
+        memcpy(m_Indices.data(), indices, indexCount * sizeof(unsigned int));
     }
 
-    bool IsIdentifierStart(char symbol)
+    if (m_Residency == GEOMETRY_RESIDENCY_KEEP)
     {
-        return symbol >= 'a' && symbol <= 'z' ||
-            symbol >= 'A' && symbol <= 'Z' || symbol == '_';
+        m_Vertices.resize(vertexCount);
+        ConvertToVertices(vertices, vertexCount, vertexFormat, m_Vertices.data());
     }
-
-    bool IsIdentifierBody(char symbol)
+    else
     {
-        return IsIdentifierStart(symbol) || symbol >= '0' && symbol <= '9';
+        // Every format starts with the position
+        size_t stride = GetVertexFormatDesc(vertexFormat).stride;
+        m_Positions.resize(vertexCount);
+        for (size_t i = 0; i < vertexCount; ++i)
+        {
+            memcpy(&m_Positions[i], (const unsigned char*)vertices + i * stride, sizeof(float3));
+        }
     }
+}
 
-private:
-    std::ifstream m_InputFile;
-    std::string m_CurrentLine;
-    std::string m_StringValue;
-    float3 m_VectorValue;
-    size_t m_CurrentChar;
-
-};
-
-class ObjReader : public FileReader
+// Uploads straight from the file mapping or the decoded compressed sections. Vertices
+// of compressed files before .dat version 10 come as Vertex and are converted first.
+void Mesh::LoadGeometry(const void* vertices, size_t vertexCount, VertexFormat_t vertexFormat, const void* indices, size_t indexCount, size_t indexSize)
 {
-public:
-    enum ObjToken_t
-    {
-        OBJ_MTLLIB,
-        OBJ_USEMTL,
-        OBJ_POSITION,
-        OBJ_TEXCOORD,
-        OBJ_NORMAL,
-        OBJ_FACE,
-        OBJ_SMOOTHINGGROUP,
-        OBJ_INVALID,
-        OBJ_EOF
-    };
-
-    ObjReader(const char* filename) : FileReader(filename)
+    if (vertexFormat == m_VertexFormat)
     {
+        InitVertexBuffer(vertices, vertexCount, vertexFormat);
     }
-
-    ObjToken_t NextToken()
+    else
     {
-        if (!ReadLine())
-        {
-            return OBJ_EOF;
-        }
-
-        ReadStringValue();
-        if (GetStringValue() == "mtllib")
-        {
-            ReadStringValue();
-            return OBJ_MTLLIB;
-        }
-        else if (GetStringValue() == "usemtl")
-        {
-            ReadStringValue();
-            return OBJ_USEMTL;
-        }
-        else if (GetStringValue() == "v")
-        {
-            ReadVectorValue();
-            return OBJ_POSITION;
-        }
-        else if (GetStringValue() == "vn")
-        {
-            ReadVectorValue();
-            return OBJ_NORMAL;
-        }
-        else if (GetStringValue() == "vt")
-        {
-            ReadVectorValue();
-            return OBJ_TEXCOORD;
-        }
-        else if (GetStringValue() == "f")
-        {
-            for (size_t i = 0; i < 3; ++i)
-            {
-                m_VertexIndices[i] = (unsigned int)ReadIntValue() - 1;
-                SkipSymbol('/');
-                m_TexcoordIndices[i] = (unsigned int)ReadIntValue() - 1;
-                SkipSymbol('/');
-                m_NormalIndices[i] = (unsigned int)ReadIntValue() - 1;
-
-            }
-            return OBJ_FACE;
-        }
-        else if (GetStringValue() == "s")
-        {
-            m_UintValue = ReadUintValue();
-            return OBJ_SMOOTHINGGROUP;
-        }
-        else
-        {
-            return OBJ_INVALID;
-        }
-
+        std::vector<unsigned char> convertedVertices;
+        ConvertVertices((const Vertex*)vertices, vertexCount, m_VertexFormat, convertedVertices);
+        InitVertexBuffer(convertedVertices.data(), vertexCount, m_VertexFormat);
     }
 
-    void GetFaceIndices(const unsigned int** iv, const unsigned int** it, const unsigned int** in) const
+    if (indexSize == sizeof(unsigned short))
     {
-        *iv = m_VertexIndices;
-        *it = m_TexcoordIndices;
-        *in = m_NormalIndices;
-
+        InitIndexBuffer(indices, indexCount, indexSize);
     }
-
-    int GetUintValue() const
+    else
     {
-        return m_UintValue;
+        InitIndexBuffer((const unsigned int*)indices, indexCount);
     }
+    KeepGeometry(vertices, vertexCount, vertexFormat, indices, indexCount, indexSize);
+}
 
-private:
-    // Face indices
-    unsigned int m_VertexIndices[3];
-    unsigned int m_TexcoordIndices[3];
-    unsigned int m_NormalIndices[3];
-    unsigned int m_UintValue;
-
-};
-
-void Mesh::InitBuffers()
+void Mesh::SetResidency(GeometryResidency_t residency)
 {
-    D3D11_BUFFER_DESC vertexBufferDesc;
-    ZeroMemory(&vertexBufferDesc, sizeof(vertexBufferDesc));
-
-    vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-    vertexBufferDesc.ByteWidth = sizeof(Vertex) * m_Vertices.size();
-    vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-
-    D3D11_SUBRESOURCE_DATA vertexBufferData;
-    ZeroMemory(&vertexBufferData, sizeof(vertexBufferData));
-    vertexBufferData.pSysMem = m_Vertices.data();
-
-    render->GetDevice()->CreateBuffer(&vertexBufferDesc, &vertexBufferData, &m_VertexBuffer);
-
-    D3D11_BUFFER_DESC indexBufferDesc;
-    ZeroMemory(&indexBufferDesc, sizeof(indexBufferDesc));
-
-    indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-    indexBufferDesc.ByteWidth = sizeof(unsigned int) * m_Indices.size();
-    indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-
-    D3D11_SUBRESOURCE_DATA indexBufferData;
-    ZeroMemory(&indexBufferData, sizeof(indexBufferData));
-    indexBufferData.pSysMem = m_Indices.data();
-    render->GetDevice()->CreateBuffer(&indexBufferDesc, &indexBufferData, &m_IndexBuffer);
-
+    if (residency == GEOMETRY_RESIDENCY_POSITIONS && m_Residency == GEOMETRY_RESIDENCY_DROP)
+    {
+        // Nothing left to take the positions from
+        residency = GEOMETRY_RESIDENCY_DROP;
+    }
+    m_Residency = residency;
+    ApplyResidency();
 }
 
-#include <unordered_map>
-
-std::string HashIntTriple(unsigned int a, unsigned int b, unsigned int c)
+template<typename T>
+static size_t GetHeapBytes(const std::vector<T>& vec)
 {
-    std::stringstream ss;
-    ss << a << " " << b << " " << c;
-    return ss.str();
+    return vec.capacity() * sizeof(T);
 }
 
-void ComputeTangentSpace(Vertex& v1, Vertex& v2, Vertex& v3)
+GeometryMemory_t Mesh::GetMemoryUsage() const
 {
-    const float3& v1p = v1.position;
-    const float3& v2p = v2.position;
-    const float3& v3p = v3.position;
-
-    const float2& v1t = v1.texcoord;
-    const float2& v2t = v2.texcoord;
-    const float2& v3t = v3.texcoord;
-
-    double x1 = v2p.x - v1p.x;
-    double x2 = v3p.x - v1p.x;
-    double y1 = v2p.y - v1p.y;
-    double y2 = v3p.y - v1p.y;
-    double z1 = v2p.z - v1p.z;
-    double z2 = v3p.z - v1p.z;
-
-    double s1 = v2t.x - v1t.x;
-    double s2 = v3t.x - v1t.x;
-    double t1 = v2t.y - v1t.y;
-    double t2 = v3t.y - v1t.y;
-
-    double r = 1.0 / (s1 * t2 - s2 * t1);
-    float3 sdir((t2 * x1 - t1 * x2) * r, (t2 * y1 - t1 * y2) * r, (t2 * z1 - t1 * z2) * r);
-    float3 tdir((s1 * x2 - s2 * x1) * r, (s1 * y2 - s2 * y1) * r, (s1 * z2 - s2 * z1) * r);
-
-    v1.tangent_s += sdir;
-    v2.tangent_s += sdir;
-    v3.tangent_s += sdir;
-
-    v1.tangent_t += tdir;
-    v2.tangent_t += tdir;
-    v3.tangent_t += tdir;
-
+    GeometryMemory_t memory;
+    memory.cpuBytes = GetHeapBytes(m_Vertices) + GetHeapBytes(m_Indices) + GetHeapBytes(m_Positions) + GetHeapBytes(m_MeshGroups) + GetHeapBytes(m_Lods) +
+                      GetHeapBytes(m_Meshlets) + GetHeapBytes(m_MeshletOffsets) + GetHeapBytes(m_DrawRanges) + GetHeapBytes(m_GroupBounds);
+    memory.gpuBytes = m_VertexBufferBytes + m_IndexBufferBytes;
+    return memory;
 }
 
-void Mesh::LoadFromObj(const char* filename)
+void Mesh::CreateBuffer(const void* data, size_t size, UINT bindFlags, ScopedObject<ID3D11Buffer>& buffer)
 {
-    ObjReader objReader(filename);
+    D3D11_BUFFER_DESC bufferDesc;
+    ZeroMemory(&bufferDesc, sizeof(bufferDesc));
 
-    std::vector<float3> positions;
-    std::vector<float3> normals;
-    std::vector<float2> texcoords;
-    unsigned int newIndex = 0;
-    unsigned int existingIndex = 0;
+    bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+    bufferDesc.ByteWidth = (UINT)size;
+    bufferDesc.BindFlags = bindFlags;
 
-    std::string materialName;
-    ObjReader::ObjToken_t token;
+    D3D11_SUBRESOURCE_DATA bufferData;
+    ZeroMemory(&bufferData, sizeof(bufferData));
+    bufferData.pSysMem = data;
 
-    std::unordered_map<std::string, unsigned int> indexDictionary;
-    std::unordered_map<std::string, unsigned int>::iterator iter;
-
-    MeshGroup_t meshGroup;
-    meshGroup.startIndex = 0;
-    meshGroup.indexCount = 0;
-    strcpy(meshGroup.materialName, "debug_checker");
-    
-    while ((token = objReader.NextToken()) != ObjReader::OBJ_EOF)
-    {
-        switch (token)
-        {
-        case ObjReader::OBJ_USEMTL:
-            if (meshGroup.indexCount > 0)
-            {
-                m_MeshGroups.push_back(meshGroup);
-            }
-            strcpy(meshGroup.materialName, objReader.GetStringValue().c_str());
-            meshGroup.startIndex = m_Indices.size();
-            meshGroup.indexCount = 0;
-            break;
-        case ObjReader::OBJ_POSITION:
-            positions.push_back(float3(objReader.GetVectorValue().x, -objReader.GetVectorValue().y, objReader.GetVectorValue().z));
-            //m_Vertices.push_back(Vertex(positions.back()));
-            break;
-        case ObjReader::OBJ_NORMAL:
-            normals.push_back(float3(objReader.GetVectorValue().x, -objReader.GetVectorValue().y, objReader.GetVectorValue().z));
-            break;
-        case ObjReader::OBJ_TEXCOORD:
-            texcoords.push_back(float2(objReader.GetVectorValue().x, 1.0f - objReader.GetVectorValue().y));
-            break;
-        case ObjReader::OBJ_FACE:
-            unsigned int *iv, *it, *in;
-            objReader.GetFaceIndices((const unsigned int**)&iv, (const unsigned int**)&it, (const unsigned int**)&in);
-            std::swap(iv[0], iv[1]);
-            std::swap(it[0], it[1]);
-            std::swap(in[0], in[1]);
-
-            // Re-index Mesh
-            for (size_t i = 0; i < 3; ++i)
-            {
-                std::string triple = HashIntTriple(iv[i], it[i], in[i]);
-                if ((iter = indexDictionary.find(triple)) != indexDictionary.end())
-                {
-                    m_Indices.push_back(iter->second);
-                }
-                else
-                {
-                    m_Vertices.push_back(Vertex(positions[iv[i]], texcoords[it[i]], normals[in[i]]));
-                    indexDictionary[triple] = newIndex;
-                    m_Indices.push_back(newIndex++);
-                }
-                ++meshGroup.indexCount;
-            }
-            break;
-        case ObjReader::OBJ_SMOOTHINGGROUP:
-            break;
-        }
-    }
+    buffer.Reset();
+    render->GetDevice()->CreateBuffer(&bufferDesc, &bufferData, &buffer);
+}
 
-    m_MeshGroups.push_back(meshGroup);
-    
-    for (unsigned int i = 0; i < m_Indices.size(); i += 3)
-    {
-        unsigned int i1 = m_Indices[i];
-        unsigned int i2 = m_Indices[i + 1];
-        unsigned int i3 = m_Indices[i + 2];
+void Mesh::InitVertexBuffer(const void* vertices, size_t vertexCount, VertexFormat_t vertexFormat)
+{
+    m_VertexBufferBytes = GetVertexFormatDesc(vertexFormat).stride * vertexCount;
+    CreateBuffer(vertices, m_VertexBufferBytes, D3D11_BIND_VERTEX_BUFFER, m_VertexBuffer);
+    m_VertexFormat = vertexFormat;
 
-        ComputeTangentSpace(m_Vertices[i1], m_Vertices[i2], m_Vertices[i3]);
+}
 
+void Mesh::InitIndexBuffer(const unsigned int* indices, size_t indexCount)
+{
+    if (GetIndexSize(indices, indexCount) == sizeof(unsigned short))
+    {
+        std::vector<unsigned short> narrowIndices = NarrowIndices(indices, indexCount);
+        InitIndexBuffer(narrowIndices.data(), indexCount, sizeof(unsigned short));
     }
-
-    for (unsigned int i = 0; i < m_Vertices.size(); ++i)
+    else
     {
-        float3& n = m_Vertices[i].normal;
-        const float3& t = m_Vertices[i].tangent_t;
-
-        m_Vertices[i].tangent_t = (t - n * dot(n, t)).normalize();
-        m_Vertices[i].tangent_s = cross(m_Vertices[i].tangent_t, m_Vertices[i].normal);
-
+        InitIndexBuffer(indices, indexCount, sizeof(unsigned int));
     }
 }
 
-// Maybe not good, but much faster than loading obj...
-void Mesh::SaveToDat(const char* filename) const
+void Mesh::InitIndexBuffer(const void* indices, size_t indexCount, size_t indexSize)
 {
-    std::ofstream outfile(filename, std::ios::out | std::ofstream::binary);
-    unsigned int size = m_Vertices.size() * sizeof(Vertex);
-    outfile.write((char*)&size, sizeof(size));
-    outfile.write((char*)m_Vertices.data(), size);
+    m_IndexBufferBytes = indexSize * indexCount;
+    CreateBuffer(indices, m_IndexBufferBytes, D3D11_BIND_INDEX_BUFFER, m_IndexBuffer);
 
-    size = m_Indices.size() * sizeof(unsigned int);
-    outfile.write((char*)&size, sizeof(size));
-    outfile.write((char*)m_Indices.data(), size);
+    m_IndexCount = (unsigned int)indexCount;
+    m_IndexFormat = indexSize == sizeof(unsigned short) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
 
-    size = m_MeshGroups.size() * sizeof(MeshGroup_t);
-    outfile.write((char*)&size, sizeof(size));
-    outfile.write((char*)m_MeshGroups.data(), size);
+    m_HasBaseVertices = false;
+    for (size_t i = 0; i < m_MeshGroups.size(); ++i)
+    {
+        m_HasBaseVertices |= m_MeshGroups[i].baseVertex != 0;
+    }
+
+    if (m_Lods.empty())
+    {
+        MeshLod_t lod;
+        lod.firstGroup = 0;
+        lod.groupCount = (unsigned int)m_MeshGroups.size();
+        lod.startIndex = 0;
+        lod.indexCount = m_IndexCount;
+        lod.error = 0.0f;
+        m_Lods.push_back(lod);
+    }
 
 }
 
-void Mesh::LoadFromDat(const char* filename)
+// The .obj is only parsed when the cache has no entry for its current contents
+void Mesh::LoadFromCache(const char* filename, const MeshImportOptions_t& options)
 {
-    std::ifstream infile(filename, std::ios::in | std::ifstream::binary);
-
-    unsigned int size;
-    infile.read((char*)&size, sizeof(size));
-    m_Vertices.resize(size / sizeof(Vertex));
-    infile.read((char*)m_Vertices.data(), size);
+    std::string cacheFile = GetCachePath(filename, GetImportKey(filename, options), ".dat");
 
-    infile.read((char*)&size, sizeof(size));
-    m_Indices.resize(size / sizeof(unsigned int));
-    infile.read((char*)m_Indices.data(), size);
-
-    infile.read((char*)&size, sizeof(size));
-    m_MeshGroups.resize(size / sizeof(MeshGroup_t));
-    infile.read((char*)m_MeshGroups.data(), size);
+    if (FileExists(cacheFile.c_str()))
+    {
+        try
+        {
+            LoadFromDat(cacheFile.c_str());
+            return;
+        }
+        catch (const std::exception&)
+        {
+            // Damaged entry, import again and replace it
+            m_MeshGroups.clear();
+            m_Lods.clear();
+            m_Meshlets.clear();
+        }
+    }
 
+    LoadFromObj(filename, options);
+    std::string tempFile = GetCacheTempPath(cacheFile);
+    SaveToDat(tempFile.c_str(), options.compressDat);
+    PublishCacheFile(tempFile, cacheFile);
+    InitBuffers();
 
 }
 
 // Load from .obj
-Mesh::Mesh(const char* filename, const char* mtldir, const Matrix& modelToWorld, bool castShadow) : m_ModelToWorld(modelToWorld), m_CastShadow(castShadow)
+Mesh::Mesh(const char* filename, const char* mtldir, const Matrix& modelToWorld, bool castShadow, const MeshImportOptions_t& options) : m_Name(filename), m_Residency(options.residency), m_CurrentLod(0), m_DrawCalls(0), m_VertexBufferBytes(0), m_IndexBufferBytes(0), m_ModelToWorld(modelToWorld), m_CastShadow(castShadow)
 {
     const char* ext;
     ext = strrchr(filename, '.');
 
-    if (strcmp(ext, ".obj") == 0)
+    if (ext && strcmp(ext, ".obj") == 0)
     {
-        LoadFromObj(filename);
-        char outfile[80];
-        ZeroMemory(outfile, 80);
-        strncpy(outfile, filename, ext - filename);
-        strcat(outfile, ".dat");
-        SaveToDat(outfile);
+        LoadFromCache(filename, options);
     }
-    else if (strcmp(ext, ".dat") == 0)
+    else if (ext && strcmp(ext, ".dat") == 0)
     {
         LoadFromDat(filename);
     }
+    else
+    {
+        // Nothing would fill the LODs Draw indexes
+        THROW_RUNTIME("Mesh file " << filename << " is neither .obj nor .dat")
+    }
 
     if (mtldir)
     {
         for (unsigned int i = 0; i < m_MeshGroups.size(); ++i)
         {
-            char name[56];
-            ZeroMemory(name, 56);
-            sprintf(name, "%s/%s", mtldir, m_MeshGroups[i].materialName);
-
-            memcpy(m_MeshGroups[i].materialName, name, 56);
+            MeshGroup_t& meshGroup = m_MeshGroups[i];
+            SetMaterialName(meshGroup, mtldir, meshGroup.materialName, strnlen(meshGroup.materialName, sizeof(meshGroup.materialName)));
         }
     }
 
-    InitBuffers();
-
 }
 
 Mesh::Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
-    : m_Vertices(vertices), m_Indices(indices), m_ModelToWorld(Matrix::Identity())
+    : m_Residency(GEOMETRY_RESIDENCY_DROP), m_CurrentLod(0), m_DrawCalls(0), m_VertexBufferBytes(0), m_IndexBufferBytes(0), m_ModelToWorld(AffineTransform::Identity())
 {
+    m_Vertices = vertices;
+    m_Indices = indices;
     InitBuffers();
 }
 
+bool Mesh::CullMeshGroup(unsigned int group, const MeshletCuller& culler, bool cullBackfaces)
+{
+    m_DrawRanges.clear();
+    if (m_HasBounds && !culler.IsBoxVisible(m_GroupBounds[group].mins, m_GroupBounds[group].maxs))
+    {
+        return false;
+    }
+    if (m_Meshlets.empty())
+    {
+        DrawRange_t range = { m_MeshGroups[group].startIndex, m_MeshGroups[group].indexCount };
+        m_DrawRanges.push_back(range);
+        return true;
+    }
+
+    unsigned int first = m_MeshletOffsets[group];
+    culler.Cull(m_Meshlets.data() + first, m_MeshletOffsets[group + 1] - first, cullBackfaces, m_DrawRanges);
+    return !m_DrawRanges.empty();
+}
+
 void Mesh::Draw(bool drawDepth)
 {
     if (drawDepth && !m_CastShadow)
@@ -502,13 +290,13 @@ void Mesh::Draw(bool drawDepth)
         return;
     }
 
-    UINT stride = sizeof(Vertex);
+    UINT stride = GetVertexFormatDesc(m_VertexFormat).stride;
     UINT offset = 0;
 
     const ViewSetup* view = render->GetCurrentView();
     Material::VSConstantBuffer vscb;
     vscb.matWorldToCamera = view->matWorldToCamera.Transpose();
-    vscb.matModelToWorld = m_ModelToWorld;
+    vscb.matModelToWorld = m_ModelToWorld.ToMatrix();
     vscb.viewPosition = view->origin;
     
     Material::PSConstantBuffer pscb;
@@ -516,24 +304,59 @@ void Mesh::Draw(bool drawDepth)
     pscb.lightColor = float3(1.0f, 0.9f, 0.8f) * 2.0f;
 
     render->GetDeviceContext()->IASetVertexBuffers(0, 1, &m_VertexBuffer, &stride, &offset);
-    render->GetDeviceContext()->IASetIndexBuffer(m_IndexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+    render->GetDeviceContext()->IASetIndexBuffer(m_IndexBuffer.Get(), m_IndexFormat, 0);
     render->GetDeviceContext()->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
+    m_DrawCalls = 0;
+    const MeshLod_t& lod = m_Lods[m_CurrentLod];
+    MeshletCuller culler(*view, m_ModelToWorld);
+    if (m_HasBounds && !culler.IsBoxVisible(m_Bounds.mins, m_Bounds.maxs))
+    {
+        return;
+    }
     if (drawDepth)
     {
-        materials->FindMaterial("depth")->SetMaterial(vscb, pscb);
-        render->GetDeviceContext()->DrawIndexed(m_Indices.size(), 0, 0);
+        materials->FindMaterial("depth")->SetMaterial(vscb, pscb, m_VertexFormat);
+        if (!m_HasBaseVertices && m_Meshlets.empty())
+        {
+            render->GetDeviceContext()->DrawIndexed(lod.indexCount, lod.startIndex, 0);
+            ++m_DrawCalls;
+        }
+        else
+        {
+            // The depth material draws both sides
+            for (unsigned int i = lod.firstGroup; i < lod.firstGroup + lod.groupCount; ++i)
+            {
+                if (CullMeshGroup(i, culler, false))
+                {
+                    for (size_t j = 0; j < m_DrawRanges.size(); ++j)
+                    {
+                        render->GetDeviceContext()->DrawIndexed(m_DrawRanges[j].indexCount, m_DrawRanges[j].startIndex, m_MeshGroups[i].baseVertex);
+                        ++m_DrawCalls;
+                    }
+                }
+            }
+        }
     }
     else
     {
         const ViewSetup* shadowView = render->GetPreviousView();
         vscb.matShadowToWorld = shadowView->matWorldToCamera.Transpose();
         pscb.lightPos = shadowView->origin;
-        for (unsigned int i = 0; i < m_MeshGroups.size(); ++i)
+        for (unsigned int i = lod.firstGroup; i < lod.firstGroup + lod.groupCount; ++i)
         {
             const MeshGroup_t& meshGroup = m_MeshGroups[i];
-            materials->FindMaterial(meshGroup.materialName)->SetMaterial(vscb, pscb);
-            render->GetDeviceContext()->DrawIndexed(meshGroup.indexCount, meshGroup.startIndex, 0);
+            std::shared_ptr<Material> material = materials->FindMaterial(meshGroup.materialName);
+            if (!CullMeshGroup(i, culler, material->CullsBackfaces()))
+            {
+                continue;
+            }
+            material->SetMaterial(vscb, pscb, m_VertexFormat);
+            for (size_t j = 0; j < m_DrawRanges.size(); ++j)
+            {
+                render->GetDeviceContext()->DrawIndexed(m_DrawRanges[j].indexCount, m_DrawRanges[j].startIndex, meshGroup.baseVertex);
+                ++m_DrawCalls;
+            }
         }
 
     }
@@ -543,136 +366,137 @@ void Mesh::Draw(bool drawDepth)
 
 #define MAX_COORD_INTEGER 16384
 
-std::vector<Vertex> BaseWindingForPlane(float3 normal, float dist)
-{
-    int		i, x;
-    float	max, v;
-    float3	org, vright, vup;
-    std::vector<Vertex>	w;
-
-    // find the major axis
-    max = -1;
-    x = -1;
-    for (i = 0; i<3; i++)
-    {
-        v = fabs(normal[i]);
-        if (v > max)
-        {
-            x = i;
-            max = v;
-        }
-    }
-    if (x == -1)
-    {
-        throw std::exception("BaseWindingForPlane: no axis found");
-    }
-
-    switch (x)
-    {
-    case 0:
-    case 1:
-        vup.z = 1;
-        break;
-    case 2:
-        vup.x = 1;
-        break;
-    }
-
-    v = dot(vup, normal);
-    vup -= normal * v;
-    vup = vup.normalize();
-    org = normal * dist;
-
-    vright = cross(vup, normal);
-    vup *= 1024.0f;
-    vright *= 1024.0f;
-            
-    w.push_back(Vertex(org - vright + vup, float2(0.0f, 0.0f) * 64.0f, normal));
-    w.push_back(Vertex(org + vright + vup, float2(0.0f, 1.0f) * 64.0f, normal));
-    w.push_back(Vertex(org + vright - vup, float2(1.0f, 1.0f) * 64.0f, normal));
-    w.push_back(Vertex(org - vright - vup, float2(1.0f, 0.0f) * 64.0f, normal));
-    
-    return w;
+std::vector<Vertex> BaseWindingForPlane(float3 normal, float dist)
+{
+    int		i, x;
+    float	max, v;
+    float3	org, vright, vup;
+    std::vector<Vertex>	w;
+
+    // find the major axis
+    max = -1;
+    x = -1;
+    for (i = 0; i<3; i++)
+    {
+        v = fabs(normal[i]);
+        if (v > max)
+        {
+            x = i;
+            max = v;
+        }
+    }
+    if (x == -1)
+    {
+        throw std::exception("BaseWindingForPlane: no axis found");
+    }
+
+    switch (x)
+    {
+    case 0:
+    case 1:
+        vup.z = 1;
+        break;
+    case 2:
+        vup.x = 1;
+        break;
+    }
+
+    v = dot(vup, normal);
+    vup -= normal * v;
+    vup = vup.normalize();
+    org = normal * dist;
+
+    vright = cross(vup, normal);
+    vup *= 1024.0f;
+    vright *= 1024.0f;
+            
+    w.push_back(Vertex(org - vright + vup, float2(0.0f, 0.0f) * 64.0f, normal));
+    w.push_back(Vertex(org + vright + vup, float2(0.0f, 1.0f) * 64.0f, normal));
+    w.push_back(Vertex(org + vright - vup, float2(1.0f, 1.0f) * 64.0f, normal));
+    w.push_back(Vertex(org - vright - vup, float2(1.0f, 0.0f) * 64.0f, normal));
+    
+    return w;
 }
 
 #define MAX_POINTS_ON_WINDING 64
-#define	SIDE_FRONT	0
-#define	SIDE_BACK	1
-#define	SIDE_ON		2
+#define	SIDE_FRONT	0
+#define	SIDE_BACK	1
+#define	SIDE_ON		2
 #define SIDE_CROSS  -2
 
-std::vector<Vertex> ChopWindingInPlace(const std::vector<Vertex>& in, const float3 &normal, float dist, float epsilon)
-{
-    float	dists[MAX_POINTS_ON_WINDING + 4];
-    int		sides[MAX_POINTS_ON_WINDING + 4];
-    
-    int		counts[3];
-    counts[0] = counts[1] = counts[2] = 0;
-    // determine sides for each point
-    unsigned int i;
-    for (i = 0; i < in.size(); i++)
-    {
-        float dotp = dot(in[i].position, normal);
-        dotp -= dist;
-        dists[i] = dotp;
-        if (dotp > epsilon)
-        {
-            sides[i] = SIDE_FRONT;
-        }
-        else if (dotp < -epsilon)
-        {
-            sides[i] = SIDE_BACK;
-        }
-        else
-        {
-            sides[i] = SIDE_ON;
-        }
-        counts[sides[i]]++;
-    }
-    sides[i] = sides[0];
-    dists[i] = dists[0];
-    
-    if (!counts[0] || !counts[1])
-    {
-        return in;
-    }
-
-    std::vector<Vertex> f;
-    for (i = 0; i < in.size(); i++)
-    {
-
-        if (sides[i] == SIDE_ON)
-        {
-            f.push_back(in[i]);
-            continue;
-        }
-
-        if (sides[i] == SIDE_BACK)
-        {
-            f.push_back(in[i]);
-        }
-
-        if (sides[i + 1] == SIDE_ON || sides[i + 1] == sides[i])
-            continue;
-
-        // generate a split point
-        const Vertex& v1 = in[i];
-        const Vertex& v2 = in[(i + 1) % in.size()];
-
-        float3	mid;
-        float dotp = dists[i] / (dists[i] - dists[i + 1]);
-
-        f.push_back(Vertex(v1.position + (v2.position - v1.position) * dotp, v1.texcoord + (v2.texcoord - v1.texcoord) * dotp, v1.normal));
-
-    }
-
-    return f;
+std::vector<Vertex> ChopWindingInPlace(const std::vector<Vertex>& in, const float3 &normal, float dist, float epsilon)
+{
+    float	dists[MAX_POINTS_ON_WINDING + 4];
+    int		sides[MAX_POINTS_ON_WINDING + 4];
+    
+    int		counts[3];
+    counts[0] = counts[1] = counts[2] = 0;
+    // determine sides for each point
+    unsigned int i;
+    for (i = 0; i < in.size(); i++)
+    {
+        float dotp = dot(in[i].position, normal);
+        dotp -= dist;
+        dists[i] = dotp;
+        if (dotp > epsilon)
+        {
+            sides[i] = SIDE_FRONT;
+        }
+        else if (dotp < -epsilon)
+        {
+            sides[i] = SIDE_BACK;
+        }
+        else
+        {
+            sides[i] = SIDE_ON;
+        }
+        counts[sides[i]]++;
+    }
+    sides[i] = sides[0];
+    dists[i] = dists[0];
+    
+    if (!counts[0] || !counts[1])
+    {
+        return in;
+    }
+
+    std::vector<Vertex> f;
+    for (i = 0; i < in.size(); i++)
+    {
+
+        if (sides[i] == SIDE_ON)
+        {
+            f.push_back(in[i]);
+            continue;
+        }
+
+        if (sides[i] == SIDE_BACK)
+        {
+            f.push_back(in[i]);
+        }
+
+        if (sides[i + 1] == SIDE_ON || sides[i + 1] == sides[i])
+            continue;
+
+        // generate a split point
+        const Vertex& v1 = in[i];
+        const Vertex& v2 = in[(i + 1) % in.size()];
+
+        float3	mid;
+        float dotp = dists[i] / (dists[i] - dists[i + 1]);
+
+        f.push_back(Vertex(v1.position + (v2.position - v1.position) * dotp, v1.texcoord + (v2.texcoord - v1.texcoord) * dotp, v1.normal));
+
+    }
+
+    return f;
 }
 
 AnimatedPolyhedron::AnimatedPolyhedron(float3 origin) : m_Velocity(1.0f, 0.0f, 0.0f), m_PlaneAngle(0.0), m_CurrentAngle(1.0), m_CurrentSide(0), m_CurrentEdge(0)
 {
     std::vector<Plane_t> planes;
-    m_ModelToWorld = Matrix::Translation(0, 0, 8);
+    m_Name = "polyhedron";
+    m_ModelToWorld = AffineTransform(Matrix::Translation(0, 0, 8));
     m_Velocity.normalize();
     
     planes.push_back({ float3( 0,  0, -1), 8 });
@@ -693,7 +517,7 @@ AnimatedPolyhedron::AnimatedPolyhedron(float3 origin) : m_Velocity(1.0f, 0.0f, 0
     unsigned int index = 0;
     for (unsigned int i = 0; i < planes.size(); ++i)
     {
-        std::vector<Vertex>	w = BaseWindingForPlane(planes[i].normal, planes[i].dist);
+        std::vector<Vertex>	w = BaseWindingForPlane(planes[i].normal, planes[i].dist);
 
         for (unsigned int j = 0; j < planes.size(); ++j)
         {
@@ -701,24 +525,23 @@ AnimatedPolyhedron::AnimatedPolyhedron(float3 origin) : m_Velocity(1.0f, 0.0f, 0
             w = ChopWindingInPlace(w, planes[j].normal, planes[j].dist, 0);
         }
         
-        for (unsigned int j = 2; j < w.size(); j++)
-        {
-            Vertex& v1 = w[0];
-            Vertex& v2 = w[j];
-            Vertex& v3 = w[j - 1];
-            ComputeTangentSpace(v1, v2, v3);
-
-            m_Vertices.push_back(v1);
-            m_Indices.push_back(index++);
-            m_Vertices.push_back(v2);
-            m_Indices.push_back(index++);
-            m_Vertices.push_back(v3);
-            m_Indices.push_back(index++);
+        for (unsigned int j = 2; j < w.size(); j++)
+        {
+            Vertex& v1 = w[0];
+            Vertex& v2 = w[j];
+            Vertex& v3 = w[j - 1];
+
+            m_Vertices.push_back(v1);
+            m_Indices.push_back(index++);
+            m_Vertices.push_back(v2);
+            m_Indices.push_back(index++);
+            m_Vertices.push_back(v3);
+            m_Indices.push_back(index++);
         }
         Side_t side;
         side.center = float3(0.0f);
-        for (unsigned int j = 0; j < w.size(); ++j)
-        {
+        for (unsigned int j = 0; j < w.size(); ++j)
+        {
             side.positions.push_back(w[j].position);
             side.center += w[j].position;
         }
@@ -727,15 +550,7 @@ AnimatedPolyhedron::AnimatedPolyhedron(float3 origin) : m_Velocity(1.0f, 0.0f, 0
         m_Sides.push_back(side);
     }
 
-    for (unsigned int i = 0; i < m_Vertices.size(); ++i)
-    {
-        float3& n = m_Vertices[i].normal;
-        const float3& t = m_Vertices[i].tangent_t;
-
-        m_Vertices[i].tangent_t = (t - n * dot(n, t)).normalize();
-        m_Vertices[i].tangent_s = cross(m_Vertices[i].tangent_t, m_Vertices[i].normal);
-
-    }
+    GenerateTangents(m_Vertices.data(), m_Vertices.size(), m_Indices.data(), m_Indices.size());
 
     for (unsigned int i = 0; i < m_Sides.size(); ++i)
     {
@@ -768,8 +583,10 @@ AnimatedPolyhedron::AnimatedPolyhedron(float3 origin) : m_Velocity(1.0f, 0.0f, 0
     MeshGroup_t meshGroup;
     meshGroup.startIndex = 0;
     meshGroup.indexCount = m_Indices.size();
+    meshGroup.baseVertex = 0;
     strcpy(meshGroup.materialName, "debug_checker");
     m_MeshGroups.push_back(meshGroup);
+    ComputeBounds();
     InitBuffers();
 
 }
@@ -780,18 +597,20 @@ void AnimatedPolyhedron::Draw(bool drawDepth)
     {
         if (m_PlaneAngle > 0.0f)
         {
-            m_ModelToWorld = Matrix::RotationAxisAroundPoint(v1 - v2, v1, -m_CurrentAngle + m_PlaneAngle) * m_ModelToWorld;
+            m_ModelToWorld = AffineTransform(Matrix::RotationAxisAroundPoint(v1 - v2, v1, -m_CurrentAngle + m_PlaneAngle)) * m_ModelToWorld;
         }
+        // The side's corners go to world space once for both scans
+        const Side_t& currentSide = m_Sides[m_CurrentSide];
+        m_WorldPositions.resize(currentSide.positions.size());
+        TransformPoints(m_ModelToWorld.ToMatrix(), currentSide.positions.data(), currentSide.positions.size(), m_WorldPositions.data());
+        float3 centerWorld = m_ModelToWorld * currentSide.center;
+
         float dot1 = -2.0f;
         unsigned int point1 = -1;
         float3 velocity = m_Velocity.normalize();
-        for (unsigned int i = 0; i < m_Sides[m_CurrentSide].positions.size(); ++i)
+        for (unsigned int i = 0; i < m_WorldPositions.size(); ++i)
         {
-            float3 point = m_Sides[m_CurrentSide].positions[i];
-            float3 pointWorld = m_ModelToWorld * point;
-            float3 center = m_Sides[m_CurrentSide].center;
-            float3 centerWorld = m_ModelToWorld * center;
-            float3 vec = (pointWorld - centerWorld).normalize();
+            float3 vec = (m_WorldPositions[i] - centerWorld).normalize();
             float dotp = dot(vec, velocity);
             if (dotp > dot1)
             {
@@ -802,14 +621,10 @@ void AnimatedPolyhedron::Draw(bool drawDepth)
 
         dot1 = -2.0f;
         unsigned int point2 = -1;
-        for (unsigned int i = 0; i < m_Sides[m_CurrentSide].positions.size(); ++i)
+        for (unsigned int i = 0; i < m_WorldPositions.size(); ++i)
         {
             if (i == point1) continue;
-            float3 point = m_Sides[m_CurrentSide].positions[i];
-            float3 pointWorld = m_ModelToWorld * point;
-            float3 center = m_Sides[m_CurrentSide].center;
-            float3 centerWorld = m_ModelToWorld * center;
-            float3 vec = (pointWorld - centerWorld).normalize();
+            float3 vec = (m_WorldPositions[i] - centerWorld).normalize();
             float dotp = dot(vec, velocity);
             if (dotp > dot1)
             {
@@ -834,7 +649,7 @@ void AnimatedPolyhedron::Draw(bool drawDepth)
 
     float deltaAngle = MATH_PI / 4.0 * render->GetDeltaTime();
     m_CurrentAngle += deltaAngle;
-    m_ModelToWorld = Matrix::RotationAxisAroundPoint(v1 - v2, v1, deltaAngle) * m_ModelToWorld;
+    m_ModelToWorld = AffineTransform(Matrix::RotationAxisAroundPoint(v1 - v2, v1, deltaAngle)) * m_ModelToWorld;
         
     Mesh::Draw(drawDepth);
 
@@ -4,44 +4,88 @@
 #include "render.hpp"
 #include "utils.hpp"
 #include "mathlib.hpp"
+#include "meshdata.hpp"
 #include <d3d11.h>
+#include <string>
 #include <vector>
 
 class Material;
 
-struct MeshGroup_t
+struct GeometryMemory_t
 {
-    unsigned int startIndex;
-    unsigned int indexCount;
-    char materialName[56]; // Align to 64 bytes
+    size_t cpuBytes;
+    size_t gpuBytes;
 
 };
 
-class Mesh
+class Mesh : public MeshData
 {
 public:
-    Mesh() {}
-    Mesh(const char* filename, const char* mtldir = nullptr, const Matrix& modelToWorld = Matrix::Identity(), bool castShadow = true);
+    Mesh() : m_Residency(GEOMETRY_RESIDENCY_DROP), m_CurrentLod(0), m_DrawCalls(0), m_IndexCount(0), m_IndexFormat(DXGI_FORMAT_R32_UINT), m_VertexBufferBytes(0), m_IndexBufferBytes(0), m_HasBaseVertices(false) {}
+    Mesh(const char* filename, const char* mtldir = nullptr, const Matrix& modelToWorld = Matrix::Identity(), bool castShadow = true, const MeshImportOptions_t& options = MeshImportOptions_t());
     Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices);
-    const void SetTransform(const Matrix& transform) { m_ModelToWorld = transform; }
-    const Matrix& GetModelToWorld() const { return m_ModelToWorld; }
+    // Affine transforms only, the last row is dropped
+    const void SetTransform(const Matrix& transform) { m_ModelToWorld = AffineTransform(transform); }
+    const AffineTransform& GetModelToWorld() const { return m_ModelToWorld; }
+    const std::string& GetName() const { return m_Name; }
+
+    // Drops the copies the new policy doesn't keep. Dropped copies don't come back.
+    void SetResidency(GeometryResidency_t residency);
+    GeometryResidency_t GetResidency() const { return m_Residency; }
+    // Filled under GEOMETRY_RESIDENCY_KEEP
+    const std::vector<Vertex>& GetVertices() const { return m_Vertices; }
+    // Filled under GEOMETRY_RESIDENCY_POSITIONS
+    const std::vector<float3>& GetPositions() const { return m_Positions; }
+    // Filled unless the geometry is dropped. Relative to the base vertex of their mesh group.
+    const std::vector<unsigned int>& GetIndices() const { return m_Indices; }
+    const std::vector<MeshGroup_t>& GetMeshGroups() const { return m_MeshGroups; }
+    // Heap memory held by the mesh and the size of its GPU buffers
+    virtual GeometryMemory_t GetMemoryUsage() const;
+
+    // Level drawn from now on, clamped to the coarsest one
+    void SetLod(size_t lod) { m_CurrentLod = lod < m_Lods.size() ? lod : m_Lods.size() - 1; }
+
+    MeshBounds_t GetWorldBounds() const { return TransformBounds(m_Bounds, m_ModelToWorld); }
+    MeshBounds_t GetWorldGroupBounds(size_t group) const { return TransformBounds(m_GroupBounds[group], m_ModelToWorld); }
 
     virtual void Draw(bool drawDepth = false);
+    // DrawIndexed calls issued by the last Draw
+    unsigned int GetDrawCallCount() const { return m_DrawCalls; }
 
 protected:
+    static void CreateBuffer(const void* data, size_t size, UINT bindFlags, ScopedObject<ID3D11Buffer>& buffer);
+    // Uploads m_Vertices in m_VertexFormat and m_Indices, then applies m_Residency
     void InitBuffers();
-    void LoadFromObj(const char* filename);
-    void LoadFromDat(const char* filename);
-    void SaveToDat(const char* filename) const;
+    // Frees what m_Residency doesn't keep of m_Vertices and m_Indices
+    void ApplyResidency();
+    // Fills the copies m_Residency keeps from geometry in a GPU layout
+    void KeepGeometry(const void* vertices, size_t vertexCount, VertexFormat_t vertexFormat, const void* indices, size_t indexCount, size_t indexSize);
+    void InitVertexBuffer(const void* vertices, size_t vertexCount, VertexFormat_t vertexFormat);
+    // Narrows the indices to 16 bits when they fit
+    void InitIndexBuffer(const unsigned int* indices, size_t indexCount);
+    void InitIndexBuffer(const void* indices, size_t indexCount, size_t indexSize);
+    virtual void LoadGeometry(const void* vertices, size_t vertexCount, VertexFormat_t vertexFormat, const void* indices, size_t indexCount, size_t indexSize);
+    void LoadFromCache(const char* filename, const MeshImportOptions_t& options);
+    // Fills m_DrawRanges with what is left of a mesh group after culling, returns false if nothing is
+    bool CullMeshGroup(unsigned int group, const MeshletCuller& culler, bool cullBackfaces);
 
     ScopedObject<ID3D11Buffer> m_VertexBuffer;
     ScopedObject<ID3D11Buffer> m_IndexBuffer;
 
-    std::vector<Vertex> m_Vertices;
-    std::vector<unsigned int> m_Indices;
-    std::vector<MeshGroup_t> m_MeshGroups;
-
-    Matrix m_ModelToWorld;
+    std::string m_Name;
+    GeometryResidency_t m_Residency;
+    std::vector<float3> m_Positions;
+    size_t m_CurrentLod;
+    std::vector<DrawRange_t> m_DrawRanges;
+    unsigned int m_DrawCalls;
+    unsigned int m_IndexCount;
+    DXGI_FORMAT m_IndexFormat;
+    size_t m_VertexBufferBytes;
+    size_t m_IndexBufferBytes;
+    // Groups draw with their own base vertex, so the depth pass can't draw the mesh in one call
+    bool m_HasBaseVertices;
+
+    AffineTransform m_ModelToWorld;
 
     bool m_CastShadow;
     
@@ -78,6 +122,8 @@ public:
 private:
     std::vector<unsigned int> m_Edges;
     std::vector<Side_t> m_Sides;
+    // Corners of the current side in world space, scratch for Draw
+    std::vector<float3> m_WorldPositions;
     float3 m_Velocity;
     double m_PlaneAngle;
     double m_CurrentAngle;
@@ -0,0 +1,436 @@
+#include "meshcodec.hpp"
+#include "jobsystem.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <emmintrin.h>
+
+static_assert(sizeof(PackedVertexV9_t) == 24, "PackedVertexV9_t must stay 24 bytes");
+static_assert(sizeof(Vertex) == 56, "DecodeVerticesV9 writes the Vertex layout directly");
+
+// Vertices decoded per job
+static const size_t DECODE_BLOCK_SIZE = 16384;
+static const size_t INDEX_BLOCK_SIZE = 16;
+
+static unsigned int FloatBits(float value)
+{
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float BitsToFloat(unsigned int bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+unsigned short FloatToHalf(float value)
+{
+    const unsigned int infinity = 255 << 23;
+    const unsigned int halfOverflow = (127 + 16) << 23;
+    const unsigned int denormalMagic = ((127 - 15) + (23 - 10) + 1) << 23;
+
+    unsigned int bits = FloatBits(value);
+    unsigned int sign = bits & 0x80000000;
+    bits ^= sign;
+
+    unsigned int half;
+    if (bits >= halfOverflow)
+    {
+        half = bits > infinity ? 0x7E00 : 0x7C00;
+    }
+    else if (bits < (113 << 23))
+    {
+        // Let the FPU round the denormal by adding it to a float with the right exponent
+        half = FloatBits(BitsToFloat(bits) + BitsToFloat(denormalMagic)) - denormalMagic;
+    }
+    else
+    {
+        unsigned int mantissaOdd = (bits >> 13) & 1;
+        // Rebias the exponent from 127 to 15
+        bits -= 112u << 23;
+        bits += 0xFFF + mantissaOdd;
+        half = bits >> 13;
+    }
+
+    return (unsigned short)(half | (sign >> 16));
+}
+
+short FloatToSnorm16(float value)
+{
+    value = std::max(-1.0f, std::min(1.0f, value)) * 32767.0f;
+    return (short)(value < 0.0f ? value - 0.5f : value + 0.5f);
+}
+
+size_t GetPackedVertexStride(VertexFormat_t format)
+{
+    return PACKED_POSITION_SIZE + GetVertexFormatDesc(format).stride - sizeof(float3);
+}
+
+void EncodeVertices(const Vertex* vertices, size_t count, VertexFormat_t format, PackedMeshInfo_t& info, std::vector<unsigned char>& packed)
+{
+    float3 boundsMin(count ? vertices[0].position : float3(0.0f));
+    float3 boundsMax(boundsMin);
+    for (size_t i = 1; i < count; ++i)
+    {
+        for (size_t axis = 0; axis < 3; ++axis)
+        {
+            boundsMin[axis] = std::min(boundsMin[axis], vertices[i].position[axis]);
+            boundsMax[axis] = std::max(boundsMax[axis], vertices[i].position[axis]);
+        }
+    }
+
+    float3 invScale;
+    for (size_t axis = 0; axis < 3; ++axis)
+    {
+        float extent = boundsMax[axis] - boundsMin[axis];
+        info.positionScale[axis] = extent / 65535.0f;
+        invScale[axis] = extent > 0.0f ? 65535.0f / extent : 0.0f;
+    }
+    info.positionMin = boundsMin;
+    info.vertexCount = (unsigned int)count;
+
+    // Every format starts with the position, the rest is kept as converted
+    std::vector<unsigned char> converted;
+    ConvertVertices(vertices, count, format, converted);
+    size_t stride = GetVertexFormatDesc(format).stride;
+    size_t packedStride = GetPackedVertexStride(format);
+    packed.resize(count * packedStride);
+    for (size_t i = 0; i < count; ++i)
+    {
+        unsigned short position[3];
+        for (size_t axis = 0; axis < 3; ++axis)
+        {
+            float quantized = (vertices[i].position[axis] - boundsMin[axis]) * invScale[axis];
+            position[axis] = (unsigned short)(std::max(0.0f, std::min(65535.0f, quantized)) + 0.5f);
+        }
+        memcpy(&packed[i * packedStride], position, PACKED_POSITION_SIZE);
+        memcpy(&packed[i * packedStride + PACKED_POSITION_SIZE], &converted[i * stride + sizeof(float3)], stride - sizeof(float3));
+    }
+
+}
+
+static __m128i LoadUint32(const void* data)
+{
+    int value;
+    memcpy(&value, data, sizeof(value));
+    return _mm_cvtsi32_si128(value);
+}
+
+// Four halves in the low 16 bits of each lane
+static __m128 HalfToFloat4(__m128i half)
+{
+    const __m128i expMantissaMask = _mm_set1_epi32(0x7FFF);
+    const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));
+    const __m128i lastFinite = _mm_set1_epi32(0x7BFF);
+    const __m128i infNanExponent = _mm_set1_epi32(255 << 23);
+
+    __m128i expMantissa = _mm_and_si128(half, expMantissaMask);
+    __m128i sign = _mm_slli_epi32(_mm_xor_si128(half, expMantissa), 16);
+    // Rebias by multiplying, which also normalizes denormals
+    __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expMantissa, 13)), magic);
+    __m128i infNan = _mm_and_si128(_mm_cmpgt_epi32(expMantissa, lastFinite), infNanExponent);
+
+    return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, infNan)));
+}
+
+float HalfToFloat(unsigned short half)
+{
+    return _mm_cvtss_f32(HalfToFloat4(_mm_cvtsi32_si128(half)));
+}
+
+float Snorm16ToFloat(short value)
+{
+    // -32768 and -32767 both mean -1
+    return std::max(-1.0f, value / 32767.0f);
+}
+
+// Every format has at least 2 bytes after the position, the loads and stores below spill into them
+template <size_t RestSize>
+static void DecodeVertexRange(const unsigned char* packed, size_t begin, size_t end, const PackedMeshInfo_t& info, unsigned char* vertices)
+{
+    static_assert(RestSize >= sizeof(float), "The position store spills 4 bytes into the rest of the vertex");
+    const size_t packedStride = PACKED_POSITION_SIZE + RestSize;
+    const size_t stride = sizeof(float3) + RestSize;
+    const __m128i zero = _mm_setzero_si128();
+    // Zero in w, which drops the bytes of the rest read along with the position
+    const __m128 positionMin = _mm_setr_ps(info.positionMin.x, info.positionMin.y, info.positionMin.z, 0.0f);
+    const __m128 positionScale = _mm_setr_ps(info.positionScale.x, info.positionScale.y, info.positionScale.z, 0.0f);
+
+    for (size_t i = begin; i < end; ++i)
+    {
+        const unsigned char* in = packed + i * packedStride;
+        unsigned char* out = vertices + i * stride;
+        __m128i position = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)in), zero);
+        _mm_storeu_ps((float*)out, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(position), positionScale), positionMin));
+        memcpy(out + sizeof(float3), in + PACKED_POSITION_SIZE, RestSize);
+    }
+
+}
+
+void DecodeVertices(const unsigned char* packed, size_t count, VertexFormat_t format, const PackedMeshInfo_t& info, void* vertices)
+{
+    unsigned int blockCount = (unsigned int)((count + DECODE_BLOCK_SIZE - 1) / DECODE_BLOCK_SIZE);
+    jobs->ParallelFor(blockCount, [&](unsigned int block)
+    {
+        size_t begin = block * DECODE_BLOCK_SIZE;
+        size_t end = std::min(begin + DECODE_BLOCK_SIZE, count);
+        switch (format)
+        {
+        case VERTEX_FORMAT_COMPACT:
+            DecodeVertexRange<sizeof(CompactVertex_t) - sizeof(float3)>(packed, begin, end, info, (unsigned char*)vertices);
+            break;
+        case VERTEX_FORMAT_QTANGENT:
+            DecodeVertexRange<sizeof(QTangentVertex_t) - sizeof(float3)>(packed, begin, end, info, (unsigned char*)vertices);
+            break;
+        default:
+            DecodeVertexRange<sizeof(Vertex) - sizeof(float3)>(packed, begin, end, info, (unsigned char*)vertices);
+            break;
+        }
+    });
+
+}
+
+static void DecodeVertexRangeV9(const PackedVertexV9_t* packed, size_t begin, size_t end, const PackedMeshInfoV9_t& info, Vertex* vertices)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 positionMin = _mm_setr_ps(info.positionMin.x, info.positionMin.y, info.positionMin.z, 0.0f);
+    const __m128 positionScale = _mm_setr_ps(info.positionScale.x, info.positionScale.y, info.positionScale.z, 0.0f);
+    const __m128 snormScale = _mm_set1_ps(1.0f / 32767.0f);
+    const __m128 minusOne = _mm_set1_ps(-1.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+
+    for (size_t i = begin; i < end; ++i)
+    {
+        const PackedVertexV9_t& in = packed[i];
+        float* out = (float*)&vertices[i];
+
+        // Stores run front to back, each one may spill into the next field before it is written
+        __m128i position = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)in.position), zero);
+        _mm_storeu_ps(out, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(position), positionScale), positionMin));
+
+        __m128 texcoord = HalfToFloat4(_mm_unpacklo_epi16(LoadUint32(in.texcoord), zero));
+        _mm_storel_pi((__m64*)(out + 3), texcoord);
+
+        // Lanes hold normal, tangent_s, tangent_t and an unused fourth vector
+        __m128i octahedral = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)in.normal), LoadUint32(in.tangent_t));
+        __m128 x = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(octahedral, 16), 16));
+        __m128 y = _mm_cvtepi32_ps(_mm_srai_epi32(octahedral, 16));
+        x = _mm_max_ps(_mm_mul_ps(x, snormScale), minusOne);
+        y = _mm_max_ps(_mm_mul_ps(y, snormScale), minusOne);
+
+        __m128 z = _mm_sub_ps(_mm_sub_ps(one, _mm_andnot_ps(signMask, x)), _mm_andnot_ps(signMask, y));
+        __m128 fold = _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), z), _mm_setzero_ps());
+        x = _mm_sub_ps(x, _mm_or_ps(fold, _mm_and_ps(x, signMask)));
+        y = _mm_sub_ps(y, _mm_or_ps(fold, _mm_and_ps(y, signMask)));
+
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+        __m128 invLength = _mm_div_ps(one, length);
+        x = _mm_mul_ps(x, invLength);
+        y = _mm_mul_ps(y, invLength);
+        z = _mm_mul_ps(z, invLength);
+        __m128 w = _mm_setzero_ps();
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+
+        _mm_storeu_ps(out + 5, x);
+        _mm_storeu_ps(out + 8, y);
+        _mm_storel_pi((__m64*)(out + 11), z);
+        _mm_store_ss(out + 13, _mm_movehl_ps(z, z));
+    }
+
+}
+
+void DecodeVerticesV9(const PackedVertexV9_t* packed, size_t count, const PackedMeshInfoV9_t& info, Vertex* vertices)
+{
+    unsigned int blockCount = (unsigned int)((count + DECODE_BLOCK_SIZE - 1) / DECODE_BLOCK_SIZE);
+    jobs->ParallelFor(blockCount, [&](unsigned int block)
+    {
+        size_t begin = block * DECODE_BLOCK_SIZE;
+        DecodeVertexRangeV9(packed, begin, std::min(begin + DECODE_BLOCK_SIZE, count), info, vertices);
+    });
+
+}
+
+void EncodeIndices(const unsigned int* indices, size_t count, size_t indexSize, std::vector<unsigned char>& encoded)
+{
+    encoded.clear();
+    unsigned int previous = 0;
+    for (size_t start = 0; start < count; start += INDEX_BLOCK_SIZE)
+    {
+        unsigned int deltas[INDEX_BLOCK_SIZE];
+        unsigned int largest = 0;
+        for (size_t i = 0; i < INDEX_BLOCK_SIZE; ++i)
+        {
+            // The tail of the last block repeats the previous index
+            unsigned int index = start + i < count ? indices[start + i] : previous;
+            unsigned int delta = index - previous;
+            if (indexSize == sizeof(unsigned short))
+            {
+                unsigned short delta16 = (unsigned short)delta;
+                deltas[i] = (unsigned short)((delta16 << 1) ^ (unsigned short)((short)delta16 >> 15));
+            }
+            else
+            {
+                deltas[i] = (delta << 1) ^ (unsigned int)((int)delta >> 31);
+            }
+            largest = std::max(largest, deltas[i]);
+            previous = index;
+        }
+
+        unsigned char width = largest < 0x100 ? 1 : largest < 0x10000 ? 2 : 4;
+        encoded.push_back(width);
+        for (size_t i = 0; i < INDEX_BLOCK_SIZE; ++i)
+        {
+            for (size_t byte = 0; byte < width; ++byte)
+            {
+                encoded.push_back((unsigned char)(deltas[i] >> (byte * 8)));
+            }
+        }
+    }
+
+}
+
+// Checks the width byte of the block at current and that the block is all there
+static size_t ReadIndexBlockWidth(const unsigned char*& current, const unsigned char* end, size_t maxWidth)
+{
+    if (current == end)
+    {
+        THROW_RUNTIME("Index stream is truncated")
+    }
+    size_t width = *current++;
+    if ((width != 1 && width != 2 && width != 4) || width > maxWidth)
+    {
+        THROW_RUNTIME("Index stream is corrupted")
+    }
+    if ((size_t)(end - current) < width * INDEX_BLOCK_SIZE)
+    {
+        THROW_RUNTIME("Index stream is truncated")
+    }
+    return width;
+}
+
+// Same as the 32-bit decoder, in 16-bit lanes, eight of them per register
+static void DecodeIndices16(const unsigned char* encoded, size_t size, size_t count, unsigned short* indices)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+
+    const unsigned char* current = encoded;
+    const unsigned char* end = encoded + size;
+    __m128i previous = zero;
+    for (size_t start = 0; start < count; start += INDEX_BLOCK_SIZE)
+    {
+        size_t width = ReadIndexBlockWidth(current, end, sizeof(unsigned short));
+        __m128i deltas[2];
+        if (width == 1)
+        {
+            __m128i bytes = _mm_loadu_si128((const __m128i*)current);
+            deltas[0] = _mm_unpacklo_epi8(bytes, zero);
+            deltas[1] = _mm_unpackhi_epi8(bytes, zero);
+        }
+        else
+        {
+            deltas[0] = _mm_loadu_si128((const __m128i*)current);
+            deltas[1] = _mm_loadu_si128((const __m128i*)current + 1);
+        }
+        current += width * INDEX_BLOCK_SIZE;
+
+        unsigned short block[INDEX_BLOCK_SIZE];
+        bool isFull = start + INDEX_BLOCK_SIZE <= count;
+        unsigned short* out = isFull ? indices + start : block;
+        for (size_t i = 0; i < 2; ++i)
+        {
+            __m128i delta = _mm_xor_si128(_mm_srli_epi16(deltas[i], 1), _mm_sub_epi16(zero, _mm_and_si128(deltas[i], one)));
+            delta = _mm_add_epi16(delta, _mm_slli_si128(delta, 2));
+            delta = _mm_add_epi16(delta, _mm_slli_si128(delta, 4));
+            delta = _mm_add_epi16(delta, _mm_slli_si128(delta, 8));
+            delta = _mm_add_epi16(delta, previous);
+            previous = _mm_shufflehi_epi16(delta, _MM_SHUFFLE(3, 3, 3, 3));
+            previous = _mm_unpackhi_epi64(previous, previous);
+            _mm_storeu_si128((__m128i*)(out + i * 8), delta);
+        }
+
+        if (!isFull)
+        {
+            memcpy(indices + start, block, (count - start) * sizeof(unsigned short));
+        }
+    }
+
+}
+
+static void DecodeIndices32(const unsigned char* encoded, size_t size, size_t count, unsigned int* indices)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi32(1);
+
+    const unsigned char* current = encoded;
+    const unsigned char* end = encoded + size;
+    __m128i previous = zero;
+    for (size_t start = 0; start < count; start += INDEX_BLOCK_SIZE)
+    {
+        size_t width = ReadIndexBlockWidth(current, end, sizeof(unsigned int));
+        __m128i deltas[4];
+        if (width == 1)
+        {
+            __m128i bytes = _mm_loadu_si128((const __m128i*)current);
+            __m128i low = _mm_unpacklo_epi8(bytes, zero);
+            __m128i high = _mm_unpackhi_epi8(bytes, zero);
+            deltas[0] = _mm_unpacklo_epi16(low, zero);
+            deltas[1] = _mm_unpackhi_epi16(low, zero);
+            deltas[2] = _mm_unpacklo_epi16(high, zero);
+            deltas[3] = _mm_unpackhi_epi16(high, zero);
+        }
+        else if (width == 2)
+        {
+            __m128i low = _mm_loadu_si128((const __m128i*)current);
+            __m128i high = _mm_loadu_si128((const __m128i*)current + 1);
+            deltas[0] = _mm_unpacklo_epi16(low, zero);
+            deltas[1] = _mm_unpackhi_epi16(low, zero);
+            deltas[2] = _mm_unpacklo_epi16(high, zero);
+            deltas[3] = _mm_unpackhi_epi16(high, zero);
+        }
+        else
+        {
+            for (size_t i = 0; i < 4; ++i)
+            {
+                deltas[i] = _mm_loadu_si128((const __m128i*)current + i);
+            }
+        }
+        current += width * INDEX_BLOCK_SIZE;
+
+        unsigned int block[INDEX_BLOCK_SIZE];
+        bool isFull = start + INDEX_BLOCK_SIZE <= count;
+        unsigned int* out = isFull ? indices + start : block;
+        for (size_t i = 0; i < 4; ++i)
+        {
+            // Undo the zigzag, then a running sum across the lanes seeded with the last index
+            __m128i delta = _mm_xor_si128(_mm_srli_epi32(deltas[i], 1), _mm_sub_epi32(zero, _mm_and_si128(deltas[i], one)));
+            delta = _mm_add_epi32(delta, _mm_slli_si128(delta, 4));
+            delta = _mm_add_epi32(delta, _mm_slli_si128(delta, 8));
+            delta = _mm_add_epi32(delta, previous);
+            previous = _mm_shuffle_epi32(delta, _MM_SHUFFLE(3, 3, 3, 3));
+            _mm_storeu_si128((__m128i*)(out + i * 4), delta);
+        }
+
+        if (!isFull)
+        {
+            memcpy(indices + start, block, (count - start) * sizeof(unsigned int));
+        }
+    }
+
+}
+
+void DecodeIndices(const unsigned char* encoded, size_t size, size_t count, size_t indexSize, void* indices)
+{
+    if (indexSize == sizeof(unsigned short))
+    {
+        DecodeIndices16(encoded, size, count, (unsigned short*)indices);
+    }
+    else
+    {
+        DecodeIndices32(encoded, size, count, (unsigned int*)indices);
+    }
+
+}
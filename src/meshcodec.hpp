@@ -0,0 +1,68 @@
+#ifndef MESHCODEC_HPP
+#define MESHCODEC_HPP
+
+#include "mathlib.hpp"
+#include "vertexformat.hpp"
+#include <vector>
+
+// Compressed vertex: the position as 16-bit unorm per axis inside the mesh
+// bounds, then the vertex in its stored format, less the float3 position.
+// Decodes straight into that format, 18 bytes for the 24 of QTANGENT.
+static const size_t PACKED_POSITION_SIZE = 3 * sizeof(unsigned short);
+
+// Everything the decoder needs besides the vertex and index streams
+struct PackedMeshInfo_t
+{
+    float3 positionMin;
+    float3 positionScale;
+    unsigned int vertexCount;
+    unsigned int indexCount;
+    // Of the decoded indices, 2 when every index fits in 16 bits
+    unsigned int indexSize;
+};
+
+// Compressed vertex of .dat versions 2 to 9, 24 bytes instead of 56
+//   position   16-bit unorm per axis inside the mesh bounds, w unused
+//   texcoord   half floats
+//   normal and tangents   octahedral, 16-bit snorm
+struct PackedVertexV9_t
+{
+    unsigned short position[4];
+    unsigned short texcoord[2];
+    short normal[2];
+    short tangent_s[2];
+    short tangent_t[2];
+};
+
+// PackedMeshInfo_t of .dat versions 2 to 9, indices always decode to 32 bits
+struct PackedMeshInfoV9_t
+{
+    float3 positionMin;
+    float3 positionScale;
+    unsigned int vertexCount;
+    unsigned int indexCount;
+};
+
+// Round to nearest even, overflow goes to infinity
+unsigned short FloatToHalf(float value);
+// Clamps to [-1, 1], rounds to nearest
+short FloatToSnorm16(float value);
+float HalfToFloat(unsigned short half);
+float Snorm16ToFloat(short value);
+
+size_t GetPackedVertexStride(VertexFormat_t format);
+// Fills the position fields and vertexCount of info
+void EncodeVertices(const Vertex* vertices, size_t count, VertexFormat_t format, PackedMeshInfo_t& info, std::vector<unsigned char>& packed);
+// Writes count vertices of the format, as ConvertVertices would with the quantized positions
+void DecodeVertices(const unsigned char* packed, size_t count, VertexFormat_t format, const PackedMeshInfo_t& info, void* vertices);
+void DecodeVerticesV9(const PackedVertexV9_t* packed, size_t count, const PackedMeshInfoV9_t& info, Vertex* vertices);
+
+// Indices are stored as zigzag deltas from the previous index, in blocks of 16
+// with one width byte in front of each block. 32-bit indices take 1, 2 or 4
+// bytes per delta. 16-bit ones wrap their deltas around at 16 bits, 1 or 2 bytes
+// each, so the stream is never more than 1/32 larger than the plain indices.
+// Decode throws if the stream is shorter than count indices need.
+void EncodeIndices(const unsigned int* indices, size_t count, size_t indexSize, std::vector<unsigned char>& encoded);
+void DecodeIndices(const unsigned char* encoded, size_t size, size_t count, size_t indexSize, void* indices);
+
+#endif // MESHCODEC_HPP
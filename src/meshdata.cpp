@@ -0,0 +1,751 @@
+#include "meshdata.hpp"
+#include "objreader.hpp"
+#include "datfile.hpp"
+#include "meshcodec.hpp"
+#include "assetcache.hpp"
+#include "tangents.hpp"
+#include "vertexcache.hpp"
+#include "overdraw.hpp"
+#include "simplify.hpp"
+#include "weld.hpp"
+#include "jobsystem.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <memory>
+#include <string>
+
+size_t GetIndexSize(const unsigned int* indices, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (indices[i] > 0xFFFF)
+        {
+            return sizeof(unsigned int);
+        }
+    }
+    return sizeof(unsigned short);
+}
+
+std::vector<unsigned short> NarrowIndices(const unsigned int* indices, size_t count)
+{
+    return std::vector<unsigned short>(indices, indices + count);
+}
+
+// Every material gets one group, holding its triangles in file order. Groups
+// are sorted by material name, so materials sharing a prefix such as their
+// directory sit next to each other, whatever order the file used them in.
+static void MergeMaterialGroups(std::vector<unsigned int>& indices, std::vector<MeshGroup_t>& groups)
+{
+    std::vector<unsigned int> order(groups.size());
+    for (unsigned int i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b)
+    {
+        return strncmp(groups[a].materialName, groups[b].materialName, sizeof(groups[a].materialName)) < 0;
+    });
+
+    std::vector<unsigned int> mergedIndices;
+    std::vector<MeshGroup_t> mergedGroups;
+    mergedIndices.reserve(indices.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        const MeshGroup_t& group = groups[order[i]];
+        if (mergedGroups.empty() || strncmp(mergedGroups.back().materialName, group.materialName, sizeof(group.materialName)) != 0)
+        {
+            MeshGroup_t merged = group;
+            merged.startIndex = (unsigned int)mergedIndices.size();
+            merged.indexCount = 0;
+            mergedGroups.push_back(merged);
+        }
+        mergedIndices.insert(mergedIndices.end(), indices.begin() + group.startIndex, indices.begin() + group.startIndex + group.indexCount);
+        mergedGroups.back().indexCount += group.indexCount;
+    }
+
+    indices.swap(mergedIndices);
+    groups.swap(mergedGroups);
+}
+
+// Meshes with more vertices than 16-bit indices can address still get them
+// when each group only spans 64K vertices. Indices become relative to the
+// first vertex of their group.
+static void RebaseMeshGroups(std::vector<unsigned int>& indices, std::vector<MeshGroup_t>& groups, size_t vertexCount)
+{
+    if (vertexCount <= 0x10000)
+    {
+        return;
+    }
+
+    std::vector<unsigned int> baseVertices(groups.size());
+    for (size_t i = 0; i < groups.size(); ++i)
+    {
+        baseVertices[i] = 0;
+        if (groups[i].indexCount == 0)
+        {
+            continue;
+        }
+
+        const unsigned int* groupIndices = &indices[groups[i].startIndex];
+        unsigned int minIndex = *std::min_element(groupIndices, groupIndices + groups[i].indexCount);
+        unsigned int maxIndex = *std::max_element(groupIndices, groupIndices + groups[i].indexCount);
+        if (maxIndex - minIndex > 0xFFFF)
+        {
+            return;
+        }
+        baseVertices[i] = minIndex;
+    }
+
+    for (size_t i = 0; i < groups.size(); ++i)
+    {
+        groups[i].baseVertex = baseVertices[i];
+        for (unsigned int j = 0; j < groups[i].indexCount; ++j)
+        {
+            indices[groups[i].startIndex + j] -= baseVertices[i];
+        }
+    }
+
+}
+
+// Largest extent of the bounding box, what the relative import tolerances scale with
+static float GetMeshSize(const Vertex* vertices, size_t vertexCount)
+{
+    float3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        for (size_t axis = 0; axis < 3; ++axis)
+        {
+            boundsMin[axis] = std::min<float>(boundsMin[axis], vertices[i].position[axis]);
+            boundsMax[axis] = std::max<float>(boundsMax[axis], vertices[i].position[axis]);
+        }
+    }
+    return vertexCount ? std::max<float>(boundsMax.x - boundsMin.x, std::max<float>(boundsMax.y - boundsMin.y, boundsMax.z - boundsMin.z)) : 0.0f;
+}
+
+// Box of the given vertices, or of those the indices use, and the sphere around its center
+static MeshBounds_t GetVertexBounds(const Vertex* vertices, const unsigned int* indices, size_t count, unsigned int baseVertex)
+{
+    MeshBounds_t bounds;
+    bounds.mins = float3(FLT_MAX);
+    bounds.maxs = float3(-FLT_MAX);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const float3& position = vertices[indices ? indices[i] + baseVertex : i].position;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            bounds.mins[axis] = std::min<float>(bounds.mins[axis], position[axis]);
+            bounds.maxs[axis] = std::max<float>(bounds.maxs[axis], position[axis]);
+        }
+    }
+    if (count == 0)
+    {
+        bounds.mins = bounds.maxs = float3(0.0f);
+    }
+
+    bounds.center = (bounds.mins + bounds.maxs) * 0.5f;
+    float radiusSq = 0.0f;
+    for (size_t i = 0; i < count; ++i)
+    {
+        float3 offset = vertices[indices ? indices[i] + baseVertex : i].position - bounds.center;
+        radiusSq = std::max<float>(radiusSq, dot(offset, offset));
+    }
+    bounds.radius = std::sqrt(radiusSq);
+    return bounds;
+}
+
+MeshBounds_t TransformBounds(const MeshBounds_t& bounds, const AffineTransform& transform)
+{
+    // Transforms take column vectors, the box extent goes through their absolute values
+    float3 center = transform * ((bounds.mins + bounds.maxs) * 0.5f);
+    float3 extent = (bounds.maxs - bounds.mins) * 0.5f;
+    float3 worldExtent;
+    for (int row = 0; row < 3; ++row)
+    {
+        worldExtent[row] = std::fabs(transform.m[row][0]) * extent.x + std::fabs(transform.m[row][1]) * extent.y + std::fabs(transform.m[row][2]) * extent.z;
+    }
+
+    MeshBounds_t result;
+    result.mins = center - worldExtent;
+    result.maxs = center + worldExtent;
+    result.center = transform * bounds.center;
+    result.radius = bounds.radius * GetMaxScale(transform);
+    return result;
+}
+
+void SetMaterialName(MeshGroup_t& group, const char* mtldir, const char* name, size_t nameLength)
+{
+    std::string materialName = mtldir ? std::string(mtldir) + "/" : std::string();
+    materialName.append(name, nameLength);
+    if (materialName.size() >= sizeof(group.materialName))
+    {
+        THROW_RUNTIME("Material name " << materialName << " is longer than " << sizeof(group.materialName) - 1 << " characters")
+    }
+    memset(group.materialName, 0, sizeof(group.materialName));
+    memcpy(group.materialName, materialName.data(), materialName.size());
+}
+
+float GetMaxScale(const AffineTransform& transform)
+{
+    float scale = 0.0f;
+    for (int column = 0; column < 3; ++column)
+    {
+        float3 axis(transform.m[0][column], transform.m[1][column], transform.m[2][column]);
+        scale = std::max<float>(scale, axis.length());
+    }
+    return scale;
+}
+
+// Part of the cache key of baked meshes. Bump when LoadFromObj output or the .dat layout changes.
+static const unsigned int MESH_IMPORTER_VERSION = 14;
+
+void MeshData::LoadFromObj(const char* filename, const MeshImportOptions_t& options)
+{
+    ObjData_t obj;
+    ReadObjFile(filename, obj);
+
+    MeshGroup_t meshGroup;
+    meshGroup.startIndex = 0;
+    meshGroup.indexCount = 0;
+    meshGroup.baseVertex = 0;
+    strcpy(meshGroup.materialName, "debug_checker");
+
+    for (size_t i = 0; i < obj.materialSwitches.size(); ++i)
+    {
+        const ObjMaterialSwitch_t& materialSwitch = obj.materialSwitches[i];
+        meshGroup.indexCount = materialSwitch.startCorner - meshGroup.startIndex;
+        if (meshGroup.indexCount > 0)
+        {
+            m_MeshGroups.push_back(meshGroup);
+        }
+        SetMaterialName(meshGroup, nullptr, materialSwitch.materialName.c_str(), materialSwitch.materialName.size());
+        meshGroup.startIndex = materialSwitch.startCorner;
+    }
+    meshGroup.indexCount = obj.GetCornerCount() - meshGroup.startIndex;
+    m_MeshGroups.push_back(meshGroup);
+
+    // Re-index Mesh
+    size_t cornerCount = obj.GetCornerCount();
+    VertexDictionary indexDictionary(cornerCount / 3);
+    m_Indices.resize(cornerCount);
+    for (size_t i = 0; i < cornerCount; ++i)
+    {
+        const unsigned int* corner = &obj.corners[i * 3];
+        bool isNew;
+        m_Indices[i] = indexDictionary.FindOrInsert(corner[0], corner[1], corner[2], isNew);
+        if (isNew)
+        {
+            m_Vertices.push_back(Vertex(obj.positions[corner[0]], obj.texcoords[corner[1]], obj.normals[corner[2]]));
+        }
+    }
+
+    if (options.mergeMaterials)
+    {
+        size_t groupCount = m_MeshGroups.size();
+        MergeMaterialGroups(m_Indices, m_MeshGroups);
+        LOG_INFO(filename << ": " << groupCount << " -> " << m_MeshGroups.size() << " mesh groups")
+    }
+
+    if (options.weldVertices)
+    {
+        size_t vertexCount = m_Vertices.size();
+        size_t indexCount = m_Indices.size();
+        float epsilon = options.weldEpsilon * GetMeshSize(m_Vertices.data(), m_Vertices.size());
+        WeldVertices(m_Vertices, m_Indices.data(), m_Indices.size(), epsilon);
+
+        WeldStats_t stats = {};
+        unsigned int startIndex = 0;
+        for (size_t i = 0; i < m_MeshGroups.size(); ++i)
+        {
+            MeshGroup_t& meshGroup = m_MeshGroups[i];
+            size_t keptCount = RemoveDegenerateTriangles(&m_Indices[meshGroup.startIndex], meshGroup.indexCount, m_Vertices.data(), epsilon * epsilon, stats);
+            if (startIndex != meshGroup.startIndex)
+            {
+                std::copy(m_Indices.begin() + meshGroup.startIndex, m_Indices.begin() + meshGroup.startIndex + keptCount, m_Indices.begin() + startIndex);
+            }
+            meshGroup.startIndex = startIndex;
+            meshGroup.indexCount = (unsigned int)keptCount;
+            startIndex += meshGroup.indexCount;
+        }
+        m_Indices.resize(startIndex);
+        LOG_INFO(filename << ": welded " << vertexCount << " -> " << m_Vertices.size() << " vertices, " << indexCount / 3 << " -> " << m_Indices.size() / 3
+            << " triangles (" << stats.degenerateTriangles << " degenerate, " << stats.duplicateTriangles << " duplicate)")
+    }
+
+    GenerateTangents(m_Vertices.data(), m_Vertices.size(), m_Indices.data(), m_Indices.size());
+    GenerateLods(filename, options);
+
+    if (options.optimizeVertexCache)
+    {
+        VertexCacheStats_t before = AnalyzeVertexCache(m_Indices.data(), m_Indices.size(), m_Vertices.size());
+        jobs->ParallelFor((unsigned int)m_MeshGroups.size(), [&](unsigned int i)
+        {
+            OptimizeVertexCache(&m_Indices[m_MeshGroups[i].startIndex], m_MeshGroups[i].indexCount);
+        });
+        VertexCacheStats_t after = AnalyzeVertexCache(m_Indices.data(), m_Indices.size(), m_Vertices.size());
+        LOG_INFO(filename << ": vertex cache ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr)
+    }
+
+    if (options.optimizeOverdraw)
+    {
+        // Level 0 only, the others would be drawn over it
+        float before = AnalyzeOverdraw(m_Vertices.data(), m_Indices.data(), m_Lods[0].indexCount);
+        jobs->ParallelFor((unsigned int)m_MeshGroups.size(), [&](unsigned int i)
+        {
+            OptimizeOverdraw(&m_Indices[m_MeshGroups[i].startIndex], m_MeshGroups[i].indexCount, m_Vertices.data());
+        });
+        float after = AnalyzeOverdraw(m_Vertices.data(), m_Indices.data(), m_Lods[0].indexCount);
+        LOG_INFO(filename << ": overdraw " << before << " -> " << after)
+    }
+
+    if (options.optimizeVertexFetch)
+    {
+        // Level 0 is drawn up close and uses every vertex, the order is built for it.
+        // Cache optimized triangles can fetch worse in first-use order than in the
+        // original one, a grid read row by row does, so the order has to earn its place.
+        size_t lod0IndexCount = m_Lods[0].indexCount;
+        VertexFetchStats_t before = AnalyzeVertexFetch(m_Indices.data(), lod0IndexCount, m_Vertices.size(), sizeof(Vertex));
+        VertexFetchStats_t beforeAll = AnalyzeVertexFetch(m_Indices.data(), m_Indices.size(), m_Vertices.size(), sizeof(Vertex));
+        std::vector<unsigned int> indices(m_Indices);
+        std::vector<unsigned int> remap;
+        size_t vertexCount = OptimizeVertexFetch(indices.data(), indices.size(), lod0IndexCount, m_Vertices.size(), remap);
+        VertexFetchStats_t after = AnalyzeVertexFetch(indices.data(), lod0IndexCount, vertexCount, sizeof(Vertex));
+        VertexFetchStats_t afterAll = AnalyzeVertexFetch(indices.data(), indices.size(), vertexCount, sizeof(Vertex));
+        if (after.overfetch < before.overfetch && afterAll.overfetch <= beforeAll.overfetch)
+        {
+            std::vector<Vertex> vertices(vertexCount);
+            for (size_t i = 0; i < m_Vertices.size(); ++i)
+            {
+                if (remap[i] != EMPTY_VERTEX)
+                {
+                    vertices[remap[i]] = m_Vertices[i];
+                }
+            }
+            m_Vertices.swap(vertices);
+            m_Indices.swap(indices);
+            LOG_INFO(filename << ": vertex fetch miss rate " << before.missRate << " -> " << after.missRate << ", overfetch " << before.overfetch << " -> " << after.overfetch
+                << " (all levels " << beforeAll.overfetch << " -> " << afterAll.overfetch << ")")
+        }
+        else
+        {
+            LOG_INFO(filename << ": vertex fetch order kept, overfetch " << before.overfetch << " would be " << after.overfetch
+                << " (all levels " << beforeAll.overfetch << " -> " << afterAll.overfetch << ")")
+        }
+    }
+
+    FinishImport(filename, options);
+
+}
+
+// Steps that need the final vertex and triangle order
+void MeshData::FinishImport(const char* filename, const MeshImportOptions_t& options)
+{
+    if (options.buildMeshlets)
+    {
+        for (unsigned int i = 0; i < m_MeshGroups.size(); ++i)
+        {
+            BuildMeshlets(m_Indices.data(), m_MeshGroups[i].startIndex, m_MeshGroups[i].indexCount, i, m_Vertices.data(), m_Meshlets);
+        }
+        InitMeshletOffsets(filename);
+        LOG_INFO(filename << ": " << m_Meshlets.size() << " meshlets")
+    }
+
+    ComputeBounds();
+    RebaseMeshGroups(m_Indices, m_MeshGroups, m_Vertices.size());
+
+    m_VertexFormat = ChooseVertexFormat(m_Vertices.data(), m_Vertices.size(), options.vertexFormat);
+    LOG_INFO(filename << ": " << GetVertexFormatDesc(m_VertexFormat).name << " vertices, " << GetVertexFormatDesc(m_VertexFormat).stride << " bytes each")
+
+}
+
+void MeshData::ComputeBounds()
+{
+    m_Bounds = GetVertexBounds(m_Vertices.data(), nullptr, m_Vertices.size(), 0);
+    m_GroupBounds.resize(m_MeshGroups.size());
+    for (size_t i = 0; i < m_MeshGroups.size(); ++i)
+    {
+        const MeshGroup_t& meshGroup = m_MeshGroups[i];
+        m_GroupBounds[i] = GetVertexBounds(m_Vertices.data(), &m_Indices[meshGroup.startIndex], meshGroup.indexCount, meshGroup.baseVertex);
+    }
+    m_HasBounds = true;
+}
+
+// Each level simplifies the mesh groups of the previous one. The chain ends
+// early when a level would not get much smaller, its error adds up the errors
+// of the levels it was built from.
+void MeshData::GenerateLods(const char* filename, const MeshImportOptions_t& options)
+{
+    MeshLod_t lod;
+    lod.firstGroup = 0;
+    lod.groupCount = (unsigned int)m_MeshGroups.size();
+    lod.startIndex = 0;
+    lod.indexCount = (unsigned int)m_Indices.size();
+    lod.error = 0.0f;
+    m_Lods.assign(1, lod);
+    if (options.lodCount < 2)
+    {
+        return;
+    }
+
+    // Vertices at the same position as a vertex of another group stay in place
+    static const unsigned int SHARED_GROUP = 0xFFFFFFFE;
+    std::vector<unsigned int> positionRemap;
+    GeneratePositionRemap(m_Vertices.data(), m_Vertices.size(), positionRemap);
+    std::vector<unsigned int> positionGroups(m_Vertices.size(), EMPTY_VERTEX);
+    for (unsigned int i = 0; i < m_MeshGroups.size(); ++i)
+    {
+        for (unsigned int j = 0; j < m_MeshGroups[i].indexCount; ++j)
+        {
+            unsigned int& group = positionGroups[positionRemap[m_Indices[m_MeshGroups[i].startIndex + j]]];
+            group = group == EMPTY_VERTEX || group == i ? i : SHARED_GROUP;
+        }
+    }
+    std::vector<unsigned char> lockedVertices(m_Vertices.size());
+    for (size_t i = 0; i < m_Vertices.size(); ++i)
+    {
+        lockedVertices[i] = positionGroups[positionRemap[i]] == SHARED_GROUP;
+    }
+    float maxError = options.lodMaxError * GetMeshSize(m_Vertices.data(), m_Vertices.size());
+
+    for (unsigned int level = 1; level < options.lodCount; ++level)
+    {
+        const MeshLod_t previous = m_Lods.back();
+        if (previous.error >= maxError)
+        {
+            break;
+        }
+
+        std::vector<std::vector<unsigned int> > groupIndices(previous.groupCount);
+        std::vector<float> groupErrors(previous.groupCount);
+        jobs->ParallelFor(previous.groupCount, [&](unsigned int i)
+        {
+            const MeshGroup_t& group = m_MeshGroups[previous.firstGroup + i];
+            size_t targetIndexCount = (size_t)(group.indexCount / 3 * options.lodReduction) * 3;
+            groupErrors[i] = SimplifyMesh(m_Indices.data() + group.startIndex, group.indexCount, m_Vertices.data(), lockedVertices.data(),
+                                          targetIndexCount, maxError - previous.error, groupIndices[i]);
+        });
+
+        size_t indexCount = 0;
+        float error = 0.0f;
+        for (unsigned int i = 0; i < previous.groupCount; ++i)
+        {
+            indexCount += groupIndices[i].size();
+            error = std::max<float>(error, groupErrors[i]);
+        }
+        if (indexCount > previous.indexCount * (1.0f + options.lodReduction) * 0.5f)
+        {
+            break;
+        }
+
+        lod.firstGroup = (unsigned int)m_MeshGroups.size();
+        lod.groupCount = previous.groupCount;
+        lod.startIndex = (unsigned int)m_Indices.size();
+        lod.indexCount = (unsigned int)indexCount;
+        lod.error = previous.error + error;
+        for (unsigned int i = 0; i < previous.groupCount; ++i)
+        {
+            MeshGroup_t group = m_MeshGroups[previous.firstGroup + i];
+            group.startIndex = (unsigned int)m_Indices.size();
+            group.indexCount = (unsigned int)groupIndices[i].size();
+            m_MeshGroups.push_back(group);
+            m_Indices.insert(m_Indices.end(), groupIndices[i].begin(), groupIndices[i].end());
+        }
+        m_Lods.push_back(lod);
+        LOG_INFO(filename << ": LOD " << level << " has " << indexCount / 3 << " triangles, error " << lod.error)
+    }
+
+}
+
+void MeshData::SaveToDat(const char* filename, bool compress) const
+{
+    DatWriter writer;
+    PackedMeshInfo_t packedInfo;
+    std::vector<unsigned char> packedVertices;
+    std::vector<unsigned char> packedIndices;
+    std::vector<unsigned short> indices16;
+    std::vector<unsigned char> vertices;
+    unsigned int vertexFormat = m_VertexFormat;
+    if (m_VertexFormat != VERTEX_FORMAT_FULL)
+    {
+        writer.AddSection(DAT_SECTION_VERTEX_FORMAT, &vertexFormat, sizeof(vertexFormat), 1);
+    }
+    size_t indexSize = GetIndexSize(m_Indices.data(), m_Indices.size());
+    bool packIndices = false;
+    if (compress)
+    {
+        EncodeVertices(m_Vertices.data(), m_Vertices.size(), m_VertexFormat, packedInfo, packedVertices);
+        packedInfo.indexCount = (unsigned int)m_Indices.size();
+        packedInfo.indexSize = (unsigned int)indexSize;
+        EncodeIndices(m_Indices.data(), m_Indices.size(), indexSize, packedIndices);
+        // Deltas don't shrink every triangle order, the plain indices then load without decoding
+        packIndices = packedIndices.size() < m_Indices.size() * indexSize;
+
+        writer.AddSection(DAT_SECTION_PACKED_INFO, &packedInfo, sizeof(PackedMeshInfo_t), 1);
+        writer.AddSection(DAT_SECTION_PACKED_VERTICES, packedVertices.data(), GetPackedVertexStride(m_VertexFormat), m_Vertices.size());
+    }
+    else
+    {
+        const VertexFormatDesc_t& desc = GetVertexFormatDesc(m_VertexFormat);
+        ConvertVertices(m_Vertices.data(), m_Vertices.size(), m_VertexFormat, vertices);
+        writer.AddSection(DAT_SECTION_VERTICES, vertices.data(), desc.stride, m_Vertices.size());
+    }
+    if (packIndices)
+    {
+        writer.AddSection(DAT_SECTION_PACKED_INDICES, packedIndices.data(), 1, packedIndices.size());
+    }
+    else if (indexSize == sizeof(unsigned short))
+    {
+        indices16 = NarrowIndices(m_Indices.data(), m_Indices.size());
+        writer.AddSection(DAT_SECTION_INDICES_16, indices16.data(), sizeof(unsigned short), indices16.size());
+    }
+    else
+    {
+        writer.AddSection(DAT_SECTION_INDICES, m_Indices.data(), sizeof(unsigned int), m_Indices.size());
+    }
+    writer.AddSection(DAT_SECTION_MESHGROUPS, m_MeshGroups.data(), sizeof(MeshGroup_t), m_MeshGroups.size());
+    if (m_Lods.size() > 1)
+    {
+        writer.AddSection(DAT_SECTION_LODS, m_Lods.data(), sizeof(MeshLod_t), m_Lods.size());
+    }
+    if (!m_Meshlets.empty())
+    {
+        writer.AddSection(DAT_SECTION_MESHLETS, m_Meshlets.data(), sizeof(Meshlet_t), m_Meshlets.size());
+    }
+    std::vector<MeshBounds_t> bounds;
+    if (m_HasBounds)
+    {
+        bounds.push_back(m_Bounds);
+        bounds.insert(bounds.end(), m_GroupBounds.begin(), m_GroupBounds.end());
+        writer.AddSection(DAT_SECTION_BOUNDS, bounds.data(), sizeof(MeshBounds_t), bounds.size());
+    }
+    SaveSections(writer);
+    writer.Write(filename);
+
+}
+
+// Mesh group layout of .dat versions 1 and 2, before base vertices
+struct MeshGroupV2_t
+{
+    unsigned int startIndex;
+    unsigned int indexCount;
+    char materialName[56];
+};
+
+// The geometry goes to LoadGeometry straight from the file mapping, compressed files are decoded first
+void MeshData::LoadFromDat(const char* filename)
+{
+    DatFile file(filename);
+
+    size_t groupCount;
+    if (file.GetVersion() < 3)
+    {
+        const MeshGroupV2_t* groups = (const MeshGroupV2_t*)file.GetSection(DAT_SECTION_MESHGROUPS, sizeof(MeshGroupV2_t), groupCount);
+        m_MeshGroups.resize(groupCount);
+        for (size_t i = 0; i < groupCount; ++i)
+        {
+            m_MeshGroups[i].startIndex = groups[i].startIndex;
+            m_MeshGroups[i].indexCount = groups[i].indexCount;
+            m_MeshGroups[i].baseVertex = 0;
+            // The old field held 4 more characters. Longer names are cut rather than
+            // failing the whole mesh, FindMaterial gives that group the debug checker.
+            size_t nameLength = strnlen(groups[i].materialName, sizeof(groups[i].materialName));
+            if (nameLength >= sizeof(m_MeshGroups[i].materialName))
+            {
+                LOG_INFO(filename << ": material name " << std::string(groups[i].materialName, nameLength) << " cut to "
+                         << sizeof(m_MeshGroups[i].materialName) - 1 << " characters, re-bake the mesh to keep it")
+                nameLength = sizeof(m_MeshGroups[i].materialName) - 1;
+            }
+            SetMaterialName(m_MeshGroups[i], nullptr, groups[i].materialName, nameLength);
+        }
+    }
+    else
+    {
+        const MeshGroup_t* groups = (const MeshGroup_t*)file.GetSection(DAT_SECTION_MESHGROUPS, sizeof(MeshGroup_t), groupCount);
+        m_MeshGroups.assign(groups, groups + groupCount);
+    }
+
+    size_t lodCount;
+    const MeshLod_t* lods = (const MeshLod_t*)file.GetSection(DAT_SECTION_LODS, sizeof(MeshLod_t), lodCount);
+    m_Lods.assign(lods, lods + lodCount);
+    for (size_t i = 0; i < m_Lods.size(); ++i)
+    {
+        if (m_Lods[i].firstGroup > groupCount || m_Lods[i].groupCount > groupCount - m_Lods[i].firstGroup)
+        {
+            THROW_RUNTIME("Mesh file " << filename << " has LOD " << i << " outside of its mesh groups")
+        }
+    }
+
+    size_t meshletCount;
+    const Meshlet_t* meshlets = (const Meshlet_t*)file.GetSection(DAT_SECTION_MESHLETS, sizeof(Meshlet_t), meshletCount);
+    m_Meshlets.assign(meshlets, meshlets + meshletCount);
+    InitMeshletOffsets(filename);
+
+    size_t boundsCount;
+    const MeshBounds_t* bounds = (const MeshBounds_t*)file.GetSection(DAT_SECTION_BOUNDS, sizeof(MeshBounds_t), boundsCount);
+    m_HasBounds = bounds != nullptr;
+    if (bounds)
+    {
+        if (boundsCount != groupCount + 1)
+        {
+            THROW_RUNTIME("Mesh file " << filename << " has " << boundsCount << " bounds for " << groupCount << " mesh groups")
+        }
+        m_Bounds = bounds[0];
+        m_GroupBounds.assign(bounds + 1, bounds + boundsCount);
+    }
+    else
+    {
+        m_GroupBounds.clear();
+    }
+    LoadSections(file, filename);
+
+    size_t formatCount;
+    const unsigned int* vertexFormat = (const unsigned int*)file.GetSection(DAT_SECTION_VERTEX_FORMAT, sizeof(unsigned int), formatCount);
+    m_VertexFormat = VERTEX_FORMAT_FULL;
+    if (vertexFormat && formatCount == 1)
+    {
+        if (*vertexFormat >= VERTEX_FORMAT_COUNT)
+        {
+            THROW_RUNTIME("Mesh file " << filename << " has unknown vertex format " << *vertexFormat)
+        }
+        m_VertexFormat = (VertexFormat_t)*vertexFormat;
+    }
+
+    size_t vertexCount, indexCount;
+    const void* vertices = file.GetSection(DAT_SECTION_VERTICES, GetVertexFormatDesc(m_VertexFormat).stride, vertexCount);
+    const unsigned short* indices16 = (const unsigned short*)file.GetSection(DAT_SECTION_INDICES_16, sizeof(unsigned short), indexCount);
+    if (vertices && indices16)
+    {
+        LoadGeometry(vertices, vertexCount, m_VertexFormat, indices16, indexCount, sizeof(unsigned short));
+        return;
+    }
+    const unsigned int* indices = (const unsigned int*)file.GetSection(DAT_SECTION_INDICES, sizeof(unsigned int), indexCount);
+    if (vertices && indices)
+    {
+        LoadGeometry(vertices, vertexCount, m_VertexFormat, indices, indexCount, sizeof(unsigned int));
+        return;
+    }
+
+    size_t infoCount, packedVertexCount, packedIndexSize;
+    const unsigned char* packedIndices = (const unsigned char*)file.GetSection(DAT_SECTION_PACKED_INDICES, 1, packedIndexSize);
+    if (file.GetVersion() < 10)
+    {
+        // Decodes to Vertex, LoadGeometry converts it to the vertex format
+        const PackedMeshInfoV9_t* packedInfo = (const PackedMeshInfoV9_t*)file.GetSection(DAT_SECTION_PACKED_INFO, sizeof(PackedMeshInfoV9_t), infoCount);
+        const PackedVertexV9_t* packedVertices = (const PackedVertexV9_t*)file.GetSection(DAT_SECTION_PACKED_VERTICES, sizeof(PackedVertexV9_t), packedVertexCount);
+        if (!packedInfo || !packedVertices || !packedIndices || packedInfo->vertexCount != packedVertexCount)
+        {
+            THROW_RUNTIME("Mesh file " << filename << " has no geometry")
+        }
+
+        std::vector<Vertex> decodedVertices(packedVertexCount);
+        std::vector<unsigned int> decodedIndices(packedInfo->indexCount);
+        DecodeVerticesV9(packedVertices, packedVertexCount, *packedInfo, decodedVertices.data());
+        DecodeIndices(packedIndices, packedIndexSize, decodedIndices.size(), sizeof(unsigned int), decodedIndices.data());
+        LoadGeometry(decodedVertices.data(), decodedVertices.size(), VERTEX_FORMAT_FULL, decodedIndices.data(), decodedIndices.size(), sizeof(unsigned int));
+        return;
+    }
+
+    const PackedMeshInfo_t* packedInfo = (const PackedMeshInfo_t*)file.GetSection(DAT_SECTION_PACKED_INFO, sizeof(PackedMeshInfo_t), infoCount);
+    const unsigned char* packedVertices = (const unsigned char*)file.GetSection(DAT_SECTION_PACKED_VERTICES, GetPackedVertexStride(m_VertexFormat), packedVertexCount);
+    if (!packedInfo || !packedVertices || packedInfo->vertexCount != packedVertexCount)
+    {
+        THROW_RUNTIME("Mesh file " << filename << " has no geometry")
+    }
+    if (packedInfo->indexSize != sizeof(unsigned short) && packedInfo->indexSize != sizeof(unsigned int))
+    {
+        THROW_RUNTIME("Mesh file " << filename << " has " << packedInfo->indexSize << "-byte indices")
+    }
+
+    // Decoded in the vertex format and index size they are uploaded in, left uninitialized until then
+    std::unique_ptr<unsigned char[]> decodedVertices(new unsigned char[packedVertexCount * GetVertexFormatDesc(m_VertexFormat).stride]);
+    DecodeVertices(packedVertices, packedVertexCount, m_VertexFormat, *packedInfo, decodedVertices.get());
+    const void* plainIndices = packedInfo->indexSize == sizeof(unsigned short) ? file.GetSection(DAT_SECTION_INDICES_16, sizeof(unsigned short), indexCount)
+                                                                               : file.GetSection(DAT_SECTION_INDICES, sizeof(unsigned int), indexCount);
+    if (plainIndices && indexCount == packedInfo->indexCount)
+    {
+        LoadGeometry(decodedVertices.get(), packedVertexCount, m_VertexFormat, plainIndices, indexCount, packedInfo->indexSize);
+        return;
+    }
+    if (!packedIndices)
+    {
+        THROW_RUNTIME("Mesh file " << filename << " has no indices")
+    }
+    std::unique_ptr<unsigned char[]> decodedIndices(new unsigned char[(size_t)packedInfo->indexCount * packedInfo->indexSize]);
+    DecodeIndices(packedIndices, packedIndexSize, packedInfo->indexCount, packedInfo->indexSize, decodedIndices.get());
+    LoadGeometry(decodedVertices.get(), packedVertexCount, m_VertexFormat, decodedIndices.get(), packedInfo->indexCount, packedInfo->indexSize);
+
+}
+
+void MeshData::LoadGeometry(const void* vertices, size_t vertexCount, VertexFormat_t vertexFormat, const void* indices, size_t indexCount, size_t indexSize)
+{
+    m_Vertices.resize(vertexCount);
+    ConvertToVertices(vertices, vertexCount, vertexFormat, m_Vertices.data());
+    m_Indices.resize(indexCount);
+    if (indexSize == sizeof(unsigned short))
+    {
+        const unsigned short* indices16 = (const unsigned short*)indices;
+        std::copy(indices16, indices16 + indexCount, m_Indices.begin());
+    }
+    else if (indexCount)
+    {
+        memcpy(m_Indices.data(), indices, indexCount * sizeof(unsigned int));
+    }
+}
+
+unsigned long long MeshData::GetImportKey(const char* filename, const MeshImportOptions_t& options)
+{
+    unsigned long long key = HashFile(filename);
+    key = HashBytes(&MESH_IMPORTER_VERSION, sizeof(MESH_IMPORTER_VERSION), key);
+    key = HashBytes(&options.weldVertices, sizeof(options.weldVertices), key);
+    key = HashBytes(&options.weldEpsilon, sizeof(options.weldEpsilon), key);
+    key = HashBytes(&options.mergeMaterials, sizeof(options.mergeMaterials), key);
+    key = HashBytes(&options.compressDat, sizeof(options.compressDat), key);
+    key = HashBytes(&options.optimizeVertexCache, sizeof(options.optimizeVertexCache), key);
+    key = HashBytes(&options.optimizeOverdraw, sizeof(options.optimizeOverdraw), key);
+    key = HashBytes(&options.optimizeVertexFetch, sizeof(options.optimizeVertexFetch), key);
+    key = HashBytes(&options.vertexFormat, sizeof(options.vertexFormat), key);
+    key = HashBytes(&options.lodCount, sizeof(options.lodCount), key);
+    key = HashBytes(&options.lodReduction, sizeof(options.lodReduction), key);
+    key = HashBytes(&options.lodMaxError, sizeof(options.lodMaxError), key);
+    key = HashBytes(&options.buildMeshlets, sizeof(options.buildMeshlets), key);
+    return key;
+}
+
+void MeshData::InitMeshletOffsets(const char* filename)
+{
+    m_MeshletOffsets.assign(m_Meshlets.empty() ? 0 : m_MeshGroups.size() + 1, 0);
+    unsigned int group = 0;
+    for (unsigned int i = 0; i < m_Meshlets.size(); ++i)
+    {
+        const Meshlet_t& meshlet = m_Meshlets[i];
+        if (meshlet.group < group || meshlet.group >= m_MeshGroups.size())
+        {
+            THROW_RUNTIME("Mesh " << filename << " has meshlet " << i << " out of order")
+        }
+        const MeshGroup_t& meshGroup = m_MeshGroups[meshlet.group];
+        unsigned int offset = meshlet.startIndex - meshGroup.startIndex;
+        if (meshlet.startIndex < meshGroup.startIndex || offset > meshGroup.indexCount || meshlet.indexCount > meshGroup.indexCount - offset)
+        {
+            THROW_RUNTIME("Mesh " << filename << " has meshlet " << i << " outside of its mesh group")
+        }
+        while (group < meshlet.group)
+        {
+            m_MeshletOffsets[++group] = i;
+        }
+    }
+    while (!m_Meshlets.empty() && group < m_MeshGroups.size())
+    {
+        m_MeshletOffsets[++group] = (unsigned int)m_Meshlets.size();
+    }
+
+}
+
+size_t MeshData::FindLod(float maxError) const
+{
+    size_t lod = 0;
+    while (lod + 1 < m_Lods.size() && m_Lods[lod + 1].error <= maxError)
+    {
+        ++lod;
+    }
+    return lod;
+}
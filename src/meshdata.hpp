@@ -0,0 +1,161 @@
+#ifndef MESHDATA_HPP
+#define MESHDATA_HPP
+
+#include "utils.hpp"
+#include "mathlib.hpp"
+#include "vertexformat.hpp"
+#include "meshlet.hpp"
+#include <vector>
+
+class DatFile;
+class DatWriter;
+
+struct MeshGroup_t
+{
+    unsigned int startIndex;
+    unsigned int indexCount;
+    // Added to every index of the group, lets 16-bit indices address large meshes
+    unsigned int baseVertex;
+    char materialName[52]; // Align to 64 bytes
+
+};
+
+// Sets the material of a group to "mtldir/name", or name alone when mtldir is
+// null. name may point into the group. Throws when the result does not fit,
+// FindMaterial could not resolve a cut name.
+void SetMaterialName(MeshGroup_t& group, const char* mtldir, const char* name, size_t nameLength);
+
+// Levels of detail share the vertex buffer. Each has its own mesh groups,
+// whose indices follow those of the previous level.
+struct MeshLod_t
+{
+    unsigned int firstGroup;
+    unsigned int groupCount;
+    unsigned int startIndex;
+    unsigned int indexCount;
+    // How far, in model units, the level may be from level 0
+    float error;
+
+};
+
+// Axis-aligned box and the sphere around its center that holds every vertex
+struct MeshBounds_t
+{
+    float3 mins;
+    float3 maxs;
+    float3 center;
+    float radius;
+
+};
+
+// Box around the transformed box, sphere grown by the largest scale of the transform
+MeshBounds_t TransformBounds(const MeshBounds_t& bounds, const AffineTransform& transform);
+// Length of the longest transformed axis
+float GetMaxScale(const AffineTransform& transform);
+
+// What a mesh keeps in system memory once its buffers are uploaded
+enum GeometryResidency_t
+{
+    // Nothing, the GPU buffers are the only copy
+    GEOMETRY_RESIDENCY_DROP = 0,
+    // Every vertex and index
+    GEOMETRY_RESIDENCY_KEEP,
+    // Vertex positions and indices, for collision and picking
+    GEOMETRY_RESIDENCY_POSITIONS,
+};
+
+struct MeshImportOptions_t
+{
+    MeshImportOptions_t() : weldVertices(true), weldEpsilon(1e-5f), mergeMaterials(true), compressDat(false), optimizeVertexCache(true), optimizeOverdraw(true), optimizeVertexFetch(true), vertexFormat(VERTEX_FORMAT_AUTO), lodCount(4), lodReduction(0.5f), lodMaxError(0.02f), buildMeshlets(true), residency(GEOMETRY_RESIDENCY_DROP) {}
+
+    // Merge vertices closer than weldEpsilon, relative to the size of the mesh,
+    // when the rest of their attributes match, then drop degenerate and
+    // duplicate triangles
+    bool weldVertices;
+    float weldEpsilon;
+    // One mesh group per material, sorted by material name, instead of one
+    // per usemtl. Fewer material switches and draws.
+    bool mergeMaterials;
+    // Quantize vertices and delta-code indices in the baked .dat.
+    // Lossy: positions snap to 1/65535 of the mesh bounds.
+    bool compressDat;
+    // Reorder triangles within each mesh group for post-transform cache reuse
+    bool optimizeVertexCache;
+    // Then move clusters of triangles facing outwards to the front of each group
+    bool optimizeOverdraw;
+    // Renumber vertices in the order the indices first use them
+    bool optimizeVertexFetch;
+    // Layout of the vertex buffer, AUTO picks the smallest one the texcoords allow
+    VertexFormat_t vertexFormat;
+    // Levels of detail to bake, including the imported mesh. Each has about
+    // lodReduction times the triangles of the previous one. Vertices shared
+    // by several mesh groups don't move, so groups keep meeting without cracks.
+    unsigned int lodCount;
+    float lodReduction;
+    // Largest error of a level, relative to the size of the mesh
+    float lodMaxError;
+    // Split every mesh group into meshlets, so draws skip the ones outside
+    // the view or facing away from it
+    bool buildMeshlets;
+    // Not part of the cache key, it only decides what stays in memory after loading
+    GeometryResidency_t residency;
+
+};
+
+// 16-bit indices whenever every index fits, relative to the base vertex of its group
+size_t GetIndexSize(const unsigned int* indices, size_t count);
+std::vector<unsigned short> NarrowIndices(const unsigned int* indices, size_t count);
+
+// What a mesh is made of in system memory: the .obj import, the baked .dat
+// files and the bounds. Needs no device, Mesh uploads it.
+class MeshData
+{
+public:
+    MeshData() : m_VertexFormat(VERTEX_FORMAT_FULL), m_HasBounds(false) {}
+    virtual ~MeshData() {}
+
+    size_t GetLodCount() const { return m_Lods.size(); }
+    float GetLodError(size_t lod) const { return m_Lods[lod].error; }
+    // Coarsest level whose error is within maxError
+    size_t FindLod(float maxError) const;
+
+    // Model space bounds of the whole mesh and of every mesh group, LODs included.
+    // Meshes loaded from .dat files older than version 9 have none.
+    bool HasBounds() const { return m_HasBounds; }
+    const MeshBounds_t& GetBounds() const { return m_Bounds; }
+    const MeshBounds_t& GetGroupBounds(size_t group) const { return m_GroupBounds[group]; }
+
+protected:
+    void LoadFromObj(const char* filename, const MeshImportOptions_t& options = MeshImportOptions_t());
+    // Builds meshlets, rebases the mesh groups and picks the vertex format
+    void FinishImport(const char* filename, const MeshImportOptions_t& options);
+    void GenerateLods(const char* filename, const MeshImportOptions_t& options);
+    // Fills m_Bounds and m_GroupBounds from m_Vertices, m_Indices and m_MeshGroups
+    void ComputeBounds();
+    void LoadFromDat(const char* filename);
+    // Takes the vertices, in vertexFormat, and indices of a .dat. Copies them to m_Vertices and m_Indices.
+    virtual void LoadGeometry(const void* vertices, size_t vertexCount, VertexFormat_t vertexFormat, const void* indices, size_t indexCount, size_t indexSize);
+    // Cache key of what LoadFromObj makes of the file with these options
+    static unsigned long long GetImportKey(const char* filename, const MeshImportOptions_t& options);
+    void SaveToDat(const char* filename, bool compress) const;
+    // Sections of derived meshes, written and read along with the mesh
+    virtual void SaveSections(DatWriter& /*writer*/) const {}
+    virtual void LoadSections(const DatFile& /*file*/, const char* /*filename*/) {}
+    // Checks that m_Meshlets are sorted by group and stay inside their groups, then indexes them
+    void InitMeshletOffsets(const char* filename);
+
+    std::vector<Vertex> m_Vertices;
+    std::vector<unsigned int> m_Indices;
+    std::vector<MeshGroup_t> m_MeshGroups;
+    VertexFormat_t m_VertexFormat;
+    std::vector<MeshLod_t> m_Lods;
+    std::vector<Meshlet_t> m_Meshlets;
+    // First meshlet of every mesh group, and one past the last
+    std::vector<unsigned int> m_MeshletOffsets;
+    MeshBounds_t m_Bounds;
+    std::vector<MeshBounds_t> m_GroupBounds;
+    bool m_HasBounds;
+
+};
+
+#endif // MESHDATA_HPP
@@ -0,0 +1,219 @@
+#include "meshlet.hpp"
+#include "viewsetup.hpp"
+#include <algorithm>
+
+// Cones narrower than this never cull enough to pay for the test
+static const float MIN_CONE_DOT = 0.1f;
+
+static void FinishMeshlet(const unsigned int* indices, unsigned int startIndex, unsigned int endIndex, unsigned int group,
+                          const Vertex* vertices, unsigned int vertexCount, std::vector<Meshlet_t>& meshlets)
+{
+    Meshlet_t meshlet;
+    meshlet.group = group;
+    meshlet.startIndex = startIndex;
+    meshlet.indexCount = endIndex - startIndex;
+    meshlet.vertexCount = vertexCount;
+
+    float3 mins = vertices[indices[startIndex]].position;
+    float3 maxs = mins;
+    for (unsigned int i = startIndex; i < endIndex; ++i)
+    {
+        const float3& position = vertices[indices[i]].position;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            mins[axis] = std::min<float>(mins[axis], position[axis]);
+            maxs[axis] = std::max<float>(maxs[axis], position[axis]);
+        }
+    }
+    meshlet.center = (mins + maxs) * 0.5f;
+    float radiusSq = 0.0f;
+    for (unsigned int i = startIndex; i < endIndex; ++i)
+    {
+        float3 offset = vertices[indices[i]].position - meshlet.center;
+        radiusSq = std::max<float>(radiusSq, dot(offset, offset));
+    }
+    meshlet.radius = std::sqrt(radiusSq);
+
+    // Front faces wind so that cross(b - a, c - a) points at the viewer
+    std::vector<float3> normals;
+    normals.reserve(meshlet.indexCount / 3);
+    float3 axis(0.0f, 0.0f, 0.0f);
+    for (unsigned int i = startIndex; i + 2 < endIndex; i += 3)
+    {
+        const float3& a = vertices[indices[i + 0]].position;
+        const float3& b = vertices[indices[i + 1]].position;
+        const float3& c = vertices[indices[i + 2]].position;
+        float3 normal = cross(b - a, c - a);
+        float length = normal.length();
+        if (length > 0.0f)
+        {
+            normal *= 1.0f / length;
+            normals.push_back(normal);
+            axis += normal;
+        }
+    }
+
+    meshlet.coneAxis = float3(0.0f, 0.0f, 0.0f);
+    meshlet.coneCutoff = 1.0f;
+    float axisLength = axis.length();
+    if (!normals.empty() && axisLength > 0.0f)
+    {
+        axis *= 1.0f / axisLength;
+        float minDot = 1.0f;
+        for (size_t i = 0; i < normals.size(); ++i)
+        {
+            minDot = std::min<float>(minDot, dot(axis, normals[i]));
+        }
+        if (minDot >= MIN_CONE_DOT)
+        {
+            meshlet.coneAxis = axis;
+            meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+        }
+    }
+
+    meshlets.push_back(meshlet);
+}
+
+void BuildMeshlets(const unsigned int* indices, unsigned int startIndex, unsigned int indexCount, unsigned int group,
+                   const Vertex* vertices, std::vector<Meshlet_t>& meshlets)
+{
+    unsigned int endIndex = startIndex + indexCount - indexCount % 3;
+    unsigned int meshletStart = startIndex;
+    unsigned int meshletVertices[MAX_MESHLET_VERTICES];
+    unsigned int vertexCount = 0;
+
+    for (unsigned int i = startIndex; i < endIndex; i += 3)
+    {
+        // Vertices of this triangle the meshlet does not have yet
+        unsigned int newVertices[3];
+        unsigned int newCount = 0;
+        for (unsigned int corner = 0; corner < 3; ++corner)
+        {
+            unsigned int index = indices[i + corner];
+            if (std::find(meshletVertices, meshletVertices + vertexCount, index) == meshletVertices + vertexCount &&
+                std::find(newVertices, newVertices + newCount, index) == newVertices + newCount)
+            {
+                newVertices[newCount++] = index;
+            }
+        }
+
+        if (vertexCount + newCount > MAX_MESHLET_VERTICES || (i - meshletStart) / 3 >= MAX_MESHLET_TRIANGLES)
+        {
+            FinishMeshlet(indices, meshletStart, i, group, vertices, vertexCount, meshlets);
+            meshletStart = i;
+            vertexCount = 0;
+            newCount = 0;
+            for (unsigned int corner = 0; corner < 3; ++corner)
+            {
+                unsigned int index = indices[i + corner];
+                if (std::find(newVertices, newVertices + newCount, index) == newVertices + newCount)
+                {
+                    newVertices[newCount++] = index;
+                }
+            }
+        }
+
+        for (unsigned int j = 0; j < newCount; ++j)
+        {
+            meshletVertices[vertexCount++] = newVertices[j];
+        }
+    }
+
+    if (endIndex > meshletStart)
+    {
+        FinishMeshlet(indices, meshletStart, endIndex, group, vertices, vertexCount, meshlets);
+    }
+}
+
+MeshletCuller::MeshletCuller(const ViewSetup& view, const AffineTransform& modelToWorld)
+{
+    // matWorldToCamera takes row vectors, modelToWorld column vectors
+    Matrix modelToClip = modelToWorld.ToMatrix().Transpose() * view.matWorldToCamera;
+    const float (&m)[4][4] = modelToClip.m;
+
+    // Gribb and Hartmann: the planes are sums of clip space columns, z runs from 0 to w
+    static const int planeColumns[6] = { 0, 0, 1, 1, 2, 2 };
+    static const float planeSigns[6] = { 1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f };
+    for (int plane = 0; plane < 6; ++plane)
+    {
+        int column = planeColumns[plane];
+        float sign = planeSigns[plane];
+        // The near plane is z >= 0 on its own
+        float w = plane == 4 ? 0.0f : 1.0f;
+        float3 normal(m[0][3] * w + m[0][column] * sign,
+                      m[1][3] * w + m[1][column] * sign,
+                      m[2][3] * w + m[2][column] * sign);
+        float distance = m[3][3] * w + m[3][column] * sign;
+        float length = normal.length();
+        float scale = length > 0.0f ? 1.0f / length : 0.0f;
+        m_PlaneNormals[plane] = normal * scale;
+        m_PlaneDistances[plane] = length > 0.0f ? distance * scale : 1.0f;
+    }
+
+    AffineTransform worldToModel = modelToWorld.Inverse();
+    m_Viewpoint = worldToModel * view.origin;
+    m_Ortho = view.ortho;
+    float3 direction = worldToModel * view.target - m_Viewpoint;
+    float length = direction.length();
+    m_ViewDirection = length > 0.0f ? direction * (1.0f / length) : float3(0.0f, 0.0f, 0.0f);
+}
+
+bool MeshletCuller::IsVisible(const Meshlet_t& meshlet, bool cullBackfaces) const
+{
+    for (int plane = 0; plane < 6; ++plane)
+    {
+        if (dot(m_PlaneNormals[plane], meshlet.center) + m_PlaneDistances[plane] < -meshlet.radius)
+        {
+            return false;
+        }
+    }
+
+    if (cullBackfaces && meshlet.coneCutoff < 1.0f)
+    {
+        if (m_Ortho)
+        {
+            // The view direction has to stay inside the cone around the axis
+            return dot(m_ViewDirection, meshlet.coneAxis) < meshlet.coneCutoff;
+        }
+        float3 toCenter = meshlet.center - m_Viewpoint;
+        return dot(toCenter, meshlet.coneAxis) < meshlet.coneCutoff * toCenter.length() + meshlet.radius;
+    }
+    return true;
+}
+
+bool MeshletCuller::IsBoxVisible(const float3& mins, const float3& maxs) const
+{
+    for (int plane = 0; plane < 6; ++plane)
+    {
+        // Corner farthest along the plane normal
+        const float3& normal = m_PlaneNormals[plane];
+        float3 corner(normal.x >= 0.0f ? maxs.x : mins.x, normal.y >= 0.0f ? maxs.y : mins.y, normal.z >= 0.0f ? maxs.z : mins.z);
+        if (dot(normal, corner) + m_PlaneDistances[plane] < 0.0f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void MeshletCuller::Cull(const Meshlet_t* meshlets, size_t meshletCount, bool cullBackfaces, std::vector<DrawRange_t>& ranges) const
+{
+    for (size_t i = 0; i < meshletCount; ++i)
+    {
+        const Meshlet_t& meshlet = meshlets[i];
+        if (!IsVisible(meshlet, cullBackfaces))
+        {
+            continue;
+        }
+
+        if (!ranges.empty() && ranges.back().startIndex + ranges.back().indexCount == meshlet.startIndex)
+        {
+            ranges.back().indexCount += meshlet.indexCount;
+        }
+        else
+        {
+            DrawRange_t range = { meshlet.startIndex, meshlet.indexCount };
+            ranges.push_back(range);
+        }
+    }
+}
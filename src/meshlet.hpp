@@ -0,0 +1,67 @@
+#ifndef MESHLET_HPP
+#define MESHLET_HPP
+
+#include "mathlib.hpp"
+#include <vector>
+
+struct ViewSetup;
+
+static const unsigned int MAX_MESHLET_VERTICES = 64;
+static const unsigned int MAX_MESHLET_TRIANGLES = 124;
+
+// A run of consecutive triangles of a mesh group, culled as a whole
+struct Meshlet_t
+{
+    // Bounding sphere, model space
+    float3 center;
+    float radius;
+    // Every triangle faces away from viewpoints where
+    // dot(center - viewpoint, coneAxis) >= coneCutoff * |center - viewpoint| + radius.
+    // coneCutoff is 1 when the normals are too spread out to ever cull.
+    float3 coneAxis;
+    float coneCutoff;
+    unsigned int group;
+    unsigned int startIndex;
+    unsigned int indexCount;
+    unsigned int vertexCount;
+
+};
+
+struct DrawRange_t
+{
+    unsigned int startIndex;
+    unsigned int indexCount;
+};
+
+// Cuts the triangles of indices[startIndex, startIndex + indexCount) into
+// meshlets of at most MAX_MESHLET_VERTICES and MAX_MESHLET_TRIANGLES, keeping
+// their order. Meant to run after the vertex cache optimization, whose order
+// keeps neighbouring triangles together.
+void BuildMeshlets(const unsigned int* indices, unsigned int startIndex, unsigned int indexCount, unsigned int group,
+                   const Vertex* vertices, std::vector<Meshlet_t>& meshlets);
+
+// Frustum and normal cone tests against one view, done in model space
+class MeshletCuller
+{
+public:
+    MeshletCuller(const ViewSetup& view, const AffineTransform& modelToWorld);
+
+    // Appends the index ranges of the visible meshlets, neighbours merged.
+    // Cone culling is only right when the material culls back faces.
+    void Cull(const Meshlet_t* meshlets, size_t meshletCount, bool cullBackfaces, std::vector<DrawRange_t>& ranges) const;
+    // Frustum test of a model space box
+    bool IsBoxVisible(const float3& mins, const float3& maxs) const;
+
+private:
+    bool IsVisible(const Meshlet_t& meshlet, bool cullBackfaces) const;
+
+    float3 m_PlaneNormals[6];
+    float m_PlaneDistances[6];
+    float3 m_Viewpoint;
+    // Orthographic views have a direction instead of a viewpoint
+    float3 m_ViewDirection;
+    bool m_Ortho;
+
+};
+
+#endif // MESHLET_HPP
@@ -0,0 +1,197 @@
+#include "numberparser.hpp"
+#include <clocale>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#ifndef _WIN32
+#include <locale.h>
+#endif
+
+// Every integer up to 2^24 and every power of ten up to 1e10 is exact in a float,
+// so one multiply or divide between them rounds correctly (Clinger's fast path)
+static const uint64_t MAX_EXACT_MANTISSA = 1 << 24;
+static const int MAX_EXACT_POWER = 10;
+static const float EXACT_POWERS_OF_TEN[MAX_EXACT_POWER + 1] =
+{
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+// More significant digits than this don't fit in the 64-bit mantissa
+static const int MAX_MANTISSA_DIGITS = 19;
+
+static inline bool IsDigit(char symbol)
+{
+    return symbol >= '0' && symbol <= '9';
+}
+
+// strtof reads the decimal point of the current locale, which is ',' in many.
+// The fallback converts in the C locale instead, created once before main.
+#ifdef _WIN32
+static const _locale_t g_CLocale = _create_locale(LC_NUMERIC, "C");
+
+static float StringToFloat(const char* text)
+{
+    return _strtof_l(text, nullptr, g_CLocale);
+}
+#else
+static const locale_t g_CLocale = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+
+static float StringToFloat(const char* text)
+{
+    return strtof_l(text, nullptr, g_CLocale);
+}
+#endif
+
+// Slow path for long mantissas and large exponents, strtof rounds correctly
+static float ParseFloatFallback(const char* begin, const char* end)
+{
+    char buffer[64];
+    size_t length = end - begin;
+    if (length < sizeof(buffer))
+    {
+        memcpy(buffer, begin, length);
+        buffer[length] = '\0';
+        return StringToFloat(buffer);
+    }
+
+    return StringToFloat(std::string(begin, end).c_str());
+}
+
+const char* ParseFloat(const char* begin, const char* end, float& value)
+{
+    const char* current = begin;
+    bool negative = false;
+    if (current < end && (*current == '-' || *current == '+'))
+    {
+        negative = *current++ == '-';
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool truncated = false;
+    bool hasDigits = false;
+
+    while (current < end && IsDigit(*current))
+    {
+        if (digits < MAX_MANTISSA_DIGITS)
+        {
+            mantissa = mantissa * 10 + (*current - '0');
+            digits += mantissa != 0;
+        }
+        else
+        {
+            truncated = true;
+            ++exponent;
+        }
+        ++current;
+        hasDigits = true;
+    }
+
+    if (current < end && *current == '.')
+    {
+        ++current;
+        while (current < end && IsDigit(*current))
+        {
+            if (digits < MAX_MANTISSA_DIGITS)
+            {
+                mantissa = mantissa * 10 + (*current - '0');
+                digits += mantissa != 0;
+                --exponent;
+            }
+            else
+            {
+                truncated = true;
+            }
+            ++current;
+            hasDigits = true;
+        }
+    }
+
+    if (!hasDigits)
+    {
+        value = 0.0f;
+        return begin;
+    }
+
+    // The exponent only counts if it has digits, "1e" is just 1
+    if (current < end && (*current == 'e' || *current == 'E'))
+    {
+        const char* exponentStart = current + 1;
+        bool negativeExponent = false;
+        if (exponentStart < end && (*exponentStart == '-' || *exponentStart == '+'))
+        {
+            negativeExponent = *exponentStart++ == '-';
+        }
+
+        if (exponentStart < end && IsDigit(*exponentStart))
+        {
+            int explicitExponent = 0;
+            current = exponentStart;
+            while (current < end && IsDigit(*current))
+            {
+                if (explicitExponent < 100000)
+                {
+                    explicitExponent = explicitExponent * 10 + (*current - '0');
+                }
+                ++current;
+            }
+            exponent += negativeExponent ? -explicitExponent : explicitExponent;
+        }
+    }
+
+    if (mantissa == 0)
+    {
+        value = negative ? -0.0f : 0.0f;
+    }
+    else if (!truncated && mantissa <= MAX_EXACT_MANTISSA && exponent >= -MAX_EXACT_POWER && exponent <= MAX_EXACT_POWER)
+    {
+        float result = (float)mantissa;
+        result = exponent < 0 ? result / EXACT_POWERS_OF_TEN[-exponent] : result * EXACT_POWERS_OF_TEN[exponent];
+        value = negative ? -result : result;
+    }
+    else
+    {
+        value = ParseFloatFallback(begin, current);
+    }
+
+    return current;
+
+}
+
+const char* ParseInt(const char* begin, const char* end, int& value)
+{
+    const char* current = begin;
+    bool negative = false;
+    if (current < end && (*current == '-' || *current == '+'))
+    {
+        negative = *current++ == '-';
+    }
+
+    unsigned int magnitude;
+    const char* last = ParseUint(current, end, magnitude);
+    if (last == current)
+    {
+        value = 0;
+        return begin;
+    }
+
+    value = negative ? -(int)magnitude : (int)magnitude;
+    return last;
+
+}
+
+const char* ParseUint(const char* begin, const char* end, unsigned int& value)
+{
+    const char* current = begin;
+    unsigned int result = 0;
+    while (current < end && IsDigit(*current))
+    {
+        result = result * 10 + (unsigned int)(*current++ - '0');
+    }
+
+    value = result;
+    return current;
+
+}
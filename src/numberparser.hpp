@@ -0,0 +1,15 @@
+#ifndef NUMBERPARSER_HPP
+#define NUMBERPARSER_HPP
+
+// Locale-independent number parsing over [begin, end) ranges of text, for the
+// OBJ and material readers. Nothing is read at or past end. Each function
+// returns the position after the consumed characters. If there's no number
+// at begin, it returns begin and sets value to 0.
+
+// Decimal floats with optional sign, fraction and exponent ("-1.5e-3").
+// The result is correctly rounded.
+const char* ParseFloat(const char* begin, const char* end, float& value);
+const char* ParseInt(const char* begin, const char* end, int& value);
+const char* ParseUint(const char* begin, const char* end, unsigned int& value);
+
+#endif // NUMBERPARSER_HPP
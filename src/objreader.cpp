@@ -0,0 +1,155 @@
+#include "objreader.hpp"
+#include "mappedfile.hpp"
+#include "jobsystem.hpp"
+#include <algorithm>
+
+// Chunks smaller than this aren't worth a thread
+static const size_t MIN_OBJ_CHUNK_SIZE = 1 << 20;
+
+static void ParseObjChunk(const char* begin, const char* end, ObjData_t& data)
+{
+    ObjReader objReader(begin, end);
+    ObjReader::ObjToken_t token;
+
+    while ((token = objReader.NextToken()) != ObjReader::OBJ_EOF)
+    {
+        switch (token)
+        {
+        case ObjReader::OBJ_USEMTL:
+        {
+            ObjMaterialSwitch_t materialSwitch;
+            materialSwitch.startCorner = data.GetCornerCount();
+            materialSwitch.materialName = objReader.GetStringValue().ToString();
+            data.materialSwitches.push_back(materialSwitch);
+            break;
+        }
+        case ObjReader::OBJ_POSITION:
+            data.positions.push_back(float3(objReader.GetVectorValue().x, -objReader.GetVectorValue().y, objReader.GetVectorValue().z));
+            break;
+        case ObjReader::OBJ_NORMAL:
+            data.normals.push_back(float3(objReader.GetVectorValue().x, -objReader.GetVectorValue().y, objReader.GetVectorValue().z));
+            break;
+        case ObjReader::OBJ_TEXCOORD:
+            data.texcoords.push_back(float2(objReader.GetVectorValue().x, 1.0f - objReader.GetVectorValue().y));
+            break;
+        case ObjReader::OBJ_FACE:
+        {
+            unsigned int *iv, *it, *in;
+            objReader.GetFaceIndices((const unsigned int**)&iv, (const unsigned int**)&it, (const unsigned int**)&in);
+            std::swap(iv[0], iv[1]);
+            std::swap(it[0], it[1]);
+            std::swap(in[0], in[1]);
+
+            for (size_t i = 0; i < 3; ++i)
+            {
+                data.corners.push_back(iv[i]);
+                data.corners.push_back(it[i]);
+                data.corners.push_back(in[i]);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+}
+
+template <class T>
+static void AppendRange(std::vector<T>& dst, const std::vector<T>& src)
+{
+    dst.insert(dst.end(), src.begin(), src.end());
+}
+
+void ReadObjFile(const char* filename, ObjData_t& data)
+{
+    MappedFile file(filename);
+    const char* begin = file.GetData();
+    const char* end = begin + file.GetSize();
+
+    // A few chunks per thread to even out dense and sparse parts of the file
+    size_t chunkCount = std::min<size_t>(jobs->GetThreadCount() * 4, file.GetSize() / MIN_OBJ_CHUNK_SIZE);
+    if (chunkCount < 2)
+    {
+        ParseObjChunk(begin, end, data);
+        return;
+    }
+
+    // Split at line boundaries, OBJ statements never span lines
+    std::vector<const char*> bounds(chunkCount + 1);
+    bounds[0] = begin;
+    bounds[chunkCount] = end;
+    for (size_t i = 1; i < chunkCount; ++i)
+    {
+        const char* split = std::max(begin + file.GetSize() / chunkCount * i, bounds[i - 1]);
+        const char* lineEnd = (const char*)memchr(split, '\n', end - split);
+        bounds[i] = lineEnd ? lineEnd + 1 : end;
+    }
+
+    std::vector<ObjData_t> chunks(chunkCount);
+    jobs->ParallelFor((unsigned int)chunkCount, [&](unsigned int i)
+    {
+        ParseObjChunk(bounds[i], bounds[i + 1], chunks[i]);
+    });
+
+    // Face indices are absolute, so the attribute arrays just concatenate in
+    // file order. Only the material switches need their corners rebased.
+    size_t positionCount = 0, normalCount = 0, texcoordCount = 0, cornerCount = 0;
+    for (size_t i = 0; i < chunkCount; ++i)
+    {
+        positionCount += chunks[i].positions.size();
+        normalCount += chunks[i].normals.size();
+        texcoordCount += chunks[i].texcoords.size();
+        cornerCount += chunks[i].corners.size();
+    }
+
+    data.positions.reserve(positionCount);
+    data.normals.reserve(normalCount);
+    data.texcoords.reserve(texcoordCount);
+    data.corners.reserve(cornerCount);
+
+    for (size_t i = 0; i < chunkCount; ++i)
+    {
+        ObjData_t& chunk = chunks[i];
+        size_t cornerOffset = data.GetCornerCount();
+        for (size_t j = 0; j < chunk.materialSwitches.size(); ++j)
+        {
+            chunk.materialSwitches[j].startCorner += cornerOffset;
+            data.materialSwitches.push_back(chunk.materialSwitches[j]);
+        }
+
+        AppendRange(data.positions, chunk.positions);
+        AppendRange(data.normals, chunk.normals);
+        AppendRange(data.texcoords, chunk.texcoords);
+        AppendRange(data.corners, chunk.corners);
+
+        // Release as we go to keep the peak down on huge files
+        std::vector<float3>().swap(chunk.positions);
+        std::vector<float3>().swap(chunk.normals);
+        std::vector<float2>().swap(chunk.texcoords);
+        std::vector<unsigned int>().swap(chunk.corners);
+    }
+
+}
+
+VertexDictionary::VertexDictionary(size_t faceCount) : m_Count(0)
+{
+    // Typical meshes have fewer unique corners than faces, keep the load under 1/2
+    size_t size = 64;
+    while (size < faceCount * 2) size <<= 1;
+    m_Slots.assign(size, EMPTY_SLOT);
+    // A vertex per face, grows like any vector past that
+    m_Keys.reserve(faceCount * 3);
+}
+
+void VertexDictionary::Grow()
+{
+    m_Slots.assign(m_Slots.size() * 2, EMPTY_SLOT);
+    size_t mask = m_Slots.size() - 1;
+    for (unsigned int i = 0; i < m_Count; ++i)
+    {
+        size_t slot = Hash(m_Keys[i * 3], m_Keys[i * 3 + 1], m_Keys[i * 3 + 2]) & mask;
+        while (m_Slots[slot] != EMPTY_SLOT) slot = (slot + 1) & mask;
+        m_Slots[slot] = i;
+    }
+}
@@ -0,0 +1,354 @@
+#ifndef OBJREADER_HPP
+#define OBJREADER_HPP
+
+#include "mathlib.hpp"
+#include "numberparser.hpp"
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Non-owning view into the text of a mapped file
+struct StringSpan_t
+{
+    StringSpan_t() : data(nullptr), length(0) {}
+    StringSpan_t(const char* data, size_t length) : data(data), length(length) {}
+
+    bool operator==(const char* str) const
+    {
+        return strncmp(data, str, length) == 0 && str[length] == '\0';
+    }
+
+    // Copies into a fixed-size buffer, always null-terminated
+    void CopyTo(char* buffer, size_t size) const
+    {
+        size_t count = length < size - 1 ? length : size - 1;
+        memcpy(buffer, data, count);
+        buffer[count] = '\0';
+    }
+
+    std::string ToString() const { return std::string(data, length); }
+
+    const char* data;
+    size_t length;
+
+};
+
+// Scans a range of a memory-mapped text file line by line, in place
+class FileReader
+{
+public:
+    FileReader(const char* begin, const char* end) : m_Current(begin), m_LineEnd(begin), m_End(end), m_VectorValue(0.0f)
+    {
+    }
+
+    StringSpan_t GetStringValue() const
+    {
+        return m_StringValue;
+    }
+
+    float3 GetVectorValue() const
+    {
+        return m_VectorValue;
+    }
+
+protected:
+    float ReadFloatValue()
+    {
+        SkipSpaces();
+        float value;
+        m_Current = ParseFloat(m_Current, m_LineEnd, value);
+        return value;
+    }
+
+    int ReadIntValue()
+    {
+        SkipSpaces();
+        int value;
+        m_Current = ParseInt(m_Current, m_LineEnd, value);
+        return value;
+    }
+
+    unsigned int ReadUintValue()
+    {
+        SkipSpaces();
+        unsigned int value;
+        m_Current = ParseUint(m_Current, m_LineEnd, value);
+        return value;
+    }
+
+    void ReadVectorValue()
+    {
+        m_VectorValue.x = ReadFloatValue();
+        m_VectorValue.y = ReadFloatValue();
+        m_VectorValue.z = ReadFloatValue();
+
+    }
+
+    void ReadStringValue()
+    {
+        SkipSpaces();
+        const char* start = m_Current;
+
+        if (m_Current < m_LineEnd && IsIdentifierStart(*m_Current))
+        {
+            ++m_Current;
+            while (m_Current < m_LineEnd && IsIdentifierBody(*m_Current))
+            {
+                ++m_Current;
+            }
+        }
+
+        m_StringValue = StringSpan_t(start, m_Current - start);
+
+    }
+
+    bool ReadLine()
+    {
+        // Skip the rest of the previous line and any empty lines
+        m_Current = m_LineEnd;
+        while (m_Current < m_End && *m_Current == '\n')
+        {
+            ++m_Current;
+        }
+
+        if (m_Current >= m_End)
+        {
+            return false;
+        }
+
+        m_LineEnd = (const char*)memchr(m_Current, '\n', m_End - m_Current);
+        if (!m_LineEnd)
+        {
+            m_LineEnd = m_End;
+        }
+
+        return true;
+    }
+
+    void SkipSpaces()
+    {
+        while (m_Current < m_LineEnd && IsSpace(*m_Current)) { m_Current++; }
+    }
+
+    void SkipSymbol(char symbol)
+    {
+        SkipSpaces();
+        while (m_Current < m_LineEnd && *m_Current == symbol) { m_Current++; }
+    }
+
+    bool IsSpace(char symbol)
+    {
+        return symbol == ' ' || (symbol >= '\t' && symbol <= '\r');
+    }
+
+    bool IsDigit(char symbol)
+    {
+        return symbol >= '0' && symbol <= '9';
+    }
+
+    bool IsIdentifierStart(char symbol)
+    {
+        return (symbol >= 'a' && symbol <= 'z') ||
+            (symbol >= 'A' && symbol <= 'Z') || symbol == '_';
+    }
+
+    bool IsIdentifierBody(char symbol)
+    {
+        return IsIdentifierStart(symbol) || IsDigit(symbol);
+    }
+
+private:
+    const char* m_Current;
+    const char* m_LineEnd;
+    const char* m_End;
+    StringSpan_t m_StringValue;
+    float3 m_VectorValue;
+
+};
+
+class ObjReader : public FileReader
+{
+public:
+    enum ObjToken_t
+    {
+        OBJ_MTLLIB,
+        OBJ_USEMTL,
+        OBJ_POSITION,
+        OBJ_TEXCOORD,
+        OBJ_NORMAL,
+        OBJ_FACE,
+        OBJ_SMOOTHINGGROUP,
+        OBJ_INVALID,
+        OBJ_EOF
+    };
+
+    ObjReader(const char* begin, const char* end) : FileReader(begin, end)
+    {
+    }
+
+    ObjToken_t NextToken()
+    {
+        if (!ReadLine())
+        {
+            return OBJ_EOF;
+        }
+
+        ReadStringValue();
+        if (GetStringValue() == "mtllib")
+        {
+            ReadStringValue();
+            return OBJ_MTLLIB;
+        }
+        else if (GetStringValue() == "usemtl")
+        {
+            ReadStringValue();
+            return OBJ_USEMTL;
+        }
+        else if (GetStringValue() == "v")
+        {
+            ReadVectorValue();
+            return OBJ_POSITION;
+        }
+        else if (GetStringValue() == "vn")
+        {
+            ReadVectorValue();
+            return OBJ_NORMAL;
+        }
+        else if (GetStringValue() == "vt")
+        {
+            ReadVectorValue();
+            return OBJ_TEXCOORD;
+        }
+        else if (GetStringValue() == "f")
+        {
+            for (size_t i = 0; i < 3; ++i)
+            {
+                m_VertexIndices[i] = (unsigned int)ReadIntValue() - 1;
+                SkipSymbol('/');
+                m_TexcoordIndices[i] = (unsigned int)ReadIntValue() - 1;
+                SkipSymbol('/');
+                m_NormalIndices[i] = (unsigned int)ReadIntValue() - 1;
+
+            }
+            return OBJ_FACE;
+        }
+        else if (GetStringValue() == "s")
+        {
+            m_UintValue = ReadUintValue();
+            return OBJ_SMOOTHINGGROUP;
+        }
+        else
+        {
+            return OBJ_INVALID;
+        }
+
+    }
+
+    void GetFaceIndices(const unsigned int** iv, const unsigned int** it, const unsigned int** in) const
+    {
+        *iv = m_VertexIndices;
+        *it = m_TexcoordIndices;
+        *in = m_NormalIndices;
+
+    }
+
+    int GetUintValue() const
+    {
+        return m_UintValue;
+    }
+
+private:
+    // Face indices
+    unsigned int m_VertexIndices[3];
+    unsigned int m_TexcoordIndices[3];
+    unsigned int m_NormalIndices[3];
+    unsigned int m_UintValue;
+
+};
+
+struct ObjMaterialSwitch_t
+{
+    size_t startCorner;
+    std::string materialName;
+};
+
+// Raw contents of an OBJ file. Positions, normals and texcoords are already
+// flipped into engine space, faces are flattened into v/vt/vn corner triples.
+struct ObjData_t
+{
+    std::vector<float3> positions;
+    std::vector<float3> normals;
+    std::vector<float2> texcoords;
+    std::vector<unsigned int> corners;
+    std::vector<ObjMaterialSwitch_t> materialSwitches;
+
+    size_t GetCornerCount() const { return corners.size() / 3; }
+};
+
+// Splits the file at line boundaries and parses the chunks on all cores.
+// The result is the same as parsing the file front to back.
+void ReadObjFile(const char* filename, ObjData_t& data);
+
+// Open-addressing map from an OBJ face corner (v/vt/vn triple) to the index of
+// the vertex built for it. Slots hold vertex indices only, the triples themselves
+// live in a dense array indexed by vertex, so the table stays 4 bytes per slot.
+class VertexDictionary
+{
+public:
+    VertexDictionary(size_t faceCount);
+
+    // Returns the vertex index for the triple. isNew is set when the triple
+    // is seen for the first time, it then gets the next free index.
+    unsigned int FindOrInsert(unsigned int v, unsigned int t, unsigned int n, bool& isNew)
+    {
+        if ((m_Count + 1) * 2 > m_Slots.size())
+        {
+            Grow();
+        }
+
+        size_t mask = m_Slots.size() - 1;
+        size_t slot = Hash(v, t, n) & mask;
+        while (m_Slots[slot] != EMPTY_SLOT)
+        {
+            const unsigned int* key = &m_Keys[m_Slots[slot] * 3];
+            if (key[0] == v && key[1] == t && key[2] == n)
+            {
+                isNew = false;
+                return m_Slots[slot];
+            }
+            slot = (slot + 1) & mask;
+        }
+
+        m_Keys.push_back(v);
+        m_Keys.push_back(t);
+        m_Keys.push_back(n);
+        m_Slots[slot] = m_Count;
+        isNew = true;
+        return m_Count++;
+    }
+
+private:
+    enum { EMPTY_SLOT = 0xFFFFFFFF };
+
+    static size_t Hash(unsigned int v, unsigned int t, unsigned int n)
+    {
+        // murmur3 finalizer over a cheap mix of the three indices
+        unsigned int h = v * 0x9E3779B1u ^ t * 0x85EBCA77u ^ n * 0xC2B2AE3Du;
+        h ^= h >> 16;
+        h *= 0x85EBCA6Bu;
+        h ^= h >> 13;
+        h *= 0xC2B2AE35u;
+        h ^= h >> 16;
+        return h;
+    }
+
+    void Grow();
+
+    std::vector<unsigned int> m_Slots;
+    // v/vt/vn of every vertex, 3 words each
+    std::vector<unsigned int> m_Keys;
+    unsigned int m_Count;
+
+};
+
+#endif // OBJREADER_HPP
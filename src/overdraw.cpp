@@ -0,0 +1,287 @@
+#include "overdraw.hpp"
+#include "jobsystem.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+// Resolution of the views used to measure overdraw
+static const int OVERDRAW_GRID_SIZE = 256;
+// FIFO size used to place cluster boundaries, same as AnalyzeVertexCache
+static const unsigned int CLUSTER_CACHE_SIZE = 16;
+
+// Geometric normal scaled by twice the area. Flipped to agree with the vertex
+// normals, which tell which side is the front whatever the winding of the file.
+static float3 GetFaceNormal(const Vertex& a, const Vertex& b, const Vertex& c)
+{
+    float3 normal = cross(b.position - a.position, c.position - a.position);
+    if (dot(normal, a.normal + b.normal + c.normal) < 0.0f)
+    {
+        normal = -normal;
+    }
+    return normal;
+}
+
+// Pixels on an edge belong to only one of the two triangles sharing it
+static bool IsInside(float edge, float dx, float dy)
+{
+    return edge > 0.0f || (edge == 0.0f && (dy > 0.0f || (dy == 0.0f && dx < 0.0f)));
+}
+
+// Orthographic view along axis, from the negative side or the positive one
+static void RasterizeView(const Vertex* vertices, const unsigned int* indices, size_t triangleCount,
+                          int axis, bool fromPositive, const float3& boundsMin, float boundsScale,
+                          size_t& shadedPixels, size_t& coveredPixels)
+{
+    int uAxis = (axis + 1) % 3;
+    int vAxis = (axis + 2) % 3;
+    float depthSign = fromPositive ? -1.0f : 1.0f;
+    std::vector<float> depthBuffer(OVERDRAW_GRID_SIZE * OVERDRAW_GRID_SIZE, FLT_MAX);
+    shadedPixels = 0;
+
+    for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+    {
+        const Vertex* corners[3] = { &vertices[indices[triangle * 3]], &vertices[indices[triangle * 3 + 1]], &vertices[indices[triangle * 3 + 2]] };
+        if (GetFaceNormal(*corners[0], *corners[1], *corners[2])[axis] * depthSign >= 0.0f)
+        {
+            continue;
+        }
+
+        float x[3], y[3], z[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            const float3& position = corners[i]->position;
+            x[i] = (position[uAxis] - boundsMin[uAxis]) * boundsScale;
+            y[i] = (position[vAxis] - boundsMin[vAxis]) * boundsScale;
+            z[i] = position[axis] * depthSign;
+        }
+
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+        if (area == 0.0f)
+        {
+            continue;
+        }
+        if (area < 0.0f)
+        {
+            std::swap(x[1], x[2]);
+            std::swap(y[1], y[2]);
+            std::swap(z[1], z[2]);
+            area = -area;
+        }
+
+        int minX = std::max<int>((int)std::floor(std::min<float>(x[0], std::min<float>(x[1], x[2]))), 0);
+        int minY = std::max<int>((int)std::floor(std::min<float>(y[0], std::min<float>(y[1], y[2]))), 0);
+        int maxX = std::min<int>((int)std::ceil(std::max<float>(x[0], std::max<float>(x[1], x[2]))), OVERDRAW_GRID_SIZE - 1);
+        int maxY = std::min<int>((int)std::ceil(std::max<float>(y[0], std::max<float>(y[1], y[2]))), OVERDRAW_GRID_SIZE - 1);
+
+        for (int py = minY; py <= maxY; ++py)
+        {
+            for (int px = minX; px <= maxX; ++px)
+            {
+                float sx = px + 0.5f;
+                float sy = py + 0.5f;
+                // Edge opposite to each corner, positive inside
+                float edge0 = (x[2] - x[1]) * (sy - y[1]) - (y[2] - y[1]) * (sx - x[1]);
+                float edge1 = (x[0] - x[2]) * (sy - y[2]) - (y[0] - y[2]) * (sx - x[2]);
+                float edge2 = (x[1] - x[0]) * (sy - y[0]) - (y[1] - y[0]) * (sx - x[0]);
+                if (!IsInside(edge0, x[2] - x[1], y[2] - y[1]) ||
+                    !IsInside(edge1, x[0] - x[2], y[0] - y[2]) ||
+                    !IsInside(edge2, x[1] - x[0], y[1] - y[0]))
+                {
+                    continue;
+                }
+
+                float depth = (edge0 * z[0] + edge1 * z[1] + edge2 * z[2]) / area;
+                float& stored = depthBuffer[py * OVERDRAW_GRID_SIZE + px];
+                if (depth < stored)
+                {
+                    stored = depth;
+                    ++shadedPixels;
+                }
+            }
+        }
+    }
+
+    coveredPixels = 0;
+    for (size_t i = 0; i < depthBuffer.size(); ++i)
+    {
+        coveredPixels += depthBuffer[i] != FLT_MAX;
+    }
+
+}
+
+float AnalyzeOverdraw(const Vertex* vertices, const unsigned int* indices, size_t indexCount)
+{
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+    {
+        return 0.0f;
+    }
+
+    float3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+    {
+        const float3& position = vertices[indices[i]].position;
+        for (size_t axis = 0; axis < 3; ++axis)
+        {
+            boundsMin[axis] = std::min<float>(boundsMin[axis], position[axis]);
+            boundsMax[axis] = std::max<float>(boundsMax[axis], position[axis]);
+        }
+    }
+
+    // Same scale on all axes, so thin meshes seen edge-on stay thin
+    float extent = std::max<float>(boundsMax.x - boundsMin.x, std::max<float>(boundsMax.y - boundsMin.y, boundsMax.z - boundsMin.z));
+    float boundsScale = extent > 0.0f ? OVERDRAW_GRID_SIZE / extent : 0.0f;
+
+    size_t shadedPixels[6], coveredPixels[6];
+    jobs->ParallelFor(6, [&](unsigned int view)
+    {
+        RasterizeView(vertices, indices, triangleCount, view / 2, (view & 1) != 0, boundsMin, boundsScale, shadedPixels[view], coveredPixels[view]);
+    });
+
+    size_t shaded = 0, covered = 0;
+    for (int view = 0; view < 6; ++view)
+    {
+        shaded += shadedPixels[view];
+        covered += coveredPixels[view];
+    }
+    return covered ? (float)shaded / covered : 0.0f;
+}
+
+void OptimizeOverdraw(unsigned int* indices, size_t indexCount, const Vertex* vertices, float threshold)
+{
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2)
+    {
+        return;
+    }
+
+    // FIFO simulation over the vertices of the range only
+    unsigned int minIndex = *std::min_element(indices, indices + triangleCount * 3);
+    unsigned int maxIndex = *std::max_element(indices, indices + triangleCount * 3);
+    std::vector<unsigned int> timestamps((size_t)maxIndex - minIndex + 1, 0);
+    unsigned int time = CLUSTER_CACHE_SIZE + 1;
+    auto countMisses = [&](size_t triangle)
+    {
+        unsigned int misses = 0;
+        for (size_t i = 0; i < 3; ++i)
+        {
+            unsigned int& timestamp = timestamps[indices[triangle * 3 + i] - minIndex];
+            if (time - timestamp > CLUSTER_CACHE_SIZE)
+            {
+                timestamp = time++;
+                ++misses;
+            }
+        }
+        return misses;
+    };
+    auto flushCache = [&]()
+    {
+        time += CLUSTER_CACHE_SIZE + 1;
+    };
+
+    // Hard boundaries, where the cache order jumped and every corner missed
+    std::vector<size_t> hardBoundaries;
+    for (size_t i = 0; i < triangleCount; ++i)
+    {
+        unsigned int misses = countMisses(i);
+        if (i == 0 || misses == 3)
+        {
+            hardBoundaries.push_back(i);
+        }
+    }
+    hardBoundaries.push_back(triangleCount);
+
+    // Soft boundaries, as soon as a cluster started from a cold cache
+    // has an ACMR close enough to the one of the whole hard cluster
+    std::vector<size_t> clusters;
+    for (size_t hard = 0; hard + 1 < hardBoundaries.size(); ++hard)
+    {
+        size_t begin = hardBoundaries[hard];
+        size_t end = hardBoundaries[hard + 1];
+
+        flushCache();
+        unsigned int misses = 0;
+        for (size_t i = begin; i < end; ++i)
+        {
+            misses += countMisses(i);
+        }
+        float clusterThreshold = threshold * misses / (end - begin);
+
+        flushCache();
+        clusters.push_back(begin);
+        size_t clusterStart = begin;
+        misses = 0;
+        for (size_t i = begin; i + 1 < end; ++i)
+        {
+            misses += countMisses(i);
+            if ((float)misses / (i + 1 - clusterStart) <= clusterThreshold)
+            {
+                flushCache();
+                clusters.push_back(i + 1);
+                clusterStart = i + 1;
+                misses = 0;
+            }
+        }
+    }
+    size_t clusterCount = clusters.size();
+    clusters.push_back(triangleCount);
+
+    // Area weighted centroids and normals
+    std::vector<float3> clusterCentroids(clusterCount);
+    std::vector<float3> clusterNormals(clusterCount);
+    float3 rangeCentroid;
+    float rangeArea = 0.0f;
+    for (size_t cluster = 0; cluster < clusterCount; ++cluster)
+    {
+        float3 centroid;
+        float3 normal;
+        float area = 0.0f;
+        for (size_t i = clusters[cluster]; i < clusters[cluster + 1]; ++i)
+        {
+            const Vertex& a = vertices[indices[i * 3]];
+            const Vertex& b = vertices[indices[i * 3 + 1]];
+            const Vertex& c = vertices[indices[i * 3 + 2]];
+            float3 faceNormal = GetFaceNormal(a, b, c);
+            float faceArea = faceNormal.length();
+            centroid += (a.position + b.position + c.position) * (faceArea / 3.0f);
+            normal += faceNormal;
+            area += faceArea;
+        }
+
+        rangeCentroid += centroid;
+        rangeArea += area;
+        clusterCentroids[cluster] = area > 0.0f ? centroid * (1.0f / area) : centroid;
+        clusterNormals[cluster] = normal;
+    }
+    if (rangeArea > 0.0f)
+    {
+        rangeCentroid *= 1.0f / rangeArea;
+    }
+
+    // Outward facing clusters first
+    std::vector<float> sortKeys(clusterCount, 0.0f);
+    std::vector<size_t> clusterOrder(clusterCount);
+    for (size_t cluster = 0; cluster < clusterCount; ++cluster)
+    {
+        float normalLength = clusterNormals[cluster].length();
+        if (normalLength > 0.0f)
+        {
+            sortKeys[cluster] = dot(clusterCentroids[cluster] - rangeCentroid, clusterNormals[cluster]) / normalLength;
+        }
+        clusterOrder[cluster] = cluster;
+    }
+    std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](size_t a, size_t b)
+    {
+        return sortKeys[a] > sortKeys[b];
+    });
+
+    std::vector<unsigned int> reordered;
+    reordered.reserve(triangleCount * 3);
+    for (size_t i = 0; i < clusterCount; ++i)
+    {
+        size_t cluster = clusterOrder[i];
+        reordered.insert(reordered.end(), indices + clusters[cluster] * 3, indices + clusters[cluster + 1] * 3);
+    }
+    std::copy(reordered.begin(), reordered.end(), indices);
+
+}
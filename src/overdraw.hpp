@@ -0,0 +1,18 @@
+#ifndef OVERDRAW_HPP
+#define OVERDRAW_HPP
+
+#include "mathlib.hpp"
+
+// Rasterizes the triangles in order from the six axis directions with depth
+// test and back face culling, returns shaded pixels per covered pixel. 1 at best.
+float AnalyzeOverdraw(const Vertex* vertices, const unsigned int* indices, size_t indexCount);
+
+// View-independent overdraw reduction (Sander et al., "Fast Triangle Reordering
+// for Vertex Locality and Reduced Overdraw"). The range is cut into clusters where
+// the cache order allows, then clusters facing away from the centre of the range
+// are drawn first, so they tend to occlude the rest from any direction.
+// threshold is how much worse than the input the ACMR of a cluster may get,
+// 1.05 keeps nearly all of the vertex cache ordering.
+void OptimizeOverdraw(unsigned int* indices, size_t indexCount, const Vertex* vertices, float threshold = 1.05f);
+
+#endif // OVERDRAW_HPP
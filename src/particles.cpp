@@ -67,16 +67,29 @@ void ParticleEffect::InitBuffers()
         indices.push_back(i * 4 + 2);
     }
 
+    // Four vertices per particle, 16-bit indices cover up to 16K particles
+    std::vector<unsigned short> indices16;
+    const void* indexData = indices.data();
+    size_t indexSize = sizeof(unsigned int);
+    m_IndexFormat = DXGI_FORMAT_R32_UINT;
+    if (m_MaxParticles * 4 <= 0x10000)
+    {
+        indices16.assign(indices.begin(), indices.end());
+        indexData = indices16.data();
+        indexSize = sizeof(unsigned short);
+        m_IndexFormat = DXGI_FORMAT_R16_UINT;
+    }
+
     D3D11_BUFFER_DESC indexBufferDesc;
     ZeroMemory(&indexBufferDesc, sizeof(indexBufferDesc));
 
     indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-    indexBufferDesc.ByteWidth = sizeof(unsigned int) * m_MaxParticles * 6;
+    indexBufferDesc.ByteWidth = indexSize * m_MaxParticles * 6;
     indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
 
     D3D11_SUBRESOURCE_DATA indexBufferData;
     ZeroMemory(&indexBufferData, sizeof(indexBufferData));
-    indexBufferData.pSysMem = indices.data();
+    indexBufferData.pSysMem = indexData;
     render->GetDevice()->CreateBuffer(&indexBufferDesc, &indexBufferData, &m_IndexBuffer);
     
 }
@@ -167,7 +180,7 @@ void ParticleEffect::Draw() const
     pscb.lightColor = float3(1.0f, 0.9f, 0.8f) * 2.0f;
 
     render->GetDeviceContext()->IASetVertexBuffers(0, 1, &m_VertexBuffer, &stride, &offset);
-    render->GetDeviceContext()->IASetIndexBuffer(m_IndexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+    render->GetDeviceContext()->IASetIndexBuffer(m_IndexBuffer.Get(), m_IndexFormat, 0);
     render->GetDeviceContext()->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
     const ViewSetup* shadowView = render->GetPreviousView();
@@ -70,6 +70,7 @@ private:
 
     ScopedObject<ID3D11Buffer> m_VertexBuffer;
     ScopedObject<ID3D11Buffer> m_IndexBuffer;
+    DXGI_FORMAT m_IndexFormat;
 
 };
 
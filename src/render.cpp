@@ -1,6 +1,8 @@
 #include "render.hpp"
 #include "mathlib.hpp"
 #include "mesh.hpp"
+#include "staticbatch.hpp"
+#include "skinnedmesh.hpp"
 #include "particles.hpp"
 #include "inputsystem.hpp"
 #include "materialsystem.hpp"
@@ -10,21 +12,6 @@
 static Render g_Render;
 Render* render = &g_Render;
 
-void ViewSetup::ComputeMatrices()
-{
-    matWorldToCamera = Matrix::LookAtLH(origin, target, up);
-    matWorldToView = matWorldToCamera;
-    // Projection Matrix
-    if (ortho)
-    {
-        matWorldToCamera *= Matrix::OrthoLH(viewSize.x, viewSize.y, nearZ, farZ);
-    }
-    else
-    {
-        matWorldToCamera *= Matrix::PerspectiveFovLH(fov, viewSize.x / viewSize.y, nearZ, farZ);
-    }
-}
-
 class Camera
 {
 public:
@@ -154,9 +141,12 @@ void Render::InitScene()
 {    
     //m_Meshes.push_back(std::make_shared<Mesh>("meshes/sponza.dat", "sponza", Matrix::Translation(0.0f, 0.0f, 40.0f)));
     m_Meshes.push_back(std::make_shared<Mesh>("meshes/skysphere.obj", nullptr, Matrix::Scaling(100.0f, 100.0f, 100.0f), false));
-    m_Meshes.push_back(std::make_shared<Mesh>("meshes/axis.obj", nullptr, Matrix::Scaling(32.0f, 32.0f, 32.0f)));
-    m_Meshes.push_back(std::make_shared<Mesh>("meshes/plane_1024.obj"));
-    m_Meshes.push_back(std::make_shared<Mesh>("meshes/cylinder.obj"));
+
+    std::vector<StaticBatchSource_t> staticMeshes;
+    staticMeshes.push_back(StaticBatchSource_t("meshes/axis.obj", nullptr, Matrix::Scaling(32.0f, 32.0f, 32.0f)));
+    staticMeshes.push_back(StaticBatchSource_t("meshes/plane_1024.obj"));
+    staticMeshes.push_back(StaticBatchSource_t("meshes/cylinder.obj"));
+    m_Meshes.push_back(std::make_shared<StaticBatch>("meshes/static_scene", staticMeshes));
 
     emitter = std::make_shared<RectangleEmitter>(float3(-32, 0, 72), float3(1, 0, 0), float2(32.0f, 32.0f));
     m_ParticleEffects.push_back(std::make_shared<ParticleEffect>(emitter, 2000, "particle_smoke"));
@@ -184,6 +174,7 @@ void Render::Init(HWND hWnd)
     shadowstate.depthTexture = materials->CreateRenderableTexture(2048, 2048, "_rt_ShadowDepth");
     m_ShadowStates.push_back(shadowstate);    
     InitScene();
+    ReportGeometryMemory();
     
 }
 
@@ -191,6 +182,26 @@ void Render::SetupView()
 {
 }
 
+void Render::AddSkinnedMesh(std::shared_ptr<SkinnedMesh> mesh)
+{
+    m_Meshes.push_back(mesh);
+    m_SkinnedMeshes.push_back(mesh);
+}
+
+GeometryMemory_t Render::ReportGeometryMemory() const
+{
+    GeometryMemory_t total = {};
+    for (std::vector<std::shared_ptr<Mesh> >::const_iterator it = m_Meshes.begin(); it != m_Meshes.end(); ++it)
+    {
+        GeometryMemory_t memory = (*it)->GetMemoryUsage();
+        LOG_INFO((*it)->GetName() << ": " << memory.cpuBytes / 1024 << " KB CPU, " << memory.gpuBytes / 1024 << " KB GPU")
+        total.cpuBytes += memory.cpuBytes;
+        total.gpuBytes += memory.gpuBytes;
+    }
+    LOG_INFO("Geometry: " << m_Meshes.size() << " meshes, " << total.cpuBytes / 1024 << " KB CPU, " << total.gpuBytes / 1024 << " KB GPU")
+    return total;
+}
+
 void Render::PushView(ViewSetup& view, std::shared_ptr<Texture> renderTexture)
 {
     view.ComputeMatrices();
@@ -247,6 +258,9 @@ void Render::RenderFrame()
     float emitterYaw = guimanager->GetElementByName<Trackbar>("emitter_yaw")->GetValue();
     emitter->SetAngle(AngleToVector(emitterPitch, emitterYaw));
 
+    // The shadow and camera passes draw the same skinned vertices
+    SkinnedMesh::UpdateAll(m_SkinnedMeshes);
+
     GetTickCount();
     ShadowState_t cascade = m_ShadowStates.back();
     ViewSetup& view = cascade.view;
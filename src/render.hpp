@@ -4,6 +4,7 @@
 #include "gui.hpp"
 #include "mathlib.hpp"
 #include "utils.hpp"
+#include "viewsetup.hpp"
 #include <memory>
 #include <Windows.h>
 
@@ -15,47 +16,14 @@
 //#include <DirectXMath.h>
 
 struct Vertex;
-struct ViewSetup;
 class Mesh;
+class SkinnedMesh;
+struct GeometryMemory_t;
 class Camera;
 class Texture;
 class ParticleEffect;
 class ParticleEmitter;
 
-struct ViewSetup
-{
-    ViewSetup() :
-        x(0), y(0),
-        width(128), height(128),
-        viewSize(128.0f, 128.0f),
-        origin(0.0f, 0.0f, 0.0f),
-        target(1.0f, 0.0f, 0.0f),
-        up(0.0f, 0.0f, 1.0f),
-        ortho(false),
-        fov(MATH_PIDIV2),
-        farZ(1024.0f),
-        nearZ(1.0f)
-    {}
-
-    void ComputeMatrices();
-
-    int x, y;
-    int width, height;
-    float2 viewSize;
-    float3 origin;
-    float3 target;
-    float3 up;
-    bool ortho;
-    float fov;
-    float farZ;
-    float nearZ;
-
-    Matrix matWorldToCamera;
-    Matrix matWorldToView;
-    Matrix matViewToProjection;
-
-};
-
 struct ShadowState_t
 {
     std::shared_ptr<Texture> depthTexture;
@@ -79,6 +47,12 @@ public:
     void PushView(ViewSetup& view, std::shared_ptr<Texture> renderTexture = nullptr);
     void PopView();
 
+    // Drawn like the other meshes, skinned once per frame before the first pass
+    void AddSkinnedMesh(std::shared_ptr<SkinnedMesh> mesh);
+
+    // Logs the CPU and GPU bytes of every mesh in the scene, returns the totals
+    GeometryMemory_t ReportGeometryMemory() const;
+
 private:
     void InitD3D();
     void InitScene();
@@ -95,6 +69,7 @@ private:
     double m_PreviousFrameTime;
 
     std::vector<std::shared_ptr<Mesh> > m_Meshes;
+    std::vector<std::shared_ptr<SkinnedMesh> > m_SkinnedMeshes;
     std::vector<std::shared_ptr<ParticleEffect> > m_ParticleEffects;
     std::shared_ptr<ParticleEmitter> emitter;
     std::vector<ViewSetup> m_ViewStack;
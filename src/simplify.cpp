@@ -0,0 +1,561 @@
+#include "simplify.hpp"
+#include <algorithm>
+#include <cmath>
+
+static const unsigned int NO_VERTEX = 0xFFFFFFFF;
+static const unsigned int MANY_VERTICES = 0xFFFFFFFE;
+
+// Planes through border and seam edges count this much more than the faces,
+// so outlines and UV islands keep their shape
+static const float BORDER_WEIGHT = 10.0f;
+// Collapses may not turn a face normal by more than ~75 degrees
+static const float MIN_NORMAL_DOT = 0.25f;
+// Each pass takes collapses up to this much worse than its first quarter
+static const double PASS_ERROR_FACTOR = 1.5;
+
+enum VertexKind_t
+{
+    VERTEX_MANIFOLD,
+    VERTEX_BORDER,
+    VERTEX_SEAM,
+    VERTEX_LOCKED,
+};
+
+// Sum of squared distances to weighted planes, A = sum(n n^T), b = sum(d n), c = sum(d d)
+struct Quadric_t
+{
+    double a00, a11, a22, a10, a20, a21;
+    double b0, b1, b2;
+    double c;
+    double weight;
+};
+
+struct Collapse_t
+{
+    unsigned int from;
+    unsigned int to;
+    double error;
+};
+
+static void AddPlane(Quadric_t& quadric, const float3& normal, const float3& point, float weight)
+{
+    double x = normal.x, y = normal.y, z = normal.z;
+    double d = -dot(normal, point);
+    quadric.a00 += weight * x * x;
+    quadric.a11 += weight * y * y;
+    quadric.a22 += weight * z * z;
+    quadric.a10 += weight * y * x;
+    quadric.a20 += weight * z * x;
+    quadric.a21 += weight * z * y;
+    quadric.b0 += weight * d * x;
+    quadric.b1 += weight * d * y;
+    quadric.b2 += weight * d * z;
+    quadric.c += weight * d * d;
+    quadric.weight += weight;
+}
+
+static void AddQuadric(Quadric_t& quadric, const Quadric_t& other)
+{
+    quadric.a00 += other.a00;
+    quadric.a11 += other.a11;
+    quadric.a22 += other.a22;
+    quadric.a10 += other.a10;
+    quadric.a20 += other.a20;
+    quadric.a21 += other.a21;
+    quadric.b0 += other.b0;
+    quadric.b1 += other.b1;
+    quadric.b2 += other.b2;
+    quadric.c += other.c;
+    quadric.weight += other.weight;
+}
+
+// p^T A p + 2 b.p + c
+static double EvaluateQuadric(const Quadric_t& quadric, const float3& point)
+{
+    double x = point.x, y = point.y, z = point.z;
+    double rx = quadric.a00 * x + quadric.a10 * y + quadric.a20 * z + quadric.b0;
+    double ry = quadric.a10 * x + quadric.a11 * y + quadric.a21 * z + quadric.b1;
+    double rz = quadric.a20 * x + quadric.a21 * y + quadric.a22 * z + quadric.b2;
+    return std::fabs(rx * x + ry * y + rz * z + quadric.b0 * x + quadric.b1 * y + quadric.b2 * z + quadric.c);
+}
+
+// Weighted mean squared distance of the merged vertex to the planes of both
+static double GetCollapseError(const Quadric_t& from, const Quadric_t& to, const float3& point)
+{
+    double weight = from.weight + to.weight;
+    return weight > 0.0 ? (EvaluateQuadric(from, point) + EvaluateQuadric(to, point)) / weight : 0.0;
+}
+
+template <typename GetPosition>
+static void RemapPositions(size_t vertexCount, GetPosition getPosition, std::vector<unsigned int>& remap)
+{
+    std::vector<unsigned int> order(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        order[i] = (unsigned int)i;
+    }
+    std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b)
+    {
+        const float3& pa = getPosition(a);
+        const float3& pb = getPosition(b);
+        if (pa.x != pb.x) return pa.x < pb.x;
+        if (pa.y != pb.y) return pa.y < pb.y;
+        if (pa.z != pb.z) return pa.z < pb.z;
+        return a < b;
+    });
+
+    remap.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        bool same = false;
+        if (i > 0)
+        {
+            const float3& pa = getPosition(order[i]);
+            const float3& pb = getPosition(order[i - 1]);
+            same = pa.x == pb.x && pa.y == pb.y && pa.z == pb.z;
+        }
+        remap[order[i]] = same ? remap[order[i - 1]] : order[i];
+    }
+
+}
+
+void GeneratePositionRemap(const Vertex* vertices, size_t vertexCount, std::vector<unsigned int>& remap)
+{
+    RemapPositions(vertexCount, [&](unsigned int i) -> const float3& { return vertices[i].position; }, remap);
+}
+
+// Directed edges of the triangles, by first vertex
+struct EdgeAdjacency_t
+{
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned int> targets;
+    // The other end of the only edge leaving or entering the vertex that has
+    // no twin, NO_VERTEX or MANY_VERTICES otherwise
+    std::vector<unsigned int> openOut;
+    std::vector<unsigned int> openIn;
+
+    bool HasEdge(unsigned int a, unsigned int b) const
+    {
+        for (unsigned int i = offsets[a]; i < offsets[a + 1]; ++i)
+        {
+            if (targets[i] == b)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+static void BuildEdgeAdjacency(EdgeAdjacency_t& adjacency, const unsigned int* indices, size_t indexCount, size_t vertexCount)
+{
+    adjacency.offsets.assign(vertexCount + 1, 0);
+    adjacency.targets.resize(indexCount);
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        ++adjacency.offsets[indices[i] + 1];
+    }
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        adjacency.offsets[i + 1] += adjacency.offsets[i];
+    }
+
+    std::vector<unsigned int> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+    for (size_t i = 0; i < indexCount; i += 3)
+    {
+        for (size_t e = 0; e < 3; ++e)
+        {
+            unsigned int a = indices[i + e];
+            unsigned int b = indices[i + (e + 1) % 3];
+            adjacency.targets[fill[a]++] = b;
+        }
+    }
+
+    adjacency.openOut.assign(vertexCount, NO_VERTEX);
+    adjacency.openIn.assign(vertexCount, NO_VERTEX);
+    for (unsigned int a = 0; a < vertexCount; ++a)
+    {
+        for (unsigned int i = adjacency.offsets[a]; i < adjacency.offsets[a + 1]; ++i)
+        {
+            unsigned int b = adjacency.targets[i];
+            if (!adjacency.HasEdge(b, a))
+            {
+                adjacency.openOut[a] = adjacency.openOut[a] == NO_VERTEX ? b : MANY_VERTICES;
+                adjacency.openIn[b] = adjacency.openIn[b] == NO_VERTEX ? a : MANY_VERTICES;
+            }
+        }
+    }
+
+}
+
+static bool IsSingle(unsigned int vertex)
+{
+    return vertex != NO_VERTEX && vertex != MANY_VERTICES;
+}
+
+// Triangles around each position, by position representative
+static void BuildTriangleFans(std::vector<unsigned int>& offsets, std::vector<unsigned int>& triangles,
+                              const unsigned int* indices, size_t indexCount, const std::vector<unsigned int>& remap)
+{
+    size_t vertexCount = remap.size();
+    offsets.assign(vertexCount + 1, 0);
+    triangles.resize(indexCount);
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        ++offsets[remap[indices[i]] + 1];
+    }
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        offsets[i + 1] += offsets[i];
+    }
+
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        triangles[fill[remap[indices[i]]]++] = (unsigned int)(i / 3);
+    }
+
+}
+
+// The wedge of the other side of a seam that collapses along with the first one
+static unsigned int FindSeamTarget(const EdgeAdjacency_t& adjacency, const std::vector<unsigned int>& remap, unsigned int wedge, unsigned int targetPosition)
+{
+    unsigned int openOut = adjacency.openOut[wedge];
+    unsigned int openIn = adjacency.openIn[wedge];
+    if (IsSingle(openOut) && remap[openOut] == targetPosition)
+    {
+        return openOut;
+    }
+    if (IsSingle(openIn) && remap[openIn] == targetPosition)
+    {
+        return openIn;
+    }
+    return NO_VERTEX;
+}
+
+float SimplifyMesh(const unsigned int* indices, size_t indexCount, const Vertex* vertices, const unsigned char* lockedVertices,
+                   size_t targetIndexCount, float targetError, std::vector<unsigned int>& simplified)
+{
+    indexCount -= indexCount % 3;
+
+    // Work on the vertices of the range only, numbered densely
+    std::vector<unsigned int> rangeVertices(indices, indices + indexCount);
+    std::sort(rangeVertices.begin(), rangeVertices.end());
+    rangeVertices.erase(std::unique(rangeVertices.begin(), rangeVertices.end()), rangeVertices.end());
+    size_t vertexCount = rangeVertices.size();
+
+    std::vector<float3> positions(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        positions[i] = vertices[rangeVertices[i]].position;
+    }
+    std::vector<unsigned int> remap;
+    RemapPositions(vertexCount, [&](unsigned int i) -> const float3& { return positions[i]; }, remap);
+
+    // Degenerate triangles never come back, drop them now
+    simplified.resize(indexCount);
+    size_t currentIndexCount = 0;
+    for (size_t i = 0; i < indexCount; i += 3)
+    {
+        unsigned int corners[3];
+        for (size_t k = 0; k < 3; ++k)
+        {
+            corners[k] = (unsigned int)(std::lower_bound(rangeVertices.begin(), rangeVertices.end(), indices[i + k]) - rangeVertices.begin());
+        }
+        if (remap[corners[0]] != remap[corners[1]] && remap[corners[1]] != remap[corners[2]] && remap[corners[2]] != remap[corners[0]])
+        {
+            simplified[currentIndexCount++] = corners[0];
+            simplified[currentIndexCount++] = corners[1];
+            simplified[currentIndexCount++] = corners[2];
+        }
+    }
+
+    // Vertices sharing a position, as a circular list
+    std::vector<unsigned int> wedges(vertexCount);
+    for (unsigned int i = 0; i < vertexCount; ++i)
+    {
+        wedges[i] = i;
+        if (remap[i] != i)
+        {
+            wedges[i] = wedges[remap[i]];
+            wedges[remap[i]] = i;
+        }
+    }
+
+    EdgeAdjacency_t adjacency;
+    BuildEdgeAdjacency(adjacency, simplified.data(), currentIndexCount, vertexCount);
+
+    std::vector<unsigned char> kinds(vertexCount);
+    for (unsigned int i = 0; i < vertexCount; ++i)
+    {
+        unsigned int openOut = adjacency.openOut[i];
+        unsigned int openIn = adjacency.openIn[i];
+        unsigned int wedge = wedges[i];
+        if (wedge == i)
+        {
+            if (openOut == NO_VERTEX && openIn == NO_VERTEX)
+            {
+                kinds[i] = VERTEX_MANIFOLD;
+            }
+            else if (IsSingle(openOut) && IsSingle(openIn) && openOut != openIn)
+            {
+                kinds[i] = VERTEX_BORDER;
+            }
+            else
+            {
+                kinds[i] = VERTEX_LOCKED;
+            }
+        }
+        else if (wedges[wedge] == i && IsSingle(openOut) && IsSingle(openIn) &&
+                 IsSingle(adjacency.openOut[wedge]) && IsSingle(adjacency.openIn[wedge]) &&
+                 remap[openOut] == remap[adjacency.openIn[wedge]] && remap[openIn] == remap[adjacency.openOut[wedge]])
+        {
+            // Two wedges whose open edges mirror each other
+            kinds[i] = VERTEX_SEAM;
+        }
+        else
+        {
+            kinds[i] = VERTEX_LOCKED;
+        }
+    }
+    if (lockedVertices)
+    {
+        for (unsigned int i = 0; i < vertexCount; ++i)
+        {
+            if (lockedVertices[rangeVertices[i]])
+            {
+                for (unsigned int wedge = i; ; wedge = wedges[wedge])
+                {
+                    kinds[wedge] = VERTEX_LOCKED;
+                    if (wedges[wedge] == i) break;
+                }
+            }
+        }
+    }
+
+    // Area weighted face planes, plus planes standing on border and seam edges
+    std::vector<Quadric_t> quadrics(vertexCount);
+    for (size_t i = 0; i < currentIndexCount; i += 3)
+    {
+        const unsigned int* corners = &simplified[i];
+        float3 normal = cross(positions[corners[1]] - positions[corners[0]], positions[corners[2]] - positions[corners[0]]);
+        float area = normal.length();
+        if (area == 0.0f)
+        {
+            continue;
+        }
+        normal *= 1.0f / area;
+
+        for (size_t k = 0; k < 3; ++k)
+        {
+            AddPlane(quadrics[remap[corners[k]]], normal, positions[corners[0]], area * 0.5f);
+        }
+
+        for (size_t e = 0; e < 3; ++e)
+        {
+            unsigned int a = corners[e];
+            unsigned int b = corners[(e + 1) % 3];
+            if (adjacency.HasEdge(b, a))
+            {
+                continue;
+            }
+            float3 edge = positions[b] - positions[a];
+            float3 edgeNormal = cross(edge, normal);
+            float length = edgeNormal.length();
+            if (length > 0.0f)
+            {
+                edgeNormal *= 1.0f / length;
+                float weight = dot(edge, edge) * BORDER_WEIGHT;
+                AddPlane(quadrics[remap[a]], edgeNormal, positions[a], weight);
+                AddPlane(quadrics[remap[b]], edgeNormal, positions[a], weight);
+            }
+        }
+    }
+
+    auto canCollapse = [&](unsigned int from, unsigned int to)
+    {
+        if (remap[from] == remap[to])
+        {
+            return false;
+        }
+        switch (kinds[from])
+        {
+        case VERTEX_MANIFOLD:
+            return true;
+        case VERTEX_BORDER:
+            return adjacency.openOut[from] == to || adjacency.openIn[from] == to;
+        case VERTEX_SEAM:
+            return FindSeamTarget(adjacency, remap, from, remap[to]) != NO_VERTEX &&
+                   FindSeamTarget(adjacency, remap, wedges[from], remap[to]) != NO_VERTEX;
+        default:
+            return false;
+        }
+    };
+
+    std::vector<unsigned int> fanOffsets, fanTriangles;
+    auto flipsTriangle = [&](unsigned int from, unsigned int to)
+    {
+        unsigned int fromPosition = remap[from];
+        unsigned int toPosition = remap[to];
+        for (unsigned int i = fanOffsets[fromPosition]; i < fanOffsets[fromPosition + 1]; ++i)
+        {
+            const unsigned int* corners = &simplified[fanTriangles[i] * 3];
+            float3 p[3];
+            bool collapses = false;
+            for (size_t k = 0; k < 3; ++k)
+            {
+                collapses |= remap[corners[k]] == toPosition;
+                p[k] = positions[corners[k]];
+            }
+            if (collapses)
+            {
+                continue;
+            }
+
+            float3 before = cross(p[1] - p[0], p[2] - p[0]);
+            for (size_t k = 0; k < 3; ++k)
+            {
+                if (remap[corners[k]] == fromPosition)
+                {
+                    p[k] = positions[to];
+                }
+            }
+            float3 after = cross(p[1] - p[0], p[2] - p[0]);
+            if (dot(before, after) < MIN_NORMAL_DOT * before.length() * after.length())
+            {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    double errorLimit = (double)targetError * targetError;
+    double maxError = 0.0;
+    std::vector<Collapse_t> collapses;
+    std::vector<unsigned char> touched(vertexCount);
+    std::vector<unsigned int> collapseRemap(vertexCount);
+    bool first = true;
+    while (currentIndexCount > targetIndexCount)
+    {
+        if (!first)
+        {
+            BuildEdgeAdjacency(adjacency, simplified.data(), currentIndexCount, vertexCount);
+        }
+        first = false;
+        BuildTriangleFans(fanOffsets, fanTriangles, simplified.data(), currentIndexCount, remap);
+
+        // Cheapest direction of every edge, interior edges are seen from both sides
+        collapses.clear();
+        for (size_t i = 0; i < currentIndexCount; i += 3)
+        {
+            for (size_t e = 0; e < 3; ++e)
+            {
+                unsigned int a = simplified[i + e];
+                unsigned int b = simplified[i + (e + 1) % 3];
+                if (a > b && adjacency.HasEdge(b, a))
+                {
+                    continue;
+                }
+
+                const Quadric_t& qa = quadrics[remap[a]];
+                const Quadric_t& qb = quadrics[remap[b]];
+                double errorAB = canCollapse(a, b) ? GetCollapseError(qa, qb, positions[b]) : HUGE_VAL;
+                double errorBA = canCollapse(b, a) ? GetCollapseError(qb, qa, positions[a]) : HUGE_VAL;
+                if (errorAB != HUGE_VAL || errorBA != HUGE_VAL)
+                {
+                    Collapse_t collapse = errorAB <= errorBA ? Collapse_t{ a, b, errorAB } : Collapse_t{ b, a, errorBA };
+                    collapses.push_back(collapse);
+                }
+            }
+        }
+        if (collapses.empty())
+        {
+            break;
+        }
+        // Only the collapses under the limit of the pass need to be in order
+        auto lessError = [](const Collapse_t& a, const Collapse_t& b)
+        {
+            return a.error < b.error;
+        };
+        std::nth_element(collapses.begin(), collapses.begin() + collapses.size() / 4, collapses.end(), lessError);
+        double passLimit = collapses[collapses.size() / 4].error * PASS_ERROR_FACTOR;
+        collapses.erase(std::partition(collapses.begin(), collapses.end(), [&](const Collapse_t& collapse)
+        {
+            return collapse.error <= passLimit;
+        }), collapses.end());
+        std::sort(collapses.begin(), collapses.end(), lessError);
+        size_t trianglesToRemove = (currentIndexCount - targetIndexCount + 2) / 3;
+        size_t trianglesRemoved = 0;
+        size_t applied = 0;
+        std::fill(touched.begin(), touched.end(), 0);
+        for (unsigned int i = 0; i < vertexCount; ++i)
+        {
+            collapseRemap[i] = i;
+        }
+
+        for (size_t i = 0; i < collapses.size() && trianglesRemoved < trianglesToRemove; ++i)
+        {
+            const Collapse_t& collapse = collapses[i];
+            if (collapse.error > errorLimit)
+            {
+                break;
+            }
+
+            unsigned int fromPosition = remap[collapse.from];
+            unsigned int toPosition = remap[collapse.to];
+            if (touched[fromPosition] || touched[toPosition] || flipsTriangle(collapse.from, collapse.to))
+            {
+                continue;
+            }
+
+            if (kinds[collapse.from] == VERTEX_SEAM)
+            {
+                collapseRemap[collapse.from] = FindSeamTarget(adjacency, remap, collapse.from, toPosition);
+                collapseRemap[wedges[collapse.from]] = FindSeamTarget(adjacency, remap, wedges[collapse.from], toPosition);
+            }
+            else
+            {
+                collapseRemap[collapse.from] = collapse.to;
+            }
+            AddQuadric(quadrics[toPosition], quadrics[fromPosition]);
+
+            // Triangles around the collapse may only move once per pass
+            for (unsigned int j = fanOffsets[fromPosition]; j < fanOffsets[fromPosition + 1]; ++j)
+            {
+                const unsigned int* corners = &simplified[fanTriangles[j] * 3];
+                touched[remap[corners[0]]] = touched[remap[corners[1]]] = touched[remap[corners[2]]] = 1;
+            }
+            touched[toPosition] = 1;
+
+            trianglesRemoved += kinds[collapse.from] == VERTEX_BORDER ? 1 : 2;
+            maxError = std::max<double>(maxError, collapse.error);
+            ++applied;
+        }
+        if (applied == 0)
+        {
+            break;
+        }
+
+        size_t writeIndex = 0;
+        for (size_t i = 0; i < currentIndexCount; i += 3)
+        {
+            unsigned int a = collapseRemap[simplified[i]];
+            unsigned int b = collapseRemap[simplified[i + 1]];
+            unsigned int c = collapseRemap[simplified[i + 2]];
+            if (remap[a] != remap[b] && remap[b] != remap[c] && remap[c] != remap[a])
+            {
+                simplified[writeIndex++] = a;
+                simplified[writeIndex++] = b;
+                simplified[writeIndex++] = c;
+            }
+        }
+        currentIndexCount = writeIndex;
+    }
+
+    simplified.resize(currentIndexCount);
+    for (size_t i = 0; i < currentIndexCount; ++i)
+    {
+        simplified[i] = rangeVertices[simplified[i]];
+    }
+    return (float)std::sqrt(maxError);
+}
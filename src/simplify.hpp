@@ -0,0 +1,20 @@
+#ifndef SIMPLIFY_HPP
+#define SIMPLIFY_HPP
+
+#include "mathlib.hpp"
+#include <vector>
+
+// Gives every vertex the index of the first vertex with the same position
+void GeneratePositionRemap(const Vertex* vertices, size_t vertexCount, std::vector<unsigned int>& remap);
+
+// Quadric error simplification (Garland and Heckbert, "Surface Simplification
+// Using Quadric Error Metrics") by collapsing edges onto existing vertices, so
+// the vertex buffer is shared by every level. Vertices on UV or normal seams
+// only slide along the seam, vertices on open borders along the border, and
+// vertices flagged in lockedVertices (indexed like vertices, may be null) stay.
+// Stops at targetIndexCount or before the error would exceed targetError.
+// Returns the error, roughly how far in model units the surface moved.
+float SimplifyMesh(const unsigned int* indices, size_t indexCount, const Vertex* vertices, const unsigned char* lockedVertices,
+                   size_t targetIndexCount, float targetError, std::vector<unsigned int>& simplified);
+
+#endif // SIMPLIFY_HPP
@@ -0,0 +1,113 @@
+#include "skinnedmesh.hpp"
+
+SkinnedMesh::SkinnedMesh(const char* name, const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const std::vector<VertexSkin_t>& skin,
+                         std::shared_ptr<const Skeleton> skeleton, const char* materialName, const Matrix& modelToWorld, bool castShadow)
+    : m_Skeleton(skeleton), m_BindVertices(vertices), m_Skin(skin), m_Pose(*skeleton), m_SkinMatrices(skeleton->GetBoneCount())
+{
+    if (skin.size() != vertices.size())
+    {
+        THROW_RUNTIME(name << ": " << skin.size() << " skinned vertices for " << vertices.size() << " vertices")
+    }
+    for (size_t i = 0; i < skin.size(); ++i)
+    {
+        for (unsigned int j = 0; j < MAX_BONE_INFLUENCES; ++j)
+        {
+            if ((skin[i].weights[j] || j == 0) && skin[i].bones[j] >= skeleton->GetBoneCount())
+            {
+                THROW_RUNTIME(name << ": vertex " << i << " uses bone " << (unsigned int)skin[i].bones[j] << ", the skeleton has " << skeleton->GetBoneCount())
+            }
+        }
+    }
+
+    m_Name = name;
+    m_ModelToWorld = AffineTransform(modelToWorld);
+    m_CastShadow = castShadow;
+
+    MeshGroup_t meshGroup;
+    meshGroup.startIndex = 0;
+    meshGroup.indexCount = (unsigned int)indices.size();
+    meshGroup.baseVertex = 0;
+    SetMaterialName(meshGroup, nullptr, materialName, strlen(materialName));
+    m_MeshGroups.push_back(meshGroup);
+
+    // Rewritten every frame, so the bind pose is not uploaded
+    D3D11_BUFFER_DESC vertexBufferDesc;
+    ZeroMemory(&vertexBufferDesc, sizeof(vertexBufferDesc));
+
+    vertexBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+    vertexBufferDesc.ByteWidth = (UINT)(sizeof(Vertex) * vertices.size());
+    vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+    vertexBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+    render->GetDevice()->CreateBuffer(&vertexBufferDesc, nullptr, &m_VertexBuffer);
+    m_VertexBufferBytes = vertexBufferDesc.ByteWidth;
+    m_VertexFormat = VERTEX_FORMAT_FULL;
+
+    m_Indices = indices;
+    InitIndexBuffer(m_Indices.data(), m_Indices.size());
+    ApplyResidency();
+    Update();
+
+}
+
+void SkinnedMesh::Update()
+{
+    SkinnedMesh* mesh = this;
+    Skin(&mesh, 1);
+}
+
+void SkinnedMesh::UpdateAll(const std::vector<std::shared_ptr<SkinnedMesh> >& meshes)
+{
+    std::vector<SkinnedMesh*> rawMeshes(meshes.size());
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+        rawMeshes[i] = meshes[i].get();
+    }
+    Skin(rawMeshes.data(), rawMeshes.size());
+}
+
+// All buffers are mapped on this thread, the workers write into them, then they are unmapped here
+void SkinnedMesh::Skin(SkinnedMesh* const* meshes, size_t count)
+{
+    ID3D11DeviceContext* context = render->GetDeviceContext();
+    std::vector<SkinBatch_t> batches;
+    std::vector<SkinnedMesh*> mappedMeshes;
+    batches.reserve(count);
+    mappedMeshes.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        SkinnedMesh* mesh = meshes[i];
+        mesh->m_Pose.ComputeSkinMatrices(mesh->m_SkinMatrices.data());
+
+        D3D11_MAPPED_SUBRESOURCE mappedResource;
+        if (FAILED(context->Map(mesh->m_VertexBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource)))
+        {
+            LOG_INFO(mesh->m_Name << ": can't map the vertex buffer, skipped")
+            continue;
+        }
+
+        SkinBatch_t batch;
+        batch.vertices = mesh->m_BindVertices.data();
+        batch.skin = mesh->m_Skin.data();
+        batch.vertexCount = mesh->m_BindVertices.size();
+        batch.skinMatrices = mesh->m_SkinMatrices.data();
+        batch.skinned = (Vertex*)mappedResource.pData;
+        batches.push_back(batch);
+        mappedMeshes.push_back(mesh);
+    }
+
+    SkinVertices(batches.data(), batches.size());
+
+    for (size_t i = 0; i < mappedMeshes.size(); ++i)
+    {
+        context->Unmap(mappedMeshes[i]->m_VertexBuffer.Get(), 0);
+    }
+
+}
+
+GeometryMemory_t SkinnedMesh::GetMemoryUsage() const
+{
+    GeometryMemory_t memory = Mesh::GetMemoryUsage();
+    memory.cpuBytes += m_BindVertices.capacity() * sizeof(Vertex) + m_Skin.capacity() * sizeof(VertexSkin_t) + m_SkinMatrices.capacity() * sizeof(SkinMatrix_t);
+    return memory;
+}
@@ -0,0 +1,40 @@
+#ifndef SKINNEDMESH_HPP
+#define SKINNEDMESH_HPP
+
+#include "mesh.hpp"
+#include "skinning.hpp"
+#include <memory>
+
+// Mesh deformed by a skeleton on the CPU. The bind pose stays in system memory,
+// the skinned vertices are written straight into a dynamic vertex buffer in
+// VERTEX_FORMAT_FULL once per frame, before any pass draws the mesh.
+class SkinnedMesh : public Mesh
+{
+public:
+    // One mesh group of materialName over all the triangles, skin has one entry per vertex.
+    // Starts skinned in the bind pose.
+    SkinnedMesh(const char* name, const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const std::vector<VertexSkin_t>& skin,
+                std::shared_ptr<const Skeleton> skeleton, const char* materialName, const Matrix& modelToWorld = Matrix::Identity(), bool castShadow = true);
+
+    // Changes show from the next update on
+    Pose& GetPose() { return m_Pose; }
+    const Skeleton& GetSkeleton() const { return *m_Skeleton; }
+
+    void Update();
+    // Skins every mesh with its current pose, all of them in one pass over the job system
+    static void UpdateAll(const std::vector<std::shared_ptr<SkinnedMesh> >& meshes);
+
+    virtual GeometryMemory_t GetMemoryUsage() const;
+
+private:
+    static void Skin(SkinnedMesh* const* meshes, size_t count);
+
+    std::shared_ptr<const Skeleton> m_Skeleton;
+    std::vector<Vertex> m_BindVertices;
+    std::vector<VertexSkin_t> m_Skin;
+    Pose m_Pose;
+    std::vector<SkinMatrix_t> m_SkinMatrices;
+
+};
+
+#endif // SKINNEDMESH_HPP
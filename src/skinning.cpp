@@ -0,0 +1,219 @@
+#include "skinning.hpp"
+#include "jobsystem.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <cstring>
+#include <emmintrin.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+// Vertices skinned per job
+static const size_t SKIN_BLOCK_SIZE = 2048;
+
+static_assert(sizeof(Vertex) == 14 * sizeof(float), "WriteSkinnedVertex assumes Vertex is 14 packed floats");
+
+Skeleton::Skeleton(const std::vector<Bone_t>& bones) : m_Bones(bones)
+{
+    if (bones.size() > MAX_SKELETON_BONES)
+    {
+        THROW_RUNTIME("Skeleton has " << bones.size() << " bones, at most " << MAX_SKELETON_BONES << " are supported")
+    }
+
+    std::vector<Matrix> bindPoses(bones.size());
+    m_InverseBindPoses.resize(bones.size());
+    for (size_t i = 0; i < bones.size(); ++i)
+    {
+        int parent = bones[i].parent;
+        if (parent < -1 || parent >= (int)i)
+        {
+            THROW_RUNTIME("Bone " << i << " (" << bones[i].name << ") must come after its parent " << parent)
+        }
+        bindPoses[i] = parent < 0 ? bones[i].bindTransform : bindPoses[parent] * bones[i].bindTransform;
+        m_InverseBindPoses[i] = bindPoses[i].Inverse();
+    }
+}
+
+int Skeleton::FindBone(const char* name) const
+{
+    for (size_t i = 0; i < m_Bones.size(); ++i)
+    {
+        if (strncmp(m_Bones[i].name, name, sizeof(m_Bones[i].name)) == 0)
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+Pose::Pose(const Skeleton& skeleton) : m_Skeleton(&skeleton), m_ModelTransforms(skeleton.GetBoneCount())
+{
+    Reset();
+}
+
+void Pose::Reset()
+{
+    m_LocalTransforms.resize(m_Skeleton->GetBoneCount());
+    for (size_t i = 0; i < m_LocalTransforms.size(); ++i)
+    {
+        m_LocalTransforms[i] = m_Skeleton->GetBone(i).bindTransform;
+    }
+}
+
+void Pose::ComputeSkinMatrices(SkinMatrix_t* skinMatrices)
+{
+    for (size_t i = 0; i < m_LocalTransforms.size(); ++i)
+    {
+        int parent = m_Skeleton->GetBone(i).parent;
+        m_ModelTransforms[i] = parent < 0 ? m_LocalTransforms[i] : m_ModelTransforms[parent] * m_LocalTransforms[i];
+        Matrix skin = m_ModelTransforms[i] * m_Skeleton->GetInverseBindPose(i);
+
+        SkinMatrix_t& skinMatrix = skinMatrices[i];
+        for (int column = 0; column < 4; ++column)
+        {
+            skinMatrix.columns[column][0] = skin.m[0][column];
+            skinMatrix.columns[column][1] = skin.m[1][column];
+            skinMatrix.columns[column][2] = skin.m[2][column];
+            skinMatrix.columns[column][3] = 0.0f;
+        }
+    }
+}
+
+static inline __m128 Normalize3(__m128 vec)
+{
+    __m128 squared = _mm_mul_ps(vec, vec);
+    __m128 sum = _mm_add_ss(_mm_add_ss(squared, _mm_shuffle_ps(squared, squared, _MM_SHUFFLE(1, 1, 1, 1))), _mm_shuffle_ps(squared, squared, _MM_SHUFFLE(2, 2, 2, 2)));
+    // Zero vectors stay zero
+    sum = _mm_max_ps(_mm_shuffle_ps(sum, sum, _MM_SHUFFLE(0, 0, 0, 0)), _mm_set1_ps(1e-30f));
+    // One Newton step takes the estimate to about float precision, well below the 1/255 steps of the weights
+    __m128 estimate = _mm_rsqrt_ps(sum);
+    __m128 halfSum = _mm_mul_ps(sum, _mm_set1_ps(0.5f));
+    estimate = _mm_mul_ps(estimate, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(halfSum, _mm_mul_ps(estimate, estimate))));
+    return _mm_mul_ps(vec, estimate);
+}
+
+// Assembled on the stack and copied in one go. Each store spills into the next
+// field, which is written right after.
+static inline void WriteSkinnedVertex(__m128 position, const float2& texcoord, __m128 normal, __m128 tangentS, __m128 tangentT, Vertex* skinned)
+{
+    float assembled[16];
+    _mm_storeu_ps(assembled, position);
+    assembled[3] = texcoord.x;
+    assembled[4] = texcoord.y;
+    _mm_storeu_ps(assembled + 5, normal);
+    _mm_storeu_ps(assembled + 8, tangentS);
+    _mm_storeu_ps(assembled + 11, tangentT);
+    memcpy(skinned, assembled, sizeof(Vertex));
+}
+
+#ifdef __AVX__
+
+// Two lanes of four, a in the low one and b in the high one
+static inline __m256 SplatPair(float a, float b)
+{
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(a)), _mm_set1_ps(b), 1);
+}
+
+// Transforms two directions at once, one per 128-bit lane
+static inline __m256 TransformPair(__m256 c0, __m256 c1, __m256 c2, const float3& a, const float3& b)
+{
+    return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c0, SplatPair(a.x, b.x)), _mm256_mul_ps(c1, SplatPair(a.y, b.y))), _mm256_mul_ps(c2, SplatPair(a.z, b.z)));
+}
+
+void SkinVertices(const Vertex* vertices, const VertexSkin_t* skin, size_t count, const SkinMatrix_t* skinMatrices, Vertex* skinned)
+{
+    const __m256 weightScale = _mm256_set1_ps(1.0f / 255.0f);
+    for (size_t i = 0; i < count; ++i)
+    {
+        // Two columns per register. Influences are sorted heaviest first, most vertices stop early.
+        const VertexSkin_t& vertexSkin = skin[i];
+        const SkinMatrix_t* bone = &skinMatrices[vertexSkin.bones[0]];
+        __m256 weight = _mm256_mul_ps(_mm256_set1_ps((float)vertexSkin.weights[0]), weightScale);
+        __m256 c01 = _mm256_mul_ps(weight, _mm256_loadu_ps(bone->columns[0]));
+        __m256 c23 = _mm256_mul_ps(weight, _mm256_loadu_ps(bone->columns[2]));
+        for (unsigned int j = 1; j < MAX_BONE_INFLUENCES && vertexSkin.weights[j]; ++j)
+        {
+            bone = &skinMatrices[vertexSkin.bones[j]];
+            weight = _mm256_mul_ps(_mm256_set1_ps((float)vertexSkin.weights[j]), weightScale);
+            c01 = _mm256_add_ps(c01, _mm256_mul_ps(weight, _mm256_loadu_ps(bone->columns[0])));
+            c23 = _mm256_add_ps(c23, _mm256_mul_ps(weight, _mm256_loadu_ps(bone->columns[2])));
+        }
+
+        __m256 c0 = _mm256_permute2f128_ps(c01, c01, 0x00);
+        __m256 c1 = _mm256_permute2f128_ps(c01, c01, 0x11);
+        __m256 c2 = _mm256_permute2f128_ps(c23, c23, 0x00);
+        __m128 c3 = _mm256_extractf128_ps(c23, 1);
+
+        const Vertex& vertex = vertices[i];
+        __m256 positionNormal = TransformPair(c0, c1, c2, vertex.position, vertex.normal);
+        __m256 tangents = TransformPair(c0, c1, c2, vertex.tangent_s, vertex.tangent_t);
+        WriteSkinnedVertex(_mm_add_ps(_mm256_castps256_ps128(positionNormal), c3), vertex.texcoord,
+                           Normalize3(_mm256_extractf128_ps(positionNormal, 1)),
+                           Normalize3(_mm256_castps256_ps128(tangents)),
+                           Normalize3(_mm256_extractf128_ps(tangents, 1)), &skinned[i]);
+    }
+}
+
+#else
+
+static inline __m128 TransformDirection(const __m128* c, const float3& vec)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(c[0], _mm_set1_ps(vec.x)), _mm_mul_ps(c[1], _mm_set1_ps(vec.y))), _mm_mul_ps(c[2], _mm_set1_ps(vec.z)));
+}
+
+void SkinVertices(const Vertex* vertices, const VertexSkin_t* skin, size_t count, const SkinMatrix_t* skinMatrices, Vertex* skinned)
+{
+    const __m128 weightScale = _mm_set1_ps(1.0f / 255.0f);
+    for (size_t i = 0; i < count; ++i)
+    {
+        // Influences are sorted heaviest first, most vertices stop early
+        const VertexSkin_t& vertexSkin = skin[i];
+        const SkinMatrix_t* bone = &skinMatrices[vertexSkin.bones[0]];
+        __m128 weight = _mm_mul_ps(_mm_set1_ps((float)vertexSkin.weights[0]), weightScale);
+        __m128 c[4];
+        for (int column = 0; column < 4; ++column)
+        {
+            c[column] = _mm_mul_ps(weight, _mm_loadu_ps(bone->columns[column]));
+        }
+        for (unsigned int j = 1; j < MAX_BONE_INFLUENCES && vertexSkin.weights[j]; ++j)
+        {
+            bone = &skinMatrices[vertexSkin.bones[j]];
+            weight = _mm_mul_ps(_mm_set1_ps((float)vertexSkin.weights[j]), weightScale);
+            for (int column = 0; column < 4; ++column)
+            {
+                c[column] = _mm_add_ps(c[column], _mm_mul_ps(weight, _mm_loadu_ps(bone->columns[column])));
+            }
+        }
+
+        const Vertex& vertex = vertices[i];
+        WriteSkinnedVertex(_mm_add_ps(TransformDirection(c, vertex.position), c[3]), vertex.texcoord,
+                           Normalize3(TransformDirection(c, vertex.normal)),
+                           Normalize3(TransformDirection(c, vertex.tangent_s)),
+                           Normalize3(TransformDirection(c, vertex.tangent_t)), &skinned[i]);
+    }
+}
+
+#endif
+
+void SkinVertices(const SkinBatch_t* batches, size_t batchCount)
+{
+    // First block of each batch, the blocks of a batch are consecutive
+    std::vector<size_t> firstBlocks(batchCount + 1);
+    size_t blockCount = 0;
+    for (size_t i = 0; i < batchCount; ++i)
+    {
+        firstBlocks[i] = blockCount;
+        blockCount += (batches[i].vertexCount + SKIN_BLOCK_SIZE - 1) / SKIN_BLOCK_SIZE;
+    }
+    firstBlocks[batchCount] = blockCount;
+
+    jobs->ParallelFor((unsigned int)blockCount, [&](unsigned int block)
+    {
+        // Empty batches share their first block with the next one, upper_bound skips them
+        size_t batchIndex = std::upper_bound(firstBlocks.begin(), firstBlocks.end(), (size_t)block) - firstBlocks.begin() - 1;
+        const SkinBatch_t& batch = batches[batchIndex];
+        size_t begin = (block - firstBlocks[batchIndex]) * SKIN_BLOCK_SIZE;
+        size_t end = std::min(begin + SKIN_BLOCK_SIZE, batch.vertexCount);
+        SkinVertices(batch.vertices + begin, batch.skin + begin, end - begin, batch.skinMatrices, batch.skinned + begin);
+    });
+}
@@ -0,0 +1,92 @@
+#ifndef SKINNING_HPP
+#define SKINNING_HPP
+
+#include "mathlib.hpp"
+#include "vertexformat.hpp"
+#include <vector>
+
+// Bone indices are stored in a byte per influence
+static const unsigned int MAX_SKELETON_BONES = 256;
+
+struct Bone_t
+{
+    char name[32];
+    // Index of the parent bone, which comes before it, -1 for roots
+    int parent;
+    // Bind pose, relative to the parent or to the model for roots
+    Matrix bindTransform;
+
+};
+
+// Posed model space from bind pose model space, the first three rows of a
+// matrix taking column vectors, stored by columns so the kernel blends them
+// without shuffles. The last lane of each column is 0.
+struct SkinMatrix_t
+{
+    float columns[4][4];
+
+};
+
+// Bones sorted parents first, with the inverses of their bind poses in model space
+class Skeleton
+{
+public:
+    // Throws if a bone comes before its parent or there are too many bones
+    Skeleton(const std::vector<Bone_t>& bones);
+
+    size_t GetBoneCount() const { return m_Bones.size(); }
+    const Bone_t& GetBone(size_t bone) const { return m_Bones[bone]; }
+    const Matrix& GetInverseBindPose(size_t bone) const { return m_InverseBindPoses[bone]; }
+    // -1 if there is no such bone
+    int FindBone(const char* name) const;
+
+private:
+    std::vector<Bone_t> m_Bones;
+    std::vector<Matrix> m_InverseBindPoses;
+
+};
+
+// Transforms of the bones of a skeleton, relative to their parents. Starts in the bind pose.
+class Pose
+{
+public:
+    Pose(const Skeleton& skeleton);
+
+    const Skeleton& GetSkeleton() const { return *m_Skeleton; }
+    void SetLocalTransform(size_t bone, const Matrix& transform) { m_LocalTransforms[bone] = transform; }
+    const Matrix& GetLocalTransform(size_t bone) const { return m_LocalTransforms[bone]; }
+    // Back to the bind pose
+    void Reset();
+
+    // Resolves the hierarchy in one pass, then fills one matrix per bone
+    void ComputeSkinMatrices(SkinMatrix_t* skinMatrices);
+
+private:
+    const Skeleton* m_Skeleton;
+    std::vector<Matrix> m_LocalTransforms;
+    std::vector<Matrix> m_ModelTransforms;
+
+};
+
+// Blends the matrices of the bones of each vertex and moves positions, normals
+// and tangents from the bind pose to the pose. Directions go through the same
+// matrix and are renormalized, which is exact for rotations and uniform scales.
+// Texcoords are copied. Each vertex is written once, front to back, so skinned
+// may point into a mapped vertex buffer. Uses AVX when compiled with it, SSE otherwise.
+void SkinVertices(const Vertex* vertices, const VertexSkin_t* skin, size_t count, const SkinMatrix_t* skinMatrices, Vertex* skinned);
+
+struct SkinBatch_t
+{
+    const Vertex* vertices;
+    const VertexSkin_t* skin;
+    size_t vertexCount;
+    const SkinMatrix_t* skinMatrices;
+    Vertex* skinned;
+
+};
+
+// Skins every batch across the job system. Batches are cut into blocks of
+// vertices, so a few large meshes spread over the cores as well as many small ones.
+void SkinVertices(const SkinBatch_t* batches, size_t batchCount);
+
+#endif // SKINNING_HPP
@@ -0,0 +1,214 @@
+#include "staticbatch.hpp"
+#include "datfile.hpp"
+#include "assetcache.hpp"
+#include <cstring>
+
+// Part of the cache key of batches, on top of the import keys of the sources. Bump when Merge changes.
+static const unsigned int STATIC_BATCH_VERSION = 1;
+
+// Matrices take column vectors, the translation is left out
+static float3 TransformDirection(const Matrix& matrix, const float3& direction)
+{
+    return float3(matrix.m[0][0] * direction.x + matrix.m[0][1] * direction.y + matrix.m[0][2] * direction.z,
+                  matrix.m[1][0] * direction.x + matrix.m[1][1] * direction.y + matrix.m[1][2] * direction.z,
+                  matrix.m[2][0] * direction.x + matrix.m[2][1] * direction.y + matrix.m[2][2] * direction.z);
+}
+
+static float3 SafeNormalize(const float3& vec)
+{
+    float length = vec.length();
+    return length > 0.0f ? vec * (1.0f / length) : vec;
+}
+
+StaticBatch::StaticBatch(const char* name, const std::vector<StaticBatchSource_t>& sources, bool castShadow, const MeshImportOptions_t& options)
+{
+    m_Name = name;
+    m_Residency = options.residency;
+    m_ModelToWorld = AffineTransform::Identity();
+    m_CastShadow = castShadow;
+
+    MeshImportOptions_t sourceOptions = options;
+    sourceOptions.lodCount = 1;
+    sourceOptions.buildMeshlets = false;
+    unsigned long long key = HashBytes(&STATIC_BATCH_VERSION, sizeof(STATIC_BATCH_VERSION));
+    key = HashBytes(&options.buildMeshlets, sizeof(options.buildMeshlets), key);
+    for (size_t i = 0; i < sources.size(); ++i)
+    {
+        unsigned long long sourceKey = GetImportKey(sources[i].filename.c_str(), sourceOptions);
+        key = HashBytes(&sourceKey, sizeof(sourceKey), key);
+        key = HashBytes(sources[i].modelToWorld.m, sizeof(sources[i].modelToWorld.m), key);
+        key = HashBytes(sources[i].mtldir.c_str(), sources[i].mtldir.size() + 1, key);
+    }
+    std::string cacheFile = GetCachePath(name, key, ".dat");
+
+    bool loaded = false;
+    if (FileExists(cacheFile.c_str()))
+    {
+        try
+        {
+            LoadFromDat(cacheFile.c_str());
+            loaded = true;
+        }
+        catch (const std::exception&)
+        {
+            // Damaged entry, merge again and replace it
+            m_MeshGroups.clear();
+            m_Lods.clear();
+            m_Meshlets.clear();
+            m_Ranges.clear();
+        }
+    }
+
+    if (!loaded)
+    {
+        Merge(name, sources, options);
+        std::string tempFile = GetCacheTempPath(cacheFile);
+        SaveToDat(tempFile.c_str(), options.compressDat);
+        PublishCacheFile(tempFile, cacheFile);
+        InitBuffers();
+    }
+
+    LOG_INFO(name << ": " << sources.size() << " meshes batched, " << GetSourceDrawCount() << " draws -> " << GetBatchDrawCount() << " draws")
+
+}
+
+// Sources are imported one after the other into this mesh, then moved into
+// the merged arrays. Triangles of a material keep the order of the sources.
+void StaticBatch::Merge(const char* name, const std::vector<StaticBatchSource_t>& sources, const MeshImportOptions_t& options)
+{
+    MeshImportOptions_t sourceOptions = options;
+    sourceOptions.lodCount = 1;
+    sourceOptions.buildMeshlets = false;
+
+    std::vector<Vertex> vertices;
+    std::vector<MeshGroup_t> groups;
+    std::vector<std::vector<unsigned int> > groupIndices;
+    // Ranges of each merged group, start relative to the group
+    std::vector<std::vector<BatchRange_t> > groupRanges;
+    for (unsigned int i = 0; i < sources.size(); ++i)
+    {
+        const StaticBatchSource_t& source = sources[i];
+        const char* ext = strrchr(source.filename.c_str(), '.');
+        if (!ext || strcmp(ext, ".obj") != 0)
+        {
+            THROW_RUNTIME("Static batch " << name << " can't merge " << source.filename << ", sources must be .obj files")
+        }
+
+        m_Vertices.clear();
+        m_Indices.clear();
+        m_MeshGroups.clear();
+        m_Lods.clear();
+        m_Meshlets.clear();
+        LoadFromObj(source.filename.c_str(), sourceOptions);
+
+        // Normals take the inverse transpose, mirroring transforms flip the winding
+        const Matrix& modelToWorld = source.modelToWorld;
+        Matrix normalToWorld = modelToWorld.Inverse().Transpose();
+        const float (&m)[4][4] = modelToWorld.m;
+        float determinant = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+                          - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+                          + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+        bool mirrored = determinant < 0.0f;
+
+        unsigned int baseVertex = (unsigned int)vertices.size();
+        for (size_t j = 0; j < m_Vertices.size(); ++j)
+        {
+            Vertex vertex = m_Vertices[j];
+            vertex.position = modelToWorld * vertex.position;
+            vertex.normal = SafeNormalize(TransformDirection(normalToWorld, vertex.normal));
+            vertex.tangent_s = SafeNormalize(TransformDirection(modelToWorld, vertex.tangent_s));
+            vertex.tangent_t = SafeNormalize(TransformDirection(modelToWorld, vertex.tangent_t));
+            vertices.push_back(vertex);
+        }
+
+        for (unsigned int j = 0; j < m_MeshGroups.size(); ++j)
+        {
+            const MeshGroup_t& meshGroup = m_MeshGroups[j];
+            MeshGroup_t named;
+            SetMaterialName(named, source.mtldir.empty() ? nullptr : source.mtldir.c_str(), meshGroup.materialName, strnlen(meshGroup.materialName, sizeof(meshGroup.materialName)));
+            const char (&materialName)[sizeof(named.materialName)] = named.materialName;
+
+            size_t group = 0;
+            while (group < groups.size() && strncmp(groups[group].materialName, materialName, sizeof(materialName)) != 0)
+            {
+                ++group;
+            }
+            if (group == groups.size())
+            {
+                MeshGroup_t merged;
+                merged.startIndex = 0;
+                merged.indexCount = 0;
+                merged.baseVertex = 0;
+                memcpy(merged.materialName, materialName, sizeof(materialName));
+                groups.push_back(merged);
+                groupIndices.push_back(std::vector<unsigned int>());
+                groupRanges.push_back(std::vector<BatchRange_t>());
+            }
+
+            std::vector<unsigned int>& indices = groupIndices[group];
+            BatchRange_t range;
+            range.source = i;
+            range.sourceGroup = j;
+            range.startIndex = (unsigned int)indices.size();
+            for (unsigned int k = 0; k + 3 <= meshGroup.indexCount; k += 3)
+            {
+                const unsigned int* triangle = &m_Indices[meshGroup.startIndex + k];
+                indices.push_back(triangle[0] + meshGroup.baseVertex + baseVertex);
+                indices.push_back(triangle[mirrored ? 2 : 1] + meshGroup.baseVertex + baseVertex);
+                indices.push_back(triangle[mirrored ? 1 : 2] + meshGroup.baseVertex + baseVertex);
+            }
+            range.indexCount = (unsigned int)indices.size() - range.startIndex;
+            groupRanges[group].push_back(range);
+        }
+    }
+
+    m_Vertices.swap(vertices);
+    m_Indices.clear();
+    m_MeshGroups.clear();
+    m_Lods.clear();
+    m_Meshlets.clear();
+    m_Ranges.clear();
+    for (size_t i = 0; i < groups.size(); ++i)
+    {
+        groups[i].startIndex = (unsigned int)m_Indices.size();
+        groups[i].indexCount = (unsigned int)groupIndices[i].size();
+        m_Indices.insert(m_Indices.end(), groupIndices[i].begin(), groupIndices[i].end());
+        m_MeshGroups.push_back(groups[i]);
+        for (size_t j = 0; j < groupRanges[i].size(); ++j)
+        {
+            BatchRange_t range = groupRanges[i][j];
+            range.startIndex += groups[i].startIndex;
+            m_Ranges.push_back(range);
+        }
+    }
+
+    FinishImport(name, options);
+
+}
+
+void StaticBatch::SaveSections(DatWriter& writer) const
+{
+    writer.AddSection(DAT_SECTION_BATCH_RANGES, m_Ranges.data(), sizeof(BatchRange_t), m_Ranges.size());
+}
+
+void StaticBatch::LoadSections(const DatFile& file, const char* filename)
+{
+    size_t rangeCount;
+    const BatchRange_t* ranges = (const BatchRange_t*)file.GetSection(DAT_SECTION_BATCH_RANGES, sizeof(BatchRange_t), rangeCount);
+    m_Ranges.assign(ranges, ranges + rangeCount);
+    for (size_t i = 0; i < m_Ranges.size(); ++i)
+    {
+        const BatchRange_t& range = m_Ranges[i];
+        bool inside = false;
+        for (size_t j = 0; j < m_MeshGroups.size() && !inside; ++j)
+        {
+            const MeshGroup_t& meshGroup = m_MeshGroups[j];
+            inside = range.startIndex >= meshGroup.startIndex && range.startIndex - meshGroup.startIndex <= meshGroup.indexCount &&
+                     range.indexCount <= meshGroup.indexCount - (range.startIndex - meshGroup.startIndex);
+        }
+        if (!inside)
+        {
+            THROW_RUNTIME("Mesh file " << filename << " has batch range " << i << " outside of its mesh groups")
+        }
+    }
+}
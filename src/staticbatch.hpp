@@ -0,0 +1,57 @@
+#ifndef STATICBATCH_HPP
+#define STATICBATCH_HPP
+
+#include "mesh.hpp"
+#include <string>
+
+struct StaticBatchSource_t
+{
+    StaticBatchSource_t(const char* filename, const char* mtldir = nullptr, const Matrix& modelToWorld = Matrix::Identity())
+        : filename(filename), mtldir(mtldir ? mtldir : ""), modelToWorld(modelToWorld)
+    {}
+
+    std::string filename;
+    std::string mtldir;
+    Matrix modelToWorld;
+
+};
+
+// Where one mesh group of a source mesh ended up in the batch
+struct BatchRange_t
+{
+    unsigned int source;
+    unsigned int sourceGroup;
+    unsigned int startIndex;
+    unsigned int indexCount;
+
+};
+
+// Static meshes merged at load time into one vertex and index buffer,
+// transformed to world space, with one mesh group per material. The merged
+// result is baked into the asset cache. Meshlets are rebuilt over the merged
+// groups, so parts out of view are still culled and the visible neighbours
+// of a material go out in one draw.
+class StaticBatch : public Mesh
+{
+public:
+    // name is used for the cache entry and the log. Sources are .obj files, level 0 is used.
+    StaticBatch(const char* name, const std::vector<StaticBatchSource_t>& sources, bool castShadow = true, const MeshImportOptions_t& options = MeshImportOptions_t());
+
+    // Draws the sources would take on their own, one per mesh group
+    size_t GetSourceDrawCount() const { return m_Ranges.size(); }
+    // Draws the batch takes with nothing culled, one per material
+    size_t GetBatchDrawCount() const { return m_MeshGroups.size(); }
+    const std::vector<BatchRange_t>& GetRanges() const { return m_Ranges; }
+
+protected:
+    virtual void SaveSections(DatWriter& writer) const;
+    virtual void LoadSections(const DatFile& file, const char* filename);
+
+private:
+    void Merge(const char* name, const std::vector<StaticBatchSource_t>& sources, const MeshImportOptions_t& options);
+
+    std::vector<BatchRange_t> m_Ranges;
+
+};
+
+#endif // STATICBATCH_HPP
@@ -0,0 +1,500 @@
+#include "streamingmesh.hpp"
+#include "materialsystem.hpp"
+#include "datfile.hpp"
+#include "assetcache.hpp"
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+// Part of the cache key of baked chunks, on top of the import key. Bump when SaveChunks changes.
+static const unsigned int CHUNK_BAKER_VERSION = 1;
+
+static const unsigned int NO_VERTEX = 0xFFFFFFFF;
+
+StreamingMesh::StreamingMesh(const char* filename, const char* mtldir, const Matrix& modelToWorld, bool castShadow, const StreamingOptions_t& options)
+    : m_Options(options), m_Frame(0)
+{
+    m_Name = filename;
+    m_ModelToWorld = AffineTransform(modelToWorld);
+    m_CastShadow = castShadow;
+    memset(&m_Stats, 0, sizeof(m_Stats));
+
+    const char* ext = strrchr(filename, '.');
+    if (ext && strcmp(ext, ".obj") == 0)
+    {
+        MeshImportOptions_t importOptions = options.import;
+        importOptions.lodCount = 1;
+        importOptions.buildMeshlets = false;
+        unsigned long long key = GetImportKey(filename, importOptions);
+        key = HashBytes(&CHUNK_BAKER_VERSION, sizeof(CHUNK_BAKER_VERSION), key);
+        key = HashBytes(&options.chunkTriangles, sizeof(options.chunkTriangles), key);
+        std::string cacheFile = GetCachePath(filename, key, ".dat");
+
+        bool loaded = false;
+        if (FileExists(cacheFile.c_str()))
+        {
+            try
+            {
+                LoadChunks(cacheFile.c_str());
+                loaded = true;
+            }
+            catch (const std::exception&)
+            {
+                // Damaged entry, bake again and replace it
+                m_File.reset();
+            }
+        }
+
+        if (!loaded)
+        {
+            LoadFromObj(filename, importOptions);
+            std::string tempFile = GetCacheTempPath(cacheFile);
+            SaveChunks(tempFile.c_str());
+            PublishCacheFile(tempFile, cacheFile);
+
+            // Only the chunk table stays in memory
+            std::vector<Vertex>().swap(m_Vertices);
+            std::vector<unsigned int>().swap(m_Indices);
+            m_Lods.clear();
+            LoadChunks(cacheFile.c_str());
+        }
+    }
+    else
+    {
+        LoadChunks(filename);
+    }
+
+    if (mtldir)
+    {
+        for (unsigned int i = 0; i < m_MeshGroups.size(); ++i)
+        {
+            MeshGroup_t& meshGroup = m_MeshGroups[i];
+            SetMaterialName(meshGroup, mtldir, meshGroup.materialName, strnlen(meshGroup.materialName, sizeof(meshGroup.materialName)));
+        }
+    }
+
+    LOG_INFO(filename << ": " << m_Chunks.size() << " chunks, " << GetVertexFormatDesc(m_VertexFormat).name << " vertices")
+
+}
+
+StreamingMesh::~StreamingMesh()
+{
+}
+
+// Median splits along the longest axis of the triangle centroids, so every
+// chunk covers a compact region. Triangles keep their imported order inside
+// a chunk, and vertices are numbered in the order the chunk first uses them.
+void StreamingMesh::SaveChunks(const char* filename) const
+{
+    const MeshLod_t& lod = m_Lods[0];
+    std::vector<unsigned int> triangleGroups;
+    std::vector<float3> centroids;
+    triangleGroups.reserve(lod.indexCount / 3);
+    centroids.reserve(lod.indexCount / 3);
+    std::vector<unsigned int> indices(m_Indices.begin(), m_Indices.begin() + lod.startIndex + lod.indexCount);
+    for (unsigned int i = lod.firstGroup; i < lod.firstGroup + lod.groupCount; ++i)
+    {
+        const MeshGroup_t& meshGroup = m_MeshGroups[i];
+        for (unsigned int j = 0; j + 3 <= meshGroup.indexCount; j += 3)
+        {
+            unsigned int* triangle = &indices[meshGroup.startIndex + j];
+            for (int corner = 0; corner < 3; ++corner)
+            {
+                triangle[corner] += meshGroup.baseVertex;
+            }
+            triangleGroups.push_back(i);
+            centroids.push_back((m_Vertices[triangle[0]].position + m_Vertices[triangle[1]].position + m_Vertices[triangle[2]].position) * (1.0f / 3.0f));
+        }
+    }
+
+    // Triangle numbers, reordered in place by the splits
+    std::vector<unsigned int> triangles(centroids.size());
+    std::vector<unsigned int> firstIndices(centroids.size());
+    for (unsigned int i = 0; i < triangles.size(); ++i)
+    {
+        triangles[i] = i;
+    }
+    for (unsigned int i = lod.firstGroup, t = 0; i < lod.firstGroup + lod.groupCount; ++i)
+    {
+        for (unsigned int j = 0; j + 3 <= m_MeshGroups[i].indexCount; j += 3)
+        {
+            firstIndices[t++] = m_MeshGroups[i].startIndex + j;
+        }
+    }
+
+    unsigned int chunkTriangles = std::max<unsigned int>(m_Options.chunkTriangles, 1);
+    std::vector<std::pair<size_t, size_t> > ranges;
+    std::vector<std::pair<size_t, size_t> > leaves;
+    ranges.push_back(std::make_pair((size_t)0, triangles.size()));
+    while (!ranges.empty())
+    {
+        std::pair<size_t, size_t> range = ranges.back();
+        ranges.pop_back();
+        if (range.second - range.first <= chunkTriangles)
+        {
+            if (range.second > range.first)
+            {
+                leaves.push_back(range);
+            }
+            continue;
+        }
+
+        float3 mins = centroids[triangles[range.first]];
+        float3 maxs = mins;
+        for (size_t i = range.first; i < range.second; ++i)
+        {
+            const float3& centroid = centroids[triangles[i]];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                mins[axis] = std::min<float>(mins[axis], centroid[axis]);
+                maxs[axis] = std::max<float>(maxs[axis], centroid[axis]);
+            }
+        }
+        float3 extent = maxs - mins;
+        int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+        size_t middle = range.first + (range.second - range.first) / 2;
+        std::nth_element(triangles.begin() + range.first, triangles.begin() + middle, triangles.begin() + range.second, [&](unsigned int a, unsigned int b)
+        {
+            return centroids[a][axis] < centroids[b][axis];
+        });
+        // Second half first, so chunks come out in depth-first order and neighbours stay close in the file
+        ranges.push_back(std::make_pair(middle, range.second));
+        ranges.push_back(std::make_pair(range.first, middle));
+    }
+
+    std::vector<MeshChunk_t> chunks(leaves.size());
+    std::vector<MeshGroup_t> chunkGroups;
+    std::vector<std::vector<unsigned char> > chunkVertices(leaves.size());
+    std::vector<std::vector<unsigned char> > chunkIndices(leaves.size());
+    std::vector<unsigned int> remap(m_Vertices.size(), NO_VERTEX);
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> localIndices;
+    for (size_t i = 0; i < leaves.size(); ++i)
+    {
+        std::sort(triangles.begin() + leaves[i].first, triangles.begin() + leaves[i].second);
+
+        vertices.clear();
+        localIndices.clear();
+        MeshChunk_t& chunk = chunks[i];
+        chunk.firstGroup = (unsigned int)chunkGroups.size();
+        for (size_t j = leaves[i].first; j < leaves[i].second; ++j)
+        {
+            unsigned int triangle = triangles[j];
+            if (chunkGroups.size() == chunk.firstGroup || triangleGroups[triangle] != triangleGroups[triangles[j - 1]])
+            {
+                MeshGroup_t meshGroup = m_MeshGroups[triangleGroups[triangle]];
+                meshGroup.startIndex = (unsigned int)localIndices.size();
+                meshGroup.indexCount = 0;
+                meshGroup.baseVertex = 0;
+                chunkGroups.push_back(meshGroup);
+            }
+            for (unsigned int corner = 0; corner < 3; ++corner)
+            {
+                unsigned int index = indices[firstIndices[triangle] + corner];
+                if (remap[index] == NO_VERTEX)
+                {
+                    remap[index] = (unsigned int)vertices.size();
+                    vertices.push_back(m_Vertices[index]);
+                }
+                localIndices.push_back(remap[index]);
+            }
+            chunkGroups.back().indexCount += 3;
+        }
+        chunk.groupCount = (unsigned int)chunkGroups.size() - chunk.firstGroup;
+        chunk.vertexCount = (unsigned int)vertices.size();
+        chunk.indexCount = (unsigned int)localIndices.size();
+
+        float3 mins = vertices[0].position;
+        float3 maxs = mins;
+        for (size_t j = 0; j < vertices.size(); ++j)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                mins[axis] = std::min<float>(mins[axis], vertices[j].position[axis]);
+                maxs[axis] = std::max<float>(maxs[axis], vertices[j].position[axis]);
+            }
+        }
+        chunk.center = (mins + maxs) * 0.5f;
+        float radiusSq = 0.0f;
+        for (size_t j = 0; j < vertices.size(); ++j)
+        {
+            float3 offset = vertices[j].position - chunk.center;
+            radiusSq = std::max<float>(radiusSq, dot(offset, offset));
+        }
+        chunk.radius = std::sqrt(radiusSq);
+
+        ConvertVertices(vertices.data(), vertices.size(), m_VertexFormat, chunkVertices[i]);
+        if (vertices.size() <= 0x10000)
+        {
+            chunk.indexSize = sizeof(unsigned short);
+            std::vector<unsigned short> narrowIndices(localIndices.begin(), localIndices.end());
+            chunkIndices[i].assign((const unsigned char*)narrowIndices.data(), (const unsigned char*)(narrowIndices.data() + narrowIndices.size()));
+        }
+        else
+        {
+            chunk.indexSize = sizeof(unsigned int);
+            chunkIndices[i].assign((const unsigned char*)localIndices.data(), (const unsigned char*)(localIndices.data() + localIndices.size()));
+        }
+
+        for (size_t j = leaves[i].first; j < leaves[i].second; ++j)
+        {
+            for (unsigned int corner = 0; corner < 3; ++corner)
+            {
+                remap[indices[firstIndices[triangles[j]] + corner]] = NO_VERTEX;
+            }
+        }
+    }
+
+    DatWriter writer;
+    unsigned int vertexFormat = m_VertexFormat;
+    writer.AddSection(DAT_SECTION_VERTEX_FORMAT, &vertexFormat, sizeof(vertexFormat), 1);
+    writer.AddSection(DAT_SECTION_CHUNKS, chunks.data(), sizeof(MeshChunk_t), chunks.size());
+    writer.AddSection(DAT_SECTION_CHUNK_GROUPS, chunkGroups.data(), sizeof(MeshGroup_t), chunkGroups.size());
+    size_t stride = GetVertexFormatDesc(m_VertexFormat).stride;
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        writer.AddSection(DAT_SECTION_CHUNK_VERTICES, chunkVertices[i].data(), stride, chunks[i].vertexCount);
+        writer.AddSection(DAT_SECTION_CHUNK_INDICES, chunkIndices[i].data(), chunks[i].indexSize, chunks[i].indexCount);
+    }
+    writer.Write(filename);
+
+}
+
+// Only the chunk table and mesh groups are read here, the chunks themselves stay in the mapping
+void StreamingMesh::LoadChunks(const char* filename)
+{
+    std::unique_ptr<DatFile> file(new DatFile(filename));
+
+    size_t formatCount;
+    const unsigned int* vertexFormat = (const unsigned int*)file->GetSection(DAT_SECTION_VERTEX_FORMAT, sizeof(unsigned int), formatCount);
+    m_VertexFormat = VERTEX_FORMAT_FULL;
+    if (vertexFormat && formatCount == 1)
+    {
+        if (*vertexFormat >= VERTEX_FORMAT_COUNT)
+        {
+            THROW_RUNTIME("Mesh file " << filename << " has unknown vertex format " << *vertexFormat)
+        }
+        m_VertexFormat = (VertexFormat_t)*vertexFormat;
+    }
+
+    size_t chunkCount, groupCount;
+    const MeshChunk_t* chunks = (const MeshChunk_t*)file->GetSection(DAT_SECTION_CHUNKS, sizeof(MeshChunk_t), chunkCount);
+    const MeshGroup_t* groups = (const MeshGroup_t*)file->GetSection(DAT_SECTION_CHUNK_GROUPS, sizeof(MeshGroup_t), groupCount);
+    if (!chunks || !groups)
+    {
+        THROW_RUNTIME("Mesh file " << filename << " is not a streaming mesh")
+    }
+
+    for (size_t i = 0; i < chunkCount; ++i)
+    {
+        const MeshChunk_t& chunk = chunks[i];
+        if (chunk.firstGroup > groupCount || chunk.groupCount > groupCount - chunk.firstGroup)
+        {
+            THROW_RUNTIME("Mesh file " << filename << " has chunk " << i << " outside of its mesh groups")
+        }
+        if (chunk.indexSize != sizeof(unsigned short) && chunk.indexSize != sizeof(unsigned int))
+        {
+            THROW_RUNTIME("Mesh file " << filename << " has chunk " << i << " with " << chunk.indexSize << "-byte indices")
+        }
+        for (unsigned int j = chunk.firstGroup; j < chunk.firstGroup + chunk.groupCount; ++j)
+        {
+            if (groups[j].startIndex > chunk.indexCount || groups[j].indexCount > chunk.indexCount - groups[j].startIndex)
+            {
+                THROW_RUNTIME("Mesh file " << filename << " has chunk " << i << " with a mesh group out of bounds")
+            }
+        }
+    }
+
+    m_Chunks.assign(chunks, chunks + chunkCount);
+    m_MeshGroups.assign(groups, groups + groupCount);
+    m_ChunkStates.reset(new ChunkState_t[chunkCount]);
+    m_ResidentChunks.clear();
+    m_File = std::move(file);
+    m_Stats.chunkCount = (unsigned int)chunkCount;
+
+}
+
+size_t StreamingMesh::GetChunkBytes(unsigned int chunk) const
+{
+    return (size_t)m_Chunks[chunk].vertexCount * GetVertexFormatDesc(m_VertexFormat).stride + (size_t)m_Chunks[chunk].indexCount * m_Chunks[chunk].indexSize;
+}
+
+void StreamingMesh::LoadChunk(unsigned int chunk)
+{
+    const MeshChunk_t& info = m_Chunks[chunk];
+    size_t vertexCount, indexCount;
+    const void* vertices = m_File->GetSection(DAT_SECTION_CHUNK_VERTICES, chunk, GetVertexFormatDesc(m_VertexFormat).stride, vertexCount);
+    const void* indices = m_File->GetSection(DAT_SECTION_CHUNK_INDICES, chunk, info.indexSize, indexCount);
+    if (!vertices || !indices || vertexCount != info.vertexCount || indexCount != info.indexCount)
+    {
+        THROW_RUNTIME("Streaming mesh chunk " << chunk << " doesn't match its table entry")
+    }
+
+    ChunkState_t& state = m_ChunkStates[chunk];
+    CreateBuffer(vertices, vertexCount * GetVertexFormatDesc(m_VertexFormat).stride, D3D11_BIND_VERTEX_BUFFER, state.vertexBuffer);
+    CreateBuffer(indices, indexCount * info.indexSize, D3D11_BIND_INDEX_BUFFER, state.indexBuffer);
+    state.resident = true;
+    m_ResidentChunks.push_back(chunk);
+
+    size_t bytes = GetChunkBytes(chunk);
+    ++m_Stats.loads;
+    m_Stats.loadedBytes += bytes;
+    m_Stats.residentBytes += bytes;
+    m_Stats.peakResidentBytes = std::max<size_t>(m_Stats.peakResidentBytes, m_Stats.residentBytes);
+    m_Stats.residentChunks = (unsigned int)m_ResidentChunks.size();
+}
+
+bool StreamingMesh::EvictChunk()
+{
+    size_t oldest = m_ResidentChunks.size();
+    for (size_t i = 0; i < m_ResidentChunks.size(); ++i)
+    {
+        unsigned int lastUsedFrame = m_ChunkStates[m_ResidentChunks[i]].lastUsedFrame;
+        if (lastUsedFrame != m_Frame && (oldest == m_ResidentChunks.size() || lastUsedFrame < m_ChunkStates[m_ResidentChunks[oldest]].lastUsedFrame))
+        {
+            oldest = i;
+        }
+    }
+    if (oldest == m_ResidentChunks.size())
+    {
+        return false;
+    }
+
+    unsigned int chunk = m_ResidentChunks[oldest];
+    ChunkState_t& state = m_ChunkStates[chunk];
+    state.vertexBuffer.Reset();
+    state.indexBuffer.Reset();
+    state.resident = false;
+    m_ResidentChunks[oldest] = m_ResidentChunks.back();
+    m_ResidentChunks.pop_back();
+
+    size_t bytes = GetChunkBytes(chunk);
+    ++m_Stats.evictions;
+    m_Stats.evictedBytes += bytes;
+    m_Stats.residentBytes -= bytes;
+    m_Stats.residentChunks = (unsigned int)m_ResidentChunks.size();
+    return true;
+}
+
+void StreamingMesh::Update(const float3& viewOrigin)
+{
+    ++m_Frame;
+
+    // Bounding spheres grow with the largest scale of the transform
+    float scale = GetMaxScale(m_ModelToWorld);
+
+    m_Requests.clear();
+    for (unsigned int i = 0; i < m_Chunks.size(); ++i)
+    {
+        float distance = (m_ModelToWorld * m_Chunks[i].center - viewOrigin).length() - m_Chunks[i].radius * scale;
+        if (distance > m_Options.streamDistance)
+        {
+            continue;
+        }
+
+        m_ChunkStates[i].lastUsedFrame = m_Frame;
+        if (!m_ChunkStates[i].resident)
+        {
+            m_Requests.push_back(std::make_pair(distance, i));
+        }
+    }
+    std::sort(m_Requests.begin(), m_Requests.end());
+
+    unsigned int loads = 0;
+    size_t request = 0;
+    for (; request < m_Requests.size() && loads < m_Options.maxLoadsPerFrame; ++request)
+    {
+        unsigned int chunk = m_Requests[request].second;
+        size_t bytes = GetChunkBytes(chunk);
+        while (m_Stats.residentBytes + bytes > m_Options.memoryBudget && EvictChunk())
+        {
+        }
+        if (m_Stats.residentBytes + bytes > m_Options.memoryBudget)
+        {
+            ++m_Stats.budgetMisses;
+            continue;
+        }
+
+        LoadChunk(chunk);
+        ++loads;
+    }
+    m_Stats.pendingChunks = (unsigned int)(m_Requests.size() - loads);
+
+}
+
+// Draws the resident chunks in range as of the last update. The depth pass
+// comes first in a frame and draws what the camera picked the frame before.
+void StreamingMesh::Draw(bool drawDepth)
+{
+    if (drawDepth && !m_CastShadow)
+    {
+        return;
+    }
+
+    const ViewSetup* view = render->GetCurrentView();
+    if (!drawDepth)
+    {
+        Update(view->origin);
+    }
+
+    UINT stride = GetVertexFormatDesc(m_VertexFormat).stride;
+    UINT offset = 0;
+
+    Material::VSConstantBuffer vscb;
+    vscb.matWorldToCamera = view->matWorldToCamera.Transpose();
+    vscb.matModelToWorld = m_ModelToWorld.ToMatrix();
+    vscb.viewPosition = view->origin;
+
+    Material::PSConstantBuffer pscb;
+    pscb.viewPosition = view->origin;
+    pscb.lightColor = float3(1.0f, 0.9f, 0.8f) * 2.0f;
+
+    m_DrawCalls = 0;
+    render->GetDeviceContext()->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    if (drawDepth)
+    {
+        materials->FindMaterial("depth")->SetMaterial(vscb, pscb, m_VertexFormat);
+    }
+    else
+    {
+        const ViewSetup* shadowView = render->GetPreviousView();
+        vscb.matShadowToWorld = shadowView->matWorldToCamera.Transpose();
+        pscb.lightPos = shadowView->origin;
+    }
+
+    for (size_t i = 0; i < m_ResidentChunks.size(); ++i)
+    {
+        unsigned int chunk = m_ResidentChunks[i];
+        ChunkState_t& state = m_ChunkStates[chunk];
+        if (state.lastUsedFrame != m_Frame)
+        {
+            continue;
+        }
+
+        const MeshChunk_t& info = m_Chunks[chunk];
+        render->GetDeviceContext()->IASetVertexBuffers(0, 1, &state.vertexBuffer, &stride, &offset);
+        render->GetDeviceContext()->IASetIndexBuffer(state.indexBuffer.Get(), info.indexSize == sizeof(unsigned short) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT, 0);
+        for (unsigned int j = info.firstGroup; j < info.firstGroup + info.groupCount; ++j)
+        {
+            const MeshGroup_t& meshGroup = m_MeshGroups[j];
+            if (!drawDepth)
+            {
+                materials->FindMaterial(meshGroup.materialName)->SetMaterial(vscb, pscb, m_VertexFormat);
+            }
+            render->GetDeviceContext()->DrawIndexed(meshGroup.indexCount, meshGroup.startIndex, 0);
+            ++m_DrawCalls;
+        }
+    }
+
+}
+
+// The mapped file isn't counted, the OS pages it in and out as it likes
+GeometryMemory_t StreamingMesh::GetMemoryUsage() const
+{
+    GeometryMemory_t memory = Mesh::GetMemoryUsage();
+    memory.cpuBytes += m_Chunks.capacity() * sizeof(MeshChunk_t) + m_Chunks.size() * sizeof(ChunkState_t) +
+                       m_ResidentChunks.capacity() * sizeof(unsigned int) + m_Requests.capacity() * sizeof(m_Requests[0]);
+    memory.gpuBytes += m_Stats.residentBytes;
+    return memory;
+}
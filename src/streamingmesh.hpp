@@ -0,0 +1,109 @@
+#ifndef STREAMINGMESH_HPP
+#define STREAMINGMESH_HPP
+
+#include "mesh.hpp"
+#include <memory>
+#include <utility>
+
+class DatFile;
+
+// Spatially coherent part of a streaming mesh, paged in and out as a whole
+struct MeshChunk_t
+{
+    // Bounding sphere, model space
+    float3 center;
+    float radius;
+    // Range of the chunk's mesh groups, whose indices are relative to the chunk
+    unsigned int firstGroup;
+    unsigned int groupCount;
+    unsigned int vertexCount;
+    unsigned int indexCount;
+    // 2 or 4
+    unsigned int indexSize;
+
+};
+
+struct StreamingOptions_t
+{
+    StreamingOptions_t() : chunkTriangles(32768), memoryBudget(256 * 1024 * 1024), streamDistance(1024.0f), maxLoadsPerFrame(4) {}
+
+    // Used when baking an .obj. Chunks are built from level 0 without meshlets.
+    MeshImportOptions_t import;
+    // Chunks are split in half until they have at most this many triangles
+    unsigned int chunkTriangles;
+    // Vertex and index buffer bytes resident at once
+    size_t memoryBudget;
+    // Chunks whose bounding sphere is farther than this from the camera are neither drawn nor loaded
+    float streamDistance;
+    // Chunks loaded per frame, nearest first. The rest wait for the next frames.
+    unsigned int maxLoadsPerFrame;
+
+};
+
+struct StreamingStats_t
+{
+    unsigned int chunkCount;
+    unsigned int residentChunks;
+    size_t residentBytes;
+    size_t peakResidentBytes;
+    // Chunks in range that are not resident yet, as of the last update
+    unsigned int pendingChunks;
+    // Totals since the mesh was created
+    unsigned long long loads;
+    unsigned long long loadedBytes;
+    unsigned long long evictions;
+    unsigned long long evictedBytes;
+    // Loads given up because every resident chunk was still in use
+    unsigned long long budgetMisses;
+
+};
+
+// Mesh too large to keep in memory. The chunks are read from the mapped .dat
+// when the camera gets near them, and the least recently used ones are
+// released to stay within the memory budget.
+class StreamingMesh : public Mesh
+{
+public:
+    // An .obj is baked into a chunked .dat in the asset cache first
+    StreamingMesh(const char* filename, const char* mtldir = nullptr, const Matrix& modelToWorld = Matrix::Identity(), bool castShadow = true, const StreamingOptions_t& options = StreamingOptions_t());
+    ~StreamingMesh();
+
+    // Pages in chunks in range of viewOrigin. Draw calls it for the camera view.
+    void Update(const float3& viewOrigin);
+    virtual void Draw(bool drawDepth = false);
+
+    const StreamingStats_t& GetStats() const { return m_Stats; }
+    virtual GeometryMemory_t GetMemoryUsage() const;
+
+private:
+    struct ChunkState_t
+    {
+        ChunkState_t() : lastUsedFrame(0), resident(false) {}
+
+        ScopedObject<ID3D11Buffer> vertexBuffer;
+        ScopedObject<ID3D11Buffer> indexBuffer;
+        unsigned int lastUsedFrame;
+        bool resident;
+    };
+
+    // Splits the imported level 0 into chunks and writes them out
+    void SaveChunks(const char* filename) const;
+    void LoadChunks(const char* filename);
+    size_t GetChunkBytes(unsigned int chunk) const;
+    void LoadChunk(unsigned int chunk);
+    // Releases the least recently used chunk not used this frame, returns false if there is none
+    bool EvictChunk();
+
+    StreamingOptions_t m_Options;
+    std::unique_ptr<DatFile> m_File;
+    std::vector<MeshChunk_t> m_Chunks;
+    std::unique_ptr<ChunkState_t[]> m_ChunkStates;
+    std::vector<unsigned int> m_ResidentChunks;
+    // Distance and chunk of the chunks to load, rebuilt every update
+    std::vector<std::pair<float, unsigned int> > m_Requests;
+    unsigned int m_Frame;
+    StreamingStats_t m_Stats;
+
+};
+
+#endif // STREAMINGMESH_HPP
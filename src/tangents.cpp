@@ -0,0 +1,196 @@
+#include "tangents.hpp"
+#include "jobsystem.hpp"
+#include <algorithm>
+#include <vector>
+#include <emmintrin.h>
+
+// Triangles or vertices handled per job, at least
+static const size_t TANGENT_BLOCK_SHIFT = 14;
+static const size_t TANGENT_BLOCK_SIZE = (size_t)1 << TANGENT_BLOCK_SHIFT;
+
+// Only the t direction is needed, tangent_s is rebuilt from it and the normal.
+// Must stay the exact same sequence of float operations as the SIMD path below,
+// so a triangle gets the same result whichever path it goes through.
+static float3 ComputeTriangleTangent(const Vertex& v1, const Vertex& v2, const Vertex& v3)
+{
+    float x1 = v2.position.x - v1.position.x;
+    float x2 = v3.position.x - v1.position.x;
+    float y1 = v2.position.y - v1.position.y;
+    float y2 = v3.position.y - v1.position.y;
+    float z1 = v2.position.z - v1.position.z;
+    float z2 = v3.position.z - v1.position.z;
+
+    float s1 = v2.texcoord.x - v1.texcoord.x;
+    float s2 = v3.texcoord.x - v1.texcoord.x;
+    float t1 = v2.texcoord.y - v1.texcoord.y;
+    float t2 = v3.texcoord.y - v1.texcoord.y;
+
+    float r = 1.0f / (s1 * t2 - s2 * t1);
+    return float3((s1 * x2 - s2 * x1) * r, (s1 * y2 - s2 * y1) * r, (s1 * z2 - s2 * z1) * r);
+}
+
+// (a * b - c * d) * r
+static __m128 CrossTerm(__m128 a, __m128 b, __m128 c, __m128 d, __m128 r)
+{
+    return _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(a, b), _mm_mul_ps(c, d)), r);
+}
+
+// Four triangles per iteration, one per lane
+static void ComputeTriangleTangents(const Vertex* vertices, const unsigned int* indices, size_t begin, size_t end, float3* tangents)
+{
+    size_t triangle = begin;
+    for (; triangle + 4 <= end; triangle += 4)
+    {
+        // Position and texcoord of one corner of the four triangles
+        __m128 x[3], y[3], z[3], s[3], t[3];
+        for (size_t corner = 0; corner < 3; ++corner)
+        {
+            const Vertex& v0 = vertices[indices[triangle * 3 + corner]];
+            const Vertex& v1 = vertices[indices[triangle * 3 + 3 + corner]];
+            const Vertex& v2 = vertices[indices[triangle * 3 + 6 + corner]];
+            const Vertex& v3 = vertices[indices[triangle * 3 + 9 + corner]];
+            x[corner] = _mm_loadu_ps(&v0.position.x);
+            y[corner] = _mm_loadu_ps(&v1.position.x);
+            z[corner] = _mm_loadu_ps(&v2.position.x);
+            s[corner] = _mm_loadu_ps(&v3.position.x);
+            _MM_TRANSPOSE4_PS(x[corner], y[corner], z[corner], s[corner]);
+            t[corner] = _mm_setr_ps(v0.texcoord.y, v1.texcoord.y, v2.texcoord.y, v3.texcoord.y);
+        }
+
+        __m128 x1 = _mm_sub_ps(x[1], x[0]), x2 = _mm_sub_ps(x[2], x[0]);
+        __m128 y1 = _mm_sub_ps(y[1], y[0]), y2 = _mm_sub_ps(y[2], y[0]);
+        __m128 z1 = _mm_sub_ps(z[1], z[0]), z2 = _mm_sub_ps(z[2], z[0]);
+        __m128 s1 = _mm_sub_ps(s[1], s[0]), s2 = _mm_sub_ps(s[2], s[0]);
+        __m128 t1 = _mm_sub_ps(t[1], t[0]), t2 = _mm_sub_ps(t[2], t[0]);
+
+        __m128 r = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sub_ps(_mm_mul_ps(s1, t2), _mm_mul_ps(s2, t1)));
+        __m128 tx = CrossTerm(s1, x2, s2, x1, r);
+        __m128 ty = CrossTerm(s1, y2, s2, y1, r);
+        __m128 tz = CrossTerm(s1, z2, s2, z1, r);
+        __m128 tw = _mm_setzero_ps();
+        _MM_TRANSPOSE4_PS(tx, ty, tz, tw);
+
+        // Each store spills into the next triangle, which is written right after,
+        // except for the last one which may belong to another job
+        float* out = &tangents[triangle].x;
+        _mm_storeu_ps(out, tx);
+        _mm_storeu_ps(out + 3, ty);
+        _mm_storeu_ps(out + 6, tz);
+        _mm_storel_pi((__m64*)(out + 9), tw);
+        _mm_store_ss(out + 11, _mm_movehl_ps(tw, tw));
+    }
+
+    for (; triangle < end; ++triangle)
+    {
+        const unsigned int* corners = &indices[triangle * 3];
+        tangents[triangle] = ComputeTriangleTangent(vertices[corners[0]], vertices[corners[1]], vertices[corners[2]]);
+    }
+
+}
+
+static void OrthonormalizeTangent(Vertex& vertex, const float3& t)
+{
+    float3& n = vertex.normal;
+    vertex.tangent_t = (t - n * dot(n, t)).normalize();
+    vertex.tangent_s = cross(vertex.tangent_t, vertex.normal);
+}
+
+void GenerateTangents(Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount)
+{
+    size_t triangleCount = indexCount / 3;
+    size_t cornerCount = triangleCount * 3;
+    std::vector<float3> triangleTangents(triangleCount);
+    jobs->ParallelFor((unsigned int)((triangleCount + TANGENT_BLOCK_SIZE - 1) / TANGENT_BLOCK_SIZE), [&](unsigned int block)
+    {
+        size_t begin = block * TANGENT_BLOCK_SIZE;
+        ComputeTriangleTangents(vertices, indices, begin, std::min(begin + TANGENT_BLOCK_SIZE, triangleCount), triangleTangents.data());
+    });
+
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        vertices[i].tangent_t = float3(0.0f);
+    }
+
+    // Each job owns a range of vertices and sums the triangles touching them.
+    // A vertex always adds its triangles in ascending order, so the partition
+    // only decides who does the work, not the result.
+    // Ranges are a power of two in size, a few per thread
+    size_t threadCount = jobs->GetThreadCount();
+    size_t rangeShift = TANGENT_BLOCK_SHIFT;
+    while (((size_t)1 << rangeShift) * threadCount * 4 < vertexCount)
+    {
+        ++rangeShift;
+    }
+    size_t rangeSize = (size_t)1 << rangeShift;
+    size_t rangeCount = (vertexCount + rangeSize - 1) / rangeSize;
+
+    if (threadCount < 2 || rangeCount < 2)
+    {
+        for (size_t i = 0; i < cornerCount; ++i)
+        {
+            vertices[indices[i]].tangent_t += triangleTangents[i / 3];
+        }
+        for (size_t i = 0; i < vertexCount; ++i)
+        {
+            OrthonormalizeTangent(vertices[i], vertices[i].tangent_t);
+        }
+        return;
+    }
+
+    // Bucket the corners by vertex range, keeping them in order inside each bucket.
+    // Corners are split into as many contiguous chunks as there are ranges.
+    size_t chunkCount = rangeCount;
+    size_t chunkSize = (cornerCount + chunkCount - 1) / chunkCount;
+    std::vector<size_t> counts(chunkCount * rangeCount, 0);
+    jobs->ParallelFor((unsigned int)chunkCount, [&](unsigned int chunk)
+    {
+        size_t* chunkCounts = &counts[chunk * rangeCount];
+        size_t end = std::min((chunk + 1) * chunkSize, cornerCount);
+        for (size_t i = chunk * chunkSize; i < end; ++i)
+        {
+            ++chunkCounts[indices[i] >> rangeShift];
+        }
+    });
+
+    // Bucket offsets, range major so each range sees its chunks in file order
+    std::vector<size_t> offsets(chunkCount * rangeCount);
+    std::vector<size_t> rangeOffsets(rangeCount + 1);
+    size_t offset = 0;
+    for (size_t range = 0; range < rangeCount; ++range)
+    {
+        rangeOffsets[range] = offset;
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+        {
+            offsets[chunk * rangeCount + range] = offset;
+            offset += counts[chunk * rangeCount + range];
+        }
+    }
+    rangeOffsets[rangeCount] = offset;
+
+    std::vector<unsigned int> bucketedCorners(cornerCount);
+    jobs->ParallelFor((unsigned int)chunkCount, [&](unsigned int chunk)
+    {
+        size_t* chunkOffsets = &offsets[chunk * rangeCount];
+        size_t end = std::min((chunk + 1) * chunkSize, cornerCount);
+        for (size_t i = chunk * chunkSize; i < end; ++i)
+        {
+            bucketedCorners[chunkOffsets[indices[i] >> rangeShift]++] = (unsigned int)i;
+        }
+    });
+
+    jobs->ParallelFor((unsigned int)rangeCount, [&](unsigned int range)
+    {
+        for (size_t i = rangeOffsets[range]; i < rangeOffsets[range + 1]; ++i)
+        {
+            unsigned int corner = bucketedCorners[i];
+            vertices[indices[corner]].tangent_t += triangleTangents[corner / 3];
+        }
+
+        size_t end = std::min((range + 1) * rangeSize, vertexCount);
+        for (size_t i = range * rangeSize; i < end; ++i)
+        {
+            OrthonormalizeTangent(vertices[i], vertices[i].tangent_t);
+        }
+    });
+
+}
@@ -0,0 +1,14 @@
+#ifndef TANGENTS_HPP
+#define TANGENTS_HPP
+
+#include "mathlib.hpp"
+
+// Builds tangent_s and tangent_t for an indexed triangle list.
+// Every triangle adds its texture-space directions to the vertices it uses,
+// then tangent_t is orthonormalized against the normal and tangent_s = tangent_t x normal.
+// Existing tangents are overwritten. Triangles are processed four at a time in
+// SSE lanes and the per-vertex sums always run in triangle order, so the result
+// is bit-identical whatever the number of threads.
+void GenerateTangents(Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount);
+
+#endif // TANGENTS_HPP
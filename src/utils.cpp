@@ -0,0 +1,16 @@
+#include "utils.hpp"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <cstdio>
+#endif
+
+void LogMessage(const std::string& message)
+{
+#ifdef _WIN32
+    OutputDebugStringA((message + "\n").c_str());
+#else
+    fprintf(stderr, "%s\n", message.c_str());
+#endif
+}
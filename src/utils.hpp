@@ -3,10 +3,17 @@
 
 #include <stdexcept>
 #include <sstream>
+#include <string>
 
 #define THROW_RUNTIME(message) \
     throw std::runtime_error(((std::ostringstream&) (std::ostringstream("") << message)).str().c_str());
 
+#define LOG_INFO(message) \
+    LogMessage(((std::ostringstream&) (std::ostringstream("") << message)).str());
+
+// Goes to the debugger output window, stderr elsewhere
+void LogMessage(const std::string& message);
+
 template<class T>
 class ScopedObject
 {
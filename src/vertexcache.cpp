@@ -0,0 +1,351 @@
+#include "vertexcache.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Scoring model from the paper, tuned for an LRU cache of this size
+static const int CACHE_SIZE = 32;
+static const int MAX_VALENCE = 32;
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRIANGLE_SCORE = 0.75f;
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+
+static const unsigned int EMPTY_ID = 0xFFFFFFFF;
+
+// Vertex fetch model, a 16 KB cache of 64-byte lines
+static const size_t FETCH_LINE_SIZE = 64;
+static const unsigned int FETCH_LINE_COUNT = 256;
+
+struct VertexScoreTables_t
+{
+    VertexScoreTables_t()
+    {
+        for (int i = 0; i < CACHE_SIZE; ++i)
+        {
+            if (i < 3)
+            {
+                // The last triangle's vertices get a fixed score, so the next
+                // triangle doesn't just reuse the same edge every time
+                cache[i] = LAST_TRIANGLE_SCORE;
+            }
+            else
+            {
+                cache[i] = std::pow(1.0f - (float)(i - 3) / (CACHE_SIZE - 3), CACHE_DECAY_POWER);
+            }
+        }
+
+        valence[0] = 0.0f;
+        for (int i = 1; i <= MAX_VALENCE; ++i)
+        {
+            // Boost vertices with few triangles left, to get rid of lone triangles early
+            valence[i] = VALENCE_BOOST_SCALE * std::pow((float)i, -VALENCE_BOOST_POWER);
+        }
+    }
+
+    float cache[CACHE_SIZE];
+    float valence[MAX_VALENCE + 1];
+
+};
+
+static const VertexScoreTables_t g_ScoreTables;
+
+static float GetVertexScore(int cachePosition, unsigned int remainingTriangles)
+{
+    if (remainingTriangles == 0)
+    {
+        return -1.0f;
+    }
+
+    float score = cachePosition >= 0 ? g_ScoreTables.cache[cachePosition] : 0.0f;
+    return score + g_ScoreTables.valence[std::min<unsigned int>(remainingTriangles, MAX_VALENCE)];
+}
+
+VertexCacheStats_t AnalyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize)
+{
+    // A vertex is still in the FIFO if fewer than cacheSize misses happened since it went in
+    std::vector<unsigned int> timestamps(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+    unsigned int time = cacheSize + 1;
+    size_t misses = 0;
+    size_t uniqueVertices = 0;
+
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        unsigned int index = indices[i];
+        if (time - timestamps[index] > cacheSize)
+        {
+            timestamps[index] = time++;
+            ++misses;
+        }
+        if (!referenced[index])
+        {
+            referenced[index] = true;
+            ++uniqueVertices;
+        }
+    }
+
+    VertexCacheStats_t stats;
+    stats.acmr = indexCount ? (float)misses / (indexCount / 3) : 0.0f;
+    stats.atvr = uniqueVertices ? (float)misses / uniqueVertices : 0.0f;
+    return stats;
+}
+
+void OptimizeVertexCache(unsigned int* indices, size_t indexCount)
+{
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2)
+    {
+        return;
+    }
+
+    // Work on dense local vertex ids, a range usually touches a small part of the mesh.
+    // Ranges from the importer use mostly consecutive vertices, so a flat lookup
+    // over the span covers them. Anything more scattered goes through a sort.
+    unsigned int minIndex = *std::min_element(indices, indices + triangleCount * 3);
+    unsigned int maxIndex = *std::max_element(indices, indices + triangleCount * 3);
+    size_t span = (size_t)maxIndex - minIndex + 1;
+
+    std::vector<unsigned int> localIndices(triangleCount * 3);
+    size_t vertexCount = 0;
+    if (span <= localIndices.size() * 2)
+    {
+        std::vector<unsigned int> localIds(span, EMPTY_ID);
+        for (size_t i = 0; i < localIndices.size(); ++i)
+        {
+            unsigned int& localId = localIds[indices[i] - minIndex];
+            if (localId == EMPTY_ID)
+            {
+                localId = (unsigned int)vertexCount++;
+            }
+            localIndices[i] = localId;
+        }
+    }
+    else
+    {
+        std::vector<unsigned int> vertexIds(indices, indices + triangleCount * 3);
+        std::sort(vertexIds.begin(), vertexIds.end());
+        vertexIds.erase(std::unique(vertexIds.begin(), vertexIds.end()), vertexIds.end());
+        vertexCount = vertexIds.size();
+        for (size_t i = 0; i < localIndices.size(); ++i)
+        {
+            localIndices[i] = (unsigned int)(std::lower_bound(vertexIds.begin(), vertexIds.end(), indices[i]) - vertexIds.begin());
+        }
+    }
+
+    // Triangles of each vertex. The first remainingTriangles[v] entries are the ones not emitted yet.
+    std::vector<unsigned int> remainingTriangles(vertexCount, 0);
+    for (size_t i = 0; i < localIndices.size(); ++i)
+    {
+        ++remainingTriangles[localIndices[i]];
+    }
+
+    std::vector<unsigned int> triangleOffsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        triangleOffsets[i + 1] = triangleOffsets[i] + remainingTriangles[i];
+    }
+
+    std::vector<unsigned int> vertexTriangles(localIndices.size());
+    std::vector<unsigned int> cursors(triangleOffsets.begin(), triangleOffsets.end() - 1);
+    for (size_t i = 0; i < localIndices.size(); ++i)
+    {
+        vertexTriangles[cursors[localIndices[i]]++] = (unsigned int)(i / 3);
+    }
+
+    std::vector<int> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        vertexScores[i] = GetVertexScore(-1, remainingTriangles[i]);
+    }
+
+    // Start from the best triangle overall
+    std::vector<float> triangleScores(triangleCount);
+    size_t bestTriangle = 0;
+    float bestScore = -1.0f;
+    for (size_t i = 0; i < triangleCount; ++i)
+    {
+        const unsigned int* corners = &localIndices[i * 3];
+        triangleScores[i] = vertexScores[corners[0]] + vertexScores[corners[1]] + vertexScores[corners[2]];
+        if (triangleScores[i] > bestScore)
+        {
+            bestScore = triangleScores[i];
+            bestTriangle = i;
+        }
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> order;
+    order.reserve(triangleCount);
+
+    // Three extra slots hold the vertices pushed out by the newest triangle
+    unsigned int cache[CACHE_SIZE + 3];
+    unsigned int newCache[CACHE_SIZE + 3];
+    size_t cacheCount = 0;
+
+    size_t scanCursor = 0;
+    while (order.size() < triangleCount)
+    {
+        // Nothing left around the cache, continue with the first remaining triangle.
+        // Not the best one overall, but it keeps the whole pass linear.
+        if (bestTriangle == triangleCount)
+        {
+            while (emitted[scanCursor])
+            {
+                ++scanCursor;
+            }
+            bestTriangle = scanCursor;
+        }
+
+        emitted[bestTriangle] = true;
+        order.push_back((unsigned int)bestTriangle);
+
+        const unsigned int* corners = &localIndices[bestTriangle * 3];
+        size_t newCacheCount = 0;
+        for (size_t i = 0; i < 3; ++i)
+        {
+            unsigned int vertex = corners[i];
+            // Degenerate triangles list a vertex twice
+            if (std::find(newCache, newCache + newCacheCount, vertex) == newCache + newCacheCount)
+            {
+                newCache[newCacheCount++] = vertex;
+            }
+
+            unsigned int* triangles = &vertexTriangles[triangleOffsets[vertex]];
+            unsigned int* last = triangles + remainingTriangles[vertex] - 1;
+            *std::find(triangles, last, (unsigned int)bestTriangle) = *last;
+            *last = (unsigned int)bestTriangle;
+            --remainingTriangles[vertex];
+        }
+
+        for (size_t i = 0; i < cacheCount; ++i)
+        {
+            unsigned int vertex = cache[i];
+            if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2])
+            {
+                newCache[newCacheCount++] = vertex;
+            }
+        }
+
+        std::copy(newCache, newCache + newCacheCount, cache);
+        cacheCount = std::min<size_t>(newCacheCount, CACHE_SIZE);
+
+        // Rescore everything that moved in the cache, including the vertices that just fell out.
+        // Triangle scores are sums of vertex scores, so they only need the difference.
+        for (size_t i = 0; i < newCacheCount; ++i)
+        {
+            unsigned int vertex = cache[i];
+            cachePositions[vertex] = i < CACHE_SIZE ? (int)i : -1;
+            float score = GetVertexScore(cachePositions[vertex], remainingTriangles[vertex]);
+            float delta = score - vertexScores[vertex];
+            vertexScores[vertex] = score;
+
+            const unsigned int* triangles = &vertexTriangles[triangleOffsets[vertex]];
+            for (unsigned int j = 0; j < remainingTriangles[vertex]; ++j)
+            {
+                triangleScores[triangles[j]] += delta;
+            }
+        }
+
+        bestTriangle = triangleCount;
+        bestScore = -1.0f;
+        for (size_t i = 0; i < cacheCount; ++i)
+        {
+            unsigned int vertex = cache[i];
+            const unsigned int* triangles = &vertexTriangles[triangleOffsets[vertex]];
+            for (unsigned int j = 0; j < remainingTriangles[vertex]; ++j)
+            {
+                if (triangleScores[triangles[j]] > bestScore)
+                {
+                    bestScore = triangleScores[triangles[j]];
+                    bestTriangle = triangles[j];
+                }
+            }
+        }
+    }
+
+    std::vector<unsigned int> reordered(triangleCount * 3);
+    for (size_t i = 0; i < triangleCount; ++i)
+    {
+        std::copy(indices + order[i] * 3, indices + order[i] * 3 + 3, reordered.begin() + i * 3);
+    }
+    std::copy(reordered.begin(), reordered.end(), indices);
+
+}
+
+VertexFetchStats_t AnalyzeVertexFetch(const unsigned int* indices, size_t indexCount, size_t vertexCount, size_t vertexSize)
+{
+    // Post-transform FIFO in front, as in AnalyzeVertexCache
+    const unsigned int cacheSize = 16;
+    std::vector<unsigned int> vertexTimestamps(vertexCount, 0);
+    unsigned int vertexTime = cacheSize + 1;
+
+    std::vector<unsigned int> lineTimestamps((vertexCount * vertexSize + FETCH_LINE_SIZE - 1) / FETCH_LINE_SIZE, 0);
+    unsigned int lineTime = FETCH_LINE_COUNT + 1;
+    size_t lineReads = 0;
+    size_t lineMisses = 0;
+
+    std::vector<bool> referenced(vertexCount, false);
+    size_t referencedVertices = 0;
+
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        unsigned int index = indices[i];
+        if (!referenced[index])
+        {
+            referenced[index] = true;
+            ++referencedVertices;
+        }
+        if (vertexTime - vertexTimestamps[index] <= cacheSize)
+        {
+            continue;
+        }
+        vertexTimestamps[index] = vertexTime++;
+
+        size_t firstLine = index * vertexSize / FETCH_LINE_SIZE;
+        size_t lastLine = ((index + 1) * vertexSize - 1) / FETCH_LINE_SIZE;
+        for (size_t line = firstLine; line <= lastLine; ++line)
+        {
+            ++lineReads;
+            if (lineTime - lineTimestamps[line] > FETCH_LINE_COUNT)
+            {
+                lineTimestamps[line] = lineTime++;
+                ++lineMisses;
+            }
+        }
+    }
+
+    VertexFetchStats_t stats;
+    stats.missRate = lineReads ? (float)lineMisses / lineReads : 0.0f;
+    stats.overfetch = referencedVertices ? (float)(lineMisses * FETCH_LINE_SIZE) / (referencedVertices * vertexSize) : 0.0f;
+    return stats;
+}
+
+size_t OptimizeVertexFetch(unsigned int* indices, size_t indexCount, size_t primaryIndexCount, size_t vertexCount, std::vector<unsigned int>& remap)
+{
+    remap.assign(vertexCount, EMPTY_VERTEX);
+    unsigned int nextVertex = 0;
+    // The primary range first, wherever the others use its vertices
+    for (size_t i = 0; i < primaryIndexCount; ++i)
+    {
+        unsigned int& newIndex = remap[indices[i]];
+        if (newIndex == EMPTY_VERTEX)
+        {
+            newIndex = nextVertex++;
+        }
+    }
+    for (size_t i = primaryIndexCount; i < indexCount; ++i)
+    {
+        unsigned int& newIndex = remap[indices[i]];
+        if (newIndex == EMPTY_VERTEX)
+        {
+            newIndex = nextVertex++;
+        }
+    }
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        indices[i] = remap[indices[i]];
+    }
+    return nextVertex;
+}
@@ -0,0 +1,44 @@
+#ifndef VERTEXCACHE_HPP
+#define VERTEXCACHE_HPP
+
+#include <cstddef>
+#include <vector>
+
+struct VertexCacheStats_t
+{
+    // Vertex shader runs per triangle, 0.5 at best, 3 at worst
+    float acmr;
+    // Vertex shader runs per referenced vertex, 1 at best
+    float atvr;
+};
+
+struct VertexFetchStats_t
+{
+    // Cache lines missed per cache line read
+    float missRate;
+    // Bytes read from memory per byte of referenced vertices, 1 at best
+    float overfetch;
+};
+
+// Simulates a FIFO post-transform cache, the model most GPUs are close to
+VertexCacheStats_t AnalyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize = 16);
+
+// Reorders the triangles of an index range for post-transform cache reuse
+// (Forsyth, "Linear-Speed Vertex Cache Optimisation"). Triangles keep their
+// winding, only their order changes.
+void OptimizeVertexCache(unsigned int* indices, size_t indexCount);
+
+// Simulates vertex fetch through a small cache of 64-byte lines, for the
+// vertices that miss the post-transform cache
+VertexFetchStats_t AnalyzeVertexFetch(const unsigned int* indices, size_t indexCount, size_t vertexCount, size_t vertexSize);
+
+static const unsigned int EMPTY_VERTEX = 0xFFFFFFFF;
+
+// Renumbers vertices in the order the first primaryIndexCount indices first use
+// them, so the vertex buffer is read front to back when drawing those. Vertices
+// only the remaining indices use follow, in their first-use order. remap gets
+// the new index of every old vertex, EMPTY_VERTEX for the ones no index uses.
+// Returns the new vertex count.
+size_t OptimizeVertexFetch(unsigned int* indices, size_t indexCount, size_t primaryIndexCount, size_t vertexCount, std::vector<unsigned int>& remap);
+
+#endif // VERTEXCACHE_HPP
@@ -0,0 +1,304 @@
+#include "vertexformat.hpp"
+#include "meshcodec.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+static_assert(sizeof(CompactVertex_t) == 28, "CompactVertex_t must match its input layout");
+static_assert(sizeof(QTangentVertex_t) == 24, "QTangentVertex_t must match its input layout");
+
+// Half floats keep 1/1024 or better up to this texcoord magnitude, 1/512 above it
+static const float HALF_TEXCOORD_LIMIT = 2.0f;
+
+static const VertexFormatDesc_t g_VertexFormats[VERTEX_FORMAT_COUNT] =
+{
+    {
+        "full", nullptr, sizeof(Vertex), 5,
+        {
+            { "POSITION",   VERTEX_ELEMENT_FLOAT3,             offsetof(Vertex, position) },
+            { "TEXCOORD",   VERTEX_ELEMENT_FLOAT2,             offsetof(Vertex, texcoord) },
+            { "NORMAL",     VERTEX_ELEMENT_FLOAT3,             offsetof(Vertex, normal) },
+            { "TANGENT_S",  VERTEX_ELEMENT_FLOAT3,             offsetof(Vertex, tangent_s) },
+            { "TANGENT_T",  VERTEX_ELEMENT_FLOAT3,             offsetof(Vertex, tangent_t) },
+        }
+    },
+    {
+        "compact", "VERTEX_FORMAT_COMPACT", sizeof(CompactVertex_t), 5,
+        {
+            { "POSITION",   VERTEX_ELEMENT_FLOAT3,             offsetof(CompactVertex_t, position) },
+            { "TEXCOORD",   VERTEX_ELEMENT_HALF2,              offsetof(CompactVertex_t, texcoord) },
+            { "NORMAL",     VERTEX_ELEMENT_UNORM_10_10_10_2,   offsetof(CompactVertex_t, normal) },
+            { "TANGENT_S",  VERTEX_ELEMENT_UNORM_10_10_10_2,   offsetof(CompactVertex_t, tangent_s) },
+            { "TANGENT_T",  VERTEX_ELEMENT_UNORM_10_10_10_2,   offsetof(CompactVertex_t, tangent_t) },
+        }
+    },
+    {
+        "qtangent", "VERTEX_FORMAT_QTANGENT", sizeof(QTangentVertex_t), 3,
+        {
+            { "POSITION",       VERTEX_ELEMENT_FLOAT3,             offsetof(QTangentVertex_t, position) },
+            { "TEXCOORD",       VERTEX_ELEMENT_HALF2,              offsetof(QTangentVertex_t, texcoord) },
+            { "TANGENT_FRAME",  VERTEX_ELEMENT_SNORM16_4,          offsetof(QTangentVertex_t, tangentFrame) },
+        }
+    },
+};
+
+const VertexFormatDesc_t& GetVertexFormatDesc(VertexFormat_t format)
+{
+    return g_VertexFormats[format < VERTEX_FORMAT_COUNT ? format : VERTEX_FORMAT_FULL];
+}
+
+VertexFormat_t ChooseVertexFormat(const Vertex* vertices, size_t count, VertexFormat_t requested)
+{
+    if (requested != VERTEX_FORMAT_AUTO)
+    {
+        return requested;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const float2& texcoord = vertices[i].texcoord;
+        if (!(std::abs(texcoord.x) <= HALF_TEXCOORD_LIMIT && std::abs(texcoord.y) <= HALF_TEXCOORD_LIMIT))
+        {
+            return VERTEX_FORMAT_FULL;
+        }
+    }
+    return VERTEX_FORMAT_QTANGENT;
+}
+
+// Unit vector into 10:10:10:2 unorm, w left at 0
+static unsigned int PackUnorm1010102(const float3& vec)
+{
+    unsigned int packed = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float value = std::max<float>(-1.0f, std::min<float>(1.0f, vec[axis]));
+        packed |= (unsigned int)((value * 0.5f + 0.5f) * 1023.0f + 0.5f) << (axis * 10);
+    }
+    return packed;
+}
+
+static float3 SafeNormalize(const float3& vec, const float3& fallback)
+{
+    float length = vec.length();
+    return length > 0.0f && length == length ? vec * (1.0f / length) : fallback;
+}
+
+static float3 UnpackUnorm1010102(unsigned int packed)
+{
+    float3 vec;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        vec[axis] = ((packed >> (axis * 10)) & 1023) / 1023.0f * 2.0f - 1.0f;
+    }
+    return vec;
+}
+
+// Quaternion of the rotation whose columns are tangent_s, tangent_t and normal.
+// Mirrored frames store the quaternion negated, its w is kept away from 0 so the sign survives.
+static void PackTangentFrame(const Vertex& vertex, short* packed)
+{
+    float3 n = SafeNormalize(vertex.normal, float3(0.0f, 0.0f, 1.0f));
+    float3 axis = std::abs(n.x) < 0.9f ? float3(1.0f, 0.0f, 0.0f) : float3(0.0f, 1.0f, 0.0f);
+    float3 t = SafeNormalize(vertex.tangent_t - n * dot(n, vertex.tangent_t), cross(n, axis).normalize());
+    float3 s = cross(t, n);
+    bool mirrored = dot(s, vertex.tangent_s) < 0.0f;
+
+    float m00 = s.x, m01 = t.x, m02 = n.x;
+    float m10 = s.y, m11 = t.y, m12 = n.y;
+    float m20 = s.z, m21 = t.z, m22 = n.z;
+    float q[4];
+    float trace = m00 + m11 + m22;
+    if (trace > 0.0f)
+    {
+        float r = std::sqrt(1.0f + trace) * 2.0f;
+        q[3] = 0.25f * r;
+        q[0] = (m21 - m12) / r;
+        q[1] = (m02 - m20) / r;
+        q[2] = (m10 - m01) / r;
+    }
+    else if (m00 > m11 && m00 > m22)
+    {
+        float r = std::sqrt(1.0f + m00 - m11 - m22) * 2.0f;
+        q[3] = (m21 - m12) / r;
+        q[0] = 0.25f * r;
+        q[1] = (m01 + m10) / r;
+        q[2] = (m02 + m20) / r;
+    }
+    else if (m11 > m22)
+    {
+        float r = std::sqrt(1.0f + m11 - m00 - m22) * 2.0f;
+        q[3] = (m02 - m20) / r;
+        q[0] = (m01 + m10) / r;
+        q[1] = 0.25f * r;
+        q[2] = (m12 + m21) / r;
+    }
+    else
+    {
+        float r = std::sqrt(1.0f + m22 - m00 - m11) * 2.0f;
+        q[3] = (m10 - m01) / r;
+        q[0] = (m02 + m20) / r;
+        q[1] = (m12 + m21) / r;
+        q[2] = 0.25f * r;
+    }
+
+    float length = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    float sign = (q[3] < 0.0f) != mirrored ? -1.0f : 1.0f;
+    for (int i = 0; i < 4; ++i)
+    {
+        packed[i] = FloatToSnorm16(q[i] * sign / length);
+    }
+    if (packed[3] == 0)
+    {
+        packed[3] = mirrored ? -1 : 1;
+    }
+}
+
+void ConvertVertices(const Vertex* vertices, size_t count, VertexFormat_t format, std::vector<unsigned char>& converted)
+{
+    converted.resize(count * GetVertexFormatDesc(format).stride);
+    switch (format)
+    {
+    case VERTEX_FORMAT_COMPACT:
+        for (size_t i = 0; i < count; ++i)
+        {
+            const Vertex& vertex = vertices[i];
+            CompactVertex_t out;
+            out.position = vertex.position;
+            out.texcoord[0] = FloatToHalf(vertex.texcoord.x);
+            out.texcoord[1] = FloatToHalf(vertex.texcoord.y);
+            out.normal = PackUnorm1010102(vertex.normal);
+            out.tangent_s = PackUnorm1010102(vertex.tangent_s);
+            out.tangent_t = PackUnorm1010102(vertex.tangent_t);
+            memcpy(&converted[i * sizeof(out)], &out, sizeof(out));
+        }
+        break;
+
+    case VERTEX_FORMAT_QTANGENT:
+        for (size_t i = 0; i < count; ++i)
+        {
+            const Vertex& vertex = vertices[i];
+            QTangentVertex_t out;
+            out.position = vertex.position;
+            out.texcoord[0] = FloatToHalf(vertex.texcoord.x);
+            out.texcoord[1] = FloatToHalf(vertex.texcoord.y);
+            PackTangentFrame(vertex, out.tangentFrame);
+            memcpy(&converted[i * sizeof(out)], &out, sizeof(out));
+        }
+        break;
+
+    default:
+        if (count)
+        {
+            memcpy(converted.data(), vertices, count * sizeof(Vertex));
+        }
+        break;
+    }
+
+}
+
+// Inverse of PackTangentFrame
+static void UnpackTangentFrame(const short* packed, Vertex& vertex)
+{
+    float q[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        q[i] = Snorm16ToFloat(packed[i]);
+    }
+    bool mirrored = q[3] < 0.0f;
+    float length = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    float scale = (mirrored ? -1.0f : 1.0f) / length;
+    float x = q[0] * scale, y = q[1] * scale, z = q[2] * scale, w = q[3] * scale;
+
+    float3 s(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y));
+    vertex.tangent_t = float3(2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x));
+    vertex.normal = float3(2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y));
+    vertex.tangent_s = mirrored ? s * -1.0f : s;
+}
+
+void ConvertToVertices(const void* converted, size_t count, VertexFormat_t format, Vertex* vertices)
+{
+    const unsigned char* data = (const unsigned char*)converted;
+    switch (format)
+    {
+    case VERTEX_FORMAT_COMPACT:
+        for (size_t i = 0; i < count; ++i)
+        {
+            CompactVertex_t in;
+            memcpy(&in, &data[i * sizeof(in)], sizeof(in));
+            Vertex& vertex = vertices[i];
+            vertex.position = in.position;
+            vertex.texcoord = float2(HalfToFloat(in.texcoord[0]), HalfToFloat(in.texcoord[1]));
+            vertex.normal = UnpackUnorm1010102(in.normal);
+            vertex.tangent_s = UnpackUnorm1010102(in.tangent_s);
+            vertex.tangent_t = UnpackUnorm1010102(in.tangent_t);
+        }
+        break;
+
+    case VERTEX_FORMAT_QTANGENT:
+        for (size_t i = 0; i < count; ++i)
+        {
+            QTangentVertex_t in;
+            memcpy(&in, &data[i * sizeof(in)], sizeof(in));
+            Vertex& vertex = vertices[i];
+            vertex.position = in.position;
+            vertex.texcoord = float2(HalfToFloat(in.texcoord[0]), HalfToFloat(in.texcoord[1]));
+            UnpackTangentFrame(in.tangentFrame, vertex);
+        }
+        break;
+
+    default:
+        if (count)
+        {
+            memcpy(vertices, converted, count * sizeof(Vertex));
+        }
+        break;
+    }
+
+}
+
+VertexSkin_t PackVertexSkin(const unsigned int* bones, const float* weights, size_t count)
+{
+    unsigned int heaviestBones[MAX_BONE_INFLUENCES] = {};
+    float heaviestWeights[MAX_BONE_INFLUENCES] = {};
+    for (size_t i = 0; i < count; ++i)
+    {
+        // Insertion into the sorted heaviest ones
+        unsigned int slot = MAX_BONE_INFLUENCES;
+        while (slot > 0 && weights[i] > heaviestWeights[slot - 1])
+        {
+            if (slot < MAX_BONE_INFLUENCES)
+            {
+                heaviestBones[slot] = heaviestBones[slot - 1];
+                heaviestWeights[slot] = heaviestWeights[slot - 1];
+            }
+            --slot;
+        }
+        if (slot < MAX_BONE_INFLUENCES)
+        {
+            heaviestBones[slot] = bones[i];
+            heaviestWeights[slot] = weights[i];
+        }
+    }
+
+    float sum = 0.0f;
+    for (unsigned int i = 0; i < MAX_BONE_INFLUENCES; ++i)
+    {
+        sum += heaviestWeights[i];
+    }
+
+    VertexSkin_t skin;
+    unsigned int restWeight = 0;
+    for (unsigned int i = 0; i < MAX_BONE_INFLUENCES; ++i)
+    {
+        skin.bones[i] = (unsigned char)heaviestBones[i];
+        skin.weights[i] = 0;
+        if (i > 0 && sum > 0.0f)
+        {
+            skin.weights[i] = (unsigned char)(heaviestWeights[i] / sum * 255.0f + 0.5f);
+            restWeight += skin.weights[i];
+        }
+    }
+    // Without weights the vertex follows the first bone
+    skin.weights[0] = (unsigned char)(255 - restWeight);
+    return skin;
+}
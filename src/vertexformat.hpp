@@ -0,0 +1,98 @@
+#ifndef VERTEXFORMAT_HPP
+#define VERTEXFORMAT_HPP
+
+#include "mathlib.hpp"
+#include <vector>
+
+// GPU-side vertex layouts. Meshes are imported as Vertex and converted to one
+// of these when they are baked. Shaders see the same inputs for all of them,
+// vertexformat.fxh unpacks the compact ones in the vertex shader.
+enum VertexFormat_t
+{
+    // Vertex as is, 56 bytes
+    VERTEX_FORMAT_FULL = 0,
+    // Half texcoords, normal and tangents in 10:10:10:2, 28 bytes
+    VERTEX_FORMAT_COMPACT,
+    // Half texcoords, tangent frame as a 16-bit quaternion, 24 bytes
+    VERTEX_FORMAT_QTANGENT,
+    VERTEX_FORMAT_COUNT,
+
+    // Import option only: QTANGENT when the texcoords keep their precision in half floats, FULL otherwise
+    VERTEX_FORMAT_AUTO = VERTEX_FORMAT_COUNT,
+};
+
+// Layout of one element, the input layout maps it to its DXGI format
+enum VertexElementType_t
+{
+    VERTEX_ELEMENT_FLOAT2 = 0,
+    VERTEX_ELEMENT_FLOAT3,
+    VERTEX_ELEMENT_HALF2,
+    // Normalized to [0, 1]
+    VERTEX_ELEMENT_UNORM_10_10_10_2,
+    // Normalized to [-1, 1]
+    VERTEX_ELEMENT_SNORM16_4,
+};
+
+struct VertexElement_t
+{
+    const char* semantic;
+    VertexElementType_t type;
+    unsigned int offset;
+};
+
+static const unsigned int MAX_VERTEX_ELEMENTS = 5;
+
+struct VertexFormatDesc_t
+{
+    const char* name;
+    // Defined when compiling shaders for this format, nullptr for FULL
+    const char* shaderDefine;
+    unsigned int stride;
+    unsigned int elementCount;
+    VertexElement_t elements[MAX_VERTEX_ELEMENTS];
+};
+
+struct CompactVertex_t
+{
+    float3 position;
+    unsigned short texcoord[2];
+    unsigned int normal;
+    unsigned int tangent_s;
+    unsigned int tangent_t;
+};
+
+struct QTangentVertex_t
+{
+    float3 position;
+    unsigned short texcoord[2];
+    // Rotation from tangent space (tangent_s, tangent_t, normal) to model space.
+    // w < 0 means tangent_s is mirrored.
+    short tangentFrame[4];
+};
+
+static const unsigned int MAX_BONE_INFLUENCES = 4;
+
+// Bones of a skinned vertex, heaviest first. Weights sum to 255, unused slots
+// weigh 0. Kept beside the vertices on the CPU, which skins them into
+// VERTEX_FORMAT_FULL, so no input layout reads it.
+struct VertexSkin_t
+{
+    unsigned char bones[MAX_BONE_INFLUENCES];
+    unsigned char weights[MAX_BONE_INFLUENCES];
+};
+
+const VertexFormatDesc_t& GetVertexFormatDesc(VertexFormat_t format);
+
+// Resolves VERTEX_FORMAT_AUTO for the given vertices
+VertexFormat_t ChooseVertexFormat(const Vertex* vertices, size_t count, VertexFormat_t requested);
+
+// Writes count vertices of the format, stride bytes each
+void ConvertVertices(const Vertex* vertices, size_t count, VertexFormat_t format, std::vector<unsigned char>& converted);
+// Back to Vertex, with the precision the format kept
+void ConvertToVertices(const void* converted, size_t count, VertexFormat_t format, Vertex* vertices);
+
+// Keeps the MAX_BONE_INFLUENCES heaviest of count influences and quantizes their
+// weights, the heaviest takes the rounding error. Bones must be below 256.
+VertexSkin_t PackVertexSkin(const unsigned int* bones, const float* weights, size_t count);
+
+#endif // VERTEXFORMAT_HPP
@@ -0,0 +1,18 @@
+#include "viewsetup.hpp"
+
+void ViewSetup::ComputeMatrices()
+{
+    worldToView = AffineTransform::LookAtLH(origin, target, up);
+    // The matrices take row vectors
+    matWorldToView = worldToView.ToMatrix().Transpose();
+    // Projection Matrix
+    if (ortho)
+    {
+        matViewToProjection = Matrix::OrthoLH(viewSize.x, viewSize.y, nearZ, farZ);
+    }
+    else
+    {
+        matViewToProjection = Matrix::PerspectiveFovLH(fov, viewSize.x / viewSize.y, nearZ, farZ);
+    }
+    matWorldToCamera = matWorldToView * matViewToProjection;
+}
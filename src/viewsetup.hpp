@@ -0,0 +1,42 @@
+#ifndef VIEWSETUP_HPP
+#define VIEWSETUP_HPP
+
+#include "mathlib.hpp"
+
+struct ViewSetup
+{
+    ViewSetup() :
+        x(0), y(0),
+        width(128), height(128),
+        viewSize(128.0f, 128.0f),
+        origin(0.0f, 0.0f, 0.0f),
+        target(1.0f, 0.0f, 0.0f),
+        up(0.0f, 0.0f, 1.0f),
+        ortho(false),
+        fov(MATH_PIDIV2),
+        farZ(1024.0f),
+        nearZ(1.0f)
+    {}
+
+    void ComputeMatrices();
+
+    int x, y;
+    int width, height;
+    float2 viewSize;
+    float3 origin;
+    float3 target;
+    float3 up;
+    bool ortho;
+    float fov;
+    float farZ;
+    float nearZ;
+
+    // Camera space from world space, for column vectors
+    AffineTransform worldToView;
+    Matrix matWorldToCamera;
+    Matrix matWorldToView;
+    Matrix matViewToProjection;
+
+};
+
+#endif // VIEWSETUP_HPP
@@ -0,0 +1,193 @@
+#include "weld.hpp"
+#include <cmath>
+#include <cstring>
+
+static const unsigned int EMPTY_ENTRY = 0xFFFFFFFF;
+
+static size_t GetTableSize(size_t count)
+{
+    size_t size = 16;
+    while (size < count * 2)
+    {
+        size <<= 1;
+    }
+    return size;
+}
+
+static unsigned int HashCell(long long x, long long y, long long z)
+{
+    return (unsigned int)x * 73856093u ^ (unsigned int)y * 19349663u ^ (unsigned int)z * 83492791u;
+}
+
+// FNV-1a over 32-bit words
+static unsigned int HashWords(const unsigned int* words, size_t count)
+{
+    unsigned int hash = 0x811C9DC5;
+    for (size_t i = 0; i < count; ++i)
+    {
+        hash = (hash ^ words[i]) * 0x01000193;
+    }
+    return hash;
+}
+
+// Position, texcoord and normal with -0 turned into 0, so equal values compare equal bitwise
+struct VertexKey_t
+{
+    VertexKey_t(const Vertex& vertex)
+    {
+        const float values[8] =
+        {
+            vertex.position.x, vertex.position.y, vertex.position.z,
+            vertex.texcoord.x, vertex.texcoord.y,
+            vertex.normal.x, vertex.normal.y, vertex.normal.z,
+        };
+        for (int i = 0; i < 8; ++i)
+        {
+            float value = values[i] + 0.0f;
+            memcpy(&words[i], &value, sizeof(value));
+        }
+    }
+
+    bool operator==(const VertexKey_t& other) const { return memcmp(words, other.words, sizeof(words)) == 0; }
+
+    unsigned int words[8];
+};
+
+size_t WeldVertices(std::vector<Vertex>& vertices, unsigned int* indices, size_t indexCount, float epsilon)
+{
+    size_t vertexCount = vertices.size();
+    size_t tableSize = GetTableSize(vertexCount);
+    size_t mask = tableSize - 1;
+
+    if (epsilon > 0.0f)
+    {
+        // Vertices that kept their position, chained per bucket. Buckets are
+        // shared by unrelated cells, the distance test sorts them out.
+        std::vector<unsigned int> buckets(tableSize, EMPTY_ENTRY);
+        std::vector<unsigned int> next(vertexCount, EMPTY_ENTRY);
+        float scale = 1.0f / epsilon;
+        float epsilonSq = epsilon * epsilon;
+        for (size_t i = 0; i < vertexCount; ++i)
+        {
+            float3 position = vertices[i].position;
+            long long cell[3];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                cell[axis] = (long long)std::floor(position[axis] * scale);
+            }
+
+            unsigned int nearest = EMPTY_ENTRY;
+            float nearestSq = epsilonSq;
+            for (int dz = -1; dz <= 1; ++dz)
+            {
+                for (int dy = -1; dy <= 1; ++dy)
+                {
+                    for (int dx = -1; dx <= 1; ++dx)
+                    {
+                        size_t bucket = HashCell(cell[0] + dx, cell[1] + dy, cell[2] + dz) & mask;
+                        for (unsigned int other = buckets[bucket]; other != EMPTY_ENTRY; other = next[other])
+                        {
+                            float3 offset = vertices[other].position - position;
+                            float distanceSq = dot(offset, offset);
+                            if (distanceSq <= nearestSq)
+                            {
+                                nearest = other;
+                                nearestSq = distanceSq;
+                            }
+                        }
+                    }
+                }
+            }
+
+            if (nearest != EMPTY_ENTRY)
+            {
+                vertices[i].position = vertices[nearest].position;
+            }
+            else
+            {
+                size_t bucket = HashCell(cell[0], cell[1], cell[2]) & mask;
+                next[i] = buckets[bucket];
+                buckets[bucket] = (unsigned int)i;
+            }
+        }
+    }
+
+    // Vertices are compacted in place, a vertex never moves past itself
+    std::vector<unsigned int> table(tableSize, EMPTY_ENTRY);
+    std::vector<unsigned int> remap(vertexCount);
+    size_t uniqueCount = 0;
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        VertexKey_t key(vertices[i]);
+        size_t slot = HashWords(key.words, 8) & mask;
+        while (table[slot] != EMPTY_ENTRY && !(VertexKey_t(vertices[table[slot]]) == key))
+        {
+            slot = (slot + 1) & mask;
+        }
+
+        if (table[slot] == EMPTY_ENTRY)
+        {
+            vertices[uniqueCount] = vertices[i];
+            table[slot] = (unsigned int)uniqueCount++;
+        }
+        remap[i] = table[slot];
+    }
+    vertices.resize(uniqueCount);
+
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        indices[i] = remap[indices[i]];
+    }
+    return uniqueCount;
+}
+
+size_t RemoveDegenerateTriangles(unsigned int* indices, size_t indexCount, const Vertex* vertices, float minArea, WeldStats_t& stats)
+{
+    size_t triangleCount = indexCount / 3;
+    size_t tableSize = GetTableSize(triangleCount);
+    size_t mask = tableSize - 1;
+    // Kept triangles, by their first index in the compacted output
+    std::vector<unsigned int> table(tableSize, EMPTY_ENTRY);
+
+    size_t keptCount = 0;
+    for (size_t i = 0; i < triangleCount; ++i)
+    {
+        unsigned int a = indices[i * 3 + 0];
+        unsigned int b = indices[i * 3 + 1];
+        unsigned int c = indices[i * 3 + 2];
+        float3 normal = cross(vertices[b].position - vertices[a].position, vertices[c].position - vertices[a].position);
+        if (a == b || b == c || c == a || normal.length() * 0.5f <= minArea)
+        {
+            ++stats.degenerateTriangles;
+            continue;
+        }
+
+        // Rotated to start at the smallest index, winding kept
+        unsigned int triangle[3] = { a, b, c };
+        if (b < a && b < c)
+        {
+            triangle[0] = b; triangle[1] = c; triangle[2] = a;
+        }
+        else if (c < a && c < b)
+        {
+            triangle[0] = c; triangle[1] = a; triangle[2] = b;
+        }
+
+        size_t slot = HashWords(triangle, 3) & mask;
+        while (table[slot] != EMPTY_ENTRY && memcmp(&indices[table[slot]], triangle, sizeof(triangle)) != 0)
+        {
+            slot = (slot + 1) & mask;
+        }
+        if (table[slot] != EMPTY_ENTRY)
+        {
+            ++stats.duplicateTriangles;
+            continue;
+        }
+
+        // Kept triangles are stored rotated, which keeps their winding
+        table[slot] = (unsigned int)(keptCount * 3);
+        memcpy(&indices[keptCount * 3], triangle, sizeof(triangle));
+        ++keptCount;
+    }
+    return keptCount * 3;
+}
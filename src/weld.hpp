@@ -0,0 +1,24 @@
+#ifndef WELD_HPP
+#define WELD_HPP
+
+#include "mathlib.hpp"
+#include <vector>
+
+struct WeldStats_t
+{
+    size_t degenerateTriangles;
+    size_t duplicateTriangles;
+};
+
+// Moves every vertex onto the first vertex within epsilon of its position,
+// found through a spatial hash of epsilon sized cells, then merges vertices
+// whose position, texcoord and normal are now identical. Rewrites indices
+// and shrinks vertices. Returns the number of vertices left.
+size_t WeldVertices(std::vector<Vertex>& vertices, unsigned int* indices, size_t indexCount, float epsilon);
+
+// Drops triangles that use a vertex twice, whose area is at most minArea,
+// or that repeat an earlier triangle with the same winding. Compacts the
+// indices in place and returns how many are left.
+size_t RemoveDegenerateTriangles(unsigned int* indices, size_t indexCount, const Vertex* vertices, float minArea, WeldStats_t& stats);
+
+#endif // WELD_HPP